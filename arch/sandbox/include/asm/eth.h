@@ -14,4 +14,12 @@ void sandbox_eth_disable_response(int index, bool disable);
 
 void sandbox_eth_skip_timeout(void);
 
+void sandbox_eth_tftp_serve(const void *data, size_t size, int drop_block);
+
+void sandbox_eth_tftp_stats(uint *windowsizep, uint *acksp);
+
+void sandbox_eth_nfs_serve(const void *data, size_t size, uint max_read);
+
+void sandbox_eth_nfs_stats(uint *windowp, uint *readsp);
+
 #endif /* __ETH_H */
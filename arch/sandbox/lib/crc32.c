@@ -0,0 +1,96 @@
+/*
+ * CRC32 using PCLMULQDQ and CRC32C using SSE4.2 on the x86 host CPU
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <errno.h>
+#include <u-boot/crc.h>
+#include <cpuid.h>
+#include <immintrin.h>
+
+/* 1 if the host CPU has the instructions, 0 if not, -1 if not known */
+static int have_sse42 = -1;
+static int have_pclmul = -1;
+
+static void crc32_probe(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (have_sse42 != -1)
+		return;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		ecx = 0;
+	have_sse42 = !!(ecx & bit_SSE4_2);
+	have_pclmul = have_sse42 && (ecx & bit_PCLMUL);
+	debug("%s: host SSE4.2 %d, PCLMULQDQ %d\n", __func__, have_sse42,
+	      have_pclmul);
+}
+
+/*
+ * Fold the data 16 bytes at a time with carry-less multiplies, keeping a
+ * 128-bit value whose CRC is that of all the data so far. The constants are
+ * x^(128 + 32) and x^(128 - 32) mod P, bit-reflected. The last 16 bytes of
+ * fold and any tail are finished off with the tables.
+ */
+__attribute__((target("sse4.2,pclmul")))
+static u32 crc32_pclmul(u32 crc, const u8 *p, uint len)
+{
+	const __m128i k = _mm_set_epi64x(0x0ccaa009e, 0x1751997d0);
+	u8 fold[16];
+	__m128i x;
+
+	x = _mm_loadu_si128((const __m128i *)p);
+	x = _mm_xor_si128(x, _mm_cvtsi32_si128(crc));
+	for (p += 16, len -= 16; len >= 16; p += 16, len -= 16) {
+		x = _mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00),
+				  _mm_clmulepi64_si128(x, k, 0x11));
+		x = _mm_xor_si128(x, _mm_loadu_si128((const __m128i *)p));
+	}
+	_mm_storeu_si128((__m128i *)fold, x);
+	crc = crc32_no_comp_generic(0, fold, sizeof(fold));
+
+	return crc32_no_comp_generic(crc, p, len);
+}
+
+int crc32_no_comp_arch(uint32_t *crc, const unsigned char *buf, uint len)
+{
+	crc32_probe();
+	/* Too little data to be worth setting up the fold */
+	if (!have_pclmul || len < 64)
+		return -ENOSYS;
+	*crc = crc32_pclmul(*crc, buf, len);
+
+	return 0;
+}
+
+#ifdef CONFIG_CRC32C
+__attribute__((target("sse4.2")))
+static u32 crc32c_sse42(u32 crc, const u8 *p, uint len)
+{
+	for (; len && ((ulong)p & 7); len--)
+		crc = _mm_crc32_u8(crc, *p++);
+#ifdef __x86_64__
+	for (; len >= 8; len -= 8, p += 8)
+		crc = _mm_crc32_u64(crc, *(const u64 *)p);
+#else
+	for (; len >= 4; len -= 4, p += 4)
+		crc = _mm_crc32_u32(crc, *(const u32 *)p);
+#endif
+	while (len--)
+		crc = _mm_crc32_u8(crc, *p++);
+
+	return crc;
+}
+
+int crc32c_no_comp_arch(uint32_t *crc, const unsigned char *buf, uint len)
+{
+	crc32_probe();
+	if (!have_sse42)
+		return -ENOSYS;
+	*crc = crc32c_sse42(*crc, buf, len);
+
+	return 0;
+}
+#endif
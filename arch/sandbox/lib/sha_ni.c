@@ -0,0 +1,229 @@
+/*
+ * SHA-1 and SHA-256 using the x86 SHA extensions of the host CPU
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <errno.h>
+#include <u-boot/sha1.h>
+#include <u-boot/sha256.h>
+#include <cpuid.h>
+#include <immintrin.h>
+
+#define SHA_NI_TARGET	__attribute__((target("sha,sse4.1,ssse3")))
+
+/* 1 if the host CPU has the SHA extensions, 0 if not, -1 if not known */
+static int sha_ni = -1;
+
+static bool sha_ni_present(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (sha_ni == -1) {
+		sha_ni = __get_cpuid(1, &eax, &ebx, &ecx, &edx) &&
+			(ecx & bit_SSE4_1) && (ecx & bit_SSSE3) &&
+			__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) &&
+			(ebx & bit_SHA);
+		debug("%s: host SHA extensions %spresent\n", __func__,
+		      sha_ni ? "" : "not ");
+	}
+
+	return sha_ni;
+}
+
+static const uint32_t sha256_k[64] __aligned(16) = {
+	0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5,
+	0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+	0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3,
+	0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+	0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC,
+	0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+	0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7,
+	0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+	0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13,
+	0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+	0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3,
+	0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+	0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5,
+	0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+	0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208,
+	0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2,
+};
+
+/*
+ * Four rounds, using message words @m and preparing later ones: @next gets
+ * its second step and @prev its first. The round number @i is a constant,
+ * so the compiler drops the steps which are not needed.
+ */
+#define SHA256_QROUND(i, prev, m, next) do {				\
+	msg = _mm_add_epi32(m,						\
+		_mm_load_si128((const __m128i *)&sha256_k[4 * (i)]));	\
+	state1 = _mm_sha256rnds2_epu32(state1, state0, msg);		\
+	if ((i) >= 3 && (i) <= 14) {					\
+		next = _mm_add_epi32(next, _mm_alignr_epi8(m, prev, 4));	\
+		next = _mm_sha256msg2_epu32(next, m);			\
+	}								\
+	msg = _mm_shuffle_epi32(msg, 0x0e);				\
+	state0 = _mm_sha256rnds2_epu32(state0, state1, msg);		\
+	if ((i) >= 1 && (i) <= 12)					\
+		prev = _mm_sha256msg1_epu32(prev, m);			\
+} while (0)
+
+SHA_NI_TARGET
+static void sha256_ni_blocks(uint32_t state[8], const uint8_t *data,
+			     unsigned int blocks)
+{
+	const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+					    0x0405060700010203ULL);
+	__m128i state0, state1, save0, save1;
+	__m128i msg, m0, m1, m2, m3, tmp;
+
+	/* The instructions want the state as ABEF and CDGH */
+	tmp = _mm_loadu_si128((const __m128i *)&state[0]);
+	state1 = _mm_loadu_si128((const __m128i *)&state[4]);
+	tmp = _mm_shuffle_epi32(tmp, 0xb1);
+	state1 = _mm_shuffle_epi32(state1, 0x1b);
+	state0 = _mm_alignr_epi8(tmp, state1, 8);
+	state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+
+	for (; blocks; blocks--, data += 64) {
+		save0 = state0;
+		save1 = state1;
+
+		m0 = _mm_loadu_si128((const __m128i *)data);
+		m0 = _mm_shuffle_epi8(m0, mask);
+		m1 = _mm_loadu_si128((const __m128i *)(data + 16));
+		m1 = _mm_shuffle_epi8(m1, mask);
+		m2 = _mm_loadu_si128((const __m128i *)(data + 32));
+		m2 = _mm_shuffle_epi8(m2, mask);
+		m3 = _mm_loadu_si128((const __m128i *)(data + 48));
+		m3 = _mm_shuffle_epi8(m3, mask);
+
+		SHA256_QROUND(0, m3, m0, m1);
+		SHA256_QROUND(1, m0, m1, m2);
+		SHA256_QROUND(2, m1, m2, m3);
+		SHA256_QROUND(3, m2, m3, m0);
+		SHA256_QROUND(4, m3, m0, m1);
+		SHA256_QROUND(5, m0, m1, m2);
+		SHA256_QROUND(6, m1, m2, m3);
+		SHA256_QROUND(7, m2, m3, m0);
+		SHA256_QROUND(8, m3, m0, m1);
+		SHA256_QROUND(9, m0, m1, m2);
+		SHA256_QROUND(10, m1, m2, m3);
+		SHA256_QROUND(11, m2, m3, m0);
+		SHA256_QROUND(12, m3, m0, m1);
+		SHA256_QROUND(13, m0, m1, m2);
+		SHA256_QROUND(14, m1, m2, m3);
+		SHA256_QROUND(15, m2, m3, m0);
+
+		state0 = _mm_add_epi32(state0, save0);
+		state1 = _mm_add_epi32(state1, save1);
+	}
+
+	/* Back to ABCD and EFGH */
+	tmp = _mm_shuffle_epi32(state0, 0x1b);
+	state1 = _mm_shuffle_epi32(state1, 0xb1);
+	state0 = _mm_blend_epi16(tmp, state1, 0xf0);
+	state1 = _mm_alignr_epi8(state1, tmp, 8);
+	_mm_storeu_si128((__m128i *)&state[0], state0);
+	_mm_storeu_si128((__m128i *)&state[4], state1);
+}
+
+int sha256_process_arch(uint32_t state[8], const uint8_t *data,
+			unsigned int blocks)
+{
+	if (!sha_ni_present())
+		return -ENOSYS;
+	sha256_ni_blocks(state, data, blocks);
+
+	return 0;
+}
+
+/*
+ * Four rounds, using message words @m. E alternates between @e and @f, with
+ * @f taking the value of ABCD for the next four rounds. @next gets the last
+ * step of its preparation, @prev the first and @prev2 the second. Again
+ * @i is a constant.
+ */
+#define SHA1_QROUND(i, e, f, prev2, prev, m, next) do {			\
+	e = _mm_sha1nexte_epu32(e, m);					\
+	f = abcd;							\
+	if ((i) >= 3 && (i) <= 18)					\
+		next = _mm_sha1msg2_epu32(next, m);			\
+	abcd = _mm_sha1rnds4_epu32(abcd, e, (i) / 5);			\
+	if ((i) <= 16)							\
+		prev = _mm_sha1msg1_epu32(prev, m);			\
+	if ((i) >= 2 && (i) <= 17)					\
+		prev2 = _mm_xor_si128(prev2, m);			\
+} while (0)
+
+SHA_NI_TARGET
+static void sha1_ni_blocks(uint32_t state[5], const uint8_t *data,
+			   unsigned int blocks)
+{
+	const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL,
+					    0x08090a0b0c0d0e0fULL);
+	__m128i abcd, e0, e1, save_abcd, save_e;
+	__m128i m0, m1, m2, m3;
+
+	abcd = _mm_loadu_si128((const __m128i *)state);
+	abcd = _mm_shuffle_epi32(abcd, 0x1b);
+	e0 = _mm_set_epi32(state[4], 0, 0, 0);
+
+	for (; blocks; blocks--, data += 64) {
+		save_abcd = abcd;
+		save_e = e0;
+
+		m0 = _mm_loadu_si128((const __m128i *)data);
+		m0 = _mm_shuffle_epi8(m0, mask);
+		m1 = _mm_loadu_si128((const __m128i *)(data + 16));
+		m1 = _mm_shuffle_epi8(m1, mask);
+		m2 = _mm_loadu_si128((const __m128i *)(data + 32));
+		m2 = _mm_shuffle_epi8(m2, mask);
+		m3 = _mm_loadu_si128((const __m128i *)(data + 48));
+		m3 = _mm_shuffle_epi8(m3, mask);
+
+		/* The first four rounds add the saved E directly */
+		e0 = _mm_add_epi32(e0, m0);
+		e1 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+		SHA1_QROUND(1, e1, e0, m3, m0, m1, m2);
+		SHA1_QROUND(2, e0, e1, m0, m1, m2, m3);
+		SHA1_QROUND(3, e1, e0, m1, m2, m3, m0);
+		SHA1_QROUND(4, e0, e1, m2, m3, m0, m1);
+		SHA1_QROUND(5, e1, e0, m3, m0, m1, m2);
+		SHA1_QROUND(6, e0, e1, m0, m1, m2, m3);
+		SHA1_QROUND(7, e1, e0, m1, m2, m3, m0);
+		SHA1_QROUND(8, e0, e1, m2, m3, m0, m1);
+		SHA1_QROUND(9, e1, e0, m3, m0, m1, m2);
+		SHA1_QROUND(10, e0, e1, m0, m1, m2, m3);
+		SHA1_QROUND(11, e1, e0, m1, m2, m3, m0);
+		SHA1_QROUND(12, e0, e1, m2, m3, m0, m1);
+		SHA1_QROUND(13, e1, e0, m3, m0, m1, m2);
+		SHA1_QROUND(14, e0, e1, m0, m1, m2, m3);
+		SHA1_QROUND(15, e1, e0, m1, m2, m3, m0);
+		SHA1_QROUND(16, e0, e1, m2, m3, m0, m1);
+		SHA1_QROUND(17, e1, e0, m3, m0, m1, m2);
+		SHA1_QROUND(18, e0, e1, m0, m1, m2, m3);
+		SHA1_QROUND(19, e1, e0, m1, m2, m3, m0);
+
+		e0 = _mm_sha1nexte_epu32(e0, save_e);
+		abcd = _mm_add_epi32(abcd, save_abcd);
+	}
+
+	abcd = _mm_shuffle_epi32(abcd, 0x1b);
+	_mm_storeu_si128((__m128i *)state, abcd);
+	state[4] = _mm_extract_epi32(e0, 3);
+}
+
+int sha1_process_arch(uint32_t state[5], const unsigned char *data,
+		      unsigned int blocks)
+{
+	if (!sha_ni_present())
+		return -ENOSYS;
+	sha1_ni_blocks(state, data, blocks);
+
+	return 0;
+}
@@ -13,16 +13,27 @@
 static int blkc_show(cmd_tbl_t *cmdtp, int flag,
 		     int argc, char * const argv[])
 {
+	struct block_cache_dev_stats dev_stats;
 	struct block_cache_stats stats;
+	int i;
+
 	blkcache_stats(&stats);
 
 	printf("hits: %u\n"
 	       "misses: %u\n"
+	       "evictions: %u\n"
 	       "entries: %u\n"
 	       "max blocks/entry: %u\n"
 	       "max cache entries: %u\n",
-	       stats.hits, stats.misses, stats.entries,
+	       stats.hits, stats.misses, stats.evictions, stats.entries,
 	       stats.max_blocks_per_entry, stats.max_entries);
+	for (i = 0; !blkcache_dev_stats(i, &dev_stats); i++) {
+		printf("%s %d: hits %u, misses %u, evictions %u, "
+		       "write-backs %u\n",
+		       blk_get_if_type_name(dev_stats.iftype),
+		       dev_stats.devnum, dev_stats.hits, dev_stats.misses,
+		       dev_stats.evictions, dev_stats.writebacks);
+	}
 	return 0;
 }
 
@@ -36,14 +47,21 @@ static int blkc_configure(cmd_tbl_t *cmdtp, int flag,
 	blocks_per_entry = simple_strtoul(argv[1], 0, 0);
 	max_entries = simple_strtoul(argv[2], 0, 0);
 	blkcache_configure(blocks_per_entry, max_entries);
-	printf("changed to max of %u entries of %u blocks each\n",
+	printf("changed to max of %u lines, caching up to %u blocks at once\n",
 	       max_entries, blocks_per_entry);
 	return 0;
 }
 
+static int blkc_flush(cmd_tbl_t *cmdtp, int flag,
+		      int argc, char * const argv[])
+{
+	return blkcache_flush_all() ? CMD_RET_FAILURE : CMD_RET_SUCCESS;
+}
+
 static cmd_tbl_t cmd_blkc_sub[] = {
 	U_BOOT_CMD_MKENT(show, 0, 0, blkc_show, "", ""),
 	U_BOOT_CMD_MKENT(configure, 3, 0, blkc_configure, "", ""),
+	U_BOOT_CMD_MKENT(flush, 0, 0, blkc_flush, "", ""),
 };
 
 static __maybe_unused void blkc_reloc(void)
@@ -84,4 +102,5 @@ U_BOOT_CMD(
 	"block cache diagnostics and control",
 	"show - show and reset statistics\n"
 	"blkcache configure blocks entries\n"
+	"blkcache flush - write back blocks held in the cache\n"
 );
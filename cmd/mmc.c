@@ -8,6 +8,7 @@
 #include <common.h>
 #include <command.h>
 #include <console.h>
+#include <div64.h>
 #include <mmc.h>
 
 static int curr_device = -1;
@@ -90,6 +91,15 @@ static void print_mmcinfo(struct mmc *mmc)
 			}
 		}
 	}
+
+	printf("Commands: %lu, with data: %lu", mmc->cmd_count,
+	       mmc->data_cmd_count);
+	if (mmc->data_cmd_count) {
+		puts(", ");
+		print_size(lldiv(mmc->data_bytes, mmc->data_cmd_count),
+			   " per command");
+	}
+	putc('\n');
 }
 static struct mmc *init_mmc_device(int dev, bool force_init)
 {
@@ -280,17 +290,46 @@ static int do_mmcrpmb(cmd_tbl_t *cmdtp, int flag,
 }
 #endif
 
+/* Bytes read at a time when a FIT being read is hashed as it arrives */
+#define MMC_READ_STREAM_SIZE	(512 << 10)
+
+/*
+ * Read blocks to memory. If a FIT is being read, each piece is hashed while
+ * it is still in the cache.
+ */
+static ulong mmc_read_blocks(struct mmc *mmc, u32 blk, u32 cnt, ulong start)
+{
+	struct blk_desc *desc = mmc_get_blk_desc(mmc);
+	void *addr = (void *)start;
+	u32 chunk, done, n;
+
+	if (!IMAGE_ENABLE_STREAM_HASH)
+		return blk_dread(desc, blk, cnt, addr);
+
+	fit_stream_load(start, 0);
+	chunk = max_t(u32, MMC_READ_STREAM_SIZE / desc->blksz, 1);
+	for (done = 0; done < cnt; done += n) {
+		n = blk_dread(desc, blk + done, min(cnt - done, chunk),
+			      addr + done * desc->blksz);
+		if (n != min(cnt - done, chunk))
+			return done + n;
+		fit_stream_load(start, (done + n) * desc->blksz);
+	}
+
+	return done;
+}
+
 static int do_mmc_read(cmd_tbl_t *cmdtp, int flag,
 		       int argc, char * const argv[])
 {
 	struct mmc *mmc;
 	u32 blk, cnt, n;
-	void *addr;
+	ulong addr;
 
 	if (argc != 4)
 		return CMD_RET_USAGE;
 
-	addr = (void *)simple_strtoul(argv[1], NULL, 16);
+	addr = simple_strtoul(argv[1], NULL, 16);
 	blk = simple_strtoul(argv[2], NULL, 16);
 	cnt = simple_strtoul(argv[3], NULL, 16);
 
@@ -301,7 +340,7 @@ static int do_mmc_read(cmd_tbl_t *cmdtp, int flag,
 	printf("\nMMC read: dev # %d, block # %d, count %d ... ",
 	       curr_device, blk, cnt);
 
-	n = blk_dread(mmc_get_blk_desc(mmc), blk, cnt, addr);
+	n = mmc_read_blocks(mmc, blk, cnt, addr);
 	printf("%d blocks read: %s\n", n, (n == cnt) ? "OK" : "ERROR");
 
 	return (n == cnt) ? CMD_RET_SUCCESS : CMD_RET_FAILURE;
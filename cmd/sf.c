@@ -153,24 +153,123 @@ static int do_spi_flash_probe(int argc, char * const argv[])
 	return 0;
 }
 
+/* Statistics gathered by sf update */
+struct sf_update_stats {
+	size_t skipped;		/* bytes which were already correct */
+	uint pages_written;	/* pages programmed */
+	uint pages_skipped;	/* pages left alone: unchanged or blank */
+	uint erases;		/* sectors erased */
+	uint erases_avoided;	/* sectors changed without an erase */
+};
+
+/**
+ * Check whether flash can be changed from @old to @new without an erase,
+ * i.e. programming only needs to clear bits.
+ *
+ * @param old		data in the flash
+ * @param new		data to write
+ * @param len		number of bytes to check
+ * @return true if no bit has to go from 0 to 1
+ */
+static bool spi_flash_can_program(const u8 *old, const u8 *new, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if ((old[i] & new[i]) != new[i])
+			return false;
+	}
+
+	return true;
+}
+
+static bool spi_flash_is_blank(const u8 *buf, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if (buf[i] != 0xff)
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Program those pages of a block which need it, writing runs of adjacent
+ * pages in one go.
+ *
+ * A page is skipped if it already holds the data (@old is not NULL) or if
+ * it is blank and the block has just been erased (@old is NULL).
+ *
+ * @param flash		flash context pointer
+ * @param offset	flash offset to write
+ * @param len		number of bytes to write
+ * @param buf		buffer to write from
+ * @param old		current flash contents, or NULL if erased
+ * @param stats		statistics to update
+ * @return 0 if OK, -ve on error
+ */
+static int spi_flash_update_pages(struct spi_flash *flash, u32 offset,
+		size_t len, const u8 *buf, const u8 *old,
+		struct sf_update_stats *stats)
+{
+	u32 page_size = flash->page_size;
+	size_t pos, todo, run = 0;
+	bool dirty;
+	int ret;
+
+	for (pos = 0; pos < len; pos += todo) {
+		todo = min_t(size_t, len - pos,
+			     page_size - (offset + pos) % page_size);
+		if (old)
+			dirty = memcmp(old + pos, buf + pos, todo) != 0;
+		else
+			dirty = !spi_flash_is_blank(buf + pos, todo);
+
+		if (dirty) {
+			stats->pages_written++;
+			run += todo;
+			continue;
+		}
+		stats->pages_skipped++;
+		if (run) {
+			ret = spi_flash_write(flash, offset + pos - run, run,
+					      buf + pos - run);
+			if (ret)
+				return ret;
+			run = 0;
+		}
+	}
+	if (run)
+		return spi_flash_write(flash, offset + pos - run, run,
+				       buf + pos - run);
+
+	return 0;
+}
+
 /**
  * Write a block of data to SPI flash, first checking if it is different from
  * what is already there.
  *
- * If the data being written is the same, then *skipped is incremented by len.
+ * If the data being written is the same, then stats->skipped is incremented
+ * by len. If the changes only clear bits, the changed pages are programmed
+ * without erasing the sector. Otherwise the sector is erased and only the
+ * pages which are not blank are written back.
  *
  * @param flash		flash context pointer
  * @param offset	flash offset to write
  * @param len		number of bytes to write
  * @param buf		buffer to write from
  * @param cmp_buf	read buffer to use to compare data
- * @param skipped	Count of skipped data (incremented by this function)
+ * @param stats		statistics to update
  * @return NULL if OK, else a string containing the stage which failed
  */
 static const char *spi_flash_update_block(struct spi_flash *flash, u32 offset,
-		size_t len, const char *buf, char *cmp_buf, size_t *skipped)
+		size_t len, const char *buf, char *cmp_buf,
+		struct sf_update_stats *stats)
 {
-	char *ptr = (char *)buf;
+	const u8 *ptr = (const u8 *)buf;
 
 	debug("offset=%#x, sector_size=%#x, len=%#zx\n",
 	      offset, flash->sector_size, len);
@@ -181,19 +280,31 @@ static const char *spi_flash_update_block(struct spi_flash *flash, u32 offset,
 	if (memcmp(cmp_buf, buf, len) == 0) {
 		debug("Skip region %x size %zx: no change\n",
 		      offset, len);
-		*skipped += len;
+		stats->skipped += len;
+		stats->pages_skipped += DIV_ROUND_UP(len, flash->page_size);
+		return NULL;
+	}
+	if (spi_flash_can_program((u8 *)cmp_buf, ptr, len)) {
+		debug("Program region %x size %zx without erase\n",
+		      offset, len);
+		stats->erases_avoided++;
+		if (spi_flash_update_pages(flash, offset, len, ptr,
+					   (u8 *)cmp_buf, stats))
+			return "write";
 		return NULL;
 	}
 	/* Erase the entire sector */
 	if (spi_flash_erase(flash, offset, flash->sector_size))
 		return "erase";
+	stats->erases++;
 	/* If it's a partial sector, copy the data into the temp-buffer */
 	if (len != flash->sector_size) {
 		memcpy(cmp_buf, buf, len);
-		ptr = cmp_buf;
+		ptr = (u8 *)cmp_buf;
 	}
-	/* Write one complete sector */
-	if (spi_flash_write(flash, offset, flash->sector_size, ptr))
+	/* Write back the pages of the sector which are not blank */
+	if (spi_flash_update_pages(flash, offset, flash->sector_size, ptr,
+				   NULL, stats))
 		return "write";
 
 	return NULL;
@@ -216,12 +327,13 @@ static int spi_flash_update(struct spi_flash *flash, u32 offset,
 	char *cmp_buf;
 	const char *end = buf + len;
 	size_t todo;		/* number of bytes to do in this pass */
-	size_t skipped = 0;	/* statistics */
+	struct sf_update_stats stats;
 	const ulong start_time = get_timer(0);
 	size_t scale = 1;
 	const char *start_buf = buf;
 	ulong delta;
 
+	memset(&stats, '\0', sizeof(stats));
 	if (end - buf >= 200)
 		scale = (end - buf) / 100;
 	cmp_buf = memalign(ARCH_DMA_MINALIGN, flash->sector_size);
@@ -238,7 +350,7 @@ static int spi_flash_update(struct spi_flash *flash, u32 offset,
 				last_update = get_timer(0);
 			}
 			err_oper = spi_flash_update_block(flash, offset, todo,
-					buf, cmp_buf, &skipped);
+					buf, cmp_buf, &stats);
 		}
 	} else {
 		err_oper = "malloc";
@@ -251,14 +363,52 @@ static int spi_flash_update(struct spi_flash *flash, u32 offset,
 	}
 
 	delta = get_timer(start_time);
-	printf("%zu bytes written, %zu bytes skipped", len - skipped,
-	       skipped);
+	printf("%zu bytes written, %zu bytes skipped", len - stats.skipped,
+	       stats.skipped);
 	printf(" in %ld.%lds, speed %ld B/s\n",
 	       delta / 1000, delta % 1000, bytes_per_second(len, start_time));
+	printf("%u pages programmed, %u pages skipped, %u sectors erased, %u erases avoided\n",
+	       stats.pages_written, stats.pages_skipped, stats.erases,
+	       stats.erases_avoided);
 
 	return 0;
 }
 
+/**
+ * struct sf_read_stream - An image being read into memory by sf_read()
+ *
+ * @addr:	Address the image is read to
+ * @start:	Offset in the flash of the start of the image
+ */
+struct sf_read_stream {
+	ulong addr;
+	u32 start;
+};
+
+/* Tell the FIT verifier how much of the image is in */
+static int sf_read_stream_fn(void *priv, u32 offset, const void *buf,
+			     size_t len)
+{
+	struct sf_read_stream *rs = priv;
+
+	fit_stream_load(rs->addr, offset - rs->start + len);
+
+	return 0;
+}
+
+static int sf_read(ulong addr, u32 offset, size_t len, void *buf)
+{
+	struct sf_read_stream rs = { .addr = addr, .start = offset };
+
+	if (!IMAGE_ENABLE_STREAM_HASH)
+		return spi_flash_read(flash, offset, len, buf);
+
+	fit_stream_load(addr, 0);
+
+	return spi_flash_read_stream(flash, offset, len, buf, 0,
+				     sf_read_stream_fn, &rs);
+}
+
 static int do_spi_flash_read_write(int argc, char * const argv[])
 {
 	unsigned long addr;
@@ -300,7 +450,7 @@ static int do_spi_flash_read_write(int argc, char * const argv[])
 
 		read = strncmp(argv[0], "read", 4) == 0;
 		if (read)
-			ret = spi_flash_read(flash, offset, len, buf);
+			ret = sf_read(addr, offset, len, buf);
 		else
 			ret = spi_flash_write(flash, offset, len, buf);
 
@@ -380,6 +530,65 @@ static int do_spi_protect(int argc, char * const argv[])
 	return ret == 0 ? 0 : 1;
 }
 
+static void spi_flash_show_timing(const char *name,
+				  struct spi_flash_timing *t)
+{
+	u64 avg = t->total_us;
+	int i;
+
+	if (t->count)
+		do_div(avg, t->count);
+	printf("%-12s %9u %7u %7u %9u %9llu %9u %8u %4u ", name, t->typ_us,
+	       t->max_ms, t->count, t->count ? t->min_us : 0, avg, t->max_us,
+	       t->polls, t->timeouts);
+	for (i = 0; i < SPI_FLASH_TIMING_BUCKETS; i++)
+		printf(" %5u", t->hist[i]);
+	putc('\n');
+}
+
+static int do_spi_flash_stats(int argc, char * const argv[])
+{
+	struct spi_flash_timing *t;
+	char name[20];
+	int i;
+
+	if (argc > 2 || (argc == 2 && strcmp(argv[1], "reset")))
+		return -1;
+
+	for (i = 0; i < SPI_FLASH_OP_COUNT; i++) {
+		t = &flash->timing[i];
+		if (argc == 2) {
+			u32 typ_us = t->typ_us, max_ms = t->max_ms;
+			u32 wait_us = t->wait_us;
+
+			memset(t, '\0', sizeof(*t));
+			t->typ_us = typ_us;
+			t->max_ms = max_ms;
+			t->wait_us = wait_us;
+		}
+	}
+	if (argc == 2)
+		return 0;
+
+	printf("%-12s %9s %7s %7s %9s %9s %9s %8s %4s  %5s %5s %5s %5s %5s %5s\n",
+	       "busy time", "typ(us)", "max(ms)", "count", "min(us)",
+	       "avg(us)", "max(us)", "polls", "t/o", "<1/2", "<1", "<2",
+	       "<4", "<8", ">=8");
+	spi_flash_show_timing("program", &flash->timing[SPI_FLASH_OP_PROGRAM]);
+	for (i = 0; i < SPI_FLASH_MAX_ERASE_TYPES; i++) {
+		if (!flash->erase_types[i].size)
+			break;
+		snprintf(name, sizeof(name), "erase %uK",
+			 flash->erase_types[i].size >> 10);
+		spi_flash_show_timing(name,
+				      &flash->timing[SPI_FLASH_OP_ERASE + i]);
+	}
+	spi_flash_show_timing("chip erase",
+			      &flash->timing[SPI_FLASH_OP_CHIP_ERASE]);
+
+	return 0;
+}
+
 #ifdef CONFIG_CMD_SF_TEST
 enum {
 	STAGE_ERASE,
@@ -498,6 +707,263 @@ static int spi_flash_test(struct spi_flash *flash, uint8_t *buf, ulong len,
 	return 0;
 }
 
+/* Most operations timed for each line of the benchmark */
+#define SF_BENCH_MAX_OPS	128
+
+static const char *const sf_bench_mode_name[SPI_FLASH_READ_MODE_COUNT] = {
+	"slow",
+	"fast",
+	"dual",
+	"quad",
+};
+
+static const uint sf_bench_sizes[] = { 1, 16, 256, 4096, 65536 };
+
+/*
+ * A set of timed operations of the same kind, reported as one line: a
+ * JSON object with the throughput and latency percentiles
+ */
+struct sf_bench {
+	const char *op;
+	const char *path;
+	int cmd;
+	const char *mode;
+	uint size;
+	uint align;
+	uint ops;
+	u32 lat_us[SF_BENCH_MAX_OPS];
+	bool first;
+};
+
+static void sf_bench_start(struct sf_bench *bench, const char *op,
+			   const char *path, int cmd, const char *mode,
+			   uint size, uint align)
+{
+	bench->op = op;
+	bench->path = path;
+	bench->cmd = cmd;
+	bench->mode = mode;
+	bench->size = size;
+	bench->align = align;
+	bench->ops = 0;
+}
+
+static u32 sf_bench_percentile(struct sf_bench *bench, uint pct)
+{
+	return bench->lat_us[(bench->ops - 1) * pct / 100];
+}
+
+static void sf_bench_report(struct sf_bench *bench)
+{
+	u64 total_us = 0, bps;
+	u32 lat, frac;
+	uint i, j;
+
+	if (!bench->ops)
+		return;
+
+	/* Sort the latencies, there are not many */
+	for (i = 1; i < bench->ops; i++) {
+		lat = bench->lat_us[i];
+		for (j = i; j && bench->lat_us[j - 1] > lat; j--)
+			bench->lat_us[j] = bench->lat_us[j - 1];
+		bench->lat_us[j] = lat;
+	}
+	for (i = 0; i < bench->ops; i++)
+		total_us += bench->lat_us[i];
+	bps = (u64)bench->size * bench->ops * 1000000;
+	do_div(bps, (u32)clamp_t(u64, total_us, 1, UINT_MAX));
+	frac = do_div(bps, 1000000) / 1000;
+
+	printf("%s{\"op\": \"%s\", \"path\": \"%s\", ",
+	       bench->first ? "  " : ", ", bench->op, bench->path);
+	if (bench->cmd >= 0)
+		printf("\"cmd\": \"0x%02x\", ", bench->cmd);
+	if (bench->mode)
+		printf("\"mode\": \"%s\", ", bench->mode);
+	printf("\"size\": %u, \"align\": %u, \"ops\": %u, ", bench->size,
+	       bench->align, bench->ops);
+	printf("\"MBps\": %llu.%03u, ", bps, frac);
+	printf("\"lat_us\": {\"p50\": %u, \"p90\": %u, \"p99\": %u, \"max\": %u}}\n",
+	       sf_bench_percentile(bench, 50), sf_bench_percentile(bench, 90),
+	       sf_bench_percentile(bench, 99), bench->lat_us[bench->ops - 1]);
+	bench->first = false;
+}
+
+/* Time reads of each size at an aligned and an unaligned offset */
+static int sf_bench_read(struct sf_bench *bench, const char *path,
+			 const char *mode, const uint8_t *buf, ulong len,
+			 ulong offset, uint8_t *vbuf)
+{
+	ulong start, pos;
+	uint align, i;
+	int cmd = flash->memory_map ? -1 : flash->read_cmd;
+
+	for (i = 0; i < ARRAY_SIZE(sf_bench_sizes); i++) {
+		uint size = sf_bench_sizes[i];
+
+		for (align = 0; align < 2; align++) {
+			sf_bench_start(bench, "read", path, cmd, mode, size,
+				       align);
+			for (pos = align; pos + size <= len &&
+			     bench->ops < SF_BENCH_MAX_OPS; pos += size) {
+				start = timer_get_us();
+				if (spi_flash_read(flash, offset + pos, size,
+						   vbuf + pos))
+					return -EIO;
+				bench->lat_us[bench->ops++] =
+					timer_get_us() - start;
+				if (memcmp(vbuf + pos, buf + pos, size)) {
+					printf("Read verify failed at %#lx\n",
+					       offset + pos);
+					return -EIO;
+				}
+			}
+			sf_bench_report(bench);
+		}
+	}
+
+	return 0;
+}
+
+/* Time writes of whole and part pages, erasing the area before each run */
+static int sf_bench_write(struct sf_bench *bench, const uint8_t *buf,
+			  ulong len, ulong offset, uint8_t *vbuf)
+{
+	const uint sizes[] = { 16, flash->page_size };
+	ulong start, pos, end;
+	uint align, i;
+
+	for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+		for (align = 0; align < 2; align++) {
+			if (spi_flash_erase(flash, offset, len))
+				return -EIO;
+			sf_bench_start(bench, "write", "cmd", flash->write_cmd,
+				       NULL, sizes[i], align);
+			for (pos = align; pos + sizes[i] <= len &&
+			     bench->ops < SF_BENCH_MAX_OPS; pos += sizes[i]) {
+				start = timer_get_us();
+				if (spi_flash_write(flash, offset + pos,
+						    sizes[i], buf + pos))
+					return -EIO;
+				bench->lat_us[bench->ops++] =
+					timer_get_us() - start;
+			}
+			end = pos;
+			pos = align;
+			if (spi_flash_read(flash, offset + pos, end - pos,
+					   vbuf) ||
+			    memcmp(vbuf, buf + pos, end - pos)) {
+				printf("Write verify failed\n");
+				return -EIO;
+			}
+			sf_bench_report(bench);
+		}
+	}
+
+	return 0;
+}
+
+/* Time each erase type over as much of the area as it fits */
+static int sf_bench_erase(struct sf_bench *bench, ulong len, ulong offset)
+{
+	const struct spi_flash_erase_type *type;
+	ulong start, pos;
+	int i;
+
+	for (i = 0; i < SPI_FLASH_MAX_ERASE_TYPES; i++) {
+		type = &flash->erase_types[i];
+		if (!type->size)
+			break;
+		sf_bench_start(bench, "erase", "cmd", type->cmd, NULL,
+			       type->size, 0);
+		for (pos = roundup(offset, type->size) - offset;
+		     pos + type->size <= len && bench->ops < SF_BENCH_MAX_OPS;
+		     pos += type->size) {
+			start = timer_get_us();
+			if (spi_flash_erase(flash, offset + pos, type->size))
+				return -EIO;
+			bench->lat_us[bench->ops++] = timer_get_us() - start;
+		}
+		sf_bench_report(bench);
+	}
+
+	return 0;
+}
+
+/**
+ * Benchmark the SPI flash
+ *
+ * This times reads of a range of sizes with each read command the flash
+ * and bus support, through the memory map as well if there is one. Then it
+ * times writes and erases. Each line of the report is a JSON object, so
+ * that the results can be compared between runs.
+ *
+ * @param flash		SPI flash to use
+ * @param buf		Source buffer for data to write
+ * @param len		Size of the area to use
+ * @param offset	Offset within flash of the area
+ * @param vbuf		Verification buffer
+ * @return 0 if ok, -1 on error
+ */
+static int spi_flash_bench(struct spi_flash *flash, uint8_t *buf, ulong len,
+			   ulong offset, uint8_t *vbuf)
+{
+	u8 read_cmd = flash->read_cmd, dummy_byte = flash->dummy_byte;
+	void *memory_map = flash->memory_map;
+	struct sf_bench *bench;
+	int mode;
+	int ret;
+
+	bench = malloc(sizeof(*bench));
+	if (!bench)
+		return -1;
+	bench->first = true;
+
+	ret = -EIO;
+	if (spi_flash_erase(flash, offset, len) ||
+	    spi_flash_write(flash, offset, len, buf))
+		goto out;
+
+	printf("{\"flash\": \"%s\", \"size\": %u, \"results\": [\n",
+	       flash->name, flash->size);
+	if (memory_map) {
+		ret = sf_bench_read(bench, "mmap", NULL, buf, len, offset,
+				    vbuf);
+		if (ret)
+			goto out;
+		flash->memory_map = NULL;
+	}
+	for (mode = 0; mode < SPI_FLASH_READ_MODE_COUNT; mode++) {
+		if (spi_flash_set_read_mode(flash, mode))
+			continue;
+		ret = sf_bench_read(bench, "cmd", sf_bench_mode_name[mode],
+				    buf, len, offset, vbuf);
+		if (ret)
+			goto out;
+	}
+	flash->read_cmd = read_cmd;
+	flash->dummy_byte = dummy_byte;
+	flash->memory_map = memory_map;
+
+	ret = sf_bench_write(bench, buf, len, offset, vbuf);
+	if (!ret)
+		ret = sf_bench_erase(bench, len, offset);
+	printf("]}\n");
+
+out:
+	flash->read_cmd = read_cmd;
+	flash->dummy_byte = dummy_byte;
+	flash->memory_map = memory_map;
+	free(bench);
+	if (ret) {
+		printf("Benchmark failed\n");
+		return -1;
+	}
+
+	return 0;
+}
+
 static int do_spi_flash_test(int argc, char * const argv[])
 {
 	unsigned long offset;
@@ -505,10 +971,16 @@ static int do_spi_flash_test(int argc, char * const argv[])
 	uint8_t *buf, *from;
 	char *endp;
 	uint8_t *vbuf;
+	bool bench = false;
 	int ret;
 
 	if (argc < 3)
 		return -1;
+	if (argc > 3) {
+		if (strcmp(argv[3], "bench"))
+			return -1;
+		bench = true;
+	}
 	offset = simple_strtoul(argv[1], &endp, 16);
 	if (*argv[1] == 0 || *endp != 0)
 		return -1;
@@ -530,7 +1002,10 @@ static int do_spi_flash_test(int argc, char * const argv[])
 
 	from = map_sysmem(CONFIG_SYS_TEXT_BASE, 0);
 	memcpy(buf, from, len);
-	ret = spi_flash_test(flash, buf, len, offset, vbuf);
+	if (bench)
+		ret = spi_flash_bench(flash, buf, len, offset, vbuf);
+	else
+		ret = spi_flash_test(flash, buf, len, offset, vbuf);
 	free(vbuf);
 	free(buf);
 	if (ret) {
@@ -574,6 +1049,8 @@ static int do_spi_flash(cmd_tbl_t *cmdtp, int flag, int argc,
 		ret = do_spi_flash_erase(argc, argv);
 	else if (strcmp(cmd, "protect") == 0)
 		ret = do_spi_protect(argc, argv);
+	else if (strcmp(cmd, "stats") == 0)
+		ret = do_spi_flash_stats(argc, argv);
 #ifdef CONFIG_CMD_SF_TEST
 	else if (!strcmp(cmd, "test"))
 		ret = do_spi_flash_test(argc, argv);
@@ -590,8 +1067,9 @@ usage:
 }
 
 #ifdef CONFIG_CMD_SF_TEST
-#define SF_TEST_HELP "\nsf test offset len		" \
-		"- run a very basic destructive test"
+#define SF_TEST_HELP "\nsf test offset len [bench]	" \
+		"- run a very basic destructive test,\n" \
+		"					  or benchmark each operation"
 #else
 #define SF_TEST_HELP
 #endif
@@ -615,5 +1093,7 @@ U_BOOT_CMD(
 	"					  or to start of mtd `partition'\n"
 	"sf protect lock/unlock sector len	- protect/unprotect 'len' bytes starting\n"
 	"					  at address 'sector'\n"
+	"sf stats [reset]			- show or reset how long the flash\n"
+	"					  has been busy with each operation\n"
 	SF_TEST_HELP
 );
@@ -7,6 +7,8 @@
 
 #include <common.h>
 #include <command.h>
+#include <mapmem.h>
+#include <u-boot/lz4.h>
 
 static int do_unzip(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 {
@@ -86,3 +88,47 @@ U_BOOT_CMD(
 	"\t\tand is required for files with uncompressed lengths\n"
 	"\t\t4 GiB or larger\n"
 );
+
+#ifdef CONFIG_LZ4
+static int do_lz4write(cmd_tbl_t *cmdtp, int flag,
+		       int argc, char * const argv[])
+{
+	struct blk_desc *bdev;
+	int ret;
+	void *addr;
+	unsigned long length;
+	unsigned long writebuf = 1 << 20;
+	u64 startoffs = 0;
+
+	if (argc < 5)
+		return CMD_RET_USAGE;
+	ret = blk_get_device_by_str(argv[1], argv[2], &bdev);
+	if (ret < 0)
+		return CMD_RET_FAILURE;
+
+	length = simple_strtoul(argv[4], NULL, 16);
+	addr = map_sysmem(simple_strtoul(argv[3], NULL, 16), length);
+
+	if (5 < argc) {
+		writebuf = simple_strtoul(argv[5], NULL, 16);
+		if (6 < argc)
+			startoffs = simple_strtoull(argv[6], NULL, 16);
+	}
+
+	ret = lz4write(addr, length, bdev, writebuf, startoffs);
+	unmap_sysmem(addr);
+
+	return ret ? CMD_RET_FAILURE : CMD_RET_SUCCESS;
+}
+
+U_BOOT_CMD(
+	lz4write, 7, 0, do_lz4write,
+	"decompress an lz4 frame and write it to block device",
+	"<interface> <dev> <addr> length [wbuf=1M [offs=0]]\n"
+	"\twbuf is the size in bytes (hex) of write buffer\n"
+	"\t\tand should be padded to erase size for SSDs\n"
+	"\toffs is the output start offset in bytes (hex)\n"
+	"\tThe frame must use independent blocks; smaller block sizes\n"
+	"\t(lz4 -B4 or -B5) need less memory to decompress\n"
+);
+#endif
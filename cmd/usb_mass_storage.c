@@ -41,8 +41,15 @@ static void ums_fini(void)
 {
 	int i;
 
-	for (i = 0; i < ums_count; i++)
+	/*
+	 * Cached writes refer to our copy of each blk_desc, so write them
+	 * back before it goes away
+	 */
+	for (i = 0; i < ums_count; i++) {
+		blkcache_invalidate(ums[i].block_dev.if_type,
+				    ums[i].block_dev.devnum);
 		free((void *)ums[i].name);
+	}
 	free(ums);
 	ums = NULL;
 	ums_count = 0;
@@ -7,6 +7,7 @@
 
 #ifndef USE_HOSTCC
 #include <common.h>
+#include <blk.h>
 #include <bootstage.h>
 #include <bzlib.h>
 #include <errno.h>
@@ -500,6 +501,12 @@ ulong bootm_disable_interrupts(void)
 # endif
 #endif
 
+	/*
+	 * The OS will not know about blocks still waiting in the cache. Write
+	 * them back while USB storage is still running.
+	 */
+	blkcache_flush_all();
+
 #if defined(CONFIG_CMD_USB)
 	/*
 	 * turn off USB to prevent the host controller from writing to the
@@ -512,6 +519,7 @@ ulong bootm_disable_interrupts(void)
 	 */
 	usb_stop();
 #endif
+
 	return iflag;
 }
 
@@ -10,6 +10,7 @@
  */
 
 #include <common.h>
+#include <blk.h>
 #include <command.h>
 #include <console.h>
 #include <linux/ctype.h>
@@ -537,6 +538,12 @@ enum command_ret_t cmd_process(int flag, int argc, char * const argv[],
 		if (ticks)
 			*ticks = get_timer(0);
 		rc = cmd_call(cmdtp, flag, argc, argv);
+		/*
+		 * Leave no writes in the block cache once a command is done.
+		 * If they cannot be written back the command has failed.
+		 */
+		if (blkcache_flush_all() && rc == CMD_RET_SUCCESS)
+			rc = CMD_RET_FAILURE;
 		if (ticks)
 			*ticks = get_timer(*ticks);
 		*repeatable &= cmdtp->repeatable;
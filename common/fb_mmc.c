@@ -260,19 +260,11 @@ static int fb_mmc_update_zimage(struct blk_desc *dev_desc,
 }
 #endif
 
-void fb_mmc_flash_write(const char *cmd, void *download_buffer,
-			unsigned int download_bytes)
+static void fb_mmc_write(struct blk_desc *dev_desc, const char *cmd,
+			 void *download_buffer, unsigned int download_bytes)
 {
-	struct blk_desc *dev_desc;
 	disk_partition_t info;
 
-	dev_desc = blk_get_dev("mmc", CONFIG_FASTBOOT_FLASH_MMC_DEV);
-	if (!dev_desc || dev_desc->type == DEV_TYPE_UNKNOWN) {
-		pr_err("invalid mmc device\n");
-		fastboot_fail("invalid mmc device");
-		return;
-	}
-
 #if CONFIG_IS_ENABLED(EFI_PARTITION)
 	if (strcmp(cmd, CONFIG_FASTBOOT_GPT_NAME) == 0) {
 		printf("%s: updating MBR, Primary and Backup GPT(s)\n",
@@ -351,6 +343,27 @@ void fb_mmc_flash_write(const char *cmd, void *download_buffer,
 	}
 }
 
+void fb_mmc_flash_write(const char *cmd, void *download_buffer,
+			unsigned int download_bytes)
+{
+	struct blk_desc *dev_desc;
+
+	dev_desc = blk_get_dev("mmc", CONFIG_FASTBOOT_FLASH_MMC_DEV);
+	if (!dev_desc || dev_desc->type == DEV_TYPE_UNKNOWN) {
+		pr_err("invalid mmc device\n");
+		fastboot_fail("invalid mmc device");
+		return;
+	}
+
+	fb_mmc_write(dev_desc, cmd, download_buffer, download_bytes);
+
+	/* Only say OKAY once the data has left the block cache */
+	if (blkcache_flush(dev_desc->if_type, dev_desc->devnum)) {
+		pr_err("failed writing back to device %d\n", dev_desc->devnum);
+		fastboot_fail("failed writing to device");
+	}
+}
+
 void fb_mmc_erase(const char *cmd)
 {
 	int ret;
@@ -0,0 +1,275 @@
+/*
+ * Hash FIT images while they are loaded
+ *
+ * A loader tells us how much of the FIT it has brought in. Once the FIT
+ * header is there, the data of each image with a hash or signature node is
+ * fed to the hash algorithm as it arrives, while it is still in the cache,
+ * so that fit_image_verify() does not have to read it all again.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <errno.h>
+#include <hash.h>
+#include <image.h>
+#include <mapmem.h>
+#include <watchdog.h>
+#include <u-boot/crc.h>
+
+/* Most hash and signature nodes which are worked out during a load */
+#define FIT_STREAM_MAX_HASHES	16
+
+/* Most bytes hashed between watchdog resets */
+#define FIT_STREAM_CHUNK	(64 << 10)
+
+/**
+ * struct fit_stream_hash - A hash or signature being worked out in a load
+ *
+ * @noffset:	Offset of the hash or signature node in the FIT
+ * @algo:	Hash algorithm
+ * @ctx:	Context for @algo while hashing, NULL once done or failed
+ * @done:	Offset in the FIT of the next byte to hash
+ * @end:	Offset in the FIT of the end of the image data
+ * @value:	Hash value, once worked out
+ * @value_len:	Length of @value, 0 until it is worked out
+ */
+struct fit_stream_hash {
+	int noffset;
+	struct hash_algo *algo;
+	void *ctx;
+	ulong done;
+	ulong end;
+	uint8_t value[FIT_MAX_HASH_LEN];
+	int value_len;
+};
+
+enum fit_stream_state {
+	FIT_STREAM_IDLE,	/* not loading a FIT */
+	FIT_STREAM_HEADER,	/* waiting for the whole FIT header */
+	FIT_STREAM_DATA,	/* hashing images as they arrive */
+};
+
+/**
+ * struct fit_stream - The load being watched
+ *
+ * @state:	What we are waiting for
+ * @addr:	Address the FIT is being loaded to
+ * @loaded:	Number of bytes at @addr which are loaded
+ * @header_size: Size of the FIT header, once it has arrived
+ * @header_crc:	CRC32 of the FIT header, to check it is the same FIT later
+ * @count:	Number of entries in @hash
+ * @hash:	Hash nodes being worked out
+ */
+static struct fit_stream {
+	enum fit_stream_state state;
+	ulong addr;
+	ulong loaded;
+	ulong header_size;
+	uint32_t header_crc;
+	int count;
+	struct fit_stream_hash hash[FIT_STREAM_MAX_HASHES];
+} fit_stream;
+
+static void fit_stream_reset(void)
+{
+	uint8_t value[FIT_MAX_HASH_LEN];
+	struct fit_stream_hash *hash;
+	int i;
+
+	/* Finishing a hash is the only way to free its context */
+	for (i = 0; i < fit_stream.count; i++) {
+		hash = &fit_stream.hash[i];
+		if (hash->ctx)
+			hash->algo->hash_finish(hash->algo, hash->ctx, value,
+						sizeof(value));
+	}
+	memset(&fit_stream, '\0', sizeof(fit_stream));
+}
+
+/* Start hashing an image's data, if it comes after the FIT header */
+static void fit_stream_add_image(const void *fit, int image_noffset)
+{
+	struct fit_stream_hash *hash;
+	const void *data;
+	size_t size;
+	char *algo;
+	int noffset;
+	int offset;
+
+	/* Embedded data arrives with the header, so there is nothing to gain */
+	if (fit_image_get_data_offset(fit, image_noffset, &offset) &&
+	    fit_image_get_data_position(fit, image_noffset, &offset))
+		return;
+	if (fit_image_get_data_and_size(fit, image_noffset, &data, &size))
+		return;
+
+	fdt_for_each_subnode(noffset, fit, image_noffset) {
+		const char *name = fit_get_name(fit, noffset, NULL);
+		char checksum[16];
+
+		if (fit_stream.count == FIT_STREAM_MAX_HASHES)
+			return;
+		if (fit_image_hash_get_algo(fit, noffset, &algo))
+			continue;
+
+		/* A signature's algo is "<checksum>,<crypto>" */
+		if (IMAGE_ENABLE_VERIFY &&
+		    !strncmp(name, FIT_SIG_NODENAME,
+			     strlen(FIT_SIG_NODENAME))) {
+			strlcpy(checksum, algo, sizeof(checksum));
+			algo = strchr(checksum, ',');
+			if (!algo)
+				continue;
+			*algo = '\0';
+			algo = checksum;
+		} else if (strncmp(name, FIT_HASH_NODENAME,
+				   strlen(FIT_HASH_NODENAME))) {
+			continue;
+		}
+
+		hash = &fit_stream.hash[fit_stream.count];
+		if (hash_progressive_lookup_algo(algo, &hash->algo) ||
+		    hash->algo->hash_init(hash->algo, &hash->ctx))
+			continue;
+		hash->noffset = noffset;
+		hash->done = data - fit;
+		hash->end = hash->done + size;
+		fit_stream.count++;
+	}
+}
+
+/* The whole FIT header is loaded: work out what to hash */
+static void fit_stream_start(const void *fit)
+{
+	int images;
+	int noffset;
+
+	fit_stream.state = FIT_STREAM_IDLE;
+	if (!fit_check_format(fit))
+		return;
+	images = fdt_path_offset(fit, FIT_IMAGES_PATH);
+	if (images < 0)
+		return;
+
+	fdt_for_each_subnode(noffset, fit, images)
+		fit_stream_add_image(fit, noffset);
+	if (!fit_stream.count)
+		return;
+
+	fit_stream.header_size = fdt_totalsize(fit);
+	fit_stream.header_crc = crc32(0, fit, fit_stream.header_size);
+	fit_stream.state = FIT_STREAM_DATA;
+	debug("%s: hashing %d images at %lx\n", __func__, fit_stream.count,
+	      fit_stream.addr);
+}
+
+static void fit_stream_finish(struct fit_stream_hash *hash)
+{
+	uint32_t crc;
+
+	if (hash->algo->hash_finish(hash->algo, hash->ctx, hash->value,
+				    sizeof(hash->value))) {
+		hash->ctx = NULL;
+		return;
+	}
+	hash->ctx = NULL;
+	hash->value_len = hash->algo->digest_size;
+
+	/* A FIT holds its CRC32 big-endian, as calculate_hash() gives it */
+	if (!strcmp(hash->algo->name, "crc32")) {
+		memcpy(&crc, hash->value, sizeof(crc));
+		crc = cpu_to_uimage(crc);
+		memcpy(hash->value, &crc, sizeof(crc));
+	}
+}
+
+/* Hash whatever has arrived of each image */
+static void fit_stream_update(const void *fit)
+{
+	struct fit_stream_hash *hash;
+	ulong end, len;
+	int i;
+
+	for (i = 0; i < fit_stream.count; i++) {
+		hash = &fit_stream.hash[i];
+		if (!hash->ctx)
+			continue;
+
+		end = min(hash->end, fit_stream.loaded);
+		while (hash->done < end) {
+			len = min_t(ulong, end - hash->done, FIT_STREAM_CHUNK);
+			/* The context is freed if this fails */
+			if (hash->algo->hash_update(hash->algo, hash->ctx,
+						    fit + hash->done, len,
+						    hash->done + len ==
+						    hash->end)) {
+				hash->ctx = NULL;
+				break;
+			}
+			hash->done += len;
+			WATCHDOG_RESET();
+		}
+
+		if (hash->ctx && hash->done == hash->end)
+			fit_stream_finish(hash);
+	}
+}
+
+void fit_stream_load(ulong addr, ulong size)
+{
+	const void *fit;
+
+	if (!size) {
+		fit_stream_reset();
+		fit_stream.state = FIT_STREAM_HEADER;
+		fit_stream.addr = addr;
+		return;
+	}
+	if (fit_stream.state == FIT_STREAM_IDLE || addr != fit_stream.addr ||
+	    size <= fit_stream.loaded)
+		return;
+
+	fit_stream.loaded = size;
+	fit = map_sysmem(addr, size);
+	if (fit_stream.state == FIT_STREAM_HEADER) {
+		if (size < sizeof(struct fdt_header))
+			goto out;
+		if (fdt_check_header(fit)) {
+			fit_stream.state = FIT_STREAM_IDLE;
+			goto out;
+		}
+		if (size < fdt_totalsize(fit))
+			goto out;
+		fit_stream_start(fit);
+	}
+	if (fit_stream.state == FIT_STREAM_DATA)
+		fit_stream_update(fit);
+out:
+	unmap_sysmem(fit);
+}
+
+int fit_stream_get_hash(const void *fit, int noffset, uint8_t *value,
+			int *value_len)
+{
+	struct fit_stream_hash *hash;
+	int i;
+
+	/* Make sure this is the FIT that was loaded */
+	if (fit_stream.state != FIT_STREAM_DATA ||
+	    fit != map_sysmem(fit_stream.addr, 0) ||
+	    fdt_totalsize(fit) != fit_stream.header_size ||
+	    crc32(0, fit, fit_stream.header_size) != fit_stream.header_crc)
+		return -ENOENT;
+
+	for (i = 0; i < fit_stream.count; i++) {
+		hash = &fit_stream.hash[i];
+		if (hash->noffset != noffset || !hash->value_len)
+			continue;
+		memcpy(value, hash->value, hash->value_len);
+		*value_len = hash->value_len;
+		return 0;
+	}
+
+	return -ENOENT;
+}
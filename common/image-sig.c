@@ -185,8 +185,10 @@ int fit_image_check_sig(const void *fit, int noffset, const void *data,
 {
 	struct image_sign_info info;
 	struct image_region region;
+	uint8_t checksum[FIT_MAX_HASH_LEN];
 	uint8_t *fit_value;
 	int fit_value_len;
+	int checksum_len;
 
 	*err_msgp = NULL;
 	if (fit_image_setup_verify(&info, fit, noffset, required_keynode,
@@ -202,6 +204,14 @@ int fit_image_check_sig(const void *fit, int noffset, const void *data,
 	region.data = data;
 	region.size = size;
 
+	/* The data may have been hashed as the image was loaded */
+	if (IMAGE_ENABLE_STREAM_HASH &&
+	    !fit_stream_get_hash(fit, noffset, checksum, &checksum_len) &&
+	    checksum_len == info.checksum->checksum_len) {
+		debug("%s: hashed while loading\n", __func__);
+		info.checksum_value = checksum;
+	}
+
 	if (info.crypto->verify(&info, &region, 1, fit_value, fit_value_len)) {
 		*err_msgp = "Verification failed";
 		return -1;
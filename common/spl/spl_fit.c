@@ -9,12 +9,19 @@
 #include <errno.h>
 #include <image.h>
 #include <libfdt.h>
+#include <malloc.h>
+#include <memalign.h>
 #include <spl.h>
+#include <u-boot/lz4.h>
+#include <u-boot/zlib.h>
 
 #ifndef CONFIG_SYS_BOOTM_LEN
 #define CONFIG_SYS_BOOTM_LEN	(64 << 20)
 #endif
 
+/* Bytes of a compressed image read at a time when decompressing as we go */
+#define SPL_FIT_STREAM_CHUNK	(16 << 10)
+
 /**
  * spl_fit_get_image_name(): By using the matching configuration subnode,
  * retrieve the name of an image, specified by a property name and an index
@@ -141,6 +148,163 @@ static int get_aligned_image_size(struct spl_load_info *info, int data_size,
 	return (data_size + info->bl_len - 1) / info->bl_len;
 }
 
+/**
+ * spl_load_fit_image_stream(): read compressed data, a chunk at a time
+ * @info:	points to information about the device to load data from
+ * @sector:	the start sector of the FIT image on the device
+ * @offset:	offset of the compressed data from the start of the FIT
+ * @length:	length of the compressed data
+ * @feed:	decompresses the next chunk, returning 0 if more is needed, 1
+ *		at the end of the compressed stream or -ve on error
+ * @s:		decompression state passed to @feed
+ *
+ * The compressed image is never held in memory as a whole.
+ *
+ * Return:	0 on success or a negative error number.
+ */
+static int spl_load_fit_image_stream(struct spl_load_info *info, ulong sector,
+				     int offset, size_t length,
+				     int (*feed)(void *s, const void *buf,
+						 ulong len),
+				     void *s)
+{
+	ulong chunk, left, count, bytes, skip;
+	void *buf;
+	int ret;
+
+	/* A filesystem reads bytes, anything else reads whole blocks */
+	if (info->filename)
+		chunk = roundup(SPL_FIT_STREAM_CHUNK, ARCH_DMA_MINALIGN);
+	else
+		chunk = DIV_ROUND_UP(SPL_FIT_STREAM_CHUNK, info->bl_len);
+	buf = malloc_cache_aligned(info->filename ? chunk :
+				   chunk * info->bl_len);
+	if (!buf)
+		return -ENOMEM;
+
+	sector += get_aligned_image_offset(info, offset);
+	left = get_aligned_image_size(info, length, offset);
+	skip = get_aligned_image_overhead(info, offset);
+	for (ret = 0; !ret && left; left -= count, sector += count) {
+		count = min(left, chunk);
+		if (info->read(info, sector, count, buf) != count) {
+			ret = -EIO;
+			break;
+		}
+		bytes = info->filename ? count : count * info->bl_len;
+		bytes = min(bytes - skip, (ulong)length);
+		ret = feed(s, buf + skip, bytes);
+		length -= bytes;
+		skip = 0;
+	}
+	free(buf);
+
+	/* Running out of data before the stream ends is an error */
+	if (ret < 0)
+		return -EIO;
+	if (!ret) {
+		puts("Compressed image is truncated\n");
+		return -EIO;
+	}
+
+	return 0;
+}
+
+static int spl_fit_gunzip_feed(void *s, const void *buf, ulong len)
+{
+	return gunzip_stream(s, buf, len);
+}
+
+/**
+ * spl_load_fit_image_gzip(): read a gzip image, decompressing it as it comes
+ * @info:	points to information about the device to load data from
+ * @sector:	the start sector of the FIT image on the device
+ * @offset:	offset of the compressed data from the start of the FIT
+ * @length:	length of the compressed data
+ * @load_addr:	address to decompress the image to
+ * @sizep:	returns the size of the decompressed image
+ *
+ * The image is read a chunk at a time, and each chunk is decompressed
+ * straight to @load_addr.
+ *
+ * Return:	0 on success or a negative error number.
+ */
+static int spl_load_fit_image_gzip(struct spl_load_info *info, ulong sector,
+				   int offset, size_t length, ulong load_addr,
+				   size_t *sizep)
+{
+	z_stream s;
+	int ret;
+
+	if (gunzip_stream_init(&s, (void *)load_addr, CONFIG_SYS_BOOTM_LEN))
+		return -EIO;
+	ret = spl_load_fit_image_stream(info, sector, offset, length,
+					spl_fit_gunzip_feed, &s);
+	debug("Decompressed %lu bytes to %lx\n", s.total_out, load_addr);
+	*sizep = s.total_out;
+	gunzip_stream_end(&s);
+
+	return ret;
+}
+
+/* Where an LZ4 image is being decompressed to */
+struct spl_fit_lz4 {
+	struct ulz4f_stream s;
+	void *dst;
+	size_t size;
+};
+
+static int spl_fit_lz4_write(void *priv, const void *buf, size_t len)
+{
+	struct spl_fit_lz4 *lz4 = priv;
+
+	if (lz4->size + len > CONFIG_SYS_BOOTM_LEN)
+		return -E2BIG;
+	memcpy(lz4->dst + lz4->size, buf, len);
+	lz4->size += len;
+
+	return 0;
+}
+
+static int spl_fit_lz4_feed(void *s, const void *buf, ulong len)
+{
+	return ulz4f_stream_feed(s, buf, len);
+}
+
+/**
+ * spl_load_fit_image_lz4(): read an LZ4 image, decompressing it as it comes
+ * @info:	points to information about the device to load data from
+ * @sector:	the start sector of the FIT image on the device
+ * @offset:	offset of the compressed data from the start of the FIT
+ * @length:	length of the compressed data
+ * @load_addr:	address to decompress the image to
+ * @sizep:	returns the size of the decompressed image
+ *
+ * Each block of the LZ4 frame is decompressed to a buffer as soon as it
+ * has been read, then copied to @load_addr.
+ *
+ * Return:	0 on success or a negative error number.
+ */
+static int spl_load_fit_image_lz4(struct spl_load_info *info, ulong sector,
+				  int offset, size_t length, ulong load_addr,
+				  size_t *sizep)
+{
+	struct spl_fit_lz4 lz4;
+	int ret;
+
+	lz4.dst = (void *)load_addr;
+	lz4.size = 0;
+	ulz4f_stream_init(&lz4.s, spl_fit_lz4_write, &lz4, true);
+	ret = spl_load_fit_image_stream(info, sector, offset, length,
+					spl_fit_lz4_feed, &lz4.s);
+	if (ulz4f_stream_finish(&lz4.s) && !ret)
+		ret = -EIO;
+	debug("Decompressed %zu bytes to %lx\n", lz4.size, load_addr);
+	*sizep = lz4.size;
+
+	return ret;
+}
+
 /**
  * spl_load_fit_image(): load the image described in a certain FIT node
  * @info:	points to information about the device to load data from
@@ -174,8 +338,11 @@ static int spl_load_fit_image(struct spl_load_info *info, ulong sector,
 	uint8_t image_comp = -1, type = -1;
 	const void *data;
 	bool external_data = false;
+	int ret;
 
-	if (IS_ENABLED(CONFIG_SPL_OS_BOOT) && IS_ENABLED(CONFIG_SPL_GZIP)) {
+	if (IS_ENABLED(CONFIG_SPL_FIT_STREAM_GZIP) ||
+	    IS_ENABLED(CONFIG_SPL_FIT_STREAM_LZ4) ||
+	    (IS_ENABLED(CONFIG_SPL_OS_BOOT) && IS_ENABLED(CONFIG_SPL_GZIP))) {
 		if (fit_image_get_comp(fit, node, &image_comp))
 			puts("Cannot get image compression format.\n");
 		else
@@ -202,6 +369,23 @@ static int spl_load_fit_image(struct spl_load_info *info, ulong sector,
 		if (fit_image_get_data_size(fit, node, &len))
 			return -ENOENT;
 
+		if (IS_ENABLED(CONFIG_SPL_FIT_STREAM_GZIP) &&
+		    image_comp == IH_COMP_GZIP) {
+			ret = spl_load_fit_image_gzip(info, sector, offset, len,
+						      load_addr, &length);
+			if (ret)
+				return ret;
+			goto done;
+		}
+		if (IS_ENABLED(CONFIG_SPL_FIT_STREAM_LZ4) &&
+		    image_comp == IH_COMP_LZ4) {
+			ret = spl_load_fit_image_lz4(info, sector, offset, len,
+						     load_addr, &length);
+			if (ret)
+				return ret;
+			goto done;
+		}
+
 		load_ptr = (load_addr + align_len) & ~align_len;
 		length = len;
 
@@ -231,10 +415,10 @@ static int spl_load_fit_image(struct spl_load_info *info, ulong sector,
 	board_fit_image_post_process(&src, &length);
 #endif
 
-	if (IS_ENABLED(CONFIG_SPL_OS_BOOT)	&&
-	    IS_ENABLED(CONFIG_SPL_GZIP)		&&
+	if (IS_ENABLED(CONFIG_SPL_GZIP)		&&
 	    image_comp == IH_COMP_GZIP		&&
-	    type == IH_TYPE_KERNEL) {
+	    (IS_ENABLED(CONFIG_SPL_FIT_STREAM_GZIP) ||
+	     (IS_ENABLED(CONFIG_SPL_OS_BOOT) && type == IH_TYPE_KERNEL))) {
 		size = length;
 		if (gunzip((void *)load_addr, CONFIG_SYS_BOOTM_LEN,
 			   src, &size)) {
@@ -242,10 +426,20 @@ static int spl_load_fit_image(struct spl_load_info *info, ulong sector,
 			return -EIO;
 		}
 		length = size;
+	} else if (IS_ENABLED(CONFIG_SPL_FIT_STREAM_LZ4) &&
+		   image_comp == IH_COMP_LZ4) {
+		size_t dst_len = CONFIG_SYS_BOOTM_LEN;
+
+		if (ulz4fn(src, length, (void *)load_addr, &dst_len)) {
+			puts("Uncompressing error\n");
+			return -EIO;
+		}
+		length = dst_len;
 	} else {
 		memcpy((void *)load_addr, src, length);
 	}
 
+done:
 	if (image_info) {
 		image_info->load_addr = load_addr;
 		image_info->size = length;
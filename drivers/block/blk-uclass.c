@@ -313,11 +313,15 @@ ulong blk_write_devnum(enum if_type if_type, int devnum, lbaint_t start,
 int blk_select_hwpart(struct udevice *dev, int hwpart)
 {
 	const struct blk_ops *ops = blk_get_ops(dev);
+	int ret;
 
 	if (!ops)
 		return -ENOSYS;
 	if (!ops->select_hwpart)
 		return 0;
+	ret = blkcache_select_hwpart(dev_get_uclass_platdata(dev), hwpart);
+	if (ret)
+		return ret;
 
 	return ops->select_hwpart(dev, hwpart);
 }
@@ -432,7 +436,8 @@ unsigned long blk_dwrite(struct blk_desc *block_dev, lbaint_t start,
 	if (!ops->write)
 		return -ENOSYS;
 
-	blkcache_invalidate(block_dev->if_type, block_dev->devnum);
+	if (blkcache_write(block_dev, start, blkcnt, buffer))
+		return blkcnt;
 	return ops->write(dev, start, blkcnt, buffer);
 }
 
@@ -445,7 +450,7 @@ unsigned long blk_derase(struct blk_desc *block_dev, lbaint_t start,
 	if (!ops->erase)
 		return -ENOSYS;
 
-	blkcache_invalidate(block_dev->if_type, block_dev->devnum);
+	blkcache_discard(block_dev->if_type, block_dev->devnum, start, blkcnt);
 	return ops->erase(dev, start, blkcnt);
 }
 
@@ -622,8 +627,19 @@ int blk_unbind_all(int if_type)
 	return 0;
 }
 
+static int blk_pre_remove(struct udevice *dev)
+{
+	struct blk_desc *desc = dev_get_uclass_platdata(dev);
+
+	/* The device may come back with other contents, e.g. in tests */
+	blkcache_invalidate(desc->if_type, desc->devnum);
+
+	return 0;
+}
+
 UCLASS_DRIVER(blk) = {
 	.id		= UCLASS_BLK,
 	.name		= "blk",
+	.pre_remove	= blk_pre_remove,
 	.per_device_platdata_auto_alloc_size = sizeof(struct blk_desc),
 };
@@ -192,11 +192,16 @@ struct blk_desc *blk_get_devnum_by_type(enum if_type if_type, int devnum)
 int blk_dselect_hwpart(struct blk_desc *desc, int hwpart)
 {
 	struct blk_driver *drv = blk_driver_lookup_type(desc->if_type);
+	int ret;
 
 	if (!drv)
 		return -ENOSYS;
-	if (drv->select_hwpart)
+	if (drv->select_hwpart) {
+		ret = blkcache_select_hwpart(desc, hwpart);
+		if (ret)
+			return ret;
 		return drv->select_hwpart(desc, hwpart);
+	}
 
 	return 0;
 }
@@ -228,7 +233,7 @@ ulong blk_read_devnum(enum if_type if_type, int devnum, lbaint_t start,
 	ret = get_desc(drv, devnum, &desc);
 	if (ret)
 		return ret;
-	n = desc->block_read(desc, start, blkcnt, buffer);
+	n = blk_dread(desc, start, blkcnt, buffer);
 	if (IS_ERR_VALUE(n))
 		return n;
 
@@ -247,7 +252,7 @@ ulong blk_write_devnum(enum if_type if_type, int devnum, lbaint_t start,
 	ret = get_desc(drv, devnum, &desc);
 	if (ret)
 		return ret;
-	return desc->block_write(desc, start, blkcnt, buffer);
+	return blk_dwrite(desc, start, blkcnt, buffer);
 }
 
 int blk_select_hwpart_devnum(enum if_type if_type, int devnum, int hwpart)
@@ -259,6 +264,9 @@ int blk_select_hwpart_devnum(enum if_type if_type, int devnum, int hwpart)
 	if (!drv)
 		return -ENOSYS;
 	ret = get_desc(drv, devnum, &desc);
+	if (ret)
+		return ret;
+	ret = blkcache_select_hwpart(desc, hwpart);
 	if (ret)
 		return ret;
 	return drv->select_hwpart(desc, hwpart);
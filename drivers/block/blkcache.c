@@ -7,67 +7,499 @@
  */
 #include <config.h>
 #include <common.h>
+#include <blk.h>
+#include <dm.h>
 #include <malloc.h>
+#include <memalign.h>
 #include <part.h>
 #include <linux/ctype.h>
 #include <linux/list.h>
+#include <linux/log2.h>
 
-struct block_cache_node {
-	struct list_head lh;
+/*
+ * The cache is an arena of lines, each holding an aligned run of blocks
+ * making up BLKCACHE_LINE_SIZE bytes. A line is found by hashing its
+ * device and number to a set of BLKCACHE_WAYS lines, which are searched
+ * in turn. The least recently used line in the set is replaced on a miss.
+ * Each device also keeps a list of its lines, so that dropping or writing
+ * back a device does not have to look through the whole arena.
+ *
+ * With CONFIG_BLOCK_CACHE_WRITEBACK, small writes only go into the cache
+ * and mark their blocks dirty. The dirty blocks of a device are written
+ * back together, in order and merged into runs of up to
+ * BLKCACHE_FLUSH_LINES lines, when one of them is replaced, when a read
+ * of the device misses on them, or when blkcache_flush() is called.
+ */
+#define BLKCACHE_LINE_SIZE	4096
+#define BLKCACHE_WAYS		8
+#define BLKCACHE_MAX_DEVS	8
+#define BLKCACHE_FLUSH_LINES	32
+
+/**
+ * struct block_cache_dev - A device which has blocks in the cache
+ *
+ * A slot is taken when a device is first cached and given up again when the
+ * device is invalidated, e.g. because it is unbound.
+ *
+ * @used:	true if this slot is in use
+ * @iftype:	IF_TYPE_x for type of device
+ * @devnum:	Device index of particular type
+ * @blksz:	Size in bytes of each block
+ * @shift:	log2 of the number of blocks in each line
+ * @ndirty:	Number of lines with dirty blocks
+ * @err:	Error from writing back dirty blocks, reported by the next flush
+ * @desc:	Device to write dirty blocks back to
+ * @lines:	Valid lines of this device
+ * @stats:	Statistics for this device
+ */
+struct block_cache_dev {
+	bool used;
 	int iftype;
 	int devnum;
-	lbaint_t start;
-	lbaint_t blkcnt;
 	unsigned long blksz;
-	char *cache;
+	uint shift;
+	uint ndirty;
+	int err;
+	struct blk_desc *desc;
+	struct list_head lines;
+	struct block_cache_dev_stats stats;
+};
+
+/**
+ * struct block_cache_line - A line of blocks in the cache
+ *
+ * @lineno:	Line number on the device, i.e. its first block >> shift
+ * @stamp:	Time of the last access, for finding the least recently used
+ * @valid:	Bitmap of the blocks in the line which are cached, 0 if none
+ * @dirty:	Bitmap of the blocks which are newer than on the device
+ * @dev:	Index of the device in block_cache_devs[]
+ * @list:	Entry in the device's list of lines, if valid
+ */
+struct block_cache_line {
+	struct list_head list;
+	lbaint_t lineno;
+	u32 stamp;
+	u32 valid;
+	u32 dirty;
+	u8 dev;
 };
 
-static LIST_HEAD(block_cache);
+static struct block_cache_dev block_cache_devs[BLKCACHE_MAX_DEVS];
+
+/* The arena, allocated on first use, with the data for each line */
+static struct block_cache_line *block_cache_lines;
+static char *block_cache_data;
+static char *block_cache_bounce;
+static uint block_cache_sets;
+static u32 block_cache_clock;
 
 static struct block_cache_stats _stats = {
-	.max_blocks_per_entry = 2,
-	.max_entries = 32
+	.max_blocks_per_entry = 64,
+	.max_entries = (CONFIG_BLOCK_CACHE_SIZE << 20) / BLKCACHE_LINE_SIZE,
 };
 
-static struct block_cache_node *cache_find(int iftype, int devnum,
-					   lbaint_t start, lbaint_t blkcnt,
-					   unsigned long blksz)
-{
-	struct block_cache_node *node;
-
-	list_for_each_entry(node, &block_cache, lh)
-		if ((node->iftype == iftype) &&
-		    (node->devnum == devnum) &&
-		    (node->blksz == blksz) &&
-		    (node->start <= start) &&
-		    (node->start + node->blkcnt >= start + blkcnt)) {
-			if (block_cache.next != &node->lh) {
-				/* maintain MRU ordering */
-				list_del(&node->lh);
-				list_add(&node->lh, &block_cache);
+static int cache_alloc(void)
+{
+	uint lines, i;
+
+	block_cache_sets = _stats.max_entries / BLKCACHE_WAYS;
+	if (!block_cache_sets)
+		return -ENOSPC;
+	lines = block_cache_sets * BLKCACHE_WAYS;
+
+	block_cache_lines = calloc(lines, sizeof(*block_cache_lines));
+	block_cache_data = malloc(lines * BLKCACHE_LINE_SIZE);
+	if (IS_ENABLED(CONFIG_BLOCK_CACHE_WRITEBACK))
+		block_cache_bounce = malloc_cache_aligned(BLKCACHE_FLUSH_LINES *
+							  BLKCACHE_LINE_SIZE);
+	if (!block_cache_lines || !block_cache_data ||
+	    (IS_ENABLED(CONFIG_BLOCK_CACHE_WRITEBACK) && !block_cache_bounce)) {
+		free(block_cache_lines);
+		free(block_cache_data);
+		free(block_cache_bounce);
+		block_cache_lines = NULL;
+		block_cache_data = NULL;
+		block_cache_bounce = NULL;
+		return -ENOMEM;
+	}
+	for (i = 0; i < lines; i++)
+		INIT_LIST_HEAD(&block_cache_lines[i].list);
+	debug("blkcache: %u sets of %u lines\n", block_cache_sets,
+	      BLKCACHE_WAYS);
+
+	return 0;
+}
+
+static void cache_free(void)
+{
+	int i;
+
+	free(block_cache_lines);
+	free(block_cache_data);
+	free(block_cache_bounce);
+	block_cache_lines = NULL;
+	block_cache_data = NULL;
+	block_cache_bounce = NULL;
+	_stats.entries = 0;
+	for (i = 0; i < BLKCACHE_MAX_DEVS; i++) {
+		block_cache_devs[i].ndirty = 0;
+		INIT_LIST_HEAD(&block_cache_devs[i].lines);
+	}
+}
+
+static struct block_cache_dev *cache_find_dev(int iftype, int devnum)
+{
+	struct block_cache_dev *dev;
+
+	for (dev = block_cache_devs; dev < block_cache_devs + BLKCACHE_MAX_DEVS;
+	     dev++) {
+		if (dev->used && dev->iftype == iftype &&
+		    dev->devnum == devnum)
+			return dev;
+	}
+
+	return NULL;
+}
+
+/* Mark a line as holding nothing, taking it off its device's list */
+static void cache_drop_line(struct block_cache_line *line)
+{
+	line->valid = 0;
+	line->dirty = 0;
+	list_del_init(&line->list);
+	_stats.entries--;
+}
+
+static void cache_drop_dev(struct block_cache_dev *dev)
+{
+	struct block_cache_line *line, *next;
+
+	list_for_each_entry_safe(line, next, &dev->lines, list)
+		cache_drop_line(line);
+	dev->ndirty = 0;
+}
+
+/*
+ * Find the device a fill is for, adding it if needed. Only block sizes
+ * which are a power of two no larger than a line can be cached.
+ */
+static struct block_cache_dev *cache_get_dev(int iftype, int devnum,
+					     unsigned long blksz)
+{
+	struct block_cache_dev *dev;
+
+	if (!blksz || blksz > BLKCACHE_LINE_SIZE || !is_power_of_2(blksz) ||
+	    BLKCACHE_LINE_SIZE / blksz > 32)
+		return NULL;
+
+	dev = cache_find_dev(iftype, devnum);
+	if (!dev) {
+		for (dev = block_cache_devs; dev->used; dev++) {
+			if (dev == block_cache_devs + BLKCACHE_MAX_DEVS - 1)
+				return NULL;
+		}
+		memset(dev, '\0', sizeof(*dev));
+		dev->used = true;
+		dev->iftype = iftype;
+		dev->devnum = devnum;
+		dev->stats.iftype = iftype;
+		dev->stats.devnum = devnum;
+		INIT_LIST_HEAD(&dev->lines);
+	} else if (dev->blksz != blksz) {
+		cache_drop_dev(dev);
+	}
+	dev->blksz = blksz;
+	dev->shift = ilog2(BLKCACHE_LINE_SIZE / blksz);
+
+	return dev;
+}
+
+static struct block_cache_line *cache_set(int dev, lbaint_t lineno)
+{
+	u64 key = (u64)lineno * BLKCACHE_MAX_DEVS + dev;
+	u32 hash = (u32)(key ^ (key >> 32)) * 0x9e3779b9;
+
+	return &block_cache_lines[(hash >> 8) % block_cache_sets *
+				  BLKCACHE_WAYS];
+}
+
+static struct block_cache_line *cache_find(int dev, lbaint_t lineno)
+{
+	struct block_cache_line *line = cache_set(dev, lineno);
+	int i;
+
+	for (i = 0; i < BLKCACHE_WAYS; i++, line++) {
+		if (line->valid && line->dev == dev && line->lineno == lineno)
+			return line;
+	}
+
+	return NULL;
+}
+
+static char *cache_line_data(struct block_cache_line *line)
+{
+	return block_cache_data +
+		(line - block_cache_lines) * BLKCACHE_LINE_SIZE;
+}
+
+static ulong cache_write_dev(struct blk_desc *desc, lbaint_t start,
+			     lbaint_t blkcnt, const void *buffer)
+{
+#if CONFIG_IS_ENABLED(BLK)
+	return blk_get_ops(desc->bdev)->write(desc->bdev, start, blkcnt,
+					      buffer);
+#else
+	return desc->block_write(desc, start, blkcnt, buffer);
+#endif
+}
+
+static int cache_line_cmp(const void *a, const void *b)
+{
+	const struct block_cache_line *la = *(struct block_cache_line **)a;
+	const struct block_cache_line *lb = *(struct block_cache_line **)b;
+
+	if (la->lineno == lb->lineno)
+		return 0;
+
+	return la->lineno < lb->lineno ? -1 : 1;
+}
+
+/* Write out the run of blocks collected in the bounce buffer */
+static int cache_write_run(struct block_cache_dev *dev, lbaint_t start,
+			   lbaint_t blkcnt)
+{
+	debug("write back: start " LBAF ", count " LBAFU "\n", start, blkcnt);
+	dev->stats.writebacks++;
+	if (cache_write_dev(dev->desc, start, blkcnt,
+			    block_cache_bounce) != blkcnt)
+		return -EIO;
+
+	return 0;
+}
+
+/*
+ * Write back the dirty blocks of a device in block order, copying runs of
+ * adjacent blocks into the bounce buffer so that each becomes one write.
+ * The blocks are clean afterwards even if a write fails, since retrying
+ * is unlikely to help; the error is returned instead.
+ */
+static int cache_flush_dev(struct block_cache_dev *dev)
+{
+	const uint max = BLKCACHE_FLUSH_LINES << dev->shift;
+	struct block_cache_line **dirty, *line;
+	lbaint_t run = 0, count = 0, blk;
+	uint i, n = 0, bit, len;
+	int ret = dev->err;
+
+	dev->err = 0;
+	if (!dev->ndirty)
+		return ret;
+
+	dirty = malloc(dev->ndirty * sizeof(*dirty));
+	if (!dirty)
+		return -ENOMEM;
+	list_for_each_entry(line, &dev->lines, list) {
+		if (line->dirty)
+			dirty[n++] = line;
+	}
+	qsort(dirty, n, sizeof(*dirty), cache_line_cmp);
+
+	for (i = 0; i < n; i++) {
+		line = dirty[i];
+		for (bit = 0; bit < (1 << dev->shift); bit += len) {
+			len = 1;
+			if (!(line->dirty & (1U << bit)))
+				continue;
+			while (bit + len < (1 << dev->shift) &&
+			       (line->dirty & (1U << (bit + len))))
+				len++;
+
+			blk = (line->lineno << dev->shift) + bit;
+			if (count && (blk != run + count || count + len > max)) {
+				if (cache_write_run(dev, run, count))
+					ret = -EIO;
+				count = 0;
 			}
-			return node;
+			if (!count)
+				run = blk;
+			memcpy(block_cache_bounce + count * dev->blksz,
+			       cache_line_data(line) + bit * dev->blksz,
+			       len * dev->blksz);
+			count += len;
+		}
+		line->dirty = 0;
+	}
+	if (count && cache_write_run(dev, run, count))
+		ret = -EIO;
+	dev->ndirty = 0;
+	free(dirty);
+
+	return ret;
+}
+
+/* Bits for the blocks of line @lineno which lie in [@start, @end) */
+static u32 cache_mask(struct block_cache_dev *dev, lbaint_t lineno,
+		      lbaint_t start, lbaint_t end)
+{
+	lbaint_t base = lineno << dev->shift;
+	uint first = start > base ? start - base : 0;
+	uint last = min_t(lbaint_t, end - base, 1 << dev->shift);
+
+	return (u32)(((1ULL << (last - first)) - 1) << first);
+}
+
+/*
+ * Call @fn for each cached line of @dev with blocks in [@start, @end),
+ * stopping if it returns non-zero. @fn may drop the line. Short ranges are
+ * looked up line by line; long ones go through the device's lines instead.
+ */
+static int cache_walk_range(struct block_cache_dev *dev, lbaint_t start,
+			    lbaint_t end,
+			    int (*fn)(struct block_cache_dev *dev,
+				      struct block_cache_line *line, u32 mask))
+{
+	lbaint_t first = start >> dev->shift, last = (end - 1) >> dev->shift;
+	const uint lines = block_cache_sets * BLKCACHE_WAYS;
+	int idx = dev - block_cache_devs;
+	struct block_cache_line *line, *next;
+	lbaint_t lineno;
+	int ret;
+
+	if (!block_cache_lines || end <= start)
+		return 0;
+
+	if (last - first < lines) {
+		for (lineno = first; lineno <= last; lineno++) {
+			line = cache_find(idx, lineno);
+			if (!line)
+				continue;
+			ret = fn(dev, line, cache_mask(dev, lineno, start, end));
+			if (ret)
+				return ret;
 		}
+		return 0;
+	}
+
+	list_for_each_entry_safe(line, next, &dev->lines, list) {
+		if (line->lineno < first || line->lineno > last)
+			continue;
+		ret = fn(dev, line, cache_mask(dev, line->lineno, start, end));
+		if (ret)
+			return ret;
+	}
+
 	return 0;
 }
 
+static int cache_is_dirty(struct block_cache_dev *dev,
+			  struct block_cache_line *line, u32 mask)
+{
+	return (line->dirty & mask) != 0;
+}
+
+static int cache_drop_blocks(struct block_cache_dev *dev,
+			     struct block_cache_line *line, u32 mask)
+{
+	if (line->dirty && !(line->dirty & ~mask))
+		dev->ndirty--;
+	line->dirty &= ~mask;
+	line->valid &= ~mask;
+	if (!line->valid)
+		cache_drop_line(line);
+
+	return 0;
+}
+
+/* Find a line to fill, replacing the least recently used in its set */
+static struct block_cache_line *cache_replace(int dev, lbaint_t lineno)
+{
+	struct block_cache_line *line = cache_set(dev, lineno);
+	struct block_cache_line *lru = NULL;
+	int i;
+
+	for (i = 0; i < BLKCACHE_WAYS; i++, line++) {
+		if (!line->valid) {
+			lru = line;
+			break;
+		}
+		if (!lru || (s32)(line->stamp - lru->stamp) < 0)
+			lru = line;
+	}
+
+	if (lru->dirty) {
+		/* Write back the lot, rather than just this line */
+		struct block_cache_dev *owner = &block_cache_devs[lru->dev];
+		int ret = cache_flush_dev(owner);
+
+		if (ret) {
+			printf("blkcache: write-back failed (err=%d)\n", ret);
+			owner->err = ret;
+		}
+	}
+	if (lru->valid) {
+		debug("drop: dev %d, line " LBAF "\n", lru->dev, lru->lineno);
+		block_cache_devs[lru->dev].stats.evictions++;
+		_stats.evictions++;
+		list_del(&lru->list);
+	} else {
+		_stats.entries++;
+	}
+	lru->dev = dev;
+	lru->lineno = lineno;
+	lru->valid = 0;
+	list_add(&lru->list, &block_cache_devs[dev].lines);
+
+	return lru;
+}
+
 int blkcache_read(int iftype, int devnum,
 		  lbaint_t start, lbaint_t blkcnt,
 		  unsigned long blksz, void *buffer)
 {
-	struct block_cache_node *node = cache_find(iftype, devnum, start,
-						   blkcnt, blksz);
-	if (node) {
-		const char *src = node->cache + (start - node->start) * blksz;
-		memcpy(buffer, src, blksz * blkcnt);
-		debug("hit: start " LBAF ", count " LBAFU "\n",
-		      start, blkcnt);
-		++_stats.hits;
-		return 1;
+	struct block_cache_dev *dev = cache_find_dev(iftype, devnum);
+	struct block_cache_line *line;
+	lbaint_t blk, end = start + blkcnt;
+	uint first, count;
+	u32 mask;
+	int idx;
+
+	if (!dev || dev->blksz != blksz || !block_cache_lines ||
+	    blkcnt > _stats.max_blocks_per_entry)
+		goto miss;
+
+	/* Every block must be there; the buffer is read into anyway if not */
+	idx = dev - block_cache_devs;
+	for (blk = start; blk < end; blk += count) {
+		first = blk & ((1 << dev->shift) - 1);
+		count = min_t(lbaint_t, end - blk, (1 << dev->shift) - first);
+		mask = (u32)(((1ULL << count) - 1) << first);
+		line = cache_find(idx, blk >> dev->shift);
+		if (!line || (line->valid & mask) != mask)
+			goto miss;
+		line->stamp = ++block_cache_clock;
+		memcpy(buffer + (blk - start) * blksz,
+		       cache_line_data(line) + first * blksz, count * blksz);
 	}
 
+	debug("hit: start " LBAF ", count " LBAFU "\n",
+	      start, blkcnt);
+	++dev->stats.hits;
+	++_stats.hits;
+	return 1;
+
+miss:
 	debug("miss: start " LBAF ", count " LBAFU "\n",
 	      start, blkcnt);
+	/* The caller reads the device, so it must have the latest data */
+	if (dev && dev->ndirty &&
+	    cache_walk_range(dev, start, end, cache_is_dirty)) {
+		dev->err = cache_flush_dev(dev);
+		if (dev->err)
+			printf("blkcache: write-back failed (err=%d)\n",
+			       dev->err);
+	}
+	if (dev)
+		++dev->stats.misses;
 	++_stats.misses;
 	return 0;
 }
@@ -76,8 +508,11 @@ void blkcache_fill(int iftype, int devnum,
 		   lbaint_t start, lbaint_t blkcnt,
 		   unsigned long blksz, void const *buffer)
 {
-	lbaint_t bytes;
-	struct block_cache_node *node;
+	struct block_cache_dev *dev;
+	struct block_cache_line *line;
+	lbaint_t blk, end = start + blkcnt;
+	uint first, count;
+	int idx;
 
 	/* don't cache big stuff */
 	if (blkcnt > _stats.max_blocks_per_entry)
@@ -86,76 +521,163 @@ void blkcache_fill(int iftype, int devnum,
 	if (_stats.max_entries == 0)
 		return;
 
-	bytes = blksz * blkcnt;
-	if (_stats.max_entries <= _stats.entries) {
-		/* pop LRU */
-		node = (struct block_cache_node *)block_cache.prev;
-		list_del(&node->lh);
-		_stats.entries--;
-		debug("drop: start " LBAF ", count " LBAFU "\n",
-		      node->start, node->blkcnt);
-		if (node->blkcnt * node->blksz < bytes) {
-			free(node->cache);
-			node->cache = 0;
-		}
-	} else {
-		node = malloc(sizeof(*node));
-		if (!node)
-			return;
-		node->cache = 0;
+	if (!block_cache_lines && cache_alloc())
+		return;
+
+	dev = cache_get_dev(iftype, devnum, blksz);
+	if (!dev)
+		return;
+
+	debug("fill: start " LBAF ", count " LBAFU "\n",
+	      start, blkcnt);
+
+	idx = dev - block_cache_devs;
+	for (blk = start; blk < end; blk += count) {
+		first = blk & ((1 << dev->shift) - 1);
+		count = min_t(lbaint_t, end - blk, (1 << dev->shift) - first);
+		line = cache_find(idx, blk >> dev->shift);
+		if (!line)
+			line = cache_replace(idx, blk >> dev->shift);
+		line->valid |= (u32)(((1ULL << count) - 1) << first);
+		line->stamp = ++block_cache_clock;
+		memcpy(cache_line_data(line) + first * blksz,
+		       buffer + (blk - start) * blksz, count * blksz);
 	}
+}
 
-	if (!node->cache) {
-		node->cache = malloc(bytes);
-		if (!node->cache) {
-			free(node);
-			return;
-		}
+int blkcache_write(struct blk_desc *desc, lbaint_t start, lbaint_t blkcnt,
+		   const void *buffer)
+{
+	struct block_cache_dev *dev;
+	struct block_cache_line *line;
+	lbaint_t blk, end = start + blkcnt;
+	uint first, count;
+	u32 mask;
+	int idx;
+
+	dev = cache_find_dev(desc->if_type, desc->devnum);
+	if (!IS_ENABLED(CONFIG_BLOCK_CACHE_WRITEBACK) ||
+	    blkcnt > _stats.max_blocks_per_entry || !_stats.max_entries ||
+	    (!block_cache_lines && cache_alloc())) {
+		/* This goes straight to the device, so forget older copies */
+		if (dev)
+			cache_walk_range(dev, start, end, cache_drop_blocks);
+		return 0;
 	}
 
-	debug("fill: start " LBAF ", count " LBAFU "\n",
+	dev = cache_get_dev(desc->if_type, desc->devnum, desc->blksz);
+	if (!dev)
+		return 0;
+	dev->desc = desc;
+
+	debug("write: start " LBAF ", count " LBAFU "\n",
 	      start, blkcnt);
 
-	node->iftype = iftype;
-	node->devnum = devnum;
-	node->start = start;
-	node->blkcnt = blkcnt;
-	node->blksz = blksz;
-	memcpy(node->cache, buffer, bytes);
-	list_add(&node->lh, &block_cache);
-	_stats.entries++;
+	idx = dev - block_cache_devs;
+	for (blk = start; blk < end; blk += count) {
+		first = blk & ((1 << dev->shift) - 1);
+		count = min_t(lbaint_t, end - blk, (1 << dev->shift) - first);
+		mask = (u32)(((1ULL << count) - 1) << first);
+		line = cache_find(idx, blk >> dev->shift);
+		if (!line)
+			line = cache_replace(idx, blk >> dev->shift);
+		if (!line->dirty)
+			dev->ndirty++;
+		line->valid |= mask;
+		line->dirty |= mask;
+		line->stamp = ++block_cache_clock;
+		memcpy(cache_line_data(line) + first * desc->blksz,
+		       buffer + (blk - start) * desc->blksz,
+		       count * desc->blksz);
+	}
+
+	return 1;
+}
+
+void blkcache_discard(int iftype, int devnum, lbaint_t start,
+		      lbaint_t blkcnt)
+{
+	struct block_cache_dev *dev = cache_find_dev(iftype, devnum);
+
+	if (dev)
+		cache_walk_range(dev, start, start + blkcnt,
+				 cache_drop_blocks);
+}
+
+int blkcache_flush(int iftype, int devnum)
+{
+	struct block_cache_dev *dev = cache_find_dev(iftype, devnum);
+
+	return dev ? cache_flush_dev(dev) : 0;
+}
+
+/* Write back a device's dirty blocks, saying so if that fails */
+static int cache_flush_dev_report(struct block_cache_dev *dev)
+{
+	int ret = cache_flush_dev(dev);
+
+	if (ret)
+		printf("blkcache: write-back to %s %d failed (err=%d)\n",
+		       blk_get_if_type_name(dev->iftype), dev->devnum, ret);
+
+	return ret;
+}
+
+int blkcache_flush_all(void)
+{
+	struct block_cache_dev *dev;
+	int ret, err = 0;
+
+	for (dev = block_cache_devs; dev < block_cache_devs + BLKCACHE_MAX_DEVS;
+	     dev++) {
+		if (!dev->used)
+			continue;
+		ret = cache_flush_dev_report(dev);
+		if (ret)
+			err = ret;
+	}
+
+	return err;
+}
+
+int blkcache_select_hwpart(struct blk_desc *desc, int hwpart)
+{
+	struct block_cache_dev *dev;
+	int ret;
+
+	if (desc->hwpart == hwpart)
+		return 0;
+	dev = cache_find_dev(desc->if_type, desc->devnum);
+	if (!dev)
+		return 0;
+
+	/* The dirty blocks belong to the partition being left */
+	ret = cache_flush_dev_report(dev);
+	if (ret)
+		return ret;
+	cache_drop_dev(dev);
+
+	return 0;
 }
 
 void blkcache_invalidate(int iftype, int devnum)
 {
-	struct list_head *entry, *n;
-	struct block_cache_node *node;
-
-	list_for_each_safe(entry, n, &block_cache) {
-		node = (struct block_cache_node *)entry;
-		if ((node->iftype == iftype) &&
-		    (node->devnum == devnum)) {
-			list_del(entry);
-			free(node->cache);
-			free(node);
-			--_stats.entries;
-		}
+	struct block_cache_dev *dev = cache_find_dev(iftype, devnum);
+
+	if (dev) {
+		cache_flush_dev_report(dev);
+		cache_drop_dev(dev);
+		dev->used = false;
 	}
 }
 
 void blkcache_configure(unsigned blocks, unsigned entries)
 {
-	struct block_cache_node *node;
-	if ((blocks != _stats.max_blocks_per_entry) ||
-	    (entries != _stats.max_entries)) {
+	/* The lines do not depend on the size of fills, only their number */
+	if (entries != _stats.max_entries) {
 		/* invalidate cache */
-		while (!list_empty(&block_cache)) {
-			node = (struct block_cache_node *)block_cache.next;
-			list_del(&node->lh);
-			free(node->cache);
-			free(node);
-		}
-		_stats.entries = 0;
+		blkcache_flush_all();
+		cache_free();
 	}
 
 	_stats.max_blocks_per_entry = blocks;
@@ -163,6 +685,7 @@ void blkcache_configure(unsigned blocks, unsigned entries)
 
 	_stats.hits = 0;
 	_stats.misses = 0;
+	_stats.evictions = 0;
 }
 
 void blkcache_stats(struct block_cache_stats *stats)
@@ -170,4 +693,25 @@ void blkcache_stats(struct block_cache_stats *stats)
 	memcpy(stats, &_stats, sizeof(*stats));
 	_stats.hits = 0;
 	_stats.misses = 0;
+	_stats.evictions = 0;
+}
+
+int blkcache_dev_stats(int index, struct block_cache_dev_stats *stats)
+{
+	struct block_cache_dev *dev;
+
+	if (index < 0)
+		return -ENOENT;
+	for (dev = block_cache_devs; !dev->used || index--; dev++) {
+		if (dev == block_cache_devs + BLKCACHE_MAX_DEVS - 1)
+			return -ENOENT;
+	}
+
+	memcpy(stats, &dev->stats, sizeof(*stats));
+	dev->stats.hits = 0;
+	dev->stats.misses = 0;
+	dev->stats.evictions = 0;
+	dev->stats.writebacks = 0;
+
+	return 0;
 }
@@ -205,6 +205,7 @@ int device_remove(struct udevice *dev, uint flags)
 		device_free(dev);
 
 		dev->seq = -1;
+		uclass_index_device(dev);
 		dev->flags &= ~DM_FLAG_ACTIVATED;
 	}
 
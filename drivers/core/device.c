@@ -161,6 +161,8 @@ static int device_bind_common(struct udevice *parent, const struct driver *drv,
 		if (ret)
 			goto fail_uclass_post_bind;
 	}
+	/* The methods above may have changed the node or req_seq */
+	uclass_index_device(dev);
 
 	if (parent)
 		pr_debug("Bound device %s to %s\n", dev->name, parent->name);
@@ -364,6 +366,7 @@ int device_probe(struct udevice *dev)
 		goto fail;
 	}
 	dev->seq = seq;
+	uclass_index_device(dev);
 
 	dev->flags |= DM_FLAG_ACTIVATED;
 
@@ -422,6 +425,7 @@ fail:
 	dev->flags &= ~DM_FLAG_ACTIVATED;
 
 	dev->seq = -1;
+	uclass_index_device(dev);
 	device_free(dev);
 
 	return ret;
@@ -707,6 +711,18 @@ int device_set_name(struct udevice *dev, const char *name)
 	return 0;
 }
 
+void dev_set_ofnode(struct udevice *dev, ofnode node)
+{
+	dev->node = node;
+	uclass_index_device(dev);
+}
+
+void dev_set_req_seq(struct udevice *dev, int req_seq)
+{
+	dev->req_seq = req_seq;
+	uclass_index_device(dev);
+}
+
 bool device_is_compatible(struct udevice *dev, const char *compat)
 {
 	const void *fdt = gd->fdt_blob;
@@ -8,7 +8,9 @@
  */
 
 #include <common.h>
+#include <bootstage.h>
 #include <errno.h>
+#include <malloc.h>
 #include <dm/device.h>
 #include <dm/device-internal.h>
 #include <dm/lists.h>
@@ -17,6 +19,9 @@
 #include <dm/util.h>
 #include <fdtdec.h>
 #include <linux/compiler.h>
+#include <linux/log2.h>
+
+DECLARE_GLOBAL_DATA_PTR;
 
 struct driver *lists_driver_lookup_name(const char *name)
 {
@@ -123,10 +128,133 @@ static int driver_check_compatible(const struct udevice_id *of_match,
 	return -ENOENT;
 }
 
-int lists_bind_fdt(struct udevice *parent, ofnode node, struct udevice **devp)
+#if CONFIG_IS_ENABLED(DM_COMPAT_INDEX)
+#define COMPAT_INDEX_EMPTY	0xffff
+
+/**
+ * struct dm_compat_index - Drivers by compatible string
+ *
+ * An open-addressed hash table, each slot giving the position of a driver
+ * in the linker list and of a compatible string in its of_match table.
+ * It is rebuilt after relocation, since both the drivers and the early
+ * malloc() area it lives in before that move.
+ *
+ * @driver:	Start of the driver linker list
+ * @mask:	Number of slots less one
+ * @slot:	Slots, or COMPAT_INDEX_EMPTY in @drv if unused
+ */
+struct dm_compat_index {
+	struct driver *driver;
+	uint mask;
+	struct {
+		u16 drv;
+		u16 id;
+	} slot[];
+};
+
+/* FNV-1a */
+static uint compat_hash(const char *compat)
+{
+	u32 hash = 2166136261U;
+
+	while (*compat)
+		hash = (hash ^ (u8)*compat++) * 16777619U;
+
+	return hash;
+}
+
+static void lists_compat_index(void)
 {
 	struct driver *driver = ll_entry_start(struct driver, driver);
 	const int n_ents = ll_entry_count(struct driver, driver);
+	const struct udevice_id *id, *other;
+	struct dm_compat_index *index;
+	uint count = 0, slots, h;
+	struct driver *entry;
+	size_t size;
+
+	if (n_ents >= COMPAT_INDEX_EMPTY)
+		return;
+	for (entry = driver; entry != driver + n_ents; entry++) {
+		for (id = entry->of_match; id && id->compatible; id++)
+			count++;
+	}
+	slots = roundup_pow_of_two(max(count * 2, 16U));
+	size = sizeof(*index) + slots * sizeof(index->slot[0]);
+#if CONFIG_VAL(SYS_MALLOC_F_LEN)
+	/* Leave most of the early malloc() area to the devices being bound */
+	if (!(gd->flags & GD_FLG_FULL_MALLOC_INIT) &&
+	    size > (gd->malloc_limit - gd->malloc_ptr) / 4)
+		return;
+#endif
+	index = malloc(size);
+	if (!index)
+		return;
+	index->driver = driver;
+	index->mask = slots - 1;
+	memset(index->slot, '\xff', slots * sizeof(index->slot[0]));
+
+	/* Keep the first driver for each string, as a linear search would */
+	for (entry = driver; entry != driver + n_ents; entry++) {
+		for (id = entry->of_match; id && id->compatible; id++) {
+			h = compat_hash(id->compatible) & index->mask;
+			while (index->slot[h].drv != COMPAT_INDEX_EMPTY) {
+				other = index->driver[index->slot[h].drv].of_match +
+					index->slot[h].id;
+				if (!strcmp(other->compatible, id->compatible))
+					break;
+				h = (h + 1) & index->mask;
+			}
+			if (index->slot[h].drv != COMPAT_INDEX_EMPTY)
+				continue;
+			index->slot[h].drv = entry - driver;
+			index->slot[h].id = id - entry->of_match;
+		}
+	}
+	pr_debug("%s: %u compatible strings in %u slots\n", __func__, count,
+		 slots);
+	gd->dm_compat = index;
+}
+#endif
+
+
+struct driver *lists_driver_lookup_compat(const char *compat,
+					  const struct udevice_id **idp)
+{
+	struct driver *driver = ll_entry_start(struct driver, driver);
+	const int n_ents = ll_entry_count(struct driver, driver);
+	struct driver *entry;
+#if CONFIG_IS_ENABLED(DM_COMPAT_INDEX)
+	struct dm_compat_index *index = gd->dm_compat;
+	const struct udevice_id *id;
+	uint h;
+
+	if (index) {
+		h = compat_hash(compat) & index->mask;
+		for (; index->slot[h].drv != COMPAT_INDEX_EMPTY;
+		     h = (h + 1) & index->mask) {
+			entry = &index->driver[index->slot[h].drv];
+			id = entry->of_match + index->slot[h].id;
+			if (!strcmp(id->compatible, compat)) {
+				*idp = id;
+				return entry;
+			}
+		}
+
+		return NULL;
+	}
+#endif
+
+	for (entry = driver; entry != driver + n_ents; entry++) {
+		if (!driver_check_compatible(entry->of_match, idp, compat))
+			return entry;
+	}
+
+	return NULL;
+}
+
+int lists_bind_fdt(struct udevice *parent, ofnode node, struct udevice **devp)
+{
 	const struct udevice_id *id;
 	struct driver *entry;
 	struct udevice *dev;
@@ -163,14 +291,13 @@ int lists_bind_fdt(struct udevice *parent, ofnode node, struct udevice **devp)
 		pr_debug("   - attempt to match compatible string '%s'\n",
 			 compat);
 
-		for (entry = driver; entry != driver + n_ents; entry++) {
-			ret = driver_check_compatible(entry->of_match, &id,
-						      compat);
-			if (!ret)
-				break;
-		}
-		if (entry == driver + n_ents)
+		bootstage_start(BOOTSTAGE_ID_ACCUM_DM_COMPAT, "dm_compat");
+		entry = lists_driver_lookup_compat(compat, &id);
+		bootstage_accum(BOOTSTAGE_ID_ACCUM_DM_COMPAT);
+		if (!entry) {
+			ret = -ENOENT;
 			continue;
+		}
 
 		pr_debug("   - found match at '%s'\n", entry->name);
 		ret = device_bind_with_driver_data(parent, entry, name,
@@ -197,3 +324,15 @@ int lists_bind_fdt(struct udevice *parent, ofnode node, struct udevice **devp)
 	return result;
 }
 #endif
+
+void lists_init(void)
+{
+#if CONFIG_IS_ENABLED(OF_CONTROL) && !CONFIG_IS_ENABLED(OF_PLATDATA) && \
+	CONFIG_IS_ENABLED(DM_COMPAT_INDEX)
+	/* Any index from before relocation is in memory which has gone */
+	gd->dm_compat = NULL;
+	bootstage_start(BOOTSTAGE_ID_ACCUM_DM_COMPAT, "dm_compat");
+	lists_compat_index();
+	bootstage_accum(BOOTSTAGE_ID_ACCUM_DM_COMPAT);
+#endif
+}
@@ -21,6 +21,7 @@
 #include <dm/read.h>
 #include <dm/root.h>
 #include <dm/uclass.h>
+#include <dm/uclass-internal.h>
 #include <dm/util.h>
 #include <linux/list.h>
 
@@ -159,12 +160,15 @@ int dm_init(bool of_live)
 		return -EINVAL;
 	}
 	INIT_LIST_HEAD(&DM_UCLASS_ROOT_NON_CONST);
+	uclass_init_ids();
 
 #if defined(CONFIG_NEEDS_MANUAL_RELOC)
 	fix_drivers();
 	fix_uclass();
 	fix_devices();
 #endif
+	/* The index reads the drivers' of_match tables, so fix them first */
+	lists_init();
 
 	ret = device_bind_by_name(NULL, false, &root_info, &DM_ROOT_NON_CONST);
 	if (ret)
@@ -172,10 +176,10 @@ int dm_init(bool of_live)
 #if CONFIG_IS_ENABLED(OF_CONTROL)
 # if CONFIG_IS_ENABLED(OF_LIVE)
 	if (of_live)
-		DM_ROOT_NON_CONST->node = np_to_ofnode(gd->of_root);
+		dev_set_ofnode(DM_ROOT_NON_CONST, np_to_ofnode(gd->of_root));
 	else
 #endif
-		DM_ROOT_NON_CONST->node = offset_to_ofnode(0);
+		dev_set_ofnode(DM_ROOT_NON_CONST, offset_to_ofnode(0));
 #endif
 	ret = device_probe(DM_ROOT_NON_CONST);
 	if (ret)
@@ -188,6 +192,10 @@ int dm_uninit(void)
 {
 	device_remove(dm_root(), DM_REMOVE_NORMAL);
 	device_unbind(dm_root());
+	free(gd->dm_compat);
+	gd->dm_compat = NULL;
+	free(gd->uclass_by_id);
+	gd->uclass_by_id = NULL;
 
 	return 0;
 }
@@ -20,17 +20,195 @@
 
 DECLARE_GLOBAL_DATA_PTR;
 
+#if CONFIG_IS_ENABLED(DM_UCLASS_INDEX)
+/* Buckets for each key in a new index, doubling when it has more entries */
+#define UCLASS_INDEX_MIN	4
+
+/**
+ * struct uclass_index_entry - A device's entries in its uclass's index
+ *
+ * @node:	Links into the index, unhashed if the device has no such key
+ * @dev:	Device these entries are for
+ * @pos:	Position of the device in its uclass's list, for picking the
+ *		first of several devices with the same key
+ */
+struct uclass_index_entry {
+	struct hlist_node node[UCLASS_INDEX_COUNT];
+	struct udevice *dev;
+	uint pos;
+};
+
+/* Each key has its own buckets, so that a chain only holds one kind of node */
+static struct hlist_head *uclass_index_bucket(struct uclass *uc,
+					      enum uclass_index_key key,
+					      ulong val)
+{
+	u32 hash = (u32)val ^ (u32)((u64)val >> 32);
+
+	/* Fibonacci hashing, folding the top bits down */
+	hash *= 0x9e3779b1;
+
+	return &uc->index[key * (uc->index_mask + 1) +
+			  ((hash ^ hash >> 16) & uc->index_mask)];
+}
+
+/* Get the value of a device's key, returning false if the device has none */
+static bool uclass_index_key(struct udevice *dev, enum uclass_index_key key,
+			     ulong *valp)
+{
+	switch (key) {
+	case UCLASS_INDEX_SEQ:
+		*valp = dev->seq;
+		return dev->seq != -1;
+	case UCLASS_INDEX_REQ_SEQ:
+		*valp = dev->req_seq;
+		return dev->req_seq != -1;
+	case UCLASS_INDEX_OFNODE:
+		*valp = dev->node.of_offset;
+		return ofnode_valid(dev->node);
+#if CONFIG_IS_ENABLED(OF_CONTROL)
+	case UCLASS_INDEX_PHANDLE:
+		if (!dev_has_of_node(dev))
+			return false;
+		*valp = (uint)dev_read_phandle(dev);
+		return *valp != 0;
+#endif
+	default:
+		return false;
+	}
+}
+
+static void uclass_index_add(struct uclass *uc, struct udevice *dev)
+{
+	struct uclass_index_entry *entry = dev->index_entry;
+	enum uclass_index_key key;
+	ulong val;
+
+	for (key = 0; key < UCLASS_INDEX_COUNT; key++) {
+		if (!uclass_index_key(dev, key, &val))
+			continue;
+		hlist_add_head(&entry->node[key],
+			       uclass_index_bucket(uc, key, val));
+		uc->index_count++;
+	}
+}
+
+static void uclass_index_del(struct uclass *uc, struct udevice *dev)
+{
+	struct uclass_index_entry *entry = dev->index_entry;
+	enum uclass_index_key key;
+
+	for (key = 0; key < UCLASS_INDEX_COUNT; key++) {
+		if (hlist_unhashed(&entry->node[key]))
+			continue;
+		hlist_del_init(&entry->node[key]);
+		uc->index_count--;
+	}
+}
+
+/* Move to a table with @buckets buckets per key, adding every device again */
+static void uclass_index_resize(struct uclass *uc, uint buckets)
+{
+	struct hlist_head *index;
+	enum uclass_index_key key;
+	struct udevice *dev;
+
+	index = calloc(buckets * UCLASS_INDEX_COUNT, sizeof(*index));
+	if (!index)
+		return;
+	free(uc->index);
+	uc->index = index;
+	uc->index_mask = buckets - 1;
+	uc->index_count = 0;
+	list_for_each_entry(dev, &uc->dev_head, uclass_node) {
+		for (key = 0; key < UCLASS_INDEX_COUNT; key++)
+			INIT_HLIST_NODE(&dev->index_entry->node[key]);
+		uclass_index_add(uc, dev);
+	}
+}
+
+void uclass_index_device(struct udevice *dev)
+{
+	struct uclass *uc = dev->uclass;
+
+	if (!dev->index_entry)
+		return;
+	uclass_index_del(uc, dev);
+	uclass_index_add(uc, dev);
+	if (uc->index_count > (uc->index_mask + 1) * UCLASS_INDEX_COUNT)
+		uclass_index_resize(uc, (uc->index_mask + 1) * 2);
+}
+
+/*
+ * Find the device with a key in a uclass's index, returning the first in
+ * the uclass's list if there are several, just as a search of it would
+ */
+static int uclass_index_find(struct uclass *uc, enum uclass_index_key key,
+			     ulong val, struct udevice **devp)
+{
+	struct uclass_index_entry *entry, *found = NULL;
+	struct hlist_node *node;
+	ulong dev_val;
+
+	hlist_for_each(node, uclass_index_bucket(uc, key, val)) {
+		entry = container_of(node - key, struct uclass_index_entry,
+				     node[0]);
+		if (found && found->pos < entry->pos)
+			continue;
+		if (!uclass_index_key(entry->dev, key, &dev_val) ||
+		    dev_val != val)
+			continue;
+		found = entry;
+	}
+	if (!found)
+		return -ENODEV;
+	*devp = found->dev;
+
+	return 0;
+}
+
+static bool uclass_has_index(struct uclass *uc)
+{
+	return uc->index;
+}
+
+void uclass_init_ids(void)
+{
+	size_t size = UCLASS_COUNT * sizeof(struct uclass *);
+
+	/* Like the uclass indexes, this waits until malloc() is set up */
+	if (!gd->uclass_by_id && (gd->flags & GD_FLG_FULL_MALLOC_INIT))
+		gd->uclass_by_id = malloc(size);
+	if (gd->uclass_by_id)
+		memset(gd->uclass_by_id, '\0', size);
+}
+#else
+static int uclass_index_find(struct uclass *uc, enum uclass_index_key key,
+			     ulong val, struct udevice **devp)
+{
+	return -ENODEV;
+}
+
+static bool uclass_has_index(struct uclass *uc)
+{
+	return false;
+}
+
+void uclass_init_ids(void)
+{
+}
+#endif
+
 struct uclass *uclass_find(enum uclass_id key)
 {
 	struct uclass *uc;
 
 	if (!gd->dm_root)
 		return NULL;
-	/*
-	 * TODO(sjg@chromium.org): Optimise this, perhaps moving the found
-	 * node to the start of the list, or creating a linear array mapping
-	 * id to node.
-	 */
+#if CONFIG_IS_ENABLED(DM_UCLASS_INDEX)
+	if (gd->uclass_by_id)
+		return (uint)key < UCLASS_COUNT ? gd->uclass_by_id[key] : NULL;
+#endif
 	list_for_each_entry(uc, &gd->uclass_root, sibling_node) {
 		if (uc->uc_drv->id == key)
 			return uc;
@@ -79,7 +257,19 @@ static int uclass_add(enum uclass_id id, struct uclass **ucp)
 	uc->uc_drv = uc_drv;
 	INIT_LIST_HEAD(&uc->sibling_node);
 	INIT_LIST_HEAD(&uc->dev_head);
+#if CONFIG_IS_ENABLED(DM_UCLASS_INDEX)
+	/*
+	 * Before relocation the early malloc() area is needed for devices.
+	 * Without an index the device list is searched instead.
+	 */
+	if (gd->flags & GD_FLG_FULL_MALLOC_INIT)
+		uclass_index_resize(uc, UCLASS_INDEX_MIN);
+#endif
 	list_add(&uc->sibling_node, &DM_UCLASS_ROOT_NON_CONST);
+#if CONFIG_IS_ENABLED(DM_UCLASS_INDEX)
+	if (gd->uclass_by_id)
+		gd->uclass_by_id[id] = uc;
+#endif
 
 	if (uc_drv->init) {
 		ret = uc_drv->init(uc);
@@ -96,6 +286,11 @@ fail:
 		uc->priv = NULL;
 	}
 	list_del(&uc->sibling_node);
+#if CONFIG_IS_ENABLED(DM_UCLASS_INDEX)
+	if (gd->uclass_by_id)
+		gd->uclass_by_id[id] = NULL;
+	free(uc->index);
+#endif
 fail_mem:
 	free(uc);
 
@@ -129,6 +324,11 @@ int uclass_destroy(struct uclass *uc)
 	if (uc_drv->destroy)
 		uc_drv->destroy(uc);
 	list_del(&uc->sibling_node);
+#if CONFIG_IS_ENABLED(DM_UCLASS_INDEX)
+	if (gd->uclass_by_id)
+		gd->uclass_by_id[uc_drv->id] = NULL;
+	free(uc->index);
+#endif
 	if (uc_drv->priv_auto_alloc_size)
 		free(uc->priv);
 	free(uc);
@@ -264,6 +464,11 @@ int uclass_find_device_by_seq(enum uclass_id id, int seq_or_req_seq,
 	if (ret)
 		return ret;
 
+	if (uclass_has_index(uc)) {
+		return uclass_index_find(uc, find_req_seq ?
+					 UCLASS_INDEX_REQ_SEQ :
+					 UCLASS_INDEX_SEQ, seq_or_req_seq, devp);
+	}
 	list_for_each_entry(dev, &uc->dev_head, uclass_node) {
 		debug("   - %d %d '%s'\n", dev->req_seq, dev->seq, dev->name);
 		if ((find_req_seq ? dev->req_seq : dev->seq) ==
@@ -292,6 +497,12 @@ int uclass_find_device_by_of_offset(enum uclass_id id, int node,
 	if (ret)
 		return ret;
 
+	/* With a live tree the index holds node pointers, not offsets */
+	if (uclass_has_index(uc) && !of_live_active()) {
+		return uclass_index_find(uc, UCLASS_INDEX_OFNODE,
+					 offset_to_ofnode(node).of_offset,
+					 devp);
+	}
 	list_for_each_entry(dev, &uc->dev_head, uclass_node) {
 		if (dev_of_offset(dev) == node) {
 			*devp = dev;
@@ -316,6 +527,9 @@ int uclass_find_device_by_ofnode(enum uclass_id id, ofnode node,
 	if (ret)
 		return ret;
 
+	if (uclass_has_index(uc))
+		return uclass_index_find(uc, UCLASS_INDEX_OFNODE,
+					 node.of_offset, devp);
 	list_for_each_entry(dev, &uc->dev_head, uclass_node) {
 		if (ofnode_equal(dev_ofnode(dev), node)) {
 			*devp = dev;
@@ -327,24 +541,23 @@ int uclass_find_device_by_ofnode(enum uclass_id id, ofnode node,
 }
 
 #if CONFIG_IS_ENABLED(OF_CONTROL)
-static int uclass_find_device_by_phandle(enum uclass_id id,
-					 struct udevice *parent,
-					 const char *name,
-					 struct udevice **devp)
+int uclass_find_device_by_phandle_id(enum uclass_id id, uint find_phandle,
+				     struct udevice **devp)
 {
 	struct udevice *dev;
 	struct uclass *uc;
-	int find_phandle;
 	int ret;
 
 	*devp = NULL;
-	find_phandle = dev_read_u32_default(parent, name, -1);
-	if (find_phandle <= 0)
-		return -ENOENT;
+	if (!find_phandle)
+		return -ENODEV;
 	ret = uclass_get(id, &uc);
 	if (ret)
 		return ret;
 
+	if (uclass_has_index(uc))
+		return uclass_index_find(uc, UCLASS_INDEX_PHANDLE,
+					 find_phandle, devp);
 	list_for_each_entry(dev, &uc->dev_head, uclass_node) {
 		uint phandle;
 
@@ -358,6 +571,21 @@ static int uclass_find_device_by_phandle(enum uclass_id id,
 
 	return -ENODEV;
 }
+
+static int uclass_find_device_by_phandle(enum uclass_id id,
+					 struct udevice *parent,
+					 const char *name,
+					 struct udevice **devp)
+{
+	int find_phandle;
+
+	*devp = NULL;
+	find_phandle = dev_read_u32_default(parent, name, -1);
+	if (find_phandle <= 0)
+		return -ENOENT;
+
+	return uclass_find_device_by_phandle_id(id, find_phandle, devp);
+}
 #endif
 
 int uclass_get_device_by_driver(enum uclass_id id,
@@ -539,7 +767,17 @@ int uclass_bind_device(struct udevice *dev)
 	int ret;
 
 	uc = dev->uclass;
+#if CONFIG_IS_ENABLED(DM_UCLASS_INDEX)
+	if (uc->index) {
+		dev->index_entry = calloc(1, sizeof(*dev->index_entry));
+		if (!dev->index_entry)
+			return -ENOMEM;
+		dev->index_entry->dev = dev;
+		dev->index_entry->pos = uc->index_pos++;
+	}
+#endif
 	list_add_tail(&dev->uclass_node, &uc->dev_head);
+	uclass_index_device(dev);
 
 	if (dev->parent) {
 		struct uclass_driver *uc_drv = dev->parent->uclass->uc_drv;
@@ -555,6 +793,13 @@ int uclass_bind_device(struct udevice *dev)
 err:
 	/* There is no need to undo the parent's post_bind call */
 	list_del(&dev->uclass_node);
+#if CONFIG_IS_ENABLED(DM_UCLASS_INDEX)
+	if (dev->index_entry) {
+		uclass_index_del(uc, dev);
+		free(dev->index_entry);
+		dev->index_entry = NULL;
+	}
+#endif
 
 	return ret;
 }
@@ -573,6 +818,13 @@ int uclass_unbind_device(struct udevice *dev)
 	}
 
 	list_del(&dev->uclass_node);
+#if CONFIG_IS_ENABLED(DM_UCLASS_INDEX)
+	if (dev->index_entry) {
+		uclass_index_del(uc, dev);
+		free(dev->index_entry);
+		dev->index_entry = NULL;
+	}
+#endif
 	return 0;
 }
 #endif
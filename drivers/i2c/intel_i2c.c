@@ -282,7 +282,7 @@ static int intel_i2c_bind(struct udevice *dev)
 		 * This can be removed, once a better (correct) way for this
 		 * is found and implemented.
 		 */
-		dev->req_seq = num_cards;
+		dev_set_req_seq(dev, num_cards);
 		sprintf(name, "intel_i2c#%u", num_cards++);
 		device_set_name(dev, name);
 	}
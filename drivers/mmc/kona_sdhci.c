@@ -82,7 +82,7 @@ int kona_sdhci_init(int dev_index, u32 min_clk, u32 quirks)
 	void *reg_base;
 	struct sdhci_host *host = NULL;
 
-	host = (struct sdhci_host *)malloc(sizeof(struct sdhci_host));
+	host = (struct sdhci_host *)calloc(1, sizeof(struct sdhci_host));
 	if (!host) {
 		printf("%s: sdhci host malloc fail!\n", __func__);
 		return -ENOMEM;
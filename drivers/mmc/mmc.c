@@ -224,6 +224,7 @@ int mmc_send_cmd(struct mmc *mmc, struct mmc_cmd *cmd, struct mmc_data *data)
 	int ret;
 
 	mmmc_trace_before_send(mmc, cmd);
+	mmc_count_cmd(mmc, data);
 	ret = mmc->cfg->ops->send_cmd(mmc, cmd, data);
 	mmmc_trace_after_send(mmc, cmd, ret);
 
@@ -378,11 +379,38 @@ int mmc_send_tuning(struct mmc *mmc, u32 opcode, int *cmd_error)
 }
 #endif
 
+int mmc_set_blockcount(struct mmc *mmc, unsigned int blockcount,
+		       bool is_rel_write)
+{
+	struct mmc_cmd cmd = {0};
+
+	cmd.cmdidx = MMC_CMD_SET_BLOCK_COUNT;
+	cmd.cmdarg = blockcount & 0x0000FFFF;
+	if (is_rel_write)
+		cmd.cmdarg |= 1 << 31;
+	cmd.resp_type = MMC_RSP_R1;
+
+	return mmc_send_cmd(mmc, &cmd, NULL);
+}
+
+/*
+ * Whether multiple-block reads can give the block count up front with CMD23.
+ * The card then ends the transfer itself, so no CMD12 is needed.
+ */
+static bool mmc_use_cmd23(struct mmc *mmc)
+{
+	return mmc->card_caps & mmc->host_caps & MMC_CAP_CMD23;
+}
+
 static int mmc_read_blocks(struct mmc *mmc, void *dst, lbaint_t start,
 			   lbaint_t blkcnt)
 {
 	struct mmc_cmd cmd;
 	struct mmc_data data;
+	bool predefined = blkcnt > 1 && mmc_use_cmd23(mmc);
+
+	if (predefined && mmc_set_blockcount(mmc, blkcnt, false))
+		return 0;
 
 	if (blkcnt > 1)
 		cmd.cmdidx = MMC_CMD_READ_MULTIPLE_BLOCK;
@@ -404,7 +432,7 @@ static int mmc_read_blocks(struct mmc *mmc, void *dst, lbaint_t start,
 	if (mmc_send_cmd(mmc, &cmd, &data))
 		return 0;
 
-	if (blkcnt > 1) {
+	if (blkcnt > 1 && !predefined) {
 		cmd.cmdidx = MMC_CMD_STOP_TRANSMISSION;
 		cmd.cmdarg = 0;
 		cmd.resp_type = MMC_RSP_R1b;
@@ -431,7 +459,7 @@ ulong mmc_bread(struct blk_desc *block_dev, lbaint_t start, lbaint_t blkcnt,
 #endif
 	int dev_num = block_dev->devnum;
 	int err;
-	lbaint_t cur, blocks_todo = blkcnt;
+	lbaint_t cur, b_max, blocks_todo = blkcnt;
 
 	if (blkcnt == 0)
 		return 0;
@@ -461,9 +489,13 @@ ulong mmc_bread(struct blk_desc *block_dev, lbaint_t start, lbaint_t blkcnt,
 		return 0;
 	}
 
+	/* CMD23 has a 16-bit block count */
+	b_max = mmc->cfg->b_max;
+	if (mmc_use_cmd23(mmc))
+		b_max = min_t(lbaint_t, b_max, 0xffff);
+
 	do {
-		cur = (blocks_todo > mmc->cfg->b_max) ?
-			mmc->cfg->b_max : blocks_todo;
+		cur = (blocks_todo > b_max) ? b_max : blocks_todo;
 		if (mmc_read_blocks(mmc, dst, start, cur) != cur) {
 			pr_debug("%s: Failed to read blocks\n", __func__);
 			return 0;
@@ -831,6 +863,10 @@ static int mmc_get_capabilities(struct mmc *mmc)
 	if (mmc_host_is_spi(mmc))
 		return 0;
 
+	/* SET_BLOCK_COUNT arrived with version 3.1 of the spec */
+	if (mmc->version >= MMC_VERSION_3)
+		mmc->card_caps |= MMC_CAP_CMD23;
+
 	/* Only version 4 supports high-speed */
 	if (mmc->version < MMC_VERSION_4)
 		return 0;
@@ -1251,6 +1287,8 @@ retry_scr:
 
 	if (mmc->scr[0] & SD_DATA_4BIT)
 		mmc->card_caps |= MMC_MODE_4BIT;
+	if (mmc->scr[0] & SD_SCR_CMD23_SUPPORT)
+		mmc->card_caps |= MMC_CAP_CMD23;
 
 	/* Version 1.0 doesn't support switching */
 	if (mmc->version == SD_VERSION_1_0)
@@ -16,6 +16,8 @@ extern int mmc_send_cmd(struct mmc *mmc, struct mmc_cmd *cmd,
 			struct mmc_data *data);
 extern int mmc_send_status(struct mmc *mmc, int timeout);
 extern int mmc_set_blocklen(struct mmc *mmc, int len);
+int mmc_set_blockcount(struct mmc *mmc, unsigned int blockcount,
+		       bool is_rel_write);
 #ifdef CONFIG_FSL_ESDHC_ADAPTER_IDENT
 void mmc_adapter_card_type_ident(void);
 #endif
@@ -91,6 +93,18 @@ static inline void mmc_trace_state(struct mmc *mmc, struct mmc_cmd *cmd)
 }
 #endif
 
+/* Count a command in the statistics shown by 'mmc info' */
+static inline void mmc_count_cmd(struct mmc *mmc, struct mmc_data *data)
+{
+#ifndef CONFIG_SPL_BUILD
+	mmc->cmd_count++;
+	if (data) {
+		mmc->data_cmd_count++;
+		mmc->data_bytes += (u64)data->blocks * data->blocksize;
+	}
+#endif
+}
+
 /**
  * mmc_get_next_devnum() - Get the next available MMC device number
  *
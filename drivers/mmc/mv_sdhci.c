@@ -68,7 +68,7 @@ static char *MVSDH_NAME = "mv_sdh";
 int mv_sdh_init(unsigned long regbase, u32 max_clk, u32 min_clk, u32 quirks)
 {
 	struct sdhci_host *host = NULL;
-	host = (struct sdhci_host *)malloc(sizeof(struct sdhci_host));
+	host = (struct sdhci_host *)calloc(1, sizeof(struct sdhci_host));
 	if (!host) {
 		printf("sdh_host malloc fail!\n");
 		return -ENOMEM;
@@ -17,17 +17,26 @@ DECLARE_GLOBAL_DATA_PTR;
 struct sandbox_mmc_plat {
 	struct mmc_config cfg;
 	struct mmc mmc;
+	uint blkcnt;		/* block count set by CMD23, or 0 */
+	bool predefined;	/* last command was a read sized by CMD23 */
 };
 
 /**
  * sandbox_mmc_send_cmd() - Emulate SD commands
  *
  * This emulate an SD card version 2. Single-block reads result in zero data.
- * Multiple-block reads return a test string.
+ * Multiple-block reads return a test string. The card ends a read whose block
+ * count was set with CMD23 by itself, so a CMD12 after one is an error.
  */
 static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 				struct mmc_data *data)
 {
+	struct sandbox_mmc_plat *plat = dev_get_platdata(dev);
+
+	/* Only a CMD12 straight after the read can be stopping it */
+	if (cmd->cmdidx != MMC_CMD_STOP_TRANSMISSION)
+		plat->predefined = false;
+
 	switch (cmd->cmdidx) {
 	case MMC_CMD_ALL_SEND_CID:
 		break;
@@ -59,10 +68,19 @@ static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 	case MMC_CMD_READ_SINGLE_BLOCK:
 		memset(data->dest, '\0', data->blocksize);
 		break;
+	case MMC_CMD_SET_BLOCK_COUNT:
+		plat->blkcnt = cmd->cmdarg & 0xffff;
+		break;
 	case MMC_CMD_READ_MULTIPLE_BLOCK:
+		if (plat->blkcnt && plat->blkcnt != data->blocks)
+			return -EIO;
+		plat->predefined = plat->blkcnt != 0;
+		plat->blkcnt = 0;
 		strcpy(data->dest, "this is a test");
 		break;
 	case MMC_CMD_STOP_TRANSMISSION:
+		if (plat->predefined)
+			return -EILSEQ;
 		break;
 	case SD_CMD_APP_SEND_OP_COND:
 		cmd->response[0] = OCR_BUSY | OCR_HCS;
@@ -77,7 +95,8 @@ static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 	case SD_CMD_APP_SEND_SCR: {
 		u32 *scr = (u32 *)data->dest;
 
-		scr[0] = cpu_to_be32(2 << 24 | 1 << 15);  /* SD version 3 */
+		/* SD version 3, with CMD23 */
+		scr[0] = cpu_to_be32(2 << 24 | 1 << 15 | SD_SCR_CMD23_SUPPORT);
 		break;
 	}
 	default:
@@ -117,7 +136,8 @@ int sandbox_mmc_bind(struct udevice *dev)
 	struct mmc_config *cfg = &plat->cfg;
 
 	cfg->name = dev->name;
-	cfg->host_caps = MMC_MODE_HS_52MHz | MMC_MODE_HS | MMC_MODE_8BIT;
+	cfg->host_caps = MMC_MODE_HS_52MHz | MMC_MODE_HS | MMC_MODE_8BIT |
+			 MMC_CAP_CMD23;
 	cfg->voltages = MMC_VDD_165_195 | MMC_VDD_32_33 | MMC_VDD_33_34;
 	cfg->f_min = 1000000;
 	cfg->f_max = 52000000;
@@ -68,18 +68,112 @@ static void sdhci_transfer_pio(struct sdhci_host *host, struct mmc_data *data)
 	}
 }
 
-static int sdhci_transfer_data(struct sdhci_host *host, struct mmc_data *data,
-				unsigned int start_addr)
+#ifdef CONFIG_MMC_SDHCI_ADMA
+/*
+ * Describe the data with as many descriptors as it takes, so the controller
+ * moves all of it without stopping, then point the controller at the table.
+ */
+int sdhci_prepare_adma_table(struct sdhci_host *host,
+			     const struct sdhci_adma_seg *segs, int count)
 {
-	unsigned int stat, rdy, mask, timeout, block = 0;
-	bool transfer_done = false;
-#ifdef CONFIG_MMC_SDHCI_SDMA
-	unsigned char ctrl;
+	uint desc_len = host->flags & USE_ADMA64 ? ADMA_DESC_64_LEN :
+			ADMA_DESC_32_LEN;
+	void *table = host->adma_desc_table;
+	struct sdhci_adma_desc *desc = NULL;
+	uint ndesc = 0, size, len;
+	dma_addr_t addr;
+	u8 ctrl;
+	int i;
+
+	if (!(host->flags & USE_ADMA))
+		return -ENOTSUPP;
+	for (i = 0; i < count; i++) {
+		/* 32-bit descriptors can only reach the first 4GB */
+		if (!segs[i].len || (segs[i].addr & (ADMA_ALIGN - 1)) ||
+		    (!(host->flags & USE_ADMA64) &&
+		     upper_32_bits(segs[i].addr + segs[i].len - 1)))
+			return -EINVAL;
+		ndesc += DIV_ROUND_UP(segs[i].len, ADMA_MAX_LEN);
+	}
+	if (!ndesc)
+		return -EINVAL;
+	if (ndesc > ADMA_TABLE_NO_ENTRIES)
+		return -E2BIG;
+
+	for (i = 0; i < count; i++) {
+		addr = segs[i].addr;
+		len = segs[i].len;
+		do {
+			size = min_t(uint, len, ADMA_MAX_LEN);
+			desc = table;
+			desc->attr = ADMA_DESC_ATTR_VALID |
+				     ADMA_DESC_TRANSFER_DATA;
+			desc->reserved = 0;
+			desc->len = cpu_to_le16(size);
+			desc->addr_lo = cpu_to_le32(lower_32_bits(addr));
+			if (host->flags & USE_ADMA64)
+				desc->addr_hi = cpu_to_le32(upper_32_bits(addr));
+			addr += size;
+			len -= size;
+			table += desc_len;
+		} while (len);
+	}
+	desc->attr |= ADMA_DESC_ATTR_END;
+
+	flush_cache((ulong)host->adma_desc_table,
+		    ALIGN(table - host->adma_desc_table,
+			  CONFIG_SYS_CACHELINE_SIZE));
+	sdhci_writel(host, lower_32_bits((ulong)host->adma_desc_table),
+		     SDHCI_ADMA_ADDRESS);
+	if (host->flags & USE_ADMA64)
+		sdhci_writel(host, upper_32_bits((ulong)host->adma_desc_table),
+			     SDHCI_ADMA_ADDRESS_HI);
+
 	ctrl = sdhci_readb(host, SDHCI_HOST_CONTROL);
 	ctrl &= ~SDHCI_CTRL_DMA_MASK;
+	if (host->flags & USE_ADMA64)
+		ctrl |= SDHCI_CTRL_ADMA64;
+	else
+		ctrl |= SDHCI_CTRL_ADMA32;
 	sdhci_writeb(host, ctrl, SDHCI_HOST_CONTROL);
+
+	return 0;
+}
 #endif
 
+#if defined(CONFIG_MMC_SDHCI_SDMA) || defined(CONFIG_MMC_SDHCI_ADMA)
+/*
+ * Set up the controller to move the data by DMA, using ADMA2 where it can.
+ * Returns false if the data has to be moved by PIO instead.
+ */
+static bool sdhci_prepare_dma(struct sdhci_host *host, dma_addr_t addr,
+			      uint len)
+{
+	u8 ctrl;
+
+#ifdef CONFIG_MMC_SDHCI_ADMA
+	struct sdhci_adma_seg seg = { .addr = addr, .len = len };
+
+	if (!sdhci_prepare_adma_table(host, &seg, 1))
+		return true;
+#endif
+	ctrl = sdhci_readb(host, SDHCI_HOST_CONTROL);
+	ctrl &= ~SDHCI_CTRL_DMA_MASK;
+	sdhci_writeb(host, ctrl, SDHCI_HOST_CONTROL);
+	if (!(host->flags & USE_SDMA))
+		return false;
+	sdhci_writel(host, addr, SDHCI_DMA_ADDRESS);
+
+	return true;
+}
+#endif
+
+static int sdhci_transfer_data(struct sdhci_host *host, struct mmc_data *data,
+				dma_addr_t start_addr)
+{
+	unsigned int stat, rdy, mask, timeout, block = 0;
+	bool transfer_done = false;
+
 	timeout = 1000000;
 	rdy = SDHCI_INT_SPACE_AVAIL | SDHCI_INT_DATA_AVAIL;
 	mask = SDHCI_DATA_AVAILABLE | SDHCI_SPACE_AVAILABLE;
@@ -134,23 +228,22 @@ static int sdhci_transfer_data(struct sdhci_host *host, struct mmc_data *data,
 #define SDHCI_CMD_DEFAULT_TIMEOUT		100
 #define SDHCI_READ_STATUS_TIMEOUT		1000
 
-#ifdef CONFIG_DM_MMC
-static int sdhci_send_command(struct udevice *dev, struct mmc_cmd *cmd,
-			      struct mmc_data *data)
-{
-	struct mmc *mmc = mmc_get_mmc_dev(dev);
-
-#else
-static int sdhci_send_command(struct mmc *mmc, struct mmc_cmd *cmd,
-			      struct mmc_data *data)
+/*
+ * Send a command, moving its data from or to @data's buffer, or to the
+ * pieces of memory in @segs if there are any
+ */
+static int sdhci_do_send_command(struct mmc *mmc, struct mmc_cmd *cmd,
+				 struct mmc_data *data,
+				 const struct sdhci_adma_seg *segs, int count)
 {
-#endif
 	struct sdhci_host *host = mmc->priv;
 	unsigned int stat = 0;
 	int ret = 0;
 	int trans_bytes = 0, is_aligned = 1;
 	u32 mask, flags, mode;
-	unsigned int time = 0, start_addr = 0;
+	int i;
+	unsigned int time = 0;
+	dma_addr_t start_addr = 0;
 	int mmc_dev = mmc_get_blk_desc(mmc)->devnum;
 	unsigned start = get_timer(0);
 
@@ -212,32 +305,43 @@ static int sdhci_send_command(struct mmc *mmc, struct mmc_cmd *cmd,
 		if (data->flags == MMC_DATA_READ)
 			mode |= SDHCI_TRNS_READ;
 
-#ifdef CONFIG_MMC_SDHCI_SDMA
-		if (data->flags == MMC_DATA_READ)
-			start_addr = (unsigned long)data->dest;
-		else
-			start_addr = (unsigned long)data->src;
-		if ((host->quirks & SDHCI_QUIRK_32BIT_DMA_ADDR) &&
-				(start_addr & 0x7) != 0x0) {
+		if (segs) {
+			ret = sdhci_prepare_adma_table(host, segs, count);
+			if (ret)
+				return ret;
+			mode |= SDHCI_TRNS_DMA;
+		}
+#if defined(CONFIG_MMC_SDHCI_SDMA) || defined(CONFIG_MMC_SDHCI_ADMA)
+		if (!segs && (host->flags & USE_DMA)) {
+			if (data->flags == MMC_DATA_READ)
+				start_addr = (unsigned long)data->dest;
+			else
+				start_addr = (unsigned long)data->src;
+			if ((host->quirks & SDHCI_QUIRK_32BIT_DMA_ADDR) &&
+					(start_addr & 0x7) != 0x0) {
+				is_aligned = 0;
+				start_addr = (unsigned long)aligned_buffer;
+				if (data->flags != MMC_DATA_READ)
+					memcpy(aligned_buffer, data->src,
+					       trans_bytes);
+			}
+
+#if defined(CONFIG_FIXED_SDHCI_ALIGNED_BUFFER)
+			/*
+			 * Always use this bounce-buffer when
+			 * CONFIG_FIXED_SDHCI_ALIGNED_BUFFER is defined
+			 */
 			is_aligned = 0;
 			start_addr = (unsigned long)aligned_buffer;
 			if (data->flags != MMC_DATA_READ)
 				memcpy(aligned_buffer, data->src, trans_bytes);
-		}
-
-#if defined(CONFIG_FIXED_SDHCI_ALIGNED_BUFFER)
-		/*
-		 * Always use this bounce-buffer when
-		 * CONFIG_FIXED_SDHCI_ALIGNED_BUFFER is defined
-		 */
-		is_aligned = 0;
-		start_addr = (unsigned long)aligned_buffer;
-		if (data->flags != MMC_DATA_READ)
-			memcpy(aligned_buffer, data->src, trans_bytes);
 #endif
 
-		sdhci_writel(host, start_addr, SDHCI_DMA_ADDRESS);
-		mode |= SDHCI_TRNS_DMA;
+			if (sdhci_prepare_dma(host, start_addr, trans_bytes))
+				mode |= SDHCI_TRNS_DMA;
+			else
+				is_aligned = 1;
+		}
 #endif
 		sdhci_writew(host, SDHCI_MAKE_BLKSZ(SDHCI_DEFAULT_BOUNDARY_ARG,
 				data->blocksize),
@@ -249,8 +353,11 @@ static int sdhci_send_command(struct mmc *mmc, struct mmc_cmd *cmd,
 	}
 
 	sdhci_writel(host, cmd->cmdarg, SDHCI_ARGUMENT);
-#ifdef CONFIG_MMC_SDHCI_SDMA
-	if (data) {
+	for (i = 0; i < count; i++)
+		flush_cache(segs[i].addr,
+			    ALIGN(segs[i].len, CONFIG_SYS_CACHELINE_SIZE));
+#if defined(CONFIG_MMC_SDHCI_SDMA) || defined(CONFIG_MMC_SDHCI_ADMA)
+	if (data && !segs && (host->flags & USE_DMA)) {
 		trans_bytes = ALIGN(trans_bytes, CONFIG_SYS_CACHELINE_SIZE);
 		flush_cache(start_addr, trans_bytes);
 	}
@@ -302,6 +409,38 @@ static int sdhci_send_command(struct mmc *mmc, struct mmc_cmd *cmd,
 		return -ECOMM;
 }
 
+#ifdef CONFIG_DM_MMC
+static int sdhci_send_command(struct udevice *dev, struct mmc_cmd *cmd,
+			      struct mmc_data *data)
+{
+	return sdhci_do_send_command(mmc_get_mmc_dev(dev), cmd, data, NULL, 0);
+}
+#else
+static int sdhci_send_command(struct mmc *mmc, struct mmc_cmd *cmd,
+			      struct mmc_data *data)
+{
+	return sdhci_do_send_command(mmc, cmd, data, NULL, 0);
+}
+#endif
+
+int sdhci_send_command_segs(struct mmc *mmc, struct mmc_cmd *cmd,
+			    struct mmc_data *data,
+			    const struct sdhci_adma_seg *segs, int count)
+{
+	struct sdhci_host *host = mmc->priv;
+	uint len = 0;
+	int i;
+
+	if (!(host->flags & USE_ADMA))
+		return -ENOTSUPP;
+	for (i = 0; i < count; i++)
+		len += segs[i].len;
+	if (!data || !count || len != data->blocks * data->blocksize)
+		return -EINVAL;
+
+	return sdhci_do_send_command(mmc, cmd, data, segs, count);
+}
+
 static int sdhci_set_clock(struct mmc *mmc, unsigned int clock)
 {
 	struct sdhci_host *host = mmc->priv;
@@ -530,18 +669,40 @@ int sdhci_setup_cfg(struct mmc_config *cfg, struct sdhci_host *host,
 
 	caps = sdhci_readl(host, SDHCI_CAPABILITIES);
 
+	if (host->quirks & SDHCI_QUIRK_REG32_RW)
+		host->version =
+			sdhci_readl(host, SDHCI_HOST_VERSION - 2) >> 16;
+	else
+		host->version = sdhci_readw(host, SDHCI_HOST_VERSION);
+
+	host->flags = 0;
 #ifdef CONFIG_MMC_SDHCI_SDMA
 	if (!(caps & SDHCI_CAN_DO_SDMA)) {
 		printf("%s: Your controller doesn't support SDMA!!\n",
 		       __func__);
 		return -EINVAL;
 	}
+	host->flags |= USE_SDMA;
+#endif
+#ifdef CONFIG_MMC_SDHCI_ADMA
+	if (caps & SDHCI_CAN_DO_ADMA2) {
+		/* The table is kept if the host is set up again */
+		if (!host->adma_desc_table)
+			host->adma_desc_table = memalign(ARCH_DMA_MINALIGN,
+							 ADMA_TABLE_SZ);
+		if (host->adma_desc_table)
+			host->flags |= USE_ADMA;
+		else
+			printf("%s: ADMA table alloc failed, not using ADMA\n",
+			       __func__);
+		/* 64-bit ADMA2 descriptors are only defined from v3.00 */
+		if ((host->flags & USE_ADMA) &&
+		    IS_ENABLED(CONFIG_DMA_ADDR_T_64BIT) &&
+		    SDHCI_GET_VERSION(host) >= SDHCI_SPEC_300 &&
+		    (caps & SDHCI_CAN_64BIT))
+			host->flags |= USE_ADMA64;
+	}
 #endif
-	if (host->quirks & SDHCI_QUIRK_REG32_RW)
-		host->version =
-			sdhci_readl(host, SDHCI_HOST_VERSION - 2) >> 16;
-	else
-		host->version = sdhci_readw(host, SDHCI_HOST_VERSION);
 
 	cfg->name = host->name;
 #ifndef CONFIG_DM_MMC
@@ -595,6 +756,8 @@ int sdhci_setup_cfg(struct mmc_config *cfg, struct sdhci_host *host,
 		cfg->voltages |= host->voltages;
 
 	cfg->host_caps |= MMC_MODE_HS | MMC_MODE_HS_52MHz | MMC_MODE_4BIT;
+	if (!(host->quirks & SDHCI_QUIRK_NO_CMD23))
+		cfg->host_caps |= MMC_CAP_CMD23;
 
 	/* Since Host Controller Version3.0 */
 	if (SDHCI_GET_VERSION(host) >= SDHCI_SPEC_300) {
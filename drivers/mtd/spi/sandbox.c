@@ -9,8 +9,11 @@
  */
 
 #include <common.h>
+#include <div64.h>
 #include <dm.h>
 #include <malloc.h>
+#include <asm/unaligned.h>
+#include <linux/log2.h>
 #include <spi.h>
 #include <os.h>
 
@@ -41,13 +44,14 @@ enum sandbox_sf_state {
 	SF_READ_STATUS, /* read the flash's status register */
 	SF_READ_STATUS1, /* read the flash's status register upper 8 bits*/
 	SF_WRITE_STATUS, /* write the flash's status register */
+	SF_READ_SFDP, /* read the flash's SFDP tables */
 };
 
 static const char *sandbox_sf_state_name(enum sandbox_sf_state state)
 {
 	static const char * const states[] = {
 		"CMD", "ID", "ADDR", "READ", "WRITE", "ERASE", "READ_STATUS",
-		"READ_STATUS1", "WRITE_STATUS",
+		"READ_STATUS1", "WRITE_STATUS", "READ_SFDP",
 	};
 	return states[state];
 }
@@ -56,11 +60,31 @@ static const char *sandbox_sf_state_name(enum sandbox_sf_state state)
 #define STAT_WIP	(1 << 0)
 #define STAT_WEL	(1 << 1)
 
-/* Assume all SPI flashes have 3 byte addresses since they do atm */
+/* Commands have 3 byte addresses, except the 4-byte address ones */
 #define SF_ADDR_LEN	3
+#define SF_ADDR_LEN_4B	4
 
 #define IDCODE_LEN 3
 
+/* SFDP layout: header, parameter headers, the BFPT and then the 4BAIT */
+#define SFDP_SIZE	0x100
+#define SFDP_BFPT	0x20
+#define SFDP_4BAIT	0x60
+
+/* Typical busy times, as given in the SFDP tables */
+#define SANDBOX_SF_PP_US		256
+#define SANDBOX_SF_ERASE_4K_MS		16
+#define SANDBOX_SF_ERASE_32K_MS		32
+#define SANDBOX_SF_ERASE_MS		64
+#define SANDBOX_SF_CHIP_ERASE_MS	512
+
+/*
+ * Dummy bytes of a dual or quad output read, unless changed with
+ * sandbox_sf_set_quad_dummy(). This is the 8 cycles which the driver
+ * assumes for parts in the ID table.
+ */
+#define SANDBOX_SF_FAST_DUMMY		1
+
 /* Used to quickly bulk erase backing store */
 static u8 sandbox_sf_0xff[0x1000];
 
@@ -84,13 +108,37 @@ struct sandbox_spi_flash {
 	/* Current position in the flash; used when reading/writing/etc... */
 	uint off;
 	/* How many address bytes we've consumed */
-	uint addr_bytes, pad_addr_bytes;
+	uint addr_bytes, pad_addr_bytes, addr_len;
 	/* The current flash status (see STAT_XXX defines above) */
 	u16 status;
 	/* Data describing the flash we're emulating */
 	const struct spi_flash_info *data;
 	/* The file on disk to serv up data from */
 	int fd;
+	/* SFDP tables describing the flash */
+	u8 sfdp[SFDP_SIZE];
+	/* Report an unknown JEDEC ID, so the flash must be probed by SFDP */
+	bool sfdp_only;
+	/* Dummy bytes of a quad output read, also given in the SFDP tables */
+	uint quad_dummy;
+	/* How long things take; all zero if they take no time */
+	struct sandbox_sf_timing timing;
+	/* Number of lines the data of the current command uses */
+	uint lanes;
+	/* Busy time of the program or erase started by the current command */
+	uint busy_us;
+	/* Time at which the last program or erase finishes, in ns */
+	u64 busy_until;
+	/* Transfer time not yet slept, as os_usleep() works in microseconds */
+	u64 sck_ns;
+	/* Total modelled transfer and busy times */
+	u64 total_sck_ns;
+	u64 total_busy_us;
+	/* Fault to inject, and the number of operations to let through first */
+	enum sandbox_sf_fault fault;
+	int fault_skip;
+	/* Number of times each command has been sent */
+	uint cmd_count[256];
 };
 
 struct sandbox_spi_flash_plat_data {
@@ -98,8 +146,126 @@ struct sandbox_spi_flash_plat_data {
 	const char *device_name;
 	int bus;
 	int cs;
+	bool timed;
+	struct sandbox_sf_timing timing;
 };
 
+/*
+ * Add an erase type, with a typical time which is a multiple of 16ms. The
+ * times are short, so that tests using the timing model run quickly.
+ */
+static void sandbox_sf_add_erase_type(u32 *bfpt, int *count, u32 size,
+				      u8 cmd, uint typ_ms)
+{
+	bfpt[7 + *count / 2] |= (ilog2(size) | cmd << 8) << (16 * (*count % 2));
+	bfpt[9] |= ((typ_ms / 16 - 1) | 1 << 5) <<
+		BFPT_DW10_ERASE_TYP_SHIFT(*count);
+	(*count)++;
+}
+
+/* Build JESD216B SFDP tables which describe the flash being emulated */
+static void sandbox_sf_build_sfdp(struct sandbox_spi_flash *sbsf)
+{
+	const struct spi_flash_info *data = sbsf->data;
+	struct sfdp_header *hdr = (struct sfdp_header *)sbsf->sfdp;
+	struct sfdp_param_header *ph = (struct sfdp_param_header *)(hdr + 1);
+	u32 bfpt[SFDP_BFPT_MAX_DWORDS];
+	u32 size = data->sector_size * data->n_sectors;
+	u32 val;
+	int count = 0;
+	int i;
+
+	memset(sbsf->sfdp, 0xff, sizeof(sbsf->sfdp));
+	hdr->signature = cpu_to_le32(SFDP_SIGNATURE);
+	hdr->minor = 6;
+	hdr->major = 1;
+	hdr->nph = data->flags & ADDR_4B ? 1 : 0;
+	ph->id_lsb = SFDP_BFPT_ID & 0xff;
+	ph->id_msb = SFDP_BFPT_ID >> 8;
+	ph->minor = 6;
+	ph->major = 1;
+	ph->length = SFDP_BFPT_MAX_DWORDS;
+	ph->ptp[0] = SFDP_BFPT;
+	ph->ptp[1] = 0;
+	ph->ptp[2] = 0;
+
+	memset(bfpt, '\0', sizeof(bfpt));
+	bfpt[0] = 0xff800000 | BIT(2);
+	if (data->flags & SECT_4K)
+		bfpt[0] |= 1 | CMD_ERASE_4K << 8;
+	else
+		bfpt[0] |= 3 | 0xff << 8;
+	if (data->flags & RD_DUAL) {
+		bfpt[0] |= BFPT_DW1_FAST_READ_1_1_2;
+		bfpt[3] |= 8 | CMD_READ_DUAL_OUTPUT_FAST << 8;
+	}
+	if (data->flags & RD_QUAD) {
+		bfpt[0] |= BFPT_DW1_FAST_READ_1_1_4;
+		bfpt[2] |= (sbsf->quad_dummy * 8 |
+			    CMD_READ_QUAD_OUTPUT_FAST << 8) << 16;
+	}
+	if (size > SPI_FLASH_16MB_BOUN)
+		bfpt[0] |= BFPT_DW1_ADDR_BYTES_3_OR_4;
+	bfpt[1] = BFPT_DW2_DENSITY_POW2 | (ilog2(size) + 3);
+
+	if (data->flags & SECT_4K)
+		sandbox_sf_add_erase_type(bfpt, &count, 4 << 10, CMD_ERASE_4K,
+					  SANDBOX_SF_ERASE_4K_MS);
+	if (data->flags & SECT_32K)
+		sandbox_sf_add_erase_type(bfpt, &count, 32 << 10,
+					  CMD_ERASE_32K,
+					  SANDBOX_SF_ERASE_32K_MS);
+	sandbox_sf_add_erase_type(bfpt, &count, data->sector_size,
+				  CMD_ERASE_64K, SANDBOX_SF_ERASE_MS);
+
+	/* Page program in 64us units, chip erase in 16ms, maximum 2x typical */
+	bfpt[10] = ilog2(data->page_size) << 4;
+	bfpt[10] |= ((SANDBOX_SF_PP_US / 64 - 1) | 1 << 5) <<
+		BFPT_DW11_PP_TYP_SHIFT;
+	bfpt[10] |= (SANDBOX_SF_CHIP_ERASE_MS / 16 - 1) <<
+		BFPT_DW11_CHIP_ERASE_TYP_SHIFT;
+	switch (JEDEC_MFR(data)) {
+	case SPI_FLASH_CFI_MFR_MACRONIX:
+		bfpt[14] = SFDP_QER_SR1_BIT6 << BFPT_DW15_QER_SHIFT;
+		break;
+	case SPI_FLASH_CFI_MFR_SPANSION:
+	case SPI_FLASH_CFI_MFR_WINBOND:
+		bfpt[14] = SFDP_QER_SR2_BIT1 << BFPT_DW15_QER_SHIFT;
+		break;
+	default:
+		bfpt[14] = SFDP_QER_NONE << BFPT_DW15_QER_SHIFT;
+		break;
+	}
+
+	for (i = 0; i < SFDP_BFPT_MAX_DWORDS; i++)
+		put_unaligned_le32(bfpt[i], &sbsf->sfdp[SFDP_BFPT + i * 4]);
+
+	if (!(data->flags & ADDR_4B))
+		return;
+
+	/* Each of the erase types above has a 4-byte address version */
+	ph++;
+	ph->id_lsb = SFDP_4BAIT_ID & 0xff;
+	ph->id_msb = SFDP_4BAIT_ID >> 8;
+	ph->minor = 0;
+	ph->major = 1;
+	ph->length = 2;
+	ph->ptp[0] = SFDP_4BAIT;
+	ph->ptp[1] = 0;
+	ph->ptp[2] = 0;
+	val = SFDP_4BAIT_READ | SFDP_4BAIT_FAST_READ | SFDP_4BAIT_PP;
+	if (data->flags & RD_DUAL)
+		val |= SFDP_4BAIT_FAST_READ_1_1_2;
+	if (data->flags & RD_QUAD)
+		val |= SFDP_4BAIT_FAST_READ_1_1_4;
+	for (i = 0; i < count; i++)
+		val |= SFDP_4BAIT_ERASE_TYPE(i);
+	put_unaligned_le32(val, &sbsf->sfdp[SFDP_4BAIT]);
+	put_unaligned_le32(0xff000000 | CMD_ERASE_64K_4B << 16 |
+			   CMD_ERASE_32K_4B << 8 | CMD_ERASE_4K_4B,
+			   &sbsf->sfdp[SFDP_4BAIT + 4]);
+}
+
 /**
  * This is a very strange probe function. If it has platform data (which may
  * have come from the device tree) then this function gets the filename and
@@ -195,6 +361,10 @@ static int sandbox_sf_probe(struct udevice *dev)
 
 	sbsf->data = data;
 	sbsf->cs = cs;
+	sbsf->quad_dummy = SANDBOX_SF_FAST_DUMMY;
+	sandbox_sf_build_sfdp(sbsf);
+	if (pdata->timed)
+		sandbox_sf_set_timing(dev, &pdata->timing);
 
 	return 0;
 
@@ -222,13 +392,67 @@ static void sandbox_sf_cs_activate(struct udevice *dev)
 	sbsf->off = 0;
 	sbsf->addr_bytes = 0;
 	sbsf->pad_addr_bytes = 0;
+	sbsf->addr_len = SF_ADDR_LEN;
+	sbsf->lanes = 1;
 	sbsf->state = SF_CMD;
 	sbsf->cmd = SF_CMD;
 }
 
 static void sandbox_sf_cs_deactivate(struct udevice *dev)
 {
+	struct sandbox_spi_flash *sbsf = dev_get_priv(dev);
+
 	debug("sandbox_sf: CS deactivated; cmd done processing!\n");
+
+	/* A program or erase starts when CS goes high */
+	if (sbsf->busy_us) {
+		sbsf->busy_until = os_get_nsec() + sbsf->busy_us * 1000ULL;
+		sbsf->total_busy_us += sbsf->busy_us;
+		sbsf->busy_us = 0;
+	}
+}
+
+/* Check whether the last program or erase is still going */
+static bool sandbox_sf_busy(struct sandbox_spi_flash *sbsf)
+{
+	return sbsf->busy_until && os_get_nsec() < sbsf->busy_until;
+}
+
+/*
+ * Take as long as it would to clock the bytes of a transfer at the serial
+ * clock rate. The data of dual and quad reads goes over 2 or 4 lines.
+ */
+static void sandbox_sf_clock(struct sandbox_spi_flash *sbsf, uint bytes,
+			     uint data_bytes)
+{
+	u64 bits, ns;
+
+	if (!sbsf->timing.sck_hz)
+		return;
+
+	bits = (u64)(bytes - data_bytes) * 8 + data_bytes * 8 / sbsf->lanes;
+	ns = lldiv(bits * 1000000000ULL, sbsf->timing.sck_hz);
+	sbsf->sck_ns += ns;
+	sbsf->total_sck_ns += ns;
+	if (sbsf->sck_ns >= 1000) {
+		os_usleep(lldiv(sbsf->sck_ns, 1000));
+		sbsf->sck_ns %= 1000;
+	}
+}
+
+/* Check whether to inject a fault into the program or erase starting now */
+static bool sandbox_sf_fault_hit(struct sandbox_spi_flash *sbsf,
+				 enum sandbox_sf_fault fault)
+{
+	if (sbsf->fault != fault)
+		return false;
+	if (sbsf->fault_skip > 0) {
+		sbsf->fault_skip--;
+		return false;
+	}
+	sbsf->fault = SANDBOX_SF_FAULT_NONE;
+
+	return true;
 }
 
 /*
@@ -254,13 +478,61 @@ static int sandbox_sf_process_cmd(struct sandbox_spi_flash *sbsf, const u8 *rx,
 	if (tx)
 		sandbox_spi_tristate(tx, 1);
 
+	/* Only the status can be read while a program or erase is going */
+	if (sandbox_sf_busy(sbsf) && rx[0] != CMD_READ_STATUS &&
+	    rx[0] != CMD_READ_STATUS1) {
+		debug("sandbox_sf: cmd %#x ignored while busy\n", rx[0]);
+		return -EBUSY;
+	}
+
 	sbsf->cmd = rx[0];
+	sbsf->cmd_count[rx[0]]++;
 	switch (sbsf->cmd) {
 	case CMD_READ_ID:
 		sbsf->state = SF_ID;
 		sbsf->cmd = SF_ID;
 		break;
+	case CMD_READ_ARRAY_FAST_4B:
+	case CMD_READ_ARRAY_SLOW_4B:
+	case CMD_PAGE_PROGRAM_4B:
+		if (!(sbsf->data->flags & ADDR_4B)) {
+			debug(" cmd unknown: %#x\n", sbsf->cmd);
+			return -EIO;
+		}
+		sbsf->addr_len = SF_ADDR_LEN_4B;
+		if (sbsf->cmd == CMD_READ_ARRAY_FAST_4B)
+			sbsf->pad_addr_bytes = 1;
+		sbsf->state = SF_ADDR;
+		break;
+	case CMD_READ_DUAL_OUTPUT_FAST_4B:
+	case CMD_READ_QUAD_OUTPUT_FAST_4B:
+		if (!(sbsf->data->flags & ADDR_4B)) {
+			debug(" cmd unknown: %#x\n", sbsf->cmd);
+			return -EIO;
+		}
+		sbsf->addr_len = SF_ADDR_LEN_4B;
+		/* fall through */
+	case CMD_READ_DUAL_OUTPUT_FAST:
+	case CMD_READ_QUAD_OUTPUT_FAST:
+		if (sbsf->cmd == CMD_READ_DUAL_OUTPUT_FAST ||
+		    sbsf->cmd == CMD_READ_DUAL_OUTPUT_FAST_4B)
+			sbsf->lanes = 2;
+		else
+			sbsf->lanes = 4;
+		if (!(sbsf->data->flags &
+		      (sbsf->lanes == 2 ? RD_DUAL : RD_QUAD))) {
+			debug(" cmd unknown: %#x\n", sbsf->cmd);
+			return -EIO;
+		}
+		/* The part needs these dummy cycles however it was probed */
+		if (sbsf->lanes == 4)
+			sbsf->pad_addr_bytes = sbsf->quad_dummy;
+		else
+			sbsf->pad_addr_bytes = SANDBOX_SF_FAST_DUMMY;
+		sbsf->state = SF_ADDR;
+		break;
 	case CMD_READ_ARRAY_FAST:
+	case CMD_READ_SFDP:
 		sbsf->pad_addr_bytes = 1;
 	case CMD_READ_ARRAY_SLOW:
 	case CMD_PAGE_PROGRAM:
@@ -286,14 +558,38 @@ static int sandbox_sf_process_cmd(struct sandbox_spi_flash *sbsf, const u8 *rx,
 	default: {
 		int flags = sbsf->data->flags;
 
+		/* 4-byte address erases work like the 3-byte ones */
+		if (flags & ADDR_4B) {
+			switch (sbsf->cmd) {
+			case CMD_ERASE_4K_4B:
+				sbsf->cmd = CMD_ERASE_4K;
+				sbsf->addr_len = SF_ADDR_LEN_4B;
+				break;
+			case CMD_ERASE_32K_4B:
+				sbsf->cmd = CMD_ERASE_32K;
+				sbsf->addr_len = SF_ADDR_LEN_4B;
+				break;
+			case CMD_ERASE_64K_4B:
+				sbsf->cmd = CMD_ERASE_64K;
+				sbsf->addr_len = SF_ADDR_LEN_4B;
+				break;
+			}
+		}
+
 		/* we only support erase here */
-		if (sbsf->cmd == CMD_ERASE_CHIP) {
+		if (sbsf->cmd == CMD_ERASE_CHIP &&
+		    (flags & E_CHIP || sbsf->sfdp_only)) {
+			/* No address follows, so erase straight away */
 			sbsf->erase_size = sbsf->data->sector_size *
 				sbsf->data->n_sectors;
+			sbsf->state = SF_ERASE;
+			break;
 		} else if (sbsf->cmd == CMD_ERASE_4K && (flags & SECT_4K)) {
 			sbsf->erase_size = 4 << 10;
-		} else if (sbsf->cmd == CMD_ERASE_64K && !(flags & SECT_4K)) {
-			sbsf->erase_size = 64 << 10;
+		} else if (sbsf->cmd == CMD_ERASE_32K && (flags & SECT_32K)) {
+			sbsf->erase_size = 32 << 10;
+		} else if (sbsf->cmd == CMD_ERASE_64K) {
+			sbsf->erase_size = sbsf->data->sector_size;
 		} else {
 			debug(" cmd unknown: %#x\n", sbsf->cmd);
 			return -EIO;
@@ -326,13 +622,90 @@ int sandbox_erase_part(struct sandbox_spi_flash *sbsf, int size)
 	return 0;
 }
 
+/* Program bits from 1 to 0, as NOR flash does; it cannot set them */
+static int sandbox_sf_program(struct sandbox_spi_flash *sbsf, const u8 *rx,
+			      uint len)
+{
+	u8 buf[256];
+	uint todo, i;
+
+	while (len) {
+		todo = min(len, (uint)sizeof(buf));
+		if (os_lseek(sbsf->fd, sbsf->off, OS_SEEK_SET) < 0 ||
+		    os_read(sbsf->fd, buf, todo) != todo)
+			return -EIO;
+		for (i = 0; i < todo; i++)
+			buf[i] &= rx[i];
+		if (os_lseek(sbsf->fd, sbsf->off, OS_SEEK_SET) < 0 ||
+		    os_write(sbsf->fd, buf, todo) != todo)
+			return -EIO;
+		sbsf->off += todo;
+		rx += todo;
+		len -= todo;
+	}
+
+	return 0;
+}
+
+static uint sandbox_sf_erase_us(struct sandbox_spi_flash *sbsf)
+{
+	switch (sbsf->cmd) {
+	case CMD_ERASE_4K:
+		return sbsf->timing.erase_4k_us;
+	case CMD_ERASE_32K:
+		return sbsf->timing.erase_32k_us;
+	case CMD_ERASE_CHIP:
+		return sbsf->timing.chip_erase_us;
+	default:
+		return sbsf->timing.erase_us;
+	}
+}
+
+static void sandbox_sf_erase(struct sandbox_spi_flash *sbsf)
+{
+	int ret;
+
+	if (!(sbsf->status & STAT_WEL)) {
+		puts("sandbox_sf: write enable not set before erase\n");
+		return;
+	}
+
+	/* verify address is aligned */
+	if (sbsf->off & (sbsf->erase_size - 1)) {
+		debug(" sector erase: cmd:%#x needs align:%#x, but we got %#x\n",
+		      sbsf->cmd, sbsf->erase_size, sbsf->off);
+		sbsf->status &= ~STAT_WEL;
+		return;
+	}
+
+	debug(" sector erase addr: %u, size: %u\n", sbsf->off,
+	      sbsf->erase_size);
+
+	sbsf->busy_us = sandbox_sf_erase_us(sbsf);
+	if (sandbox_sf_fault_hit(sbsf, SANDBOX_SF_FAULT_ERASE)) {
+		debug(" sector erase: injected failure\n");
+		sbsf->status &= ~STAT_WEL;
+		return;
+	}
+
+	if (os_lseek(sbsf->fd, sbsf->off, OS_SEEK_SET) < 0) {
+		puts("sandbox_sf: os_lseek() failed");
+		return;
+	}
+
+	ret = sandbox_erase_part(sbsf, sbsf->erase_size);
+	sbsf->status &= ~STAT_WEL;
+	if (ret)
+		debug("sandbox_sf: Erase failed\n");
+}
+
 static int sandbox_sf_xfer(struct udevice *dev, unsigned int bitlen,
 			   const void *rxp, void *txp, unsigned long flags)
 {
 	struct sandbox_spi_flash *sbsf = dev_get_priv(dev);
 	const uint8_t *rx = rxp;
 	uint8_t *tx = txp;
-	uint cnt, pos = 0;
+	uint cnt, pos = 0, data_bytes = 0;
 	int bytes = bitlen / 8;
 	int ret;
 
@@ -348,6 +721,12 @@ static int sandbox_sf_xfer(struct udevice *dev, unsigned int bitlen,
 		if (ret)
 			return ret;
 		++pos;
+
+		/* Chip erase is a single byte, with no address */
+		if (sbsf->state == SF_ERASE) {
+			sandbox_sf_erase(sbsf);
+			pos = bytes;
+		}
 	}
 
 	/* Process the remaining data */
@@ -358,9 +737,12 @@ static int sandbox_sf_xfer(struct udevice *dev, unsigned int bitlen,
 
 			debug(" id: off:%u tx:", sbsf->off);
 			if (sbsf->off < IDCODE_LEN) {
+				uint jedec = JEDEC_ID(sbsf->data);
+
+				if (sbsf->sfdp_only)
+					jedec = 0xffff;
 				/* Extract correct byte from ID 0x00aabbcc */
-				id = ((JEDEC_MFR(sbsf->data) << 16) |
-					JEDEC_ID(sbsf->data)) >>
+				id = ((JEDEC_MFR(sbsf->data) << 16) | jedec) >>
 					(8 * (IDCODE_LEN - 1 - sbsf->off));
 			} else {
 				id = 0;
@@ -374,7 +756,7 @@ static int sandbox_sf_xfer(struct udevice *dev, unsigned int bitlen,
 			debug(" addr: bytes:%u rx:%02x ", sbsf->addr_bytes,
 			      rx[pos]);
 
-			if (sbsf->addr_bytes++ < SF_ADDR_LEN)
+			if (sbsf->addr_bytes++ < sbsf->addr_len)
 				sbsf->off = (sbsf->off << 8) | rx[pos];
 			debug("addr:%06x\n", sbsf->off);
 
@@ -384,7 +766,7 @@ static int sandbox_sf_xfer(struct udevice *dev, unsigned int bitlen,
 
 			/* See if we're done processing */
 			if (sbsf->addr_bytes <
-					SF_ADDR_LEN + sbsf->pad_addr_bytes)
+					sbsf->addr_len + sbsf->pad_addr_bytes)
 				break;
 
 			/* Next state! */
@@ -395,11 +777,21 @@ static int sandbox_sf_xfer(struct udevice *dev, unsigned int bitlen,
 			switch (sbsf->cmd) {
 			case CMD_READ_ARRAY_FAST:
 			case CMD_READ_ARRAY_SLOW:
+			case CMD_READ_ARRAY_FAST_4B:
+			case CMD_READ_ARRAY_SLOW_4B:
+			case CMD_READ_DUAL_OUTPUT_FAST:
+			case CMD_READ_DUAL_OUTPUT_FAST_4B:
+			case CMD_READ_QUAD_OUTPUT_FAST:
+			case CMD_READ_QUAD_OUTPUT_FAST_4B:
 				sbsf->state = SF_READ;
 				break;
 			case CMD_PAGE_PROGRAM:
+			case CMD_PAGE_PROGRAM_4B:
 				sbsf->state = SF_WRITE;
 				break;
+			case CMD_READ_SFDP:
+				sbsf->state = SF_READ_SFDP;
+				break;
 			default:
 				/* assume erase state ... */
 				sbsf->state = SF_ERASE;
@@ -423,13 +815,26 @@ static int sandbox_sf_xfer(struct udevice *dev, unsigned int bitlen,
 				return -EIO;
 			}
 			pos += ret;
+			data_bytes += ret;
 			break;
-		case SF_READ_STATUS:
-			debug(" read status: %#x\n", sbsf->status);
+		case SF_READ_SFDP:
+			debug(" sfdp: off:%u\n", sbsf->off);
+			assert(tx);
+			tx[pos++] = sbsf->off < SFDP_SIZE ?
+				sbsf->sfdp[sbsf->off] : 0xff;
+			sbsf->off++;
+			break;
+		case SF_READ_STATUS: {
+			u8 status = sbsf->status;
+
+			if (sandbox_sf_busy(sbsf))
+				status |= STAT_WIP;
+			debug(" read status: %#x\n", status);
 			cnt = bytes - pos;
-			memset(tx + pos, sbsf->status, cnt);
+			memset(tx + pos, status, cnt);
 			pos += cnt;
 			break;
+		}
 		case SF_READ_STATUS1:
 			debug(" read status: %#x\n", sbsf->status);
 			cnt = bytes - pos;
@@ -437,15 +842,17 @@ static int sandbox_sf_xfer(struct udevice *dev, unsigned int bitlen,
 			pos += cnt;
 			break;
 		case SF_WRITE_STATUS:
-			debug(" write status: %#x (ignored)\n", rx[pos]);
+			/* Keep the bits which are not status, e.g. quad enable */
+			debug(" write status: %#x\n", rx[pos]);
+			sbsf->status = (sbsf->status & (STAT_WIP | STAT_WEL)) |
+				(rx[pos] & ~(STAT_WIP | STAT_WEL));
 			pos = bytes;
 			break;
 		case SF_WRITE:
 			/*
 			 * XXX: need to handle exotic behavior:
-			 *      - unaligned addresses
 			 *      - more than a page (256) worth of data
-			 *      - reading past end of device
+			 *      - writing past end of device
 			 */
 			if (!(sbsf->status & STAT_WEL)) {
 				puts("sandbox_sf: write enable not set before write\n");
@@ -456,50 +863,26 @@ static int sandbox_sf_xfer(struct udevice *dev, unsigned int bitlen,
 			debug(" rx: write(%u)\n", cnt);
 			if (tx)
 				sandbox_spi_tristate(&tx[pos], cnt);
-			ret = os_write(sbsf->fd, rx + pos, cnt);
-			if (ret < 0) {
+			sbsf->busy_us = sbsf->timing.pp_us;
+			if (sandbox_sf_fault_hit(sbsf,
+						 SANDBOX_SF_FAULT_PROGRAM)) {
+				debug(" rx: injected program failure\n");
+			} else if (sandbox_sf_program(sbsf, rx + pos, cnt)) {
 				puts("sandbox_spi: os_write() failed\n");
 				return -EIO;
 			}
-			pos += ret;
+			pos += cnt;
+			data_bytes += cnt;
 			sbsf->status &= ~STAT_WEL;
 			break;
 		case SF_ERASE:
- case_sf_erase: {
-			if (!(sbsf->status & STAT_WEL)) {
-				puts("sandbox_sf: write enable not set before erase\n");
-				goto done;
-			}
-
-			/* verify address is aligned */
-			if (sbsf->off & (sbsf->erase_size - 1)) {
-				debug(" sector erase: cmd:%#x needs align:%#x, but we got %#x\n",
-				      sbsf->cmd, sbsf->erase_size,
-				      sbsf->off);
-				sbsf->status &= ~STAT_WEL;
-				goto done;
-			}
-
-			debug(" sector erase addr: %u, size: %u\n", sbsf->off,
-			      sbsf->erase_size);
-
+ case_sf_erase:
 			cnt = bytes - pos;
 			if (tx)
 				sandbox_spi_tristate(&tx[pos], cnt);
 			pos += cnt;
-
-			/*
-			 * TODO(vapier@gentoo.org): latch WIP in status, and
-			 * delay before clearing it ?
-			 */
-			ret = sandbox_erase_part(sbsf, sbsf->erase_size);
-			sbsf->status &= ~STAT_WEL;
-			if (ret) {
-				debug("sandbox_sf: Erase failed\n");
-				goto done;
-			}
+			sandbox_sf_erase(sbsf);
 			goto done;
-		}
 		default:
 			debug(" ??? no idea what to do ???\n");
 			goto done;
@@ -507,6 +890,7 @@ static int sandbox_sf_xfer(struct udevice *dev, unsigned int bitlen,
 	}
 
  done:
+	sandbox_sf_clock(sbsf, bytes, data_bytes);
 	if (flags & SPI_XFER_END)
 		sandbox_sf_cs_deactivate(dev);
 	return pos == bytes ? 0 : -EIO;
@@ -524,9 +908,88 @@ int sandbox_sf_ofdata_to_platdata(struct udevice *dev)
 		return -EINVAL;
 	}
 
+	/* The timing model is optional, using the typical busy times */
+	pdata->timed = dev_read_bool(dev, "sandbox,timing");
+	pdata->timing.sck_hz = dev_read_u32_default(dev,
+						    "sandbox,sck-frequency", 0);
+
 	return 0;
 }
 
+void sandbox_sf_set_sfdp_only(struct udevice *dev, bool sfdp_only)
+{
+	struct sandbox_spi_flash *sbsf = dev_get_priv(dev);
+
+	sbsf->sfdp_only = sfdp_only;
+}
+
+void sandbox_sf_set_sfdp_qer(struct udevice *dev, uint qer)
+{
+	struct sandbox_spi_flash *sbsf = dev_get_priv(dev);
+	u8 *dw15 = &sbsf->sfdp[SFDP_BFPT + 14 * 4];
+	u32 val;
+
+	val = get_unaligned_le32(dw15) & ~BFPT_DW15_QER_MASK;
+	put_unaligned_le32(val | qer << BFPT_DW15_QER_SHIFT, dw15);
+}
+
+void sandbox_sf_set_quad_dummy(struct udevice *dev, uint dummy)
+{
+	struct sandbox_spi_flash *sbsf = dev_get_priv(dev);
+
+	sbsf->quad_dummy = dummy;
+	sandbox_sf_build_sfdp(sbsf);
+}
+
+void sandbox_sf_set_timing(struct udevice *dev,
+			   const struct sandbox_sf_timing *timing)
+{
+	struct sandbox_spi_flash *sbsf = dev_get_priv(dev);
+	struct sandbox_sf_timing *t = &sbsf->timing;
+
+	memset(t, '\0', sizeof(*t));
+	sbsf->busy_until = 0;
+	sbsf->sck_ns = 0;
+	if (!timing)
+		return;
+
+	*t = *timing;
+	if (!t->pp_us)
+		t->pp_us = SANDBOX_SF_PP_US;
+	if (!t->erase_4k_us)
+		t->erase_4k_us = SANDBOX_SF_ERASE_4K_MS * 1000;
+	if (!t->erase_32k_us)
+		t->erase_32k_us = SANDBOX_SF_ERASE_32K_MS * 1000;
+	if (!t->erase_us)
+		t->erase_us = SANDBOX_SF_ERASE_MS * 1000;
+	if (!t->chip_erase_us)
+		t->chip_erase_us = SANDBOX_SF_CHIP_ERASE_MS * 1000;
+}
+
+uint sandbox_sf_get_cmd_count(struct udevice *dev, u8 cmd)
+{
+	struct sandbox_spi_flash *sbsf = dev_get_priv(dev);
+
+	return sbsf->cmd_count[cmd];
+}
+
+void sandbox_sf_get_model_time(struct udevice *dev, u64 *sck_ns, u64 *busy_us)
+{
+	struct sandbox_spi_flash *sbsf = dev_get_priv(dev);
+
+	*sck_ns = sbsf->total_sck_ns;
+	*busy_us = sbsf->total_busy_us;
+}
+
+void sandbox_sf_set_fault(struct udevice *dev, enum sandbox_sf_fault fault,
+			  int skip)
+{
+	struct sandbox_spi_flash *sbsf = dev_get_priv(dev);
+
+	sbsf->fault = fault;
+	sbsf->fault_skip = skip;
+}
+
 static const struct dm_spi_emul_ops sandbox_sf_emul_ops = {
 	.xfer          = sandbox_sf_xfer,
 };
@@ -24,10 +24,16 @@ enum spi_nor_option_flags {
 	SNOR_F_SST_WR		= BIT(0),
 	SNOR_F_USE_FSR		= BIT(1),
 	SNOR_F_USE_UPAGE	= BIT(3),
+	SNOR_F_CHIP_ERASE	= BIT(4),
+	SNOR_F_RD_DUAL		= BIT(5),
+	SNOR_F_RD_QUAD		= BIT(6),
+	SNOR_F_QUAD_EN		= BIT(7),
 };
 
 #define SPI_FLASH_3B_ADDR_LEN		3
+#define SPI_FLASH_4B_ADDR_LEN		4
 #define SPI_FLASH_CMD_LEN		(1 + SPI_FLASH_3B_ADDR_LEN)
+#define SPI_FLASH_MAX_CMD_LEN		(1 + SPI_FLASH_4B_ADDR_LEN)
 #define SPI_FLASH_16MB_BOUN		0x1000000
 
 /* CFI Manufacture ID's */
@@ -40,6 +46,7 @@ enum spi_nor_option_flags {
 
 /* Erase commands */
 #define CMD_ERASE_4K			0x20
+#define CMD_ERASE_32K			0x52
 #define CMD_ERASE_CHIP			0xc7
 #define CMD_ERASE_64K			0xd8
 
@@ -62,6 +69,20 @@ enum spi_nor_option_flags {
 #define CMD_READ_STATUS1		0x35
 #define CMD_READ_CONFIG			0x35
 #define CMD_FLAG_STATUS			0x70
+#define CMD_READ_SFDP			0x5a
+
+/* 4-byte address commands */
+#define CMD_READ_ARRAY_SLOW_4B		0x13
+#define CMD_READ_ARRAY_FAST_4B		0x0c
+#define CMD_READ_DUAL_OUTPUT_FAST_4B	0x3c
+#define CMD_READ_DUAL_IO_FAST_4B	0xbc
+#define CMD_READ_QUAD_OUTPUT_FAST_4B	0x6c
+#define CMD_READ_QUAD_IO_FAST_4B	0xec
+#define CMD_PAGE_PROGRAM_4B		0x12
+#define CMD_QUAD_PAGE_PROGRAM_4B	0x34
+#define CMD_ERASE_4K_4B			0x21
+#define CMD_ERASE_32K_4B		0x5c
+#define CMD_ERASE_64K_4B		0xdc
 
 /* Bank addr access commands */
 #ifdef CONFIG_SPI_FLASH_BAR
@@ -84,6 +105,16 @@ enum spi_nor_option_flags {
 #define SPI_FLASH_PROG_TIMEOUT		(2 * CONFIG_SYS_HZ)
 #define SPI_FLASH_PAGE_ERASE_TIMEOUT	(5 * CONFIG_SYS_HZ)
 #define SPI_FLASH_SECTOR_ERASE_TIMEOUT	(10 * CONFIG_SYS_HZ)
+#define SPI_FLASH_CHIP_ERASE_TIMEOUT_MB	(4 * CONFIG_SYS_HZ)	/* per MiB */
+
+/* Longest sleep between checks of Ctrl-C and the watchdog */
+#define SPI_FLASH_WAIT_STEP_US		10000
+
+/* Typical busy times, when the flash does not give its own through SFDP */
+#define SPI_FLASH_PROG_TYP_US		700
+#define SPI_FLASH_ERASE_TYP_US		40000	/* plus the per KiB time */
+#define SPI_FLASH_ERASE_TYP_US_KB	1500
+#define SPI_FLASH_CHIP_ERASE_TYP_MS_MB	2000	/* per MiB */
 
 /* SST specific */
 #ifdef CONFIG_SPI_FLASH_SST
@@ -132,10 +163,131 @@ struct spi_flash_info {
 #define RD_QUADIO		BIT(6)	/* use Quad IO Read */
 #define RD_DUALIO		BIT(7)	/* use Dual IO Read */
 #define RD_FULL			(RD_QUAD | RD_DUAL | RD_QUADIO | RD_DUALIO)
+#define SECT_32K		BIT(8)	/* CMD_ERASE_32K works uniformly */
+#define ADDR_4B			BIT(9)	/* supports 4-byte address opcodes */
+#define E_CHIP			BIT(10)	/* CMD_ERASE_CHIP erases the whole part */
 };
 
 extern const struct spi_flash_info spi_flash_ids[];
 
+/* Serial Flash Discoverable Parameters (JEDEC JESD216) */
+#define SFDP_SIGNATURE			0x50444653	/* "SFDP" */
+#define SFDP_BFPT_ID			0xff00
+#define SFDP_4BAIT_ID			0xff84
+#define SFDP_BFPT_MIN_DWORDS		9	/* JESD216 */
+#define SFDP_BFPT_MAX_DWORDS		16	/* JESD216A/B */
+
+struct sfdp_header {
+	__le32		signature;
+	u8		minor;
+	u8		major;
+	u8		nph;		/* number of parameter headers - 1 */
+	u8		protocol;
+} __packed;
+
+struct sfdp_param_header {
+	u8		id_lsb;
+	u8		minor;
+	u8		major;
+	u8		length;		/* in dwords */
+	u8		ptp[3];		/* parameter table pointer */
+	u8		id_msb;
+} __packed;
+
+/* Basic Flash Parameter Table, by (zero-based) dword */
+#define BFPT_DW1_FAST_READ_1_1_2	BIT(16)
+#define BFPT_DW1_ADDR_BYTES_SHIFT	17
+#define BFPT_DW1_ADDR_BYTES_MASK	(3 << BFPT_DW1_ADDR_BYTES_SHIFT)
+#define BFPT_DW1_ADDR_BYTES_3_ONLY	(0 << BFPT_DW1_ADDR_BYTES_SHIFT)
+#define BFPT_DW1_ADDR_BYTES_3_OR_4	(1 << BFPT_DW1_ADDR_BYTES_SHIFT)
+#define BFPT_DW1_ADDR_BYTES_4_ONLY	(2 << BFPT_DW1_ADDR_BYTES_SHIFT)
+#define BFPT_DW1_FAST_READ_1_2_2	BIT(20)
+#define BFPT_DW1_FAST_READ_1_4_4	BIT(21)
+#define BFPT_DW1_FAST_READ_1_1_4	BIT(22)
+#define BFPT_DW2_DENSITY_POW2		BIT(31)
+#define BFPT_DW10_ERASE_MULT_MASK	0xf
+#define BFPT_DW10_ERASE_TYP_SHIFT(i)	(4 + 7 * (i))
+#define BFPT_DW11_PROG_MULT_MASK	0xf
+#define BFPT_DW11_PP_TYP_SHIFT		8
+#define BFPT_DW11_CHIP_ERASE_TYP_SHIFT	24
+#define BFPT_DW15_QER_SHIFT		20
+#define BFPT_DW15_QER_MASK		(7 << BFPT_DW15_QER_SHIFT)
+
+/* Quad Enable Requirements, BFPT dword 15 */
+enum sfdp_qer {
+	SFDP_QER_NONE		= 0,	/* no QE bit */
+	SFDP_QER_SR2_BIT1_BUGGY	= 1,	/* SR2 bit 1, 1-byte WRSR clears it */
+	SFDP_QER_SR1_BIT6	= 2,	/* SR1 bit 6, as Macronix */
+	SFDP_QER_SR2_BIT7	= 3,	/* SR2 bit 7, via 0x3e/0x3f */
+	SFDP_QER_SR2_BIT1_NO_RD	= 4,	/* SR2 bit 1, no read of SR2 */
+	SFDP_QER_SR2_BIT1	= 5,	/* SR2 bit 1, as Spansion/Winbond */
+	SFDP_QER_UNKNOWN	= 0xff,	/* JESD216 rev 1.0, use the vendor */
+};
+
+/* 4-byte Address Instruction Table, dword 1 */
+#define SFDP_4BAIT_READ			BIT(0)
+#define SFDP_4BAIT_FAST_READ		BIT(1)
+#define SFDP_4BAIT_FAST_READ_1_1_2	BIT(2)
+#define SFDP_4BAIT_FAST_READ_1_1_4	BIT(4)
+#define SFDP_4BAIT_PP			BIT(6)
+#define SFDP_4BAIT_PP_1_1_4		BIT(7)
+#define SFDP_4BAIT_ERASE_TYPE(i)	BIT(9 + (i))
+
+/**
+ * struct spi_flash_sfdp - Flash parameters discovered through SFDP
+ *
+ * @info:		Parameters in the form of a spi_flash_ids[] entry
+ * @erase_types:	Erase commands, largest first
+ * @erase_map:		Bit n set if BFPT erase type n + 1 is present
+ * @dual_dummy:		Dummy bytes for CMD_READ_DUAL_OUTPUT_FAST
+ * @quad_dummy:		Dummy bytes for CMD_READ_QUAD_OUTPUT_FAST
+ * @addr_bytes:		Address mode, BFPT_DW1_ADDR_BYTES_...
+ * @qer:		Quad enable requirement, enum sfdp_qer
+ * @erase_typ_ms:	Typical time for each of @erase_types, 0 if not known
+ * @erase_max_ms:	Maximum time for each of @erase_types
+ * @pp_typ_us:		Typical page program time, 0 if not known
+ * @pp_max_us:		Maximum page program time
+ * @chip_erase_typ_ms:	Typical chip erase time, 0 if not known
+ * @chip_erase_max_ms:	Maximum chip erase time
+ */
+struct spi_flash_sfdp {
+	struct spi_flash_info info;
+	struct spi_flash_erase_type erase_types[SPI_FLASH_MAX_ERASE_TYPES];
+	u8 erase_map;
+	u8 dual_dummy;
+	u8 quad_dummy;
+	u8 qer;
+	u32 addr_bytes;
+	u32 erase_typ_ms[SPI_FLASH_MAX_ERASE_TYPES];
+	u32 erase_max_ms[SPI_FLASH_MAX_ERASE_TYPES];
+	u32 pp_typ_us;
+	u32 pp_max_us;
+	u32 chip_erase_typ_ms;
+	u32 chip_erase_max_ms;
+};
+
+#ifdef CONFIG_SPI_FLASH_SFDP
+/**
+ * spi_flash_read_sfdp() - Describe a flash from its SFDP tables
+ *
+ * This is used for parts which are not in spi_flash_ids[], and for the
+ * busy times of those which are.
+ *
+ * @flash:	SPI flash, with the bus claimed
+ * @id:		JEDEC ID bytes read from the flash
+ * @sfdp:	Returns the discovered parameters
+ * @return 0 if OK, -ve if the flash has no usable SFDP tables
+ */
+int spi_flash_read_sfdp(struct spi_flash *flash, const u8 *id,
+			struct spi_flash_sfdp *sfdp);
+#else
+static inline int spi_flash_read_sfdp(struct spi_flash *flash, const u8 *id,
+				      struct spi_flash_sfdp *sfdp)
+{
+	return -ENOSYS;
+}
+#endif
+
 /* Send a single-byte command to the device and read the response */
 int spi_flash_cmd(struct spi_slave *spi, u8 cmd, void *response, size_t len);
 
@@ -0,0 +1,312 @@
+/*
+ * SPI flash Serial Flash Discoverable Parameters (JEDEC JESD216)
+ *
+ * This lets a flash which is not in spi_flash_ids[] be used with its
+ * own erase sizes, fast read commands and quad enable method, instead of
+ * falling back to single-line reads.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <errno.h>
+#include <spi.h>
+#include <spi_flash.h>
+#include <linux/sizes.h>
+
+#include "sf_internal.h"
+
+static int sfdp_read(struct spi_flash *flash, u32 addr, void *buf,
+		     size_t len)
+{
+	u8 cmd[SPI_FLASH_CMD_LEN + 1];
+
+	/* 3-byte address and 8 dummy cycles, whatever the address mode */
+	cmd[0] = CMD_READ_SFDP;
+	cmd[1] = addr >> 16;
+	cmd[2] = addr >> 8;
+	cmd[3] = addr;
+	cmd[4] = 0;
+
+	return spi_flash_read_common(flash, cmd, sizeof(cmd), buf, len);
+}
+
+static u32 sfdp_param_addr(const struct sfdp_param_header *ph)
+{
+	return ph->ptp[2] << 16 | ph->ptp[1] << 8 | ph->ptp[0];
+}
+
+/*
+ * Work out the dummy bytes for a x-1-1 fast read, given the wait states
+ * and mode clocks fields of the BFPT. The address and dummy cycles go out
+ * on a single line, so only whole bytes can be sent.
+ */
+static int sfdp_dummy_bytes(u32 val)
+{
+	uint cycles = (val & 0x1f) + ((val >> 5) & 0x7);
+
+	if (cycles % 8)
+		return -EINVAL;
+
+	return cycles / 8;
+}
+
+/*
+ * The typical times in BFPT dwords 10 and 11 are a 5-bit count, plus one,
+ * of a unit given by the bits above it.
+ */
+static u32 sfdp_time(u32 val, const u32 *units, uint unit_mask)
+{
+	return ((val & 0x1f) + 1) * units[(val >> 5) & unit_mask];
+}
+
+static void sfdp_parse_timing(const u32 *bfpt, struct spi_flash_sfdp *sfdp)
+{
+	static const u32 erase_units_ms[] = { 1, 16, 128, 1000 };
+	static const u32 pp_units_us[] = { 8, 64 };
+	static const u32 chip_units_ms[] = { 16, 256, 4000, 64000 };
+	uint mult;
+	u32 val;
+	int i, j;
+
+	/* The maximum is the typical time scaled by 2 * (multiplier + 1) */
+	mult = 2 * ((bfpt[9] & BFPT_DW10_ERASE_MULT_MASK) + 1);
+	for (i = 0; i < 4; i++) {
+		u32 type = bfpt[7 + i / 2] >> (16 * (i % 2));
+
+		if (!(sfdp->erase_map & BIT(i)))
+			continue;
+		val = bfpt[9] >> BFPT_DW10_ERASE_TYP_SHIFT(i);
+		for (j = 0; j < SPI_FLASH_MAX_ERASE_TYPES; j++) {
+			if (sfdp->erase_types[j].size != 1U << (type & 0xff) ||
+			    sfdp->erase_types[j].cmd != ((type >> 8) & 0xff))
+				continue;
+			sfdp->erase_typ_ms[j] = sfdp_time(val, erase_units_ms,
+							  3);
+			sfdp->erase_max_ms[j] = sfdp->erase_typ_ms[j] * mult;
+		}
+	}
+
+	mult = 2 * ((bfpt[10] & BFPT_DW11_PROG_MULT_MASK) + 1);
+	sfdp->pp_typ_us = sfdp_time(bfpt[10] >> BFPT_DW11_PP_TYP_SHIFT,
+				    pp_units_us, 1);
+	sfdp->pp_max_us = sfdp->pp_typ_us * mult;
+	sfdp->chip_erase_typ_ms = sfdp_time(bfpt[10] >>
+					    BFPT_DW11_CHIP_ERASE_TYP_SHIFT,
+					    chip_units_ms, 3);
+	sfdp->chip_erase_max_ms = sfdp->chip_erase_typ_ms * mult;
+}
+
+static void sfdp_add_erase_type(struct spi_flash_sfdp *sfdp, u8 shift, u8 cmd)
+{
+	struct spi_flash_erase_type *types = sfdp->erase_types;
+	int i, j;
+
+	if (shift >= 32)
+		return;
+
+	/* Keep the list sorted, largest first */
+	for (i = 0; i < SPI_FLASH_MAX_ERASE_TYPES && types[i].size; i++) {
+		if (types[i].size < (1U << shift))
+			break;
+	}
+	if (i == SPI_FLASH_MAX_ERASE_TYPES)
+		return;
+	for (j = SPI_FLASH_MAX_ERASE_TYPES - 1; j > i; j--)
+		types[j] = types[j - 1];
+	types[i].size = 1U << shift;
+	types[i].cmd = cmd;
+}
+
+static int sfdp_parse_bfpt(struct spi_flash *flash,
+			   const struct sfdp_param_header *ph,
+			   struct spi_flash_sfdp *sfdp)
+{
+	struct spi_flash_info *info = &sfdp->info;
+	u32 bfpt[SFDP_BFPT_MAX_DWORDS];
+	u64 size;
+	int dummy;
+	int ret;
+	int i;
+
+	if (ph->length < SFDP_BFPT_MIN_DWORDS)
+		return -EINVAL;
+
+	memset(bfpt, '\0', sizeof(bfpt));
+	ret = sfdp_read(flash, sfdp_param_addr(ph), bfpt,
+			min_t(uint, ph->length, SFDP_BFPT_MAX_DWORDS) * 4);
+	if (ret)
+		return ret;
+	for (i = 0; i < SFDP_BFPT_MAX_DWORDS; i++)
+		bfpt[i] = le32_to_cpu(bfpt[i]);
+
+	/* Density is in bits */
+	if (bfpt[1] & BFPT_DW2_DENSITY_POW2) {
+		i = bfpt[1] & ~BFPT_DW2_DENSITY_POW2;
+		if (i < 3 || i > 32 + 3)
+			return -EINVAL;
+		size = 1ULL << (i - 3);
+	} else {
+		size = ((u64)bfpt[1] + 1) / 8;
+	}
+	if (!size || size > (u32)~0)
+		return -EINVAL;
+
+	/* Erase types 1 to 4 */
+	for (i = 0; i < 4; i++) {
+		u32 val = bfpt[7 + i / 2] >> (16 * (i % 2));
+
+		if (!(val & 0xff))
+			continue;
+		sfdp_add_erase_type(sfdp, val & 0xff, (val >> 8) & 0xff);
+		sfdp->erase_map |= BIT(i);
+	}
+
+	/*
+	 * The sector is what CMD_ERASE_64K erases, as in spi_flash_ids[].
+	 * Smaller erase commands are only used if they are the standard ones.
+	 */
+	for (i = 0; i < SPI_FLASH_MAX_ERASE_TYPES; i++) {
+		const struct spi_flash_erase_type *type = &sfdp->erase_types[i];
+
+		if (type->cmd == CMD_ERASE_64K)
+			info->sector_size = type->size;
+		else if (type->cmd == CMD_ERASE_32K && type->size == SZ_32K)
+			info->flags |= SECT_32K;
+		else if (type->cmd == CMD_ERASE_4K && type->size == SZ_4K)
+			info->flags |= SECT_4K;
+	}
+	if (!info->sector_size || (u32)size % info->sector_size) {
+		debug("SF: SFDP has no usable sector erase\n");
+		return -EINVAL;
+	}
+	info->n_sectors = (u32)size / info->sector_size;
+
+	/* x-1-1 fast reads, if they use the usual commands */
+	if (bfpt[0] & BFPT_DW1_FAST_READ_1_1_2 &&
+	    ((bfpt[3] >> 8) & 0xff) == CMD_READ_DUAL_OUTPUT_FAST) {
+		dummy = sfdp_dummy_bytes(bfpt[3]);
+		if (dummy >= 0) {
+			info->flags |= RD_DUAL;
+			sfdp->dual_dummy = dummy;
+		}
+	}
+	if (bfpt[0] & BFPT_DW1_FAST_READ_1_1_4 &&
+	    ((bfpt[2] >> 24) & 0xff) == CMD_READ_QUAD_OUTPUT_FAST) {
+		dummy = sfdp_dummy_bytes(bfpt[2] >> 16);
+		if (dummy >= 0) {
+			info->flags |= RD_QUAD;
+			sfdp->quad_dummy = dummy;
+		}
+	}
+
+	sfdp->addr_bytes = bfpt[0] & BFPT_DW1_ADDR_BYTES_MASK;
+
+	/* The rest is only in JESD216A and later */
+	info->page_size = 256;
+	sfdp->qer = SFDP_QER_UNKNOWN;
+	if (ph->length < SFDP_BFPT_MAX_DWORDS)
+		return 0;
+
+	info->page_size = 1 << ((bfpt[10] >> 4) & 0xf);
+	sfdp->qer = (bfpt[14] & BFPT_DW15_QER_MASK) >> BFPT_DW15_QER_SHIFT;
+	sfdp_parse_timing(bfpt, sfdp);
+
+	return 0;
+}
+
+/*
+ * The 4-byte address instruction table lists which of the 4-byte opcodes
+ * the flash has. Only use them if we can read, program and erase with them.
+ */
+static int sfdp_parse_4bait(struct spi_flash *flash,
+			    const struct sfdp_param_header *ph,
+			    struct spi_flash_sfdp *sfdp)
+{
+	u32 need = SFDP_4BAIT_FAST_READ | SFDP_4BAIT_PP;
+	__le32 dw;
+	u32 val;
+	int ret;
+	int i;
+
+	if (ph->length < 1)
+		return -EINVAL;
+
+	ret = sfdp_read(flash, sfdp_param_addr(ph), &dw, sizeof(dw));
+	if (ret)
+		return ret;
+	val = le32_to_cpu(dw);
+
+	for (i = 0; i < 4; i++) {
+		if (sfdp->erase_map & BIT(i))
+			need |= SFDP_4BAIT_ERASE_TYPE(i);
+	}
+	if (sfdp->info.flags & RD_DUAL)
+		need |= SFDP_4BAIT_FAST_READ_1_1_2;
+	if (sfdp->info.flags & RD_QUAD)
+		need |= SFDP_4BAIT_FAST_READ_1_1_4;
+	if ((val & need) == need)
+		sfdp->info.flags |= ADDR_4B;
+
+	return 0;
+}
+
+int spi_flash_read_sfdp(struct spi_flash *flash, const u8 *id,
+			struct spi_flash_sfdp *sfdp)
+{
+	struct sfdp_param_header ph, bfpt;
+	struct sfdp_header hdr;
+	int ret;
+	int i;
+
+	memset(sfdp, '\0', sizeof(*sfdp));
+
+	ret = sfdp_read(flash, 0, &hdr, sizeof(hdr));
+	if (ret)
+		return ret;
+	if (le32_to_cpu(hdr.signature) != SFDP_SIGNATURE || hdr.major != 1) {
+		debug("SF: no SFDP tables\n");
+		return -ENOENT;
+	}
+
+	/* The first parameter header is always the BFPT */
+	ret = sfdp_read(flash, sizeof(hdr), &bfpt, sizeof(bfpt));
+	if (ret)
+		return ret;
+	if ((bfpt.id_msb << 8 | bfpt.id_lsb) != SFDP_BFPT_ID ||
+	    bfpt.major != 1)
+		return -EINVAL;
+
+	ret = sfdp_parse_bfpt(flash, &bfpt, sfdp);
+	if (ret)
+		return ret;
+
+	for (i = 1; i <= hdr.nph; i++) {
+		ret = sfdp_read(flash, sizeof(hdr) + i * sizeof(ph), &ph,
+				sizeof(ph));
+		if (ret)
+			return ret;
+
+		switch (ph.id_msb << 8 | ph.id_lsb) {
+		case SFDP_4BAIT_ID:
+			ret = sfdp_parse_4bait(flash, &ph, sfdp);
+			break;
+		default:
+			ret = 0;
+			break;
+		}
+		if (ret)
+			debug("SF: SFDP table %02x%02x ignored (err=%d)\n",
+			      ph.id_msb, ph.id_lsb, ret);
+	}
+
+	sfdp->info.name = "sfdp";
+	memcpy(sfdp->info.id, id, SPI_FLASH_MAX_ID_LEN);
+	sfdp->info.id_len = 3;
+
+	debug("SF: SFDP rev %d.%d, %u sectors of %#x, flags %#x\n", hdr.major,
+	      hdr.minor, sfdp->info.n_sectors, sfdp->info.sector_size,
+	      sfdp->info.flags);
+
+	return 0;
+}
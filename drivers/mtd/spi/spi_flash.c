@@ -10,24 +10,28 @@
  */
 
 #include <common.h>
+#include <console.h>
 #include <errno.h>
 #include <malloc.h>
 #include <mapmem.h>
 #include <spi.h>
 #include <spi_flash.h>
+#include <watchdog.h>
 #include <linux/log2.h>
+#include <linux/sizes.h>
 #include <dma.h>
 
 #include "sf_internal.h"
 
 DECLARE_GLOBAL_DATA_PTR;
 
-static void spi_flash_addr(u32 addr, u8 *cmd)
+static void spi_flash_addr(struct spi_flash *flash, u32 addr, u8 *cmd)
 {
-	/* cmd[0] is actual command */
-	cmd[1] = addr >> 16;
-	cmd[2] = addr >> 8;
-	cmd[3] = addr >> 0;
+	int i;
+
+	/* cmd[0] is actual command, then the address MSB first */
+	for (i = flash->addr_width; i > 0; i--, addr >>= 8)
+		cmd[i] = addr;
 }
 
 static int read_sr(struct spi_flash *flash, u8 *rs)
@@ -74,7 +78,8 @@ static int write_sr(struct spi_flash *flash, u8 ws)
 	return 0;
 }
 
-#if defined(CONFIG_SPI_FLASH_SPANSION) || defined(CONFIG_SPI_FLASH_WINBOND)
+#if defined(CONFIG_SPI_FLASH_SPANSION) || defined(CONFIG_SPI_FLASH_WINBOND) || \
+	defined(CONFIG_SPI_FLASH_SFDP)
 static int read_cr(struct spi_flash *flash, u8 *rc)
 {
 	int ret;
@@ -127,7 +132,8 @@ static int clean_bar(struct spi_flash *flash)
 {
 	u8 cmd, bank_sel = 0;
 
-	if (flash->bank_curr == 0)
+	if (flash->bank_curr == 0 ||
+	    flash->addr_width == SPI_FLASH_4B_ADDR_LEN)
 		return 0;
 	cmd = flash->bank_write_cmd;
 
@@ -139,6 +145,10 @@ static int write_bar(struct spi_flash *flash, u32 offset)
 	u8 cmd, bank_sel;
 	int ret;
 
+	/* 4-byte address commands reach the whole flash without a bank */
+	if (flash->addr_width == SPI_FLASH_4B_ADDR_LEN)
+		return 0;
+
 	bank_sel = offset / (SPI_FLASH_16MB_BOUN << flash->shift);
 	if (bank_sel == flash->bank_curr)
 		goto bar_end;
@@ -271,15 +281,133 @@ static int spi_flash_wait_till_ready(struct spi_flash *flash,
 	return -ETIMEDOUT;
 }
 
-int spi_flash_write_common(struct spi_flash *flash, const u8 *cmd,
-		size_t cmd_len, const void *buf, size_t buf_len)
+/*
+ * Check whether the flash has finished programming. Unlike
+ * spi_flash_ready() this expects the bus to be claimed already.
+ */
+static int spi_flash_ready_claimed(struct spi_flash *flash)
 {
 	struct spi_slave *spi = flash->spi;
-	unsigned long timeout = SPI_FLASH_PROG_TIMEOUT;
+	u8 cmd, sr;
 	int ret;
 
-	if (buf == NULL)
-		timeout = SPI_FLASH_PAGE_ERASE_TIMEOUT;
+	cmd = CMD_READ_STATUS;
+	ret = spi_flash_cmd_read(spi, &cmd, 1, &sr, 1);
+	if (ret < 0)
+		return ret;
+	if (sr & STATUS_WIP)
+		return 0;
+
+	if (flash->flags & SNOR_F_USE_FSR) {
+		cmd = CMD_FLAG_STATUS;
+		ret = spi_flash_cmd_read(spi, &cmd, 1, &sr, 1);
+		if (ret < 0)
+			return ret;
+		if (!(sr & STATUS_PEC))
+			return 0;
+	}
+
+	return 1;
+}
+
+static void spi_flash_record_time(struct spi_flash_timing *t, u32 us)
+{
+	u64 limit = t->typ_us / 2;
+	int i;
+
+	if (!t->count || us < t->min_us)
+		t->min_us = us;
+	if (us > t->max_us)
+		t->max_us = us;
+	t->count++;
+	t->total_us += us;
+
+	for (i = 0; i < SPI_FLASH_TIMING_BUCKETS - 1 && us >= limit; i++)
+		limit *= 2;
+	t->hist[i]++;
+}
+
+/*
+ * Sleep for @us, a step of at most SPI_FLASH_WAIT_STEP_US at a time, so
+ * that the watchdog is kept fed and Ctrl-C can stop a long wait.
+ */
+static int spi_flash_sleep(u32 us)
+{
+	u32 step;
+
+	while (us) {
+		step = min_t(u32, us, SPI_FLASH_WAIT_STEP_US);
+		udelay(step);
+		us -= step;
+		WATCHDOG_RESET();
+#ifndef CONFIG_SPL_BUILD
+		if (ctrlc()) {
+			puts("SF: Interrupted, flash may still be busy\n");
+			return -EINTR;
+		}
+#endif
+	}
+
+	return 0;
+}
+
+/*
+ * Wait for the flash to finish @op, with the bus claimed.
+ *
+ * If the part gives its typical time, nothing is polled until 3/4 of it
+ * has passed; otherwise polling starts straight away. The gap between
+ * polls then doubles from 1/32 of the typical time up to 1/8 of it, so a
+ * slow operation does not keep the controller busy.
+ */
+static int spi_flash_wait_op(struct spi_flash *flash, enum spi_flash_op op)
+{
+	struct spi_flash_timing *t = &flash->timing[op];
+	unsigned long start_us, timebase;
+	u32 gap, max_gap;
+	int ret;
+
+	bootstage_start(BOOTSTAGE_ID_ACCUM_SPI, "spi_flash_busy");
+	start_us = timer_get_us();
+	timebase = get_timer(0);
+
+	ret = spi_flash_sleep(t->wait_us);
+	if (ret)
+		goto out;
+
+	gap = max(t->typ_us / 32, 1U);
+	max_gap = clamp(t->typ_us / 8, 1U, (u32)SPI_FLASH_WAIT_STEP_US);
+	for (;;) {
+		t->polls++;
+		ret = spi_flash_ready_claimed(flash);
+		if (ret < 0)
+			goto out;
+		if (ret)
+			break;
+		if (get_timer(timebase) >= t->max_ms) {
+			printf("SF: Timeout!\n");
+			t->timeouts++;
+			ret = -ETIMEDOUT;
+			goto out;
+		}
+		ret = spi_flash_sleep(gap);
+		if (ret)
+			goto out;
+		gap = min(gap * 2, max_gap);
+	}
+	spi_flash_record_time(t, timer_get_us() - start_us);
+	ret = 0;
+out:
+	bootstage_accum(BOOTSTAGE_ID_ACCUM_SPI);
+
+	return ret;
+}
+
+static int spi_flash_write_op(struct spi_flash *flash, const u8 *cmd,
+			      size_t cmd_len, const void *buf, size_t buf_len,
+			      unsigned long timeout)
+{
+	struct spi_slave *spi = flash->spi;
+	int ret;
 
 	ret = spi_claim_bus(spi);
 	if (ret) {
@@ -303,7 +431,7 @@ int spi_flash_write_common(struct spi_flash *flash, const u8 *cmd,
 	if (ret < 0) {
 		debug("SF: write %s timed out\n",
 		      timeout == SPI_FLASH_PROG_TIMEOUT ?
-			"program" : "page erase");
+			"program" : "erase");
 		return ret;
 	}
 
@@ -312,10 +440,89 @@ int spi_flash_write_common(struct spi_flash *flash, const u8 *cmd,
 	return ret;
 }
 
+int spi_flash_write_common(struct spi_flash *flash, const u8 *cmd,
+		size_t cmd_len, const void *buf, size_t buf_len)
+{
+	unsigned long timeout = SPI_FLASH_PROG_TIMEOUT;
+
+	if (buf == NULL)
+		timeout = SPI_FLASH_PAGE_ERASE_TIMEOUT;
+
+	return spi_flash_write_op(flash, cmd, cmd_len, buf, buf_len, timeout);
+}
+
+/* Send an erase command and wait for it as modelled by @op */
+static int spi_flash_erase_op(struct spi_flash *flash, const u8 *cmd,
+			      size_t cmd_len, enum spi_flash_op op)
+{
+	struct spi_slave *spi = flash->spi;
+	int ret;
+
+	ret = spi_claim_bus(spi);
+	if (ret) {
+		debug("SF: unable to claim SPI bus\n");
+		return ret;
+	}
+
+	ret = spi_flash_cmd_write_enable(flash);
+	if (ret < 0) {
+		debug("SF: enabling write failed\n");
+		goto release;
+	}
+
+	ret = spi_flash_cmd_write(spi, cmd, cmd_len, NULL, 0);
+	if (ret < 0) {
+		debug("SF: erase cmd failed\n");
+		goto release;
+	}
+
+	ret = spi_flash_wait_op(flash, op);
+	if (ret < 0)
+		debug("SF: erase timed out\n");
+
+release:
+	spi_release_bus(spi);
+
+	return ret;
+}
+
+static int spi_flash_chip_erase(struct spi_flash *flash)
+{
+	u8 cmd = CMD_ERASE_CHIP;
+
+	debug("SF: chip erase (%x bytes)\n", flash->size);
+
+	return spi_flash_erase_op(flash, &cmd, 1, SPI_FLASH_OP_CHIP_ERASE);
+}
+
+/*
+ * Pick the largest erase command which starts at @offset and does not go
+ * beyond @offset + @len. The smallest type is flash->erase_size, which the
+ * caller has checked that @offset and @len are a multiple of.
+ */
+static const struct spi_flash_erase_type *
+spi_flash_erase_type(struct spi_flash *flash, u32 offset, size_t len)
+{
+	const struct spi_flash_erase_type *type;
+	int i;
+
+	for (i = 0; i < SPI_FLASH_MAX_ERASE_TYPES; i++) {
+		type = &flash->erase_types[i];
+		if (!type->size)
+			break;
+		if (!(offset % type->size) && len >= type->size)
+			return type;
+	}
+
+	return NULL;
+}
+
 int spi_flash_cmd_erase_ops(struct spi_flash *flash, u32 offset, size_t len)
 {
+	const struct spi_flash_erase_type *type;
 	u32 erase_size, erase_addr;
-	u8 cmd[SPI_FLASH_CMD_LEN];
+	u8 cmd[SPI_FLASH_MAX_CMD_LEN];
+	size_t cmd_len = 1 + flash->addr_width;
 	int ret = -1;
 
 	erase_size = flash->erase_size;
@@ -332,8 +539,23 @@ int spi_flash_cmd_erase_ops(struct spi_flash *flash, u32 offset, size_t len)
 		}
 	}
 
-	cmd[0] = flash->erase_cmd;
+	if ((flash->flags & SNOR_F_CHIP_ERASE) && !offset &&
+	    len == flash->size)
+		return spi_flash_chip_erase(flash);
+
 	while (len) {
+#ifndef CONFIG_SPL_BUILD
+		if (ctrlc()) {
+			ret = -EINTR;
+			break;
+		}
+#endif
+		type = spi_flash_erase_type(flash, offset, len);
+		if (!type) {
+			debug("SF: no erase type for %x\n", offset);
+			ret = -EINVAL;
+			break;
+		}
 		erase_addr = offset;
 
 #ifdef CONFIG_SF_DUAL_FLASH
@@ -345,28 +567,89 @@ int spi_flash_cmd_erase_ops(struct spi_flash *flash, u32 offset, size_t len)
 		if (ret < 0)
 			return ret;
 #endif
-		spi_flash_addr(erase_addr, cmd);
+		cmd[0] = type->cmd;
+		spi_flash_addr(flash, erase_addr, cmd);
 
-		debug("SF: erase %2x %2x %2x %2x (%x)\n", cmd[0], cmd[1],
-		      cmd[2], cmd[3], erase_addr);
+		debug("SF: erase %2x (%x)\n", cmd[0], erase_addr);
 
-		ret = spi_flash_write_common(flash, cmd, sizeof(cmd), NULL, 0);
+		ret = spi_flash_erase_op(flash, cmd, cmd_len, SPI_FLASH_OP_ERASE +
+					 (type - flash->erase_types));
 		if (ret < 0) {
 			debug("SF: erase failed\n");
 			break;
 		}
 
-		offset += erase_size;
-		len -= erase_size;
+		offset += type->size;
+		len -= type->size;
 	}
 
 #ifdef CONFIG_SPI_FLASH_BAR
-	ret = clean_bar(flash);
+	if (ret < 0)
+		clean_bar(flash);
+	else
+		ret = clean_bar(flash);
 #endif
 
 	return ret;
 }
 
+/* Program one page with the bus already claimed */
+static int spi_flash_program_page(struct spi_flash *flash, const u8 *cmd,
+				  size_t cmd_len, const void *buf, size_t len)
+{
+	struct spi_slave *spi = flash->spi;
+	int ret;
+
+	ret = spi_flash_cmd_write_enable(flash);
+	if (ret < 0) {
+		debug("SF: enabling write failed\n");
+		return ret;
+	}
+
+	ret = spi_flash_cmd_write(spi, cmd, cmd_len, buf, len);
+	if (ret < 0) {
+		debug("SF: write cmd failed\n");
+		return ret;
+	}
+
+	return spi_flash_wait_op(flash, SPI_FLASH_OP_PROGRAM);
+}
+
+#ifdef CONFIG_SPI_FLASH_WRITE_VERIFY
+/* Read back a page which has just been programmed and compare it */
+static int spi_flash_verify_page(struct spi_flash *flash, u32 write_addr,
+				 const void *buf, size_t len, u8 *vbuf)
+{
+	struct spi_slave *spi = flash->spi;
+	u8 cmd[SPI_FLASH_MAX_CMD_LEN + 1];
+	size_t cmdsz = 1 + flash->addr_width + flash->dummy_byte;
+	size_t done, read_len;
+	int ret;
+
+	if (cmdsz > sizeof(cmd))
+		return -EINVAL;
+
+	memset(cmd, '\0', sizeof(cmd));
+	cmd[0] = flash->read_cmd;
+	for (done = 0; done < len; done += read_len) {
+		read_len = len - done;
+		if (spi->max_read_size)
+			read_len = min(read_len, (size_t)spi->max_read_size);
+		spi_flash_addr(flash, write_addr + (done >> flash->shift), cmd);
+		ret = spi_flash_cmd_read(spi, cmd, cmdsz, vbuf + done,
+					 read_len);
+		if (ret < 0)
+			return ret;
+	}
+	if (memcmp(vbuf, buf, len)) {
+		printf("SF: verify failed at %#x\n", write_addr);
+		return -EIO;
+	}
+
+	return 0;
+}
+#endif
+
 int spi_flash_cmd_write_ops(struct spi_flash *flash, u32 offset,
 		size_t len, const void *buf)
 {
@@ -374,7 +657,10 @@ int spi_flash_cmd_write_ops(struct spi_flash *flash, u32 offset,
 	unsigned long byte_addr, page_size;
 	u32 write_addr;
 	size_t chunk_len, actual;
-	u8 cmd[SPI_FLASH_CMD_LEN];
+	u8 cmd[SPI_FLASH_MAX_CMD_LEN];
+	size_t cmd_len = 1 + flash->addr_width;
+	bool claimed = false;
+	u8 *vbuf = NULL;
 	int ret = -1;
 
 	page_size = flash->page_size;
@@ -387,6 +673,16 @@ int spi_flash_cmd_write_ops(struct spi_flash *flash, u32 offset,
 		}
 	}
 
+#ifdef CONFIG_SPI_FLASH_WRITE_VERIFY
+	vbuf = malloc(page_size);
+	if (!vbuf)
+		return -ENOMEM;
+#endif
+
+	/*
+	 * Keep the bus claimed across pages, so that each one only costs the
+	 * write enable, the program and the status polls.
+	 */
 	cmd[0] = flash->write_cmd;
 	for (actual = 0; actual < len; actual += chunk_len) {
 		write_addr = offset;
@@ -396,34 +692,63 @@ int spi_flash_cmd_write_ops(struct spi_flash *flash, u32 offset,
 			spi_flash_dual(flash, &write_addr);
 #endif
 #ifdef CONFIG_SPI_FLASH_BAR
+		/* Selecting the bank claims the bus by itself */
+		if (claimed && flash->addr_width == SPI_FLASH_3B_ADDR_LEN &&
+		    write_addr / (SPI_FLASH_16MB_BOUN << flash->shift) !=
+		    flash->bank_curr) {
+			spi_release_bus(spi);
+			claimed = false;
+		}
 		ret = write_bar(flash, write_addr);
 		if (ret < 0)
-			return ret;
+			break;
 #endif
 		byte_addr = offset % page_size;
 		chunk_len = min(len - actual, (size_t)(page_size - byte_addr));
 
 		if (spi->max_write_size)
 			chunk_len = min(chunk_len,
-					spi->max_write_size - sizeof(cmd));
+					spi->max_write_size - cmd_len);
 
-		spi_flash_addr(write_addr, cmd);
+		spi_flash_addr(flash, write_addr, cmd);
 
-		debug("SF: 0x%p => cmd = { 0x%02x 0x%02x%02x%02x } chunk_len = %zu\n",
-		      buf + actual, cmd[0], cmd[1], cmd[2], cmd[3], chunk_len);
+		debug("SF: 0x%p => cmd = { 0x%02x 0x%x } chunk_len = %zu\n",
+		      buf + actual, cmd[0], write_addr, chunk_len);
 
-		ret = spi_flash_write_common(flash, cmd, sizeof(cmd),
-					buf + actual, chunk_len);
+		if (!claimed) {
+			ret = spi_claim_bus(spi);
+			if (ret) {
+				debug("SF: unable to claim SPI bus\n");
+				break;
+			}
+			claimed = true;
+		}
+
+		ret = spi_flash_program_page(flash, cmd, cmd_len,
+					     buf + actual, chunk_len);
 		if (ret < 0) {
 			debug("SF: write failed\n");
 			break;
 		}
 
+#ifdef CONFIG_SPI_FLASH_WRITE_VERIFY
+		ret = spi_flash_verify_page(flash, write_addr, buf + actual,
+					    chunk_len, vbuf);
+		if (ret < 0)
+			break;
+#endif
+
 		offset += chunk_len;
 	}
+	if (claimed)
+		spi_release_bus(spi);
+	free(vbuf);
 
 #ifdef CONFIG_SPI_FLASH_BAR
-	ret = clean_bar(flash);
+	if (ret < 0)
+		clean_bar(flash);
+	else
+		ret = clean_bar(flash);
 #endif
 
 	return ret;
@@ -465,13 +790,56 @@ void __weak spi_flash_copy_mmap(void *data, void *offset, size_t len)
 	memcpy(data, offset, len);
 }
 
+/*
+ * Set up @cmd to read from @offset, selecting the bank if needed, and work
+ * out how much of @len can be read with it.
+ *
+ * Returns the number of bytes to read, or -ve on error.
+ */
+static int spi_flash_read_setup(struct spi_flash *flash, u32 offset,
+				size_t len, u8 *cmd)
+{
+	struct spi_slave *spi = flash->spi;
+	u32 remain_len, read_len, read_addr;
+	int bank_sel = 0;
+#ifdef CONFIG_SPI_FLASH_BAR
+	int ret;
+#endif
+
+	read_addr = offset;
+
+#ifdef CONFIG_SF_DUAL_FLASH
+	if (flash->dual_flash > SF_SINGLE_FLASH)
+		spi_flash_dual(flash, &read_addr);
+#endif
+#ifdef CONFIG_SPI_FLASH_BAR
+	ret = write_bar(flash, read_addr);
+	if (ret < 0)
+		return ret;
+	bank_sel = flash->bank_curr;
+#endif
+	read_len = len;
+	if (flash->addr_width == SPI_FLASH_3B_ADDR_LEN) {
+		remain_len = ((SPI_FLASH_16MB_BOUN << flash->shift) *
+				(bank_sel + 1)) - offset;
+		if (len >= remain_len)
+			read_len = remain_len;
+	}
+
+	if (spi->max_read_size)
+		read_len = min(read_len, spi->max_read_size);
+
+	spi_flash_addr(flash, read_addr, cmd);
+
+	return read_len;
+}
+
 int spi_flash_cmd_read_ops(struct spi_flash *flash, u32 offset,
 		size_t len, void *data)
 {
 	struct spi_slave *spi = flash->spi;
 	u8 *cmd, cmdsz;
-	u32 remain_len, read_len, read_addr;
-	int bank_sel = 0;
+	u32 read_len;
 	int ret = -1;
 
 	/* Handle memory-mapped SPI */
@@ -488,7 +856,7 @@ int spi_flash_cmd_read_ops(struct spi_flash *flash, u32 offset,
 		return 0;
 	}
 
-	cmdsz = SPI_FLASH_CMD_LEN + flash->dummy_byte;
+	cmdsz = 1 + flash->addr_width + flash->dummy_byte;
 	cmd = calloc(1, cmdsz);
 	if (!cmd) {
 		debug("SF: Failed to allocate cmd\n");
@@ -497,29 +865,10 @@ int spi_flash_cmd_read_ops(struct spi_flash *flash, u32 offset,
 
 	cmd[0] = flash->read_cmd;
 	while (len) {
-		read_addr = offset;
-
-#ifdef CONFIG_SF_DUAL_FLASH
-		if (flash->dual_flash > SF_SINGLE_FLASH)
-			spi_flash_dual(flash, &read_addr);
-#endif
-#ifdef CONFIG_SPI_FLASH_BAR
-		ret = write_bar(flash, read_addr);
+		ret = spi_flash_read_setup(flash, offset, len, cmd);
 		if (ret < 0)
-			return ret;
-		bank_sel = flash->bank_curr;
-#endif
-		remain_len = ((SPI_FLASH_16MB_BOUN << flash->shift) *
-				(bank_sel + 1)) - offset;
-		if (len < remain_len)
-			read_len = len;
-		else
-			read_len = remain_len;
-
-		if (spi->max_read_size)
-			read_len = min(read_len, spi->max_read_size);
-
-		spi_flash_addr(read_addr, cmd);
+			break;
+		read_len = ret;
 
 		ret = spi_flash_read_common(flash, cmd, cmdsz, data, read_len);
 		if (ret < 0) {
@@ -540,6 +889,127 @@ int spi_flash_cmd_read_ops(struct spi_flash *flash, u32 offset,
 	return ret;
 }
 
+static int spi_flash_read_stream_mmap(struct spi_flash *flash, u32 offset,
+		size_t len, void *data, size_t chunk, spi_flash_stream_fn fn,
+		void *priv)
+{
+	struct spi_slave *spi = flash->spi;
+	const void *buf;
+	size_t read_len;
+	int ret;
+
+	ret = spi_claim_bus(spi);
+	if (ret) {
+		debug("SF: unable to claim SPI bus\n");
+		return ret;
+	}
+	spi_xfer(spi, 0, NULL, NULL, SPI_XFER_MMAP);
+	while (len) {
+		read_len = min(len, chunk);
+		buf = flash->memory_map + offset;
+		if (data) {
+			spi_flash_copy_mmap(data, (void *)buf, read_len);
+			buf = data;
+			data += read_len;
+		}
+		ret = fn(priv, offset, buf, read_len);
+		if (ret)
+			break;
+		offset += read_len;
+		len -= read_len;
+	}
+	spi_xfer(spi, 0, NULL, NULL, SPI_XFER_MMAP_END);
+	spi_release_bus(spi);
+
+	return ret;
+}
+
+int spi_flash_read_stream(struct spi_flash *flash, u32 offset, size_t len,
+			  void *data, size_t chunk, spi_flash_stream_fn fn,
+			  void *priv)
+{
+	struct spi_slave *spi = flash->spi;
+	u8 cmd[SPI_FLASH_MAX_CMD_LEN + 1];
+	bool claimed = false;
+	u8 *pingpong = NULL;
+	size_t cmdsz;
+	u32 read_len;
+	void *buf;
+	int ret = 0;
+	int i = 0;
+
+	if (!chunk)
+		chunk = SPI_FLASH_STREAM_CHUNK;
+	if (flash->memory_map)
+		return spi_flash_read_stream_mmap(flash, offset, len, data,
+						  chunk, fn, priv);
+
+	if (flash->dummy_byte > sizeof(cmd) - 1 - flash->addr_width)
+		return -EINVAL;
+	if (!data) {
+		pingpong = memalign(ARCH_DMA_MINALIGN, 2 * chunk);
+		if (!pingpong)
+			return -ENOMEM;
+	}
+
+	cmdsz = 1 + flash->addr_width + flash->dummy_byte;
+	memset(cmd, '\0', sizeof(cmd));
+	cmd[0] = flash->read_cmd;
+	while (len) {
+		/* Selecting the bank claims the bus by itself */
+		ret = spi_flash_read_setup(flash, offset, min(len, chunk), cmd);
+		if (ret < 0)
+			break;
+		read_len = ret;
+
+		if (!claimed) {
+			ret = spi_claim_bus(spi);
+			if (ret) {
+				debug("SF: unable to claim SPI bus\n");
+				break;
+			}
+			claimed = true;
+		}
+
+		buf = data ? data : pingpong + i * chunk;
+		ret = spi_flash_cmd_read(spi, cmd, cmdsz, buf, read_len);
+		if (ret < 0) {
+			debug("SF: read failed\n");
+			break;
+		}
+
+		ret = fn(priv, offset, buf, read_len);
+		if (ret)
+			break;
+
+		offset += read_len;
+		len -= read_len;
+		if (data)
+			data += read_len;
+		i ^= 1;
+
+#ifdef CONFIG_SPI_FLASH_BAR
+		if (flash->addr_width == SPI_FLASH_3B_ADDR_LEN &&
+		    !(offset % (SPI_FLASH_16MB_BOUN << flash->shift))) {
+			spi_release_bus(spi);
+			claimed = false;
+		}
+#endif
+	}
+	if (claimed)
+		spi_release_bus(spi);
+
+#ifdef CONFIG_SPI_FLASH_BAR
+	if (ret)
+		clean_bar(flash);
+	else
+		ret = clean_bar(flash);
+#endif
+
+	free(pingpong);
+	return ret;
+}
+
 #ifdef CONFIG_SPI_FLASH_SST
 static int sst_byte_write(struct spi_flash *flash, u32 offset, const void *buf)
 {
@@ -843,7 +1313,7 @@ int stm_unlock(struct spi_flash *flash, u32 ofs, size_t len)
 #endif
 
 
-#ifdef CONFIG_SPI_FLASH_MACRONIX
+#if defined(CONFIG_SPI_FLASH_MACRONIX) || defined(CONFIG_SPI_FLASH_SFDP)
 static int macronix_quad_enable(struct spi_flash *flash)
 {
 	u8 qeb_status;
@@ -871,7 +1341,8 @@ static int macronix_quad_enable(struct spi_flash *flash)
 }
 #endif
 
-#if defined(CONFIG_SPI_FLASH_SPANSION) || defined(CONFIG_SPI_FLASH_WINBOND)
+#if defined(CONFIG_SPI_FLASH_SPANSION) || defined(CONFIG_SPI_FLASH_WINBOND) || \
+	defined(CONFIG_SPI_FLASH_SFDP)
 static int spansion_quad_enable(struct spi_flash *flash)
 {
 	u8 qeb_status;
@@ -899,7 +1370,35 @@ static int spansion_quad_enable(struct spi_flash *flash)
 }
 #endif
 
-static const struct spi_flash_info *spi_flash_read_id(struct spi_flash *flash)
+#ifdef CONFIG_SPI_FLASH_SFDP
+/*
+ * Some flash with the quad enable bit in the second status register cannot
+ * read that register back, so write both status registers blindly.
+ */
+static int spansion_no_read_cr_quad_enable(struct spi_flash *flash)
+{
+	u8 data[2];
+	u8 cmd;
+	int ret;
+
+	ret = read_sr(flash, &data[0]);
+	if (ret < 0)
+		return ret;
+
+	cmd = CMD_WRITE_STATUS;
+	data[1] = STATUS_QEB_WINSPAN;
+	ret = spi_flash_write_common(flash, &cmd, 1, &data, 2);
+	if (ret) {
+		debug("SF: fail to write status and config registers\n");
+		return ret;
+	}
+
+	return 0;
+}
+#endif
+
+static const struct spi_flash_info *spi_flash_read_id(struct spi_flash *flash,
+						struct spi_flash_sfdp *sfdp)
 {
 	int				tmp;
 	u8				id[SPI_FLASH_MAX_ID_LEN];
@@ -919,14 +1418,40 @@ static const struct spi_flash_info *spi_flash_read_id(struct spi_flash *flash)
 		}
 	}
 
+	/* Not a part we know, so see if it can describe itself */
+	if (!spi_flash_read_sfdp(flash, id, sfdp))
+		return &sfdp->info;
+
 	printf("SF: unrecognized JEDEC id bytes: %02x, %02x, %02x\n",
 	       id[0], id[1], id[2]);
 	return ERR_PTR(-ENODEV);
 }
 
+/* Set the quad enable bit, returning -EOPNOTSUPP if we do not know how */
 static int set_quad_mode(struct spi_flash *flash,
-			 const struct spi_flash_info *info)
+			 const struct spi_flash_info *info,
+			 const struct spi_flash_sfdp *sfdp)
 {
+#ifdef CONFIG_SPI_FLASH_SFDP
+	switch (sfdp ? sfdp->qer : SFDP_QER_UNKNOWN) {
+	case SFDP_QER_NONE:
+		return 0;
+	case SFDP_QER_SR1_BIT6:
+		return macronix_quad_enable(flash);
+	case SFDP_QER_SR2_BIT1_BUGGY:
+	case SFDP_QER_SR2_BIT1_NO_RD:
+		return spansion_no_read_cr_quad_enable(flash);
+	case SFDP_QER_SR2_BIT1:
+		return spansion_quad_enable(flash);
+	case SFDP_QER_UNKNOWN:
+		break;
+	default:
+		printf("SF: Unsupported SFDP quad enable method %d\n",
+		       sfdp->qer);
+		return -EOPNOTSUPP;
+	}
+#endif
+
 	switch (JEDEC_MFR(info)) {
 #ifdef CONFIG_SPI_FLASH_MACRONIX
 	case SPI_FLASH_CFI_MFR_MACRONIX:
@@ -945,8 +1470,157 @@ static int set_quad_mode(struct spi_flash *flash,
 	default:
 		printf("SF: Need set QEB func for %02x flash\n",
 		       JEDEC_MFR(info));
-		return -1;
+		return -EOPNOTSUPP;
+	}
+}
+
+/*
+ * Add an erase type to the planner's list. Types must be added largest
+ * first; anything which is not smaller than the last type, or smaller than
+ * the minimum erase size, is ignored.
+ */
+static void spi_flash_add_erase_type(struct spi_flash *flash, int *count,
+				     u32 size, u8 cmd)
+{
+	struct spi_flash_erase_type *type;
+
+	if (*count >= SPI_FLASH_MAX_ERASE_TYPES || size < flash->erase_size)
+		return;
+	if (*count && size >= flash->erase_types[*count - 1].size)
+		return;
+
+	type = &flash->erase_types[(*count)++];
+	type->size = size;
+	type->cmd = cmd;
+}
+
+static u8 spi_flash_cmd_4b(u8 cmd)
+{
+	static const u8 cmds[][2] = {
+		{ CMD_READ_ARRAY_SLOW, CMD_READ_ARRAY_SLOW_4B },
+		{ CMD_READ_ARRAY_FAST, CMD_READ_ARRAY_FAST_4B },
+		{ CMD_READ_DUAL_OUTPUT_FAST, CMD_READ_DUAL_OUTPUT_FAST_4B },
+		{ CMD_READ_DUAL_IO_FAST, CMD_READ_DUAL_IO_FAST_4B },
+		{ CMD_READ_QUAD_OUTPUT_FAST, CMD_READ_QUAD_OUTPUT_FAST_4B },
+		{ CMD_READ_QUAD_IO_FAST, CMD_READ_QUAD_IO_FAST_4B },
+		{ CMD_PAGE_PROGRAM, CMD_PAGE_PROGRAM_4B },
+		{ CMD_QUAD_PAGE_PROGRAM, CMD_QUAD_PAGE_PROGRAM_4B },
+		{ CMD_ERASE_4K, CMD_ERASE_4K_4B },
+		{ CMD_ERASE_32K, CMD_ERASE_32K_4B },
+		{ CMD_ERASE_64K, CMD_ERASE_64K_4B },
+	};
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(cmds); i++) {
+		if (cmds[i][0] == cmd)
+			return cmds[i][1];
 	}
+
+	return 0;
+}
+
+#ifdef CONFIG_SPI_FLASH_4B_OPCODES
+/*
+ * Switch to the 4-byte address commands, so that the whole flash can be
+ * reached without a bank register. The flash itself stays in 3-byte
+ * address mode, which is what a boot ROM expects after a reset.
+ *
+ * Erase types without a 4-byte command are dropped from the planner.
+ */
+static int spi_flash_set_4b_cmds(struct spi_flash *flash,
+				 const struct spi_flash_info *info)
+{
+	struct spi_flash_erase_type *types = flash->erase_types;
+	u8 read_cmd, write_cmd, erase_cmd;
+	int i, count;
+
+	read_cmd = spi_flash_cmd_4b(flash->read_cmd);
+	write_cmd = spi_flash_cmd_4b(flash->write_cmd);
+	erase_cmd = spi_flash_cmd_4b(flash->erase_cmd);
+	/*
+	 * Macronix only has the 1-4-4 version of quad page program (0x3e),
+	 * which needs the address on four lines as well. Program on one line.
+	 */
+	if (write_cmd == CMD_QUAD_PAGE_PROGRAM_4B &&
+	    JEDEC_MFR(info) == SPI_FLASH_CFI_MFR_MACRONIX)
+		write_cmd = CMD_PAGE_PROGRAM_4B;
+	if (!read_cmd || !write_cmd || !erase_cmd)
+		return -EINVAL;
+
+	flash->read_cmd = read_cmd;
+	flash->write_cmd = write_cmd;
+	flash->erase_cmd = erase_cmd;
+	for (i = 0, count = 0; i < SPI_FLASH_MAX_ERASE_TYPES; i++) {
+		u8 cmd = spi_flash_cmd_4b(types[i].cmd);
+
+		if (!types[i].size || !cmd)
+			continue;
+		types[count].size = types[i].size;
+		types[count++].cmd = cmd;
+	}
+	for (; count < SPI_FLASH_MAX_ERASE_TYPES; count++)
+		types[count].size = 0;
+	flash->addr_width = SPI_FLASH_4B_ADDR_LEN;
+
+	return 0;
+}
+#endif
+
+int spi_flash_set_read_mode(struct spi_flash *flash,
+			    enum spi_flash_read_mode mode)
+{
+	static const u8 cmds[SPI_FLASH_READ_MODE_COUNT] = {
+		[SPI_FLASH_READ_SLOW] = CMD_READ_ARRAY_SLOW,
+		[SPI_FLASH_READ_FAST] = CMD_READ_ARRAY_FAST,
+		[SPI_FLASH_READ_DUAL] = CMD_READ_DUAL_OUTPUT_FAST,
+		[SPI_FLASH_READ_QUAD] = CMD_READ_QUAD_OUTPUT_FAST,
+	};
+	struct spi_slave *spi = flash->spi;
+	u8 cmd;
+
+	switch (mode) {
+	case SPI_FLASH_READ_SLOW:
+	case SPI_FLASH_READ_FAST:
+		break;
+	case SPI_FLASH_READ_DUAL:
+		if (!(flash->flags & SNOR_F_RD_DUAL) ||
+		    !(spi->mode & SPI_RX_DUAL))
+			return -ENOTSUPP;
+		break;
+	case SPI_FLASH_READ_QUAD:
+		/* Quad reads also need the quad enable bit set at probe */
+		if (!(flash->flags & SNOR_F_RD_QUAD) ||
+		    !(flash->flags & SNOR_F_QUAD_EN) ||
+		    !(spi->mode & SPI_RX_QUAD))
+			return -ENOTSUPP;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	cmd = cmds[mode];
+	if (flash->addr_width == SPI_FLASH_4B_ADDR_LEN)
+		cmd = spi_flash_cmd_4b(cmd);
+	if (!cmd)
+		return -ENOTSUPP;
+
+	flash->read_cmd = cmd;
+	switch (mode) {
+	case SPI_FLASH_READ_SLOW:
+		flash->dummy_byte = 0;
+		break;
+	case SPI_FLASH_READ_DUAL:
+		flash->dummy_byte = flash->dual_dummy;
+		break;
+	case SPI_FLASH_READ_QUAD:
+		flash->dummy_byte = flash->quad_dummy;
+		break;
+	default:
+		flash->dummy_byte = 1;
+		break;
+	}
+
+	return 0;
 }
 
 #if CONFIG_IS_ENABLED(OF_CONTROL)
@@ -973,15 +1647,85 @@ int spi_flash_decode_fdt(struct spi_flash *flash)
 }
 #endif /* CONFIG_IS_ENABLED(OF_CONTROL) */
 
+static void spi_flash_set_timing(struct spi_flash *flash,
+				 enum spi_flash_op op, u32 typ_us, u32 max_ms,
+				 bool part)
+{
+	struct spi_flash_timing *t = &flash->timing[op];
+
+	memset(t, '\0', sizeof(*t));
+	t->typ_us = typ_us;
+	t->max_ms = max_ms;
+	t->wait_us = part ? typ_us / 4 * 3 : 0;
+}
+
+/*
+ * Set up the busy time model. SFDP gives the typical and maximum times of
+ * the part; otherwise use typical values, with erases taking longer the
+ * more they erase. These are only a guess, so they are not waited for
+ * before polling. The timeouts are never made shorter than the defaults.
+ */
+static void spi_flash_init_timing(struct spi_flash *flash,
+				  const struct spi_flash_sfdp *sfdp)
+{
+	u32 size, typ_us, max_ms;
+	bool part;
+	int i, j;
+
+	typ_us = SPI_FLASH_PROG_TYP_US;
+	max_ms = SPI_FLASH_PROG_TIMEOUT;
+	part = sfdp && sfdp->pp_typ_us;
+	if (part) {
+		typ_us = sfdp->pp_typ_us;
+		max_ms = max_t(u32, max_ms, DIV_ROUND_UP(sfdp->pp_max_us, 1000));
+	}
+	spi_flash_set_timing(flash, SPI_FLASH_OP_PROGRAM, typ_us, max_ms, part);
+
+	for (i = 0; i < SPI_FLASH_MAX_ERASE_TYPES; i++) {
+		size = flash->erase_types[i].size >> flash->shift;
+		typ_us = SPI_FLASH_ERASE_TYP_US +
+			 (size >> 10) * SPI_FLASH_ERASE_TYP_US_KB;
+		max_ms = SPI_FLASH_PAGE_ERASE_TIMEOUT;
+		part = false;
+		for (j = 0; sfdp && j < SPI_FLASH_MAX_ERASE_TYPES; j++) {
+			if (sfdp->erase_types[j].size != size ||
+			    !sfdp->erase_typ_ms[j])
+				continue;
+			typ_us = sfdp->erase_typ_ms[j] * 1000;
+			max_ms = max(max_ms, sfdp->erase_max_ms[j]);
+			part = true;
+		}
+		spi_flash_set_timing(flash, SPI_FLASH_OP_ERASE + i, typ_us,
+				     max_ms, part);
+	}
+
+	typ_us = (flash->size >> 20) * SPI_FLASH_CHIP_ERASE_TYP_MS_MB * 1000;
+	max_ms = max_t(u32, SPI_FLASH_SECTOR_ERASE_TIMEOUT,
+		       (flash->size >> 20) * SPI_FLASH_CHIP_ERASE_TIMEOUT_MB);
+	part = sfdp && sfdp->chip_erase_typ_ms;
+	if (part) {
+		typ_us = sfdp->chip_erase_typ_ms * 1000;
+		max_ms = max(max_ms, sfdp->chip_erase_max_ms);
+	}
+	spi_flash_set_timing(flash, SPI_FLASH_OP_CHIP_ERASE, typ_us, max_ms,
+			     part);
+}
+
 int spi_flash_scan(struct spi_flash *flash)
 {
 	struct spi_slave *spi = flash->spi;
 	const struct spi_flash_info *info = NULL;
+	const struct spi_flash_sfdp *params = NULL;
+	struct spi_flash_sfdp sfdp;
+	int count;
 	int ret;
+	int i;
 
-	info = spi_flash_read_id(flash);
+	info = spi_flash_read_id(flash, &sfdp);
 	if (IS_ERR_OR_NULL(info))
 		return -ENOENT;
+	if (info == &sfdp.info)
+		params = &sfdp;
 
 	/*
 	 * Flash powers up read-only, so clear BP# bits.
@@ -1008,6 +1752,10 @@ int spi_flash_scan(struct spi_flash *flash)
 
 	if (info->flags & SST_WR)
 		flash->flags |= SNOR_F_SST_WR;
+	if (info->flags & RD_DUAL)
+		flash->flags |= SNOR_F_RD_DUAL;
+	if (info->flags & RD_QUAD)
+		flash->flags |= SNOR_F_RD_QUAD;
 
 #ifndef CONFIG_DM_SPI_FLASH
 	flash->write = spi_flash_cmd_write_ops;
@@ -1067,6 +1815,35 @@ int spi_flash_scan(struct spi_flash *flash)
 		flash->erase_size = flash->sector_size;
 	}
 
+	/* Erase types for the planner, largest first */
+	count = 0;
+	if (params) {
+		const struct spi_flash_erase_type *type = params->erase_types;
+
+		for (i = 0; i < SPI_FLASH_MAX_ERASE_TYPES; i++, type++)
+			spi_flash_add_erase_type(flash, &count,
+						 type->size << flash->shift,
+						 type->cmd);
+	} else {
+		spi_flash_add_erase_type(flash, &count, flash->sector_size,
+					 CMD_ERASE_64K);
+		if (info->flags & SECT_32K)
+			spi_flash_add_erase_type(flash, &count,
+						 SZ_32K << flash->shift,
+						 CMD_ERASE_32K);
+		spi_flash_add_erase_type(flash, &count, flash->erase_size,
+					 flash->erase_cmd);
+	}
+
+	/*
+	 * Use chip erase only if the part has it (all SFDP parts do) and the
+	 * controller can send it. It only reaches one die of a stacked pair.
+	 */
+	if ((info->flags & E_CHIP || params) &&
+	    !(spi->flash_cmds & SPI_FLASH_CMDS_NO_CHIP_ERASE) &&
+	    !(flash->dual_flash & SF_DUAL_STACKED_FLASH))
+		flash->flags |= SNOR_F_CHIP_ERASE;
+
 	/* Now erase size becomes valid sector size */
 	flash->sector_size = flash->erase_size;
 
@@ -1090,11 +1867,20 @@ int spi_flash_scan(struct spi_flash *flash)
 	if ((flash->read_cmd == CMD_READ_QUAD_OUTPUT_FAST) ||
 	    (flash->read_cmd == CMD_READ_QUAD_IO_FAST) ||
 	    (flash->write_cmd == CMD_QUAD_PAGE_PROGRAM)) {
-		ret = set_quad_mode(flash, info);
-		if (ret) {
+		ret = set_quad_mode(flash, info, params);
+		if (ret == -EOPNOTSUPP) {
+			/* Carry on with one or two data lines */
+			if (spi->mode & SPI_RX_DUAL && info->flags & RD_DUAL)
+				flash->read_cmd = CMD_READ_DUAL_OUTPUT_FAST;
+			else
+				flash->read_cmd = CMD_READ_ARRAY_FAST;
+			flash->write_cmd = CMD_PAGE_PROGRAM;
+		} else if (ret) {
 			debug("SF: Fail to set QEB for %02x\n",
 			      JEDEC_MFR(info));
 			return -EINVAL;
+		} else {
+			flash->flags |= SNOR_F_QUAD_EN;
 		}
 	}
 
@@ -1117,16 +1903,52 @@ int spi_flash_scan(struct spi_flash *flash)
 		flash->dummy_byte = 1;
 	}
 
+	/* SFDP gives the dummy cycles for the dual and quad reads */
+	flash->dual_dummy = params ? params->dual_dummy : 1;
+	flash->quad_dummy = params ? params->quad_dummy : 1;
+	if (flash->read_cmd == CMD_READ_DUAL_OUTPUT_FAST)
+		flash->dummy_byte = flash->dual_dummy;
+	else if (flash->read_cmd == CMD_READ_QUAD_OUTPUT_FAST)
+		flash->dummy_byte = flash->quad_dummy;
+
 #ifdef CONFIG_SPI_FLASH_STMICRO
 	if (info->flags & E_FSR)
 		flash->flags |= SNOR_F_USE_FSR;
 #endif
 
+	/*
+	 * Use 4-byte address commands for the part beyond 16MiB if the part
+	 * has them and the controller can send them. Otherwise the bank
+	 * register is used, if enabled.
+	 */
+	flash->addr_width = SPI_FLASH_3B_ADDR_LEN;
+#ifdef CONFIG_SPI_FLASH_4B_OPCODES
+	if (info->flags & ADDR_4B &&
+	    !(spi->flash_cmds & SPI_FLASH_CMDS_NO_ADDR_4B) &&
+	    flash->size > SPI_FLASH_16MB_BOUN << flash->shift) {
+		ret = spi_flash_set_4b_cmds(flash, info);
+		if (ret)
+			debug("SF: No 4-byte address cmds for %s\n",
+			      flash->name);
+	}
+#endif
+
+	/*
+	 * The ID table has no busy times, so take those from SFDP when a
+	 * part in the table has it
+	 */
+	if (!params && !spi_flash_read_sfdp(flash, info->id, &sfdp))
+		spi_flash_init_timing(flash, &sfdp);
+	else
+		spi_flash_init_timing(flash, params);
+
 	/* Configure the BAR - discover bank cmds and read current bank */
 #ifdef CONFIG_SPI_FLASH_BAR
-	ret = read_bar(flash, info);
-	if (ret < 0)
-		return ret;
+	if (flash->addr_width == SPI_FLASH_3B_ADDR_LEN) {
+		ret = read_bar(flash, info);
+		if (ret < 0)
+			return ret;
+	}
 #endif
 
 #if CONFIG_IS_ENABLED(OF_CONTROL) && !CONFIG_IS_ENABLED(OF_PLATDATA)
@@ -1148,10 +1970,11 @@ int spi_flash_scan(struct spi_flash *flash)
 #endif
 
 #ifndef CONFIG_SPI_FLASH_BAR
-	if (((flash->dual_flash == SF_SINGLE_FLASH) &&
-	     (flash->size > SPI_FLASH_16MB_BOUN)) ||
+	if (flash->addr_width == SPI_FLASH_3B_ADDR_LEN &&
+	    (((flash->dual_flash == SF_SINGLE_FLASH) &&
+	      (flash->size > SPI_FLASH_16MB_BOUN)) ||
 	     ((flash->dual_flash > SF_SINGLE_FLASH) &&
-	     (flash->size > SPI_FLASH_16MB_BOUN << 1))) {
+	      (flash->size > SPI_FLASH_16MB_BOUN << 1)))) {
 		puts("SF: Warning - Only lower 16MiB accessible,");
 		puts(" Full access #define CONFIG_SPI_FLASH_BAR\n");
 	}
@@ -11,27 +11,88 @@
 #include <dm.h>
 #include <malloc.h>
 #include <net.h>
+#include <asm/eth.h>
 #include <asm/test.h>
+#include <asm/unaligned.h>
 
 DECLARE_GLOBAL_DATA_PTR;
 
+/* Enough for a TFTP window, plus what is left of the one before */
+#define SB_ETH_RX_PACKETS	16
+#define SB_ETH_TFTP_MAX_WINDOW	(SB_ETH_RX_PACKETS / 2)
+#define SB_ETH_TFTP_PORT	1069
+#define SB_ETH_NFS_MAX_WINDOW	(SB_ETH_RX_PACKETS / 2)
+#define SB_ETH_MOUNT_PORT	635
+#define SB_ETH_NFS_PORT		2049
+
 /**
  * struct eth_sandbox_priv - memory for sandbox mock driver
  *
  * fake_host_hwaddr: MAC address of mocked machine
  * fake_host_ipaddr: IP address of mocked machine
- * recv_packet_buffer: buffer of the packet returned as received
- * recv_packet_length: length of the packet returned as received
+ * recv_packet_buffer: ring of packets to return as received
+ * recv_packet_length: length of each packet in the ring
+ * recv_packets: number of packets queued in the ring
+ * recv_packet_next: index of the next packet to return
  */
 struct eth_sandbox_priv {
 	uchar fake_host_hwaddr[ARP_HLEN];
 	struct in_addr fake_host_ipaddr;
-	uchar *recv_packet_buffer;
-	int recv_packet_length;
+	uchar recv_packet_buffer[SB_ETH_RX_PACKETS][PKTSIZE_ALIGN];
+	int recv_packet_length[SB_ETH_RX_PACKETS];
+	int recv_packets;
+	int recv_packet_next;
+};
+
+/**
+ * struct eth_sandbox_tftp - a mock TFTP server for downloads
+ *
+ * data: file which is served, whatever the name asked for
+ * size: size of the file in bytes
+ * drop_block: block to drop the first time it is sent, or 0 for none
+ * blksize: block size agreed with the client
+ * windowsize: window size agreed with the client
+ * acks: number of ACKs received from the client
+ */
+struct eth_sandbox_tftp {
+	const void *data;
+	size_t size;
+	int drop_block;
+	uint blksize;
+	uint windowsize;
+	uint acks;
+};
+
+/**
+ * struct eth_sandbox_nfs - a mock NFSv2 server for downloads
+ *
+ * data: file which is served, whatever the name asked for
+ * size: size of the file in bytes
+ * max_read: most bytes returned by one READ, fewer than asked is allowed
+ * client: Ethernet, IP and UDP headers of the last READ, to reply to
+ * held: READs not yet answered, as {id, offset, count}
+ * held_count: number of READs held
+ * window: most READs received before the client polled for a reply
+ * reads: number of READs received
+ *
+ * READs are held until the client next polls for a packet, then answered
+ * last first, so the window is seen and the replies come out of order.
+ */
+struct eth_sandbox_nfs {
+	const void *data;
+	size_t size;
+	uint max_read;
+	uchar client[ETHER_HDR_SIZE + IP_UDP_HDR_SIZE];
+	u32 held[SB_ETH_NFS_MAX_WINDOW][3];
+	uint held_count;
+	uint window;
+	uint reads;
 };
 
 static bool disabled[8] = {false};
 static bool skip_timeout;
+static struct eth_sandbox_tftp tftp_server;
+static struct eth_sandbox_nfs nfs_server;
 
 /*
  * sandbox_eth_disable_response()
@@ -54,16 +115,365 @@ void sandbox_eth_skip_timeout(void)
 	skip_timeout = true;
 }
 
+/*
+ * sandbox_eth_tftp_serve()
+ *
+ * data - File to serve to TFTP read requests, or NULL to ignore them
+ * size - Size of the file in bytes
+ * drop_block - Block to drop the first time it is sent, or 0 for none
+ */
+void sandbox_eth_tftp_serve(const void *data, size_t size, int drop_block)
+{
+	memset(&tftp_server, '\0', sizeof(tftp_server));
+	tftp_server.data = data;
+	tftp_server.size = size;
+	tftp_server.drop_block = drop_block;
+}
+
+/*
+ * sandbox_eth_tftp_stats()
+ *
+ * windowsizep - Returns the window size agreed in the last transfer
+ * acksp - Returns the number of ACKs received in the last transfer
+ */
+void sandbox_eth_tftp_stats(uint *windowsizep, uint *acksp)
+{
+	*windowsizep = tftp_server.windowsize;
+	*acksp = tftp_server.acks;
+}
+
+/*
+ * sandbox_eth_nfs_serve()
+ *
+ * data - File to serve to NFS READs, or NULL to ignore NFS requests
+ * size - Size of the file in bytes
+ * max_read - Most bytes to return from one READ
+ */
+void sandbox_eth_nfs_serve(const void *data, size_t size, uint max_read)
+{
+	memset(&nfs_server, '\0', sizeof(nfs_server));
+	nfs_server.data = data;
+	nfs_server.size = size;
+	nfs_server.max_read = max_read;
+}
+
+/*
+ * sandbox_eth_nfs_stats()
+ *
+ * windowp - Returns the most READs sent at once in the last transfer
+ * readsp - Returns the number of READs received in the last transfer
+ */
+void sandbox_eth_nfs_stats(uint *windowp, uint *readsp)
+{
+	*windowp = nfs_server.window;
+	*readsp = nfs_server.reads;
+}
+
+/*
+ * Get the buffer for the next packet to return as received, if there is room.
+ * The packet last returned may still be being handled, so is kept.
+ */
+static uchar *sb_eth_recv_buffer(struct eth_sandbox_priv *priv)
+{
+	if (priv->recv_packets == SB_ETH_RX_PACKETS - 1)
+		return NULL;
+
+	return priv->recv_packet_buffer[(priv->recv_packet_next +
+					 priv->recv_packets) %
+					SB_ETH_RX_PACKETS];
+}
+
+static void sb_eth_recv_queue(struct eth_sandbox_priv *priv, int length)
+{
+	priv->recv_packet_length[(priv->recv_packet_next +
+				  priv->recv_packets) % SB_ETH_RX_PACKETS] =
+		length;
+	priv->recv_packets++;
+}
+
+/*
+ * Queue a UDP packet from the fake host in reply to 'packet', with 'len'
+ * bytes of payload already placed after the headers in 'buf'
+ */
+static void sb_eth_udp_reply(struct eth_sandbox_priv *priv, uchar *buf,
+			     void *packet, int sport, int len)
+{
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	struct ethernet_hdr *eth_recv = (void *)buf;
+	struct ip_udp_hdr *ipr = (void *)buf + ETHER_HDR_SIZE;
+
+	memcpy(eth_recv->et_dest, eth->et_src, ARP_HLEN);
+	memcpy(eth_recv->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth_recv->et_protlen = htons(PROT_IP);
+
+	net_set_ip_header((uchar *)ipr, net_read_ip(&ip->ip_src),
+			  priv->fake_host_ipaddr);
+	ipr->ip_len = htons(IP_UDP_HDR_SIZE + len);
+	ipr->ip_p = IPPROTO_UDP;
+	ipr->ip_sum = compute_ip_checksum(ipr, IP_HDR_SIZE);
+	ipr->udp_src = htons(sport);
+	ipr->udp_dst = ip->udp_src;
+	ipr->udp_len = htons(UDP_HDR_SIZE + len);
+	ipr->udp_xsum = 0;
+
+	sb_eth_recv_queue(priv, ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + len);
+}
+
+/* Send the window of blocks after 'block', as a server does for an ACK */
+static void sb_eth_tftp_send_window(struct eth_sandbox_priv *priv,
+				    void *packet, uint block)
+{
+	struct eth_sandbox_tftp *tftp = &tftp_server;
+	uint last = tftp->size / tftp->blksize + 1;
+	uint i, len;
+	ulong offset;
+	uchar *buf;
+
+	for (i = 1; i <= tftp->windowsize && block + i <= last; i++) {
+		if (block + i == tftp->drop_block) {
+			debug("eth_sandbox: TFTP dropping block %u\n",
+			      block + i);
+			tftp->drop_block = 0;
+			continue;
+		}
+		buf = sb_eth_recv_buffer(priv);
+		if (!buf)
+			return;
+		offset = (ulong)(block + i - 1) * tftp->blksize;
+		len = min_t(ulong, tftp->size - offset, tftp->blksize);
+		buf += ETHER_HDR_SIZE + IP_UDP_HDR_SIZE;
+		put_unaligned_be16(3, buf);		/* DATA */
+		put_unaligned_be16(block + i, buf + 2);
+		memcpy(buf + 4, tftp->data + offset, len);
+		sb_eth_udp_reply(priv, buf - ETHER_HDR_SIZE - IP_UDP_HDR_SIZE,
+				 packet, SB_ETH_TFTP_PORT, 4 + len);
+	}
+}
+
+/*
+ * Handle a TFTP packet: a read request gets an OACK with the options the
+ * mock server agrees to, and an ACK gets the window of blocks after it.
+ * Blocks are numbered from 1 and the file is small enough not to wrap.
+ */
+static void sb_eth_tftp(struct eth_sandbox_priv *priv, void *packet,
+			int length)
+{
+	struct eth_sandbox_tftp *tftp = &tftp_server;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	char *pkt = packet + ETHER_HDR_SIZE + IP_UDP_HDR_SIZE;
+	char *end = packet + length;
+	char *opt, *val;
+	uchar *buf;
+	int len;
+
+	if (!tftp->data)
+		return;
+
+	switch (get_unaligned_be16(pkt)) {
+	case 1:		/* RRQ */
+		if (ntohs(ip->udp_dst) != 69)
+			return;
+		tftp->blksize = 512;
+		tftp->windowsize = 1;
+		tftp->acks = 0;
+		buf = sb_eth_recv_buffer(priv);
+		if (!buf)
+			return;
+		buf += ETHER_HDR_SIZE + IP_UDP_HDR_SIZE;
+		put_unaligned_be16(6, buf);		/* OACK */
+		len = 2;
+
+		/* Skip the file name and mode, then look at the options */
+		opt = pkt + 2;
+		opt += strnlen(opt, end - opt) + 1;
+		opt += strnlen(opt, end - opt) + 1;
+		while (opt < end) {
+			val = opt + strnlen(opt, end - opt) + 1;
+			if (val >= end)
+				break;
+			if (!strcmp(opt, "blksize")) {
+				tftp->blksize = simple_strtoul(val, NULL, 10);
+				len += sprintf((char *)buf + len, "blksize%c%u",
+					       0, tftp->blksize) + 1;
+			} else if (!strcmp(opt, "windowsize")) {
+				tftp->windowsize = min_t(uint,
+					simple_strtoul(val, NULL, 10),
+					SB_ETH_TFTP_MAX_WINDOW);
+				len += sprintf((char *)buf + len,
+					       "windowsize%c%u", 0,
+					       tftp->windowsize) + 1;
+			}
+			opt = val + strnlen(val, end - val) + 1;
+		}
+		sb_eth_udp_reply(priv, buf - ETHER_HDR_SIZE - IP_UDP_HDR_SIZE,
+				 packet, SB_ETH_TFTP_PORT, len);
+		break;
+	case 4:		/* ACK */
+		if (ntohs(ip->udp_dst) != SB_ETH_TFTP_PORT)
+			return;
+		tftp->acks++;
+		sb_eth_tftp_send_window(priv, packet,
+					get_unaligned_be16(pkt + 2));
+		break;
+	}
+}
+
+/* Start an RPC reply to call 'id' in 'buf', returning its length so far */
+static int sb_eth_rpc_reply(uchar *buf, u32 id)
+{
+	put_unaligned_be32(id, buf);
+	put_unaligned_be32(1, buf + 4);		/* MSG_REPLY */
+	memset(buf + 8, '\0', 16);	/* accepted, no verifier, success */
+
+	return 24;
+}
+
+/* Answer a READ of 'count' bytes at 'offset', addressed as 'packet' */
+static void sb_eth_nfs_read_reply(struct eth_sandbox_priv *priv,
+				  void *packet, u32 id, u32 offset, u32 count)
+{
+	struct eth_sandbox_nfs *nfs = &nfs_server;
+	uchar *buf = sb_eth_recv_buffer(priv);
+	uint rlen = 0;
+	int len;
+
+	if (!buf)
+		return;
+	if (offset < nfs->size)
+		rlen = min3(count, nfs->max_read, (u32)(nfs->size - offset));
+
+	buf += ETHER_HDR_SIZE + IP_UDP_HDR_SIZE;
+	len = sb_eth_rpc_reply(buf, id);
+	memset(buf + len, '\0', 4 + 68);	/* NFS_OK, file attributes */
+	len += 4 + 68;
+	put_unaligned_be32(rlen, buf + len);
+	len += 4;
+	memcpy(buf + len, nfs->data + offset, rlen);
+	memset(buf + len + rlen, '\0', ALIGN(rlen, 4) - rlen);
+	len += ALIGN(rlen, 4);
+	sb_eth_udp_reply(priv, buf - ETHER_HDR_SIZE - IP_UDP_HDR_SIZE,
+			 packet, SB_ETH_NFS_PORT, len);
+}
+
+/* Answer the READs being held, last first */
+static void sb_eth_nfs_flush(struct eth_sandbox_priv *priv)
+{
+	struct eth_sandbox_nfs *nfs = &nfs_server;
+	u32 *held;
+
+	while (nfs->held_count) {
+		held = nfs->held[--nfs->held_count];
+		sb_eth_nfs_read_reply(priv, nfs->client, held[0], held[1],
+				      held[2]);
+	}
+}
+
+/*
+ * Handle an RPC call to the portmapper, mount daemon or NFS server. This
+ * is just enough to look up the ports, mount, look up any file and read it
+ * with NFSv2; the file handles are all zero.
+ */
+static void sb_eth_nfs(struct eth_sandbox_priv *priv, void *packet,
+		       int length)
+{
+	struct eth_sandbox_nfs *nfs = &nfs_server;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	uchar *pkt = packet + ETHER_HDR_SIZE + IP_UDP_HDR_SIZE;
+	uchar *end = packet + length;
+	uint dport = ntohs(ip->udp_dst);
+	u32 id, prog, proc, port;
+	uchar *arg, *buf;
+	int len;
+
+	if (!nfs->data || end - pkt < 24)
+		return;
+	id = get_unaligned_be32(pkt);
+	if (get_unaligned_be32(pkt + 4) != 0)		/* MSG_CALL */
+		return;
+	prog = get_unaligned_be32(pkt + 12);
+	proc = get_unaligned_be32(pkt + 20);
+
+	/* Skip the credential and the verifier */
+	arg = pkt + 24;
+	if (end - arg < 8)
+		return;
+	arg += 8 + ALIGN(get_unaligned_be32(arg + 4), 4);
+	if (end - arg < 8)
+		return;
+	arg += 8 + ALIGN(get_unaligned_be32(arg + 4), 4);
+
+	if (dport == SB_ETH_NFS_PORT && prog == 100003 && proc == 6) {
+		/* READ: file handle, offset, count and total count */
+		if (end - arg < 32 + 12)
+			return;
+		nfs->reads++;
+		if (nfs->held_count == SB_ETH_NFS_MAX_WINDOW) {
+			sb_eth_nfs_read_reply(priv, packet, id,
+					      get_unaligned_be32(arg + 32),
+					      get_unaligned_be32(arg + 36));
+			return;
+		}
+		memcpy(nfs->client, packet, sizeof(nfs->client));
+		nfs->held[nfs->held_count][0] = id;
+		nfs->held[nfs->held_count][1] = get_unaligned_be32(arg + 32);
+		nfs->held[nfs->held_count][2] = get_unaligned_be32(arg + 36);
+		nfs->held_count++;
+		nfs->window = max(nfs->window, nfs->held_count);
+		return;
+	}
+
+	buf = sb_eth_recv_buffer(priv);
+	if (!buf)
+		return;
+	buf += ETHER_HDR_SIZE + IP_UDP_HDR_SIZE;
+	len = sb_eth_rpc_reply(buf, id);
+
+	if (dport == 111 && prog == 100000 && proc == 3) {
+		/* GETPORT of the mount daemon or NFS server */
+		if (end - arg < 4)
+			return;
+		switch (get_unaligned_be32(arg)) {
+		case 100005:
+			port = SB_ETH_MOUNT_PORT;
+			break;
+		case 100003:
+			port = SB_ETH_NFS_PORT;
+			break;
+		default:
+			port = 0;
+		}
+		put_unaligned_be32(port, buf + len);
+		len += 4;
+	} else if (dport == SB_ETH_MOUNT_PORT && prog == 100005 && proc == 1) {
+		/* MNT: status and directory handle */
+		memset(buf + len, '\0', 4 + 32);
+		len += 4 + 32;
+	} else if (dport == SB_ETH_MOUNT_PORT && prog == 100005 && proc == 4) {
+		/* UMNTALL: nothing more */
+	} else if (dport == SB_ETH_NFS_PORT && prog == 100003 && proc == 4) {
+		/* LOOKUP: status, file handle and file attributes */
+		memset(buf + len, '\0', 4 + 32 + 68);
+		len += 4 + 32 + 68;
+	} else {
+		return;
+	}
+	sb_eth_udp_reply(priv, buf - ETHER_HDR_SIZE - IP_UDP_HDR_SIZE,
+			 packet, dport, len);
+}
+
 static int sb_eth_start(struct udevice *dev)
 {
 	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	const u8 *hwaddr;
 
 	debug("eth_sandbox: Start\n");
 
-	fdtdec_get_byte_array(gd->fdt_blob, dev_of_offset(dev),
-			      "fake-host-hwaddr", priv->fake_host_hwaddr,
-			      ARP_HLEN);
-	priv->recv_packet_buffer = net_rx_packets[0];
+	hwaddr = dev_read_u8_array_ptr(dev, "fake-host-hwaddr", ARP_HLEN);
+	if (hwaddr)
+		memcpy(priv->fake_host_hwaddr, hwaddr, ARP_HLEN);
+	priv->recv_packets = 0;
+	priv->recv_packet_next = 0;
 	return 0;
 }
 
@@ -71,6 +481,7 @@ static int sb_eth_send(struct udevice *dev, void *packet, int length)
 {
 	struct eth_sandbox_priv *priv = dev_get_priv(dev);
 	struct ethernet_hdr *eth = packet;
+	uchar *buf;
 
 	debug("eth_sandbox: Send packet %d\n", length);
 
@@ -81,21 +492,21 @@ static int sb_eth_send(struct udevice *dev, void *packet, int length)
 	if (ntohs(eth->et_protlen) == PROT_ARP) {
 		struct arp_hdr *arp = packet + ETHER_HDR_SIZE;
 
-		if (ntohs(arp->ar_op) == ARPOP_REQUEST) {
+		buf = sb_eth_recv_buffer(priv);
+		if (ntohs(arp->ar_op) == ARPOP_REQUEST && buf) {
 			struct ethernet_hdr *eth_recv;
 			struct arp_hdr *arp_recv;
 
 			/* store this as the assumed IP of the fake host */
 			priv->fake_host_ipaddr = net_read_ip(&arp->ar_tpa);
 			/* Formulate a fake response */
-			eth_recv = (void *)priv->recv_packet_buffer;
+			eth_recv = (void *)buf;
 			memcpy(eth_recv->et_dest, eth->et_src, ARP_HLEN);
 			memcpy(eth_recv->et_src, priv->fake_host_hwaddr,
 			       ARP_HLEN);
 			eth_recv->et_protlen = htons(PROT_ARP);
 
-			arp_recv = (void *)priv->recv_packet_buffer +
-				ETHER_HDR_SIZE;
+			arp_recv = (void *)buf + ETHER_HDR_SIZE;
 			arp_recv->ar_hrd = htons(ARP_ETHER);
 			arp_recv->ar_pro = htons(PROT_IP);
 			arp_recv->ar_hln = ARP_HLEN;
@@ -107,26 +518,27 @@ static int sb_eth_send(struct udevice *dev, void *packet, int length)
 			memcpy(&arp_recv->ar_tha, &arp->ar_sha, ARP_HLEN);
 			net_copy_ip(&arp_recv->ar_tpa, &arp->ar_spa);
 
-			priv->recv_packet_length = ETHER_HDR_SIZE +
-				ARP_HDR_SIZE;
+			sb_eth_recv_queue(priv, ETHER_HDR_SIZE + ARP_HDR_SIZE);
 		}
 	} else if (ntohs(eth->et_protlen) == PROT_IP) {
 		struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
 
-		if (ip->ip_p == IPPROTO_ICMP) {
+		if (ip->ip_p == IPPROTO_UDP) {
+			sb_eth_tftp(priv, packet, length);
+			sb_eth_nfs(priv, packet, length);
+		} else if (ip->ip_p == IPPROTO_ICMP) {
 			struct icmp_hdr *icmp = (struct icmp_hdr *)&ip->udp_src;
 
-			if (icmp->type == ICMP_ECHO_REQUEST) {
+			buf = sb_eth_recv_buffer(priv);
+			if (icmp->type == ICMP_ECHO_REQUEST && buf) {
 				struct ethernet_hdr *eth_recv;
 				struct ip_udp_hdr *ipr;
 				struct icmp_hdr *icmpr;
 
 				/* reply to the ping */
-				memcpy(priv->recv_packet_buffer, packet,
-				       length);
-				eth_recv = (void *)priv->recv_packet_buffer;
-				ipr = (void *)priv->recv_packet_buffer +
-					ETHER_HDR_SIZE;
+				memcpy(buf, packet, length);
+				eth_recv = (void *)buf;
+				ipr = (void *)buf + ETHER_HDR_SIZE;
 				icmpr = (struct icmp_hdr *)&ipr->udp_src;
 				memcpy(eth_recv->et_dest, eth->et_src,
 				       ARP_HLEN);
@@ -145,7 +557,7 @@ static int sb_eth_send(struct udevice *dev, void *packet, int length)
 				icmpr->checksum = compute_ip_checksum(icmpr,
 					ICMP_HDR_SIZE);
 
-				priv->recv_packet_length = length;
+				sb_eth_recv_queue(priv, length);
 			}
 		}
 	}
@@ -162,14 +574,17 @@ static int sb_eth_recv(struct udevice *dev, int flags, uchar **packetp)
 		skip_timeout = false;
 	}
 
-	if (priv->recv_packet_length) {
-		int lcl_recv_packet_length = priv->recv_packet_length;
+	sb_eth_nfs_flush(priv);
+	if (priv->recv_packets) {
+		int i = priv->recv_packet_next;
+
+		priv->recv_packet_next = (i + 1) % SB_ETH_RX_PACKETS;
+		priv->recv_packets--;
 
 		debug("eth_sandbox: received packet %d\n",
-		      priv->recv_packet_length);
-		priv->recv_packet_length = 0;
-		*packetp = priv->recv_packet_buffer;
-		return lcl_recv_packet_length;
+		      priv->recv_packet_length[i]);
+		*packetp = priv->recv_packet_buffer[i];
+		return priv->recv_packet_length[i];
 	}
 	return 0;
 }
@@ -13,13 +13,17 @@
 #include <dm/device-internal.h>
 #include "nvme.h"
 
-#define NVME_Q_DEPTH		2
+#define NVME_Q_DEPTH		16
 #define NVME_AQ_DEPTH		2
 #define NVME_SQ_SIZE(depth)	(depth * sizeof(struct nvme_command))
 #define NVME_CQ_SIZE(depth)	(depth * sizeof(struct nvme_completion))
 #define ADMIN_TIMEOUT		60
 #define IO_TIMEOUT		30
-#define MAX_PRP_POOL		512
+/*
+ * Largest transfer for one I/O command. Its PRP list then always fits in a
+ * single page, so each outstanding command needs just one page of PRP list.
+ */
+#define NVME_MAX_XFER_SHIFT	20
 
 enum nvme_queue_id {
 	NVME_ADMIN_Q,
@@ -66,12 +70,24 @@ static int nvme_wait_ready(struct nvme_dev *dev, bool enabled)
 	return -ETIME;
 }
 
-static int nvme_setup_prps(struct nvme_dev *dev, u64 *prp2,
+/**
+ * nvme_setup_prps() - work out the second PRP entry for a transfer
+ *
+ * If the transfer covers more than two pages, a PRP list is built in
+ * @prp_list and @prp2 points to it.
+ *
+ * @dev:	NVMe device
+ * @prp_list:	PRP list to use, which holds dev->prp_entry_num entries
+ * @prp2:	Returns the value for the second PRP entry of the command
+ * @total_len:	Length of the transfer in bytes
+ * @dma_addr:	Address of the buffer to transfer
+ * @return 0 if OK, -EINVAL if the transfer needs too many PRP entries
+ */
+static int nvme_setup_prps(struct nvme_dev *dev, u64 *prp_list, u64 *prp2,
 			   int total_len, u64 dma_addr)
 {
 	u32 page_size = dev->page_size;
 	int offset = dma_addr & (page_size - 1);
-	u64 *prp_pool;
 	int length = total_len;
 	int i, nprps;
 	length -= (page_size - offset);
@@ -90,31 +106,16 @@ static int nvme_setup_prps(struct nvme_dev *dev, u64 *prp2,
 	}
 
 	nprps = DIV_ROUND_UP(length, page_size);
+	if (nprps > dev->prp_entry_num)
+		return -EINVAL;
 
-	if (nprps > dev->prp_entry_num) {
-		free(dev->prp_pool);
-		dev->prp_pool = malloc(nprps << 3);
-		if (!dev->prp_pool) {
-			printf("Error: malloc prp_pool fail\n");
-			return -ENOMEM;
-		}
-		dev->prp_entry_num = nprps;
-	}
-
-	prp_pool = dev->prp_pool;
-	i = 0;
-	while (nprps) {
-		if (i == ((page_size >> 3) - 1)) {
-			*(prp_pool + i) = cpu_to_le64((ulong)prp_pool +
-					page_size);
-			i = 0;
-			prp_pool += page_size;
-		}
-		*(prp_pool + i++) = cpu_to_le64(dma_addr);
+	for (i = 0; i < nprps; i++) {
+		prp_list[i] = cpu_to_le64(dma_addr);
 		dma_addr += page_size;
-		nprps--;
 	}
-	*prp2 = (ulong)dev->prp_pool;
+	flush_dcache_range((ulong)prp_list,
+			   (ulong)prp_list + ALIGN(nprps << 3, ARCH_DMA_MINALIGN));
+	*prp2 = (ulong)prp_list;
 
 	return 0;
 }
@@ -137,12 +138,15 @@ static u16 nvme_read_completion_status(struct nvme_queue *nvmeq, u16 index)
 }
 
 /**
- * nvme_submit_cmd() - copy a command into a queue and ring the doorbell
+ * nvme_queue_cmd() - copy a command into a queue without ringing the doorbell
+ *
+ * The controller does not see the command until the doorbell is written
+ * with the new tail, so several commands can be sent together.
  *
  * @nvmeq:	The queue to use
- * @cmd:	The command to send
+ * @cmd:	The command to add
  */
-static void nvme_submit_cmd(struct nvme_queue *nvmeq, struct nvme_command *cmd)
+static void nvme_queue_cmd(struct nvme_queue *nvmeq, struct nvme_command *cmd)
 {
 	u16 tail = nvmeq->sq_tail;
 
@@ -152,10 +156,70 @@ static void nvme_submit_cmd(struct nvme_queue *nvmeq, struct nvme_command *cmd)
 
 	if (++tail == nvmeq->q_depth)
 		tail = 0;
-	writel(tail, nvmeq->q_db);
 	nvmeq->sq_tail = tail;
 }
 
+/**
+ * nvme_submit_cmd() - copy a command into a queue and ring the doorbell
+ *
+ * @nvmeq:	The queue to use
+ * @cmd:	The command to send
+ */
+static void nvme_submit_cmd(struct nvme_queue *nvmeq, struct nvme_command *cmd)
+{
+	nvme_queue_cmd(nvmeq, cmd);
+	writel(nvmeq->sq_tail, nvmeq->q_db);
+}
+
+/**
+ * nvme_reap_cmds() - collect the completions posted to a queue
+ *
+ * This waits for at least one completion, then takes every completion that
+ * has been posted and writes the head doorbell once for all of them.
+ *
+ * @nvmeq:	The queue to use
+ * @cmd_ids:	Returns the command ID of each completion
+ * @status:	Returns the status of each completion, 0 if it succeeded
+ * @max:	Maximum number of completions to collect
+ * @timeout:	Time to wait for the first completion
+ * @return number of completions collected, or -ETIMEDOUT
+ */
+static int nvme_reap_cmds(struct nvme_queue *nvmeq, u16 *cmd_ids, u16 *status,
+			  int max, unsigned timeout)
+{
+	u16 head = nvmeq->cq_head;
+	u16 phase = nvmeq->cq_phase;
+	ulong start_time;
+	ulong timeout_us = timeout * 100000;
+	u16 cqe_status;
+	int count = 0;
+
+	start_time = timer_get_us();
+	while (count < max) {
+		cqe_status = nvme_read_completion_status(nvmeq, head);
+		if ((cqe_status & 0x01) != phase) {
+			if (count)
+				break;
+			if (timeout_us > 0 && (timer_get_us() - start_time)
+			    >= timeout_us)
+				return -ETIMEDOUT;
+			continue;
+		}
+
+		cmd_ids[count] = le16_to_cpu(readw(&nvmeq->cqes[head].command_id));
+		status[count++] = cqe_status >> 1;
+		if (++head == nvmeq->q_depth) {
+			head = 0;
+			phase = !phase;
+		}
+	}
+	writel(head, nvmeq->q_db + nvmeq->dev->db_stride);
+	nvmeq->cq_head = head;
+	nvmeq->cq_phase = phase;
+
+	return count;
+}
+
 static int nvme_submit_sync_cmd(struct nvme_queue *nvmeq,
 				struct nvme_command *cmd,
 				u32 *result, unsigned timeout)
@@ -598,18 +662,15 @@ static int nvme_get_info_from_identify(struct nvme_dev *dev)
 		 * and is reported as a power of two (2^n).
 		 *
 		 * The spec also says: a value of 0h indicates no restrictions
-		 * on transfer size. But in nvme_blk_read/write() below we have
-		 * the following algorithm for maximum number of logic blocks
-		 * per transfer:
-		 *
-		 * u16 lbas = 1 << (dev->max_transfer_shift - ns->lba_shift);
-		 *
-		 * In order for lbas not to overflow, the maximum number is 15
-		 * which means dev->max_transfer_shift = 15 + 9 (ns->lba_shift).
-		 * Let's use 20 which provides 1MB size.
+		 * on transfer size. But the number of logical blocks in a read
+		 * or write command is a 16-bit field, and nvme_blk_rw() keeps
+		 * a page of PRP list for each outstanding command. Let's use
+		 * 20 which provides 1MB size.
 		 */
 		dev->max_transfer_shift = 20;
 	}
+	dev->max_transfer_shift = min_t(u32, dev->max_transfer_shift,
+					NVME_MAX_XFER_SHIFT);
 
 	return 0;
 }
@@ -670,65 +731,145 @@ static int nvme_blk_probe(struct udevice *udev)
 	return 0;
 }
 
+/*
+ * Commands on the I/O queue have timed out, but the controller may still be
+ * working on them, reading or writing their buffers and PRP lists. Deleting
+ * the submission queue makes the controller finish or abort them all, after
+ * which both queues are created afresh, so no slot is reused while its old
+ * command could still complete. If the controller does not respond to that
+ * either, it is disabled, which stops all its DMA, and set up again.
+ */
+static int nvme_reset_io_queue(struct nvme_dev *dev)
+{
+	struct nvme_queue *nvmeq = dev->queues[NVME_IO_Q];
+	int ret;
+
+	ret = nvme_delete_sq(dev, NVME_IO_Q);
+	if (!ret)
+		ret = nvme_delete_cq(dev, NVME_IO_Q);
+	if (!ret) {
+		dev->online_queues--;
+		ret = nvme_create_queue(nvmeq, NVME_IO_Q);
+		if (!ret)
+			return 0;
+	}
+
+	printf("NVMe: resetting controller %d\n", dev->instance);
+	dev->online_queues = 0;
+	ret = nvme_configure_admin_queue(dev);
+	if (ret)
+		return ret;
+
+	return nvme_setup_io_queues(dev);
+}
+
+/*
+ * Each command outstanding on the I/O queue has a slot, which is its command
+ * ID and selects its PRP list in dev->prp_pool. Commands for as many slots as
+ * are free are added to the queue with a single doorbell write, then all the
+ * completions which have arrived are collected together, so the controller
+ * always has several commands to work on.
+ */
 static ulong nvme_blk_rw(struct udevice *udev, lbaint_t blknr,
 			 lbaint_t blkcnt, void *buffer, bool read)
 {
 	struct nvme_ns *ns = dev_get_priv(udev);
 	struct nvme_dev *dev = ns->dev;
+	struct nvme_queue *nvmeq = dev->queues[NVME_IO_Q];
 	struct nvme_command c;
 	struct blk_desc *desc = dev_get_uclass_platdata(udev);
-	int status;
-	u64 prp2;
 	u64 total_len = blkcnt << desc->log2blksz;
-	u64 temp_len = total_len;
-
-	u64 slba = blknr;
-	u16 lbas = 1 << (dev->max_transfer_shift - ns->lba_shift);
-	u64 total_lbas = blkcnt;
+	lbaint_t max_lbas = 1 << (dev->max_transfer_shift - ns->lba_shift);
+	int nslots;
+	lbaint_t slot_blk[NVME_Q_DEPTH - 1];
+	u16 cmd_ids[NVME_Q_DEPTH - 1];
+	u16 status[NVME_Q_DEPTH - 1];
+	ulong busy = 0;
+	lbaint_t next = 0;	/* blocks sent to the controller so far */
+	lbaint_t done = blkcnt;	/* start of the first failed command */
+	int count, slot, i;
+
+	/* A failed reset leaves no I/O queue to use */
+	if (dev->online_queues <= NVME_IO_Q)
+		return 0;
+	nslots = min(nvmeq->q_depth - 1, NVME_Q_DEPTH - 1);
 
-	if (!read)
-		flush_dcache_range((unsigned long)buffer,
-				   (unsigned long)buffer + total_len);
+	/*
+	 * Reads need this too: several commands may be writing into the
+	 * buffer at once, and a dirty line evicted meanwhile would overwrite
+	 * what one of them has already put there.
+	 */
+	flush_dcache_range((unsigned long)buffer,
+			   (unsigned long)buffer + total_len);
 
+	memset(&c, 0, sizeof(c));
 	c.rw.opcode = read ? nvme_cmd_read : nvme_cmd_write;
-	c.rw.flags = 0;
 	c.rw.nsid = cpu_to_le32(ns->ns_id);
-	c.rw.control = 0;
-	c.rw.dsmgmt = 0;
-	c.rw.reftag = 0;
-	c.rw.apptag = 0;
-	c.rw.appmask = 0;
-	c.rw.metadata = 0;
-
-	while (total_lbas) {
-		if (total_lbas < lbas) {
-			lbas = (u16)total_lbas;
-			total_lbas = 0;
-		} else {
-			total_lbas -= lbas;
+
+	for (;;) {
+		count = 0;
+		while (next < done && busy != (1UL << nslots) - 1) {
+			lbaint_t lbas = min(blkcnt - next, max_lbas);
+			void *buf = buffer + (next << desc->log2blksz);
+			u64 prp2;
+
+			slot = ffs(~busy) - 1;
+			if (nvme_setup_prps(dev, dev->prp_pool +
+					    slot * dev->prp_entry_num, &prp2,
+					    lbas << ns->lba_shift, (ulong)buf)) {
+				done = next;
+				break;
+			}
+			c.rw.command_id = cpu_to_le16(slot);
+			c.rw.slba = cpu_to_le64(blknr + next);
+			c.rw.length = cpu_to_le16(lbas - 1);
+			c.rw.prp1 = cpu_to_le64((ulong)buf);
+			c.rw.prp2 = cpu_to_le64(prp2);
+			nvme_queue_cmd(nvmeq, &c);
+			slot_blk[slot] = next;
+			busy |= 1UL << slot;
+			next += lbas;
+			count++;
 		}
+		if (count)
+			writel(nvmeq->sq_tail, nvmeq->q_db);
+		if (!busy)
+			break;
 
-		if (nvme_setup_prps(dev, &prp2,
-				    lbas << ns->lba_shift, (ulong)buffer))
-			return -EIO;
-		c.rw.slba = cpu_to_le64(slba);
-		slba += lbas;
-		c.rw.length = cpu_to_le16(lbas - 1);
-		c.rw.prp1 = cpu_to_le64((ulong)buffer);
-		c.rw.prp2 = cpu_to_le64(prp2);
-		status = nvme_submit_sync_cmd(dev->queues[NVME_IO_Q],
-				&c, NULL, IO_TIMEOUT);
-		if (status)
+		count = nvme_reap_cmds(nvmeq, cmd_ids, status, nslots,
+				       IO_TIMEOUT);
+		if (count < 0) {
+			/* Count only the blocks before the earliest lost one */
+			for (slot = 0; slot < nslots; slot++) {
+				if (busy & (1UL << slot))
+					done = min(done, slot_blk[slot]);
+			}
+			printf("ERROR: I/O timed out, block = " LBAF "\n",
+			       blknr + done);
+			if (nvme_reset_io_queue(dev))
+				printf("ERROR: cannot reset NVMe queue\n");
 			break;
-		temp_len -= (u32)lbas << ns->lba_shift;
-		buffer += lbas << ns->lba_shift;
+		}
+		for (i = 0; i < count; i++) {
+			slot = cmd_ids[i];
+			if (slot >= nslots || !(busy & (1UL << slot))) {
+				printf("ERROR: unexpected command id %d\n", slot);
+				continue;
+			}
+			busy &= ~(1UL << slot);
+			if (status[i]) {
+				printf("ERROR: status = %x, block = " LBAF "\n",
+				       status[i], blknr + slot_blk[slot]);
+				done = min(done, slot_blk[slot]);
+			}
+		}
 	}
 
 	if (read)
 		invalidate_dcache_range((unsigned long)buffer,
 					(unsigned long)buffer + total_len);
 
-	return (total_len - temp_len) >> desc->log2blksz;
+	return min(done, next);
 }
 
 static ulong nvme_blk_read(struct udevice *udev, lbaint_t blknr,
@@ -790,14 +931,6 @@ static int nvme_probe(struct udevice *udev)
 	}
 	memset(ndev->queues, 0, NVME_Q_NUM * sizeof(struct nvme_queue *));
 
-	ndev->prp_pool = malloc(MAX_PRP_POOL);
-	if (!ndev->prp_pool) {
-		ret = -ENOMEM;
-		printf("Error: %s: Out of memory!\n", udev->name);
-		goto free_nvme;
-	}
-	ndev->prp_entry_num = MAX_PRP_POOL >> 3;
-
 	ndev->cap = nvme_readq(&ndev->bar->cap);
 	ndev->q_depth = min_t(int, NVME_CAP_MQES(ndev->cap) + 1, NVME_Q_DEPTH);
 	ndev->db_stride = 1 << NVME_CAP_STRIDE(ndev->cap);
@@ -813,6 +946,16 @@ static int nvme_probe(struct udevice *udev)
 
 	nvme_get_info_from_identify(ndev);
 
+	/* A page of PRP list for each command outstanding on the I/O queue */
+	ndev->prp_entry_num = ndev->page_size >> 3;
+	ndev->prp_pool = memalign(ndev->page_size,
+				  (ndev->q_depth - 1) * ndev->page_size);
+	if (!ndev->prp_pool) {
+		ret = -ENOMEM;
+		printf("Error: %s: Out of memory!\n", udev->name);
+		goto free_queue;
+	}
+
 	return 0;
 
 free_queue:
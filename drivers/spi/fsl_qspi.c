@@ -905,6 +905,9 @@ struct spi_slave *spi_setup_slave(unsigned int bus, unsigned int cs,
 	qspi->priv.cur_amba_base = amba_bases[bus] + cs * FSL_QSPI_FLASH_SIZE;
 
 	qspi->slave.max_write_size = TX_BUFFER_SIZE;
+	/* There are no LUT sequences dispatched for these */
+	qspi->slave.flash_cmds = SPI_FLASH_CMDS_NO_CHIP_ERASE |
+				 SPI_FLASH_CMDS_NO_ADDR_4B;
 
 	mcr_val = qspi_read32(qspi->priv.flags, &regs->mcr);
 
@@ -986,6 +989,9 @@ static int fsl_qspi_child_pre_probe(struct udevice *dev)
 	struct spi_slave *slave = dev_get_parent_priv(dev);
 
 	slave->max_write_size = TX_BUFFER_SIZE;
+	/* There are no LUT sequences dispatched for these */
+	slave->flash_cmds = SPI_FLASH_CMDS_NO_CHIP_ERASE |
+			    SPI_FLASH_CMDS_NO_ADDR_4B;
 
 	return 0;
 }
@@ -655,6 +655,12 @@ static int ich_spi_child_pre_probe(struct udevice *dev)
 	 * once! The limit is typically 64 bytes.
 	 */
 	slave->max_write_size = priv->databytes;
+	/*
+	 * A locked opcode menu does not have chip erase, and addresses are
+	 * 24 bits
+	 */
+	slave->flash_cmds = SPI_FLASH_CMDS_NO_CHIP_ERASE |
+			    SPI_FLASH_CMDS_NO_ADDR_4B;
 	/*
 	 * ICH 7 SPI controller only supports array read command
 	 * and byte program command for SST flash
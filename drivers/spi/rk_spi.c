@@ -171,7 +171,7 @@ static int conv_of_platdata(struct udevice *dev)
 	ret = clk_get_by_index_platdata(dev, 0, dtplat->clocks, &priv->clk);
 	if (ret < 0)
 		return ret;
-	dev->req_seq = 0;
+	dev_set_req_seq(dev, 0);
 
 	return 0;
 }
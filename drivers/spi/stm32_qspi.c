@@ -624,6 +624,16 @@ static int stm32_qspi_set_mode(struct udevice *bus, uint mode)
 	return 0;
 }
 
+static int stm32_qspi_child_pre_probe(struct udevice *dev)
+{
+	struct spi_slave *slave = dev_get_parent_priv(dev);
+
+	/* The address size is always set to 24 bits */
+	slave->flash_cmds = SPI_FLASH_CMDS_NO_ADDR_4B;
+
+	return 0;
+}
+
 static const struct dm_spi_ops stm32_qspi_ops = {
 	.claim_bus	= stm32_qspi_claim_bus,
 	.release_bus	= stm32_qspi_release_bus,
@@ -647,4 +657,5 @@ U_BOOT_DRIVER(stm32_qspi) = {
 	.priv_auto_alloc_size = sizeof(struct stm32_qspi_priv),
 	.probe	= stm32_qspi_probe,
 	.remove = stm32_qspi_remove,
+	.child_pre_probe = stm32_qspi_child_pre_probe,
 };
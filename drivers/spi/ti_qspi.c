@@ -385,6 +385,8 @@ struct spi_slave *spi_setup_slave(unsigned int bus, unsigned int cs,
 
 	priv->base = (struct ti_qspi_regs *)QSPI_BASE;
 	priv->mode = mode;
+	/* The memory-mapped read uses a 3-byte address */
+	priv->slave.flash_cmds = SPI_FLASH_CMDS_NO_ADDR_4B;
 #if defined(CONFIG_DRA7XX)
 	priv->ctrl_mod_mmap = (void *)CORE_CTRL_IO;
 	priv->slave.memory_map = (void *)MMAP_START_ADDR_DRA;
@@ -622,6 +624,8 @@ static int ti_qspi_child_pre_probe(struct udevice *dev)
 	struct ti_qspi_priv *priv = dev_get_priv(bus);
 
 	slave->memory_map = priv->memory_map;
+	/* The memory-mapped read uses a 3-byte address */
+	slave->flash_cmds = SPI_FLASH_CMDS_NO_ADDR_4B;
 	return 0;
 }
 
@@ -1003,6 +1003,12 @@ static int do_write(struct fsg_common *common)
 
 static int do_synchronize_cache(struct fsg_common *common)
 {
+	struct fsg_lun		*curlun = &common->luns[common->lun];
+	struct blk_desc		*desc = &ums[common->lun].block_dev;
+
+	/* Write out whatever the block cache holds for the device */
+	if (blkcache_flush(desc->if_type, desc->devnum))
+		curlun->sense_data = SS_WRITE_ERROR;
 	return 0;
 }
 
@@ -1523,43 +1523,229 @@ void ext4fs_allocate_blocks(struct ext2_inode *file_inode,
 
 #endif
 
-static struct ext4_extent_header *ext4fs_get_extent_block
-	(struct ext2_data *data, char *buf,
-		struct ext4_extent_header *ext_block,
-		uint32_t fileblock, int log2_blksz)
+/* Extents longer than this are unwritten, with the length less this */
+#define EXT4_EXT_INIT_MAX_LEN	(1U << 15)
+
+#define EXT4_EXTENT_CACHE_SLOTS	4
+
+/**
+ * struct ext4_extent_cache - A decoded leaf of an inode's extent tree
+ *
+ * The inode is identified by the root of its tree, which is kept in the
+ * inode itself, so copies of the same inode find the same leaves.
+ *
+ * @root:	Root of the extent tree, from the inode
+ * @first:	First file block covered by the leaf
+ * @last:	Last file block covered by the leaf
+ * @count:	Number of extents in the leaf
+ * @runs:	The extents, in order
+ * @stamp:	Time of the last lookup, to find the least recently used
+ */
+struct ext4_extent_cache {
+	char root[sizeof(((struct ext2_inode *)0)->b)];
+	uint32_t first;
+	uint32_t last;
+	int count;
+	struct ext4_block_run *runs;
+	uint stamp;
+};
+
+static struct ext4_extent_cache ext4fs_extent_cache[EXT4_EXTENT_CACHE_SLOTS];
+static uint ext4fs_extent_clock;
+
+void ext4fs_free_extent_cache(void)
 {
-	struct ext4_extent_idx *index;
-	unsigned long long block;
-	int blksz = EXT2_BLOCK_SIZE(data);
 	int i;
 
-	while (1) {
-		index = (struct ext4_extent_idx *)(ext_block + 1);
+	for (i = 0; i < EXT4_EXTENT_CACHE_SLOTS; i++) {
+		free(ext4fs_extent_cache[i].runs);
+		memset(&ext4fs_extent_cache[i], '\0',
+		       sizeof(ext4fs_extent_cache[i]));
+	}
+}
 
-		if (le16_to_cpu(ext_block->eh_magic) != EXT4_EXT_MAGIC)
-			return NULL;
+static struct ext4_extent_cache *ext4fs_find_extent_leaf
+	(struct ext2_inode *inode, uint32_t fileblock)
+{
+	struct ext4_extent_cache *ec;
+	int i;
+
+	for (i = 0; i < EXT4_EXTENT_CACHE_SLOTS; i++) {
+		ec = &ext4fs_extent_cache[i];
+		if (ec->stamp && fileblock >= ec->first &&
+		    fileblock <= ec->last &&
+		    !memcmp(ec->root, &inode->b, sizeof(ec->root))) {
+			ec->stamp = ++ext4fs_extent_clock;
+			return ec;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Walk the extent tree of an inode down to the leaf covering a file
+ * block, noting the range of file blocks the leaf covers, and decode it
+ * into the least recently used cache slot.
+ */
+static struct ext4_extent_cache *ext4fs_read_extent_leaf
+	(struct ext2_inode *inode, uint32_t fileblock)
+{
+	struct ext4_extent_header *ext_block;
+	struct ext4_extent_cache *ec;
+	struct ext4_extent_idx *index;
+	struct ext4_extent *extent;
+	struct ext4_block_run *runs = NULL;
+	uint32_t first = 0, last = ~0U;
+	unsigned long long block;
+	int blksz = EXT2_BLOCK_SIZE(ext4fs_root);
+	int log2_blksz = LOG2_BLOCK_SIZE(ext4fs_root) -
+		get_fs()->dev_desc->log2blksz;
+	int entries, i;
+	char *buf = NULL;
 
+	ext_block = (struct ext4_extent_header *)inode->b.blocks.dir_blocks;
+	for (;;) {
+		if (le16_to_cpu(ext_block->eh_magic) != EXT4_EXT_MAGIC)
+			goto err;
+		entries = le16_to_cpu(ext_block->eh_entries);
 		if (ext_block->eh_depth == 0)
-			return ext_block;
-		i = -1;
-		do {
-			i++;
-			if (i >= le16_to_cpu(ext_block->eh_entries))
+			break;
+
+		index = (struct ext4_extent_idx *)(ext_block + 1);
+		for (i = 0; i < entries; i++) {
+			if (fileblock < le32_to_cpu(index[i].ei_block))
 				break;
-		} while (fileblock >= le32_to_cpu(index[i].ei_block));
+		}
+		if (i < entries)
+			last = le32_to_cpu(index[i].ei_block) - 1;
+		if (!i) {
+			/* A hole before the first index: an empty leaf */
+			entries = 0;
+			break;
+		}
+		first = le32_to_cpu(index[i - 1].ei_block);
+
+		block = le16_to_cpu(index[i - 1].ei_leaf_hi);
+		block = (block << 32) + le32_to_cpu(index[i - 1].ei_leaf_lo);
+		if (!buf) {
+			buf = malloc(blksz);
+			if (!buf)
+				return NULL;
+		}
+		if (!ext4fs_devread((lbaint_t)block << log2_blksz, 0, blksz,
+				    buf))
+			goto err;
+		ext_block = (struct ext4_extent_header *)buf;
+	}
 
-		if (--i < 0)
-			return NULL;
+	if (entries) {
+		runs = malloc(entries * sizeof(*runs));
+		if (!runs)
+			goto err;
+	}
+	extent = (struct ext4_extent *)(ext_block + 1);
+	for (i = 0; i < entries; i++) {
+		uint len = le16_to_cpu(extent[i].ee_len);
+
+		runs[i].logical = le32_to_cpu(extent[i].ee_block);
+		runs[i].physical = le16_to_cpu(extent[i].ee_start_hi);
+		runs[i].physical = (runs[i].physical << 32) +
+			le32_to_cpu(extent[i].ee_start_lo);
+		runs[i].unwritten = len > EXT4_EXT_INIT_MAX_LEN;
+		runs[i].len = runs[i].unwritten ?
+			len - EXT4_EXT_INIT_MAX_LEN : len;
+	}
+	free(buf);
 
-		block = le16_to_cpu(index[i].ei_leaf_hi);
-		block = (block << 32) + le32_to_cpu(index[i].ei_leaf_lo);
+	ec = &ext4fs_extent_cache[0];
+	for (i = 1; i < EXT4_EXTENT_CACHE_SLOTS; i++) {
+		if (ext4fs_extent_cache[i].stamp < ec->stamp)
+			ec = &ext4fs_extent_cache[i];
+	}
+	free(ec->runs);
+	memcpy(ec->root, &inode->b, sizeof(ec->root));
+	ec->first = first;
+	ec->last = last;
+	ec->count = entries;
+	ec->runs = runs;
+	ec->stamp = ++ext4fs_extent_clock;
+
+	return ec;
+
+err:
+	free(buf);
+	return NULL;
+}
 
-		if (ext4fs_devread((lbaint_t)block << log2_blksz, 0, blksz,
-				   buf))
-			ext_block = (struct ext4_extent_header *)buf;
+/* Find the run of an extent file which a block is in */
+static int ext4fs_map_extent(struct ext2_inode *inode, uint32_t fileblock,
+			     uint32_t max, struct ext4_block_run *run)
+{
+	struct ext4_extent_cache *ec;
+	uint64_t end;
+	int lo, hi, mid;
+
+	ec = ext4fs_find_extent_leaf(inode, fileblock);
+	if (!ec)
+		ec = ext4fs_read_extent_leaf(inode, fileblock);
+	if (!ec)
+		return -EINVAL;
+
+	/* Find the last extent starting at or before the block */
+	lo = 0;
+	hi = ec->count;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (ec->runs[mid].logical <= fileblock)
+			lo = mid + 1;
 		else
-			return NULL;
+			hi = mid;
+	}
+
+	run->logical = fileblock;
+	if (lo && fileblock - ec->runs[lo - 1].logical < ec->runs[lo - 1].len) {
+		const struct ext4_block_run *ext = &ec->runs[lo - 1];
+
+		run->physical = ext->physical + fileblock - ext->logical;
+		run->unwritten = ext->unwritten;
+		end = (uint64_t)ext->logical + ext->len;
+	} else {
+		/* A hole, up to the next extent or the end of the leaf */
+		run->physical = 0;
+		run->unwritten = false;
+		end = lo < ec->count ? ec->runs[lo].logical :
+			(uint64_t)ec->last + 1;
 	}
+	run->len = min_t(uint64_t, end - fileblock, max);
+
+	return 0;
+}
+
+int ext4fs_map_blocks(struct ext2_inode *inode, uint32_t fileblock,
+		      uint32_t max, struct ext4_block_run *run)
+{
+	long int blknr, next;
+
+	if (!max)
+		return -EINVAL;
+	if (le32_to_cpu(inode->flags) & EXT4_EXTENTS_FL)
+		return ext4fs_map_extent(inode, fileblock, max, run);
+
+	/* Indirect blocks are looked up one by one, but mostly cached */
+	blknr = read_allocated_block(inode, fileblock);
+	if (blknr < 0)
+		return blknr;
+	run->logical = fileblock;
+	run->physical = blknr;
+	run->unwritten = false;
+	for (run->len = 1; run->len < max; run->len++) {
+		next = read_allocated_block(inode, fileblock + run->len);
+		if (next < 0 || next != (blknr ? blknr + run->len : 0))
+			break;
+	}
+
+	return 0;
 }
 
 static int ext4fs_blockgroup
@@ -1624,53 +1810,21 @@ long int read_allocated_block(struct ext2_inode *inode, int fileblock)
 	long int rblock;
 	long int perblock_parent;
 	long int perblock_child;
-	unsigned long long start;
 	/* get the blocksize of the filesystem */
 	blksz = EXT2_BLOCK_SIZE(ext4fs_root);
 	log2_blksz = LOG2_BLOCK_SIZE(ext4fs_root)
 		- get_fs()->dev_desc->log2blksz;
 
 	if (le32_to_cpu(inode->flags) & EXT4_EXTENTS_FL) {
-		long int startblock, endblock;
-		char *buf = zalloc(blksz);
-		if (!buf)
-			return -ENOMEM;
-		struct ext4_extent_header *ext_block;
-		struct ext4_extent *extent;
-		int i;
-		ext_block =
-			ext4fs_get_extent_block(ext4fs_root, buf,
-						(struct ext4_extent_header *)
-						inode->b.blocks.dir_blocks,
-						fileblock, log2_blksz);
-		if (!ext_block) {
-			printf("invalid extent block\n");
-			free(buf);
-			return -EINVAL;
-		}
-
-		extent = (struct ext4_extent *)(ext_block + 1);
-
-		for (i = 0; i < le16_to_cpu(ext_block->eh_entries); i++) {
-			startblock = le32_to_cpu(extent[i].ee_block);
-			endblock = startblock + le16_to_cpu(extent[i].ee_len);
-
-			if (startblock > fileblock) {
-				/* Sparse file */
-				free(buf);
-				return 0;
+		struct ext4_block_run run;
 
-			} else if (fileblock < endblock) {
-				start = le16_to_cpu(extent[i].ee_start_hi);
-				start = (start << 32) +
-					le32_to_cpu(extent[i].ee_start_lo);
-				free(buf);
-				return (fileblock - startblock) + start;
-			}
+		status = ext4fs_map_extent(inode, fileblock, 1, &run);
+		if (status) {
+			printf("invalid extent block\n");
+			return status;
 		}
 
-		free(buf);
-		return 0;
+		return run.physical;
 	}
 
 	/* Direct blocks. */
@@ -1990,6 +2144,7 @@ void ext4fs_reinit_global(void)
 		ext4fs_indir3_size = 0;
 		ext4fs_indir3_blkno = -1;
 	}
+	ext4fs_free_extent_cache();
 }
 void ext4fs_close(void)
 {
@@ -738,6 +738,8 @@ void ext4fs_deinit(void)
 
 	free(fs->gdtable);
 	fs->gdtable = NULL;
+	/* the write may have changed extent trees */
+	ext4fs_free_extent_cache();
 	/*
 	 * reinitiliazed the global inode and
 	 * block bitmap first execution check variables
@@ -12,6 +12,7 @@
 #include <common.h>
 #include <blk.h>
 #include <config.h>
+#include <div64.h>
 #include <exports.h>
 #include <fat.h>
 #include <fs.h>
@@ -145,25 +146,91 @@ static void get_name(dir_entry *dirent, char *s_name)
 		*s_name = DELETED_FLAG;
 }
 
-static int flush_dirty_fat_buffer(fsdata *mydata);
+static int flush_fat_window(fsdata *mydata, struct fat_window *win);
 #if !defined(CONFIG_FAT_WRITE)
 /* Stub for read only operation */
-int flush_dirty_fat_buffer(fsdata *mydata)
+int flush_fat_window(fsdata *mydata, struct fat_window *win)
 {
 	(void)(mydata);
+	(void)(win);
 	return 0;
 }
 #endif
 
+static void init_fat_windows(fsdata *mydata)
+{
+	int i;
+
+	for (i = 0; i < FATBUFWINDOWS; i++) {
+		mydata->fatwin[i].num = -1;
+		mydata->fatwin[i].used = 0;
+		mydata->fatwin[i].dirty = 0;
+	}
+	mydata->fatwin_clock = 0;
+}
+
+static __u8 *fat_window_buf(fsdata *mydata, struct fat_window *win)
+{
+	return mydata->fatbuf + (win - mydata->fatwin) * FATBUFSIZE;
+}
+
+/*
+ * Get the window holding block 'bufnum' of FAT entries, reading it into the
+ * least recently used window if it is not cached. That window is written
+ * back first if it has been modified.
+ * Return NULL on failure.
+ */
+static struct fat_window *get_fat_window(fsdata *mydata, __u32 bufnum)
+{
+	struct fat_window *win, *lru = NULL;
+	__u32 getsize = FATBUFBLOCKS;
+	__u32 fatlength = mydata->fatlength;
+	__u32 startblock = bufnum * FATBUFBLOCKS;
+	int i;
+
+	for (i = 0; i < FATBUFWINDOWS; i++) {
+		win = &mydata->fatwin[i];
+		if (win->num == bufnum) {
+			win->used = ++mydata->fatwin_clock;
+			return win;
+		}
+		if (!lru || (lru->num != -1 &&
+			     (win->num == -1 || win->used < lru->used)))
+			lru = win;
+	}
+
+	/* Cap length if fatlength is not a multiple of FATBUFBLOCKS */
+	if (startblock + getsize > fatlength)
+		getsize = fatlength - startblock;
+
+	startblock += mydata->fat_sect;	/* Offset from start of disk */
+
+	/* Write back the window to the disk */
+	if (flush_fat_window(mydata, lru) < 0)
+		return NULL;
+
+	lru->num = -1;
+	if (disk_read(startblock, getsize, fat_window_buf(mydata, lru)) < 0) {
+		debug("Error reading FAT blocks\n");
+		return NULL;
+	}
+	lru->num = bufnum;
+	lru->used = ++mydata->fatwin_clock;
+
+	return lru;
+}
+
 /*
  * Get the entry at index 'entry' in a FAT (12/16/32) table.
  * On failure 0x00 is returned.
  */
 static __u32 get_fatent(fsdata *mydata, __u32 entry)
 {
+	struct fat_window *win;
 	__u32 bufnum;
 	__u32 offset, off8;
 	__u32 ret = 0x00;
+	__u8 *fatbuf;
 
 	if (CHECK_CLUST(entry, mydata->fatsize)) {
 		printf("Error: Invalid FAT entry: 0x%08x\n", entry);
@@ -192,42 +259,23 @@ static __u32 get_fatent(fsdata *mydata, __u32 entry)
 	debug("FAT%d: entry: 0x%08x = %d, offset: 0x%04x = %d\n",
 	       mydata->fatsize, entry, entry, offset, offset);
 
-	/* Read a new block of FAT entries into the cache. */
-	if (bufnum != mydata->fatbufnum) {
-		__u32 getsize = FATBUFBLOCKS;
-		__u8 *bufptr = mydata->fatbuf;
-		__u32 fatlength = mydata->fatlength;
-		__u32 startblock = bufnum * FATBUFBLOCKS;
-
-		/* Cap length if fatlength is not a multiple of FATBUFBLOCKS */
-		if (startblock + getsize > fatlength)
-			getsize = fatlength - startblock;
-
-		startblock += mydata->fat_sect;	/* Offset from start of disk */
-
-		/* Write back the fatbuf to the disk */
-		if (flush_dirty_fat_buffer(mydata) < 0)
-			return -1;
-
-		if (disk_read(startblock, getsize, bufptr) < 0) {
-			debug("Error reading FAT blocks\n");
-			return ret;
-		}
-		mydata->fatbufnum = bufnum;
-	}
+	win = get_fat_window(mydata, bufnum);
+	if (!win)
+		return ret;
+	fatbuf = fat_window_buf(mydata, win);
 
 	/* Get the actual entry from the table */
 	switch (mydata->fatsize) {
 	case 32:
-		ret = FAT2CPU32(((__u32 *) mydata->fatbuf)[offset]);
+		ret = FAT2CPU32(((__u32 *)fatbuf)[offset]);
 		break;
 	case 16:
-		ret = FAT2CPU16(((__u16 *) mydata->fatbuf)[offset]);
+		ret = FAT2CPU16(((__u16 *)fatbuf)[offset]);
 		break;
 	case 12:
 		off8 = (offset * 3) / 2;
 		/* fatbut + off8 may be unaligned, read in byte granularity */
-		ret = mydata->fatbuf[off8] + (mydata->fatbuf[off8 + 1] << 8);
+		ret = fatbuf[off8] + (fatbuf[off8 + 1] << 8);
 
 		if (offset & 0x1)
 			ret >>= 4;
@@ -301,6 +349,28 @@ get_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer, unsigned long size)
 	return 0;
 }
 
+/*
+ * Follow the cluster chain from 'clust' for as long as the clusters are
+ * consecutive, up to 'max' clusters, so that the run can be read at once.
+ * Return the number of clusters in the run, and set *nextp to the entry
+ * after its last cluster, i.e. the next cluster or an end-of-chain marker.
+ */
+static __u32 get_fat_run(fsdata *mydata, __u32 clust, __u32 max,
+			 __u32 *nextp)
+{
+	__u32 count, next;
+
+	for (count = 1; ; count++) {
+		next = get_fatent(mydata, clust + count - 1);
+		if (count >= max || next != clust + count)
+			break;
+	}
+	debug("run: 0x%08x, %u clusters, next: 0x%08x\n", clust, count, next);
+	*nextp = next;
+
+	return count;
+}
+
 /*
  * Read at most 'maxsize' bytes from 'pos' in the file associated with 'dentptr'
  * into 'buffer'.
@@ -315,7 +385,7 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 	loff_t filesize = FAT2CPU32(dentptr->size);
 	unsigned int bytesperclust = mydata->clust_size * mydata->sect_size;
 	__u32 curclust = START(dentptr);
-	__u32 endclust, newclust;
+	__u32 skip, count, newclust;
 	loff_t actsize;
 
 	*gotsize = 0;
@@ -331,21 +401,18 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 
 	debug("%llu bytes\n", filesize);
 
-	actsize = bytesperclust;
-
-	/* go to cluster at pos */
-	while (actsize <= pos) {
-		curclust = get_fatent(mydata, curclust);
+	/* go to cluster at pos, a run at a time */
+	skip = lldiv(pos, bytesperclust);
+	actsize = (loff_t)skip * bytesperclust;
+	while (skip) {
+		skip -= get_fat_run(mydata, curclust, skip, &curclust);
 		if (CHECK_CLUST(curclust, mydata->fatsize)) {
 			debug("curclust: 0x%x\n", curclust);
 			debug("Invalid FAT entry\n");
 			return 0;
 		}
-		actsize += bytesperclust;
 	}
 
-	/* actsize > pos */
-	actsize -= bytesperclust;
 	filesize -= actsize;
 	pos -= actsize;
 
@@ -373,49 +440,28 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 		}
 	}
 
-	actsize = bytesperclust;
-	endclust = curclust;
-
+	/* read each run of consecutive clusters with a single disk_read() */
 	do {
-		/* search for consecutive clusters */
-		while (actsize < filesize) {
-			newclust = get_fatent(mydata, endclust);
-			if ((newclust - 1) != endclust)
-				goto getit;
-			if (CHECK_CLUST(newclust, mydata->fatsize)) {
-				debug("curclust: 0x%x\n", newclust);
-				debug("Invalid FAT entry\n");
-				return 0;
-			}
-			endclust = newclust;
-			actsize += bytesperclust;
-		}
-
-		/* get remaining bytes */
-		actsize = filesize;
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
+		count = get_fat_run(mydata, curclust,
+				    DIV_ROUND_UP_ULL(filesize, bytesperclust),
+				    &newclust);
+		actsize = min(filesize, (loff_t)count * bytesperclust);
+		if (get_cluster(mydata, curclust, buffer, actsize) != 0) {
 			printf("Error reading cluster\n");
 			return -1;
 		}
 		*gotsize += actsize;
-		return 0;
-getit:
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
-			printf("Error reading cluster\n");
-			return -1;
-		}
-		*gotsize += (int)actsize;
 		filesize -= actsize;
+		if (!filesize)
+			return 0;
 		buffer += actsize;
 
-		curclust = get_fatent(mydata, endclust);
+		curclust = newclust;
 		if (CHECK_CLUST(curclust, mydata->fatsize)) {
 			debug("curclust: 0x%x\n", curclust);
 			printf("Invalid FAT entry\n");
 			return 0;
 		}
-		actsize = bytesperclust;
-		endclust = curclust;
 	} while (1);
 }
 
@@ -591,9 +637,8 @@ static int get_fs_info(fsdata *mydata)
 			sect_to_clust(mydata, mydata->rootdir_sect);
 	}
 
-	mydata->fatbufnum = -1;
-	mydata->fat_dirty = 0;
-	mydata->fatbuf = malloc_cache_aligned(FATBUFSIZE);
+	init_fat_windows(mydata);
+	mydata->fatbuf = malloc_cache_aligned(FATBUFSIZE * FATBUFWINDOWS);
 	if (mydata->fatbuf == NULL) {
 		debug("Error: allocating memory\n");
 		return -1;
@@ -102,19 +102,18 @@ static void set_name(dir_entry *dirent, const char *filename)
 
 static __u8 num_of_fats;
 /*
- * Write fat buffer into block device
+ * Write a window of the FAT buffer into block device
  */
-static int flush_dirty_fat_buffer(fsdata *mydata)
+static int flush_fat_window(fsdata *mydata, struct fat_window *win)
 {
 	int getsize = FATBUFBLOCKS;
 	__u32 fatlength = mydata->fatlength;
-	__u8 *bufptr = mydata->fatbuf;
-	__u32 startblock = mydata->fatbufnum * FATBUFBLOCKS;
+	__u8 *bufptr = fat_window_buf(mydata, win);
+	__u32 startblock = win->num * FATBUFBLOCKS;
 
-	debug("debug: evicting %d, dirty: %d\n", mydata->fatbufnum,
-	      (int)mydata->fat_dirty);
+	debug("debug: evicting %d, dirty: %d\n", win->num, (int)win->dirty);
 
-	if ((!mydata->fat_dirty) || (mydata->fatbufnum == -1))
+	if ((!win->dirty) || (win->num == -1))
 		return 0;
 
 	/* Cap length if fatlength is not a multiple of FATBUFBLOCKS */
@@ -137,7 +136,22 @@ static int flush_dirty_fat_buffer(fsdata *mydata)
 			return -1;
 		}
 	}
-	mydata->fat_dirty = 0;
+	win->dirty = 0;
+
+	return 0;
+}
+
+/*
+ * Write all modified windows of the FAT buffer into block device
+ */
+static int flush_dirty_fat_buffer(fsdata *mydata)
+{
+	int i;
+
+	for (i = 0; i < FATBUFWINDOWS; i++) {
+		if (flush_fat_window(mydata, &mydata->fatwin[i]) < 0)
+			return -1;
+	}
 
 	return 0;
 }
@@ -365,8 +379,10 @@ get_long_file_name(fsdata *mydata, int curclust, __u8 *cluster,
  */
 static int set_fatent_value(fsdata *mydata, __u32 entry, __u32 entry_value)
 {
+	struct fat_window *win;
 	__u32 bufnum, offset, off16;
 	__u16 val1, val2;
+	__u8 *fatbuf;
 
 	switch (mydata->fatsize) {
 	case 32:
@@ -386,39 +402,21 @@ static int set_fatent_value(fsdata *mydata, __u32 entry, __u32 entry_value)
 		return -1;
 	}
 
-	/* Read a new block of FAT entries into the cache. */
-	if (bufnum != mydata->fatbufnum) {
-		int getsize = FATBUFBLOCKS;
-		__u8 *bufptr = mydata->fatbuf;
-		__u32 fatlength = mydata->fatlength;
-		__u32 startblock = bufnum * FATBUFBLOCKS;
-
-		/* Cap length if fatlength is not a multiple of FATBUFBLOCKS */
-		if (startblock + getsize > fatlength)
-			getsize = fatlength - startblock;
-
-		if (flush_dirty_fat_buffer(mydata) < 0)
-			return -1;
-
-		startblock += mydata->fat_sect;
-
-		if (disk_read(startblock, getsize, bufptr) < 0) {
-			debug("Error reading FAT blocks\n");
-			return -1;
-		}
-		mydata->fatbufnum = bufnum;
-	}
+	win = get_fat_window(mydata, bufnum);
+	if (!win)
+		return -1;
+	fatbuf = fat_window_buf(mydata, win);
 
 	/* Mark as dirty */
-	mydata->fat_dirty = 1;
+	win->dirty = 1;
 
 	/* Set the actual entry */
 	switch (mydata->fatsize) {
 	case 32:
-		((__u32 *) mydata->fatbuf)[offset] = cpu_to_le32(entry_value);
+		((__u32 *)fatbuf)[offset] = cpu_to_le32(entry_value);
 		break;
 	case 16:
-		((__u16 *) mydata->fatbuf)[offset] = cpu_to_le16(entry_value);
+		((__u16 *)fatbuf)[offset] = cpu_to_le16(entry_value);
 		break;
 	case 12:
 		off16 = (offset * 3) / 4;
@@ -426,33 +424,33 @@ static int set_fatent_value(fsdata *mydata, __u32 entry, __u32 entry_value)
 		switch (offset & 0x3) {
 		case 0:
 			val1 = cpu_to_le16(entry_value) & 0xfff;
-			((__u16 *)mydata->fatbuf)[off16] &= ~0xfff;
-			((__u16 *)mydata->fatbuf)[off16] |= val1;
+			((__u16 *)fatbuf)[off16] &= ~0xfff;
+			((__u16 *)fatbuf)[off16] |= val1;
 			break;
 		case 1:
 			val1 = cpu_to_le16(entry_value) & 0xf;
 			val2 = (cpu_to_le16(entry_value) >> 4) & 0xff;
 
-			((__u16 *)mydata->fatbuf)[off16] &= ~0xf000;
-			((__u16 *)mydata->fatbuf)[off16] |= (val1 << 12);
+			((__u16 *)fatbuf)[off16] &= ~0xf000;
+			((__u16 *)fatbuf)[off16] |= (val1 << 12);
 
-			((__u16 *)mydata->fatbuf)[off16 + 1] &= ~0xff;
-			((__u16 *)mydata->fatbuf)[off16 + 1] |= val2;
+			((__u16 *)fatbuf)[off16 + 1] &= ~0xff;
+			((__u16 *)fatbuf)[off16 + 1] |= val2;
 			break;
 		case 2:
 			val1 = cpu_to_le16(entry_value) & 0xff;
 			val2 = (cpu_to_le16(entry_value) >> 8) & 0xf;
 
-			((__u16 *)mydata->fatbuf)[off16] &= ~0xff00;
-			((__u16 *)mydata->fatbuf)[off16] |= (val1 << 8);
+			((__u16 *)fatbuf)[off16] &= ~0xff00;
+			((__u16 *)fatbuf)[off16] |= (val1 << 8);
 
-			((__u16 *)mydata->fatbuf)[off16 + 1] &= ~0xf;
-			((__u16 *)mydata->fatbuf)[off16 + 1] |= val2;
+			((__u16 *)fatbuf)[off16 + 1] &= ~0xf;
+			((__u16 *)fatbuf)[off16 + 1] |= val2;
 			break;
 		case 3:
 			val1 = cpu_to_le16(entry_value) & 0xfff;
-			((__u16 *)mydata->fatbuf)[off16] &= ~0xfff0;
-			((__u16 *)mydata->fatbuf)[off16] |= (val1 << 4);
+			((__u16 *)fatbuf)[off16] &= ~0xfff0;
+			((__u16 *)fatbuf)[off16] |= (val1 << 4);
 			break;
 		default:
 			break;
@@ -955,9 +953,9 @@ static int do_fat_write(const char *filename, void *buffer, loff_t size,
 					(mydata->clust_size * 2);
 	}
 
-	mydata->fatbufnum = -1;
-	mydata->fat_dirty = 0;
-	mydata->fatbuf = memalign(ARCH_DMA_MINALIGN, FATBUFSIZE);
+	init_fat_windows(mydata);
+	mydata->fatbuf = memalign(ARCH_DMA_MINALIGN,
+				  FATBUFSIZE * FATBUFWINDOWS);
 	if (mydata->fatbuf == NULL) {
 		debug("Error: allocating memory\n");
 		return -1;
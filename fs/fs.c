@@ -428,6 +428,12 @@ int fs_write(const char *filename, ulong addr, loff_t offset, loff_t len,
 		printf("** Unable to write file %s **\n", filename);
 		ret = -1;
 	}
+	/* Like an unmount, leave nothing for the file in the block cache */
+	if (fs_dev_desc &&
+	    blkcache_flush(fs_dev_desc->if_type, fs_dev_desc->devnum)) {
+		printf("** Unable to write file %s **\n", filename);
+		ret = -1;
+	}
 	fs_close();
 
 	return ret;
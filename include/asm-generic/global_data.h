@@ -66,6 +66,8 @@ typedef struct global_data {
 	struct udevice	*dm_root;	/* Root instance for Driver Model */
 	struct udevice	*dm_root_f;	/* Pre-relocation root instance */
 	struct list_head uclass_root;	/* Head of core tree */
+	struct dm_compat_index *dm_compat; /* Drivers by compatible string */
+	struct uclass	**uclass_by_id;	/* Uclasses by enum uclass_id */
 #endif
 #ifdef CONFIG_TIMER
 	struct udevice	*timer;		/* Timer instance for Driver Model */
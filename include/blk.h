@@ -149,16 +149,88 @@ void blkcache_fill(int iftype, int dev,
  * blkcache_invalidate() - discard the cache for a set of blocks
  * because of a write or device (re)initialization.
  *
+ * Dirty blocks are written back first. The device's statistics are dropped
+ * and its slot is freed for use by another device.
+ *
  * @param iftype - IF_TYPE_x for type of device
  * @param dev - device index of particular type
  */
 void blkcache_invalidate(int iftype, int dev);
 
+/**
+ * blkcache_write() - offer a write to the block cache
+ *
+ * With CONFIG_BLOCK_CACHE_WRITEBACK, writes no larger than a cacheable read
+ * are only stored in the cache, to be written back later by
+ * blkcache_flush(). Otherwise any cached copies of the blocks are dropped
+ * and the caller must write them to the device.
+ *
+ * @param desc - device being written to
+ * @param start - starting block number
+ * @param blkcnt - number of blocks to write
+ * @param buffer - data to write
+ *
+ * @return - '1' if the cache took the write, '0' if the caller must do it
+ */
+int blkcache_write(struct blk_desc *desc, lbaint_t start, lbaint_t blkcnt,
+		   const void *buffer);
+
+/**
+ * blkcache_discard() - drop a range of blocks, e.g. because of an erase
+ *
+ * Any dirty data for the blocks is dropped too, not written back.
+ *
+ * @param iftype - IF_TYPE_x for type of device
+ * @param dev - device index of particular type
+ * @param start - starting block number
+ * @param blkcnt - number of blocks
+ */
+void blkcache_discard(int iftype, int dev, lbaint_t start, lbaint_t blkcnt);
+
+/**
+ * blkcache_flush() - write back the dirty blocks of a device
+ *
+ * Adjacent blocks are merged into as few writes as possible.
+ *
+ * @param iftype - IF_TYPE_x for type of device
+ * @param dev - device index of particular type
+ * @return - 0 if OK, -ve on error, including an earlier failure to write
+ * back blocks which had to be replaced
+ */
+int blkcache_flush(int iftype, int dev);
+
+/**
+ * blkcache_flush_all() - write back the dirty blocks of every device
+ *
+ * This is done before booting an OS or resetting, and after each command.
+ *
+ * @return - 0 if OK, -ve if writing back to any device failed
+ */
+int blkcache_flush_all(void);
+
+/**
+ * blkcache_select_hwpart() - prepare for a switch of hardware partition
+ *
+ * Blocks are cached by device, not by hardware partition. Before a device
+ * switches to another partition its dirty blocks are written back to the
+ * current one and all its blocks are dropped.
+ *
+ * @param desc - device which is about to switch
+ * @param hwpart - hardware partition it will switch to
+ * @return - 0 if OK, -ve if the write-back failed, in which case the device
+ * must not switch
+ */
+int blkcache_select_hwpart(struct blk_desc *desc, int hwpart);
+
 /**
  * blkcache_configure() - configure block cache
  *
- * @param blocks - maximum blocks per entry
- * @param entries - maximum entries in cache
+ * The cache holds lines of 4KiB, each an aligned run of blocks. Reads and
+ * fills of up to @blocks blocks are cached, spread over as many lines as
+ * needed.
+ *
+ * @param blocks - maximum blocks per read or fill to cache
+ * @param entries - number of lines in cache, 0 to disable it
  */
 void blkcache_configure(unsigned blocks, unsigned entries);
 
@@ -168,11 +240,24 @@ void blkcache_configure(unsigned blocks, unsigned entries);
 struct block_cache_stats {
 	unsigned hits;
 	unsigned misses;
+	unsigned evictions;
 	unsigned entries; /* current entry count */
 	unsigned max_blocks_per_entry;
 	unsigned max_entries;
 };
 
+/*
+ * statistics of the block cache for one device
+ */
+struct block_cache_dev_stats {
+	int iftype;
+	int devnum;
+	unsigned hits;
+	unsigned misses;
+	unsigned evictions; /* lines of this device replaced */
+	unsigned writebacks; /* writes made to the device for dirty blocks */
+};
+
 /**
  * get_blkcache_stats() - return statistics and reset
  *
@@ -180,6 +265,16 @@ struct block_cache_stats {
  */
 void blkcache_stats(struct block_cache_stats *stats);
 
+/**
+ * blkcache_dev_stats() - return statistics for a device and reset
+ *
+ * @param index - index of the device, counting from 0 over the devices
+ *		  currently in the cache
+ * @param stats - statistics are copied here
+ * @return - 0 if OK, -ENOENT if there is no device with that index
+ */
+int blkcache_dev_stats(int index, struct block_cache_dev_stats *stats);
+
 #else
 
 static inline int blkcache_read(int iftype, int dev,
@@ -195,6 +290,30 @@ static inline void blkcache_fill(int iftype, int dev,
 
 static inline void blkcache_invalidate(int iftype, int dev) {}
 
+static inline int blkcache_write(struct blk_desc *desc, lbaint_t start,
+				 lbaint_t blkcnt, const void *buffer)
+{
+	return 0;
+}
+
+static inline void blkcache_discard(int iftype, int dev, lbaint_t start,
+				    lbaint_t blkcnt) {}
+
+static inline int blkcache_flush(int iftype, int dev)
+{
+	return 0;
+}
+
+static inline int blkcache_flush_all(void)
+{
+	return 0;
+}
+
+static inline int blkcache_select_hwpart(struct blk_desc *desc, int hwpart)
+{
+	return 0;
+}
+
 #endif
 
 #if CONFIG_IS_ENABLED(BLK)
@@ -439,14 +558,15 @@ static inline ulong blk_dread(struct blk_desc *block_dev, lbaint_t start,
 static inline ulong blk_dwrite(struct blk_desc *block_dev, lbaint_t start,
 			       lbaint_t blkcnt, const void *buffer)
 {
-	blkcache_invalidate(block_dev->if_type, block_dev->devnum);
+	if (blkcache_write(block_dev, start, blkcnt, buffer))
+		return blkcnt;
 	return block_dev->block_write(block_dev, start, blkcnt, buffer);
 }
 
 static inline ulong blk_derase(struct blk_desc *block_dev, lbaint_t start,
 			       lbaint_t blkcnt)
 {
-	blkcache_invalidate(block_dev->if_type, block_dev->devnum);
+	blkcache_discard(block_dev->if_type, block_dev->devnum, start, blkcnt);
 	return block_dev->block_erase(block_dev, start, blkcnt);
 }
 
@@ -576,6 +576,41 @@ int gunzip(void *, int, unsigned char *, unsigned long *);
 int zunzip(void *dst, int dstlen, unsigned char *src, unsigned long *lenp,
 						int stoponerr, int offset);
 
+struct z_stream_s;
+
+/**
+ * gunzip_stream_init() - Start decompressing gzip data which comes in pieces
+ *
+ * @s:		Stream state to set up
+ * @dst:	Buffer to decompress into
+ * @dstlen:	Size of @dst
+ * @return 0 if OK, -1 on error
+ */
+int gunzip_stream_init(struct z_stream_s *s, void *dst, ulong dstlen);
+
+/**
+ * gunzip_stream() - Decompress the next piece of a gzip stream
+ *
+ * The gzip header may be split across pieces. Once the stream ends, the
+ * rest of @src is ignored.
+ *
+ * @s:		Stream state from gunzip_stream_init()
+ * @src:	Next piece of compressed data
+ * @len:	Length of @src
+ * @return 1 if the stream ended and its CRC is correct, 0 if more data is
+ *	needed, -1 on error (including running out of space in the buffer)
+ */
+int gunzip_stream(struct z_stream_s *s, const void *src, ulong len);
+
+/**
+ * gunzip_stream_end() - Free the state of a gzip stream
+ *
+ * The number of bytes written to the buffer is in @s->total_out.
+ *
+ * @s:		Stream state from gunzip_stream_init()
+ */
+void gunzip_stream_end(struct z_stream_s *s);
+
 /**
  * gzwrite progress indicators: defined weak to allow board-specific
  * overrides:
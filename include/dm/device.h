@@ -21,6 +21,7 @@
 #include <linux/printk.h>
 
 struct driver_info;
+struct uclass_index_entry;
 
 /* Driver is active (probed). Cleared when it is removed */
 #define DM_FLAG_ACTIVATED		(1 << 0)
@@ -117,13 +118,16 @@ enum {
  * @child_head: List of children of this device
  * @sibling_node: Next device in list of all devices
  * @flags: Flags for this device DM_FLAG_...
- * @req_seq: Requested sequence number for this device (-1 = any)
+ * @req_seq: Requested sequence number for this device (-1 = any). This may
+ * only be changed by the bind() method or before the device is probed.
  * @seq: Allocated sequence number for this device (-1 = none). This is set up
  * when the device is probed and will be unique within the device's uclass.
  * @devres_head: List of memory allocations associated with this device.
  *		When CONFIG_DEVRES is enabled, devm_kmalloc() and friends will
  *		add to this list. Memory so-allocated will be freed
  *		automatically when the device is removed / unbound
+ * @index_entry: This device's entries in its uclass's index, or NULL if the
+ *		uclass has none (CONFIG_DM_UCLASS_INDEX)
  */
 struct udevice {
 	const struct driver *driver;
@@ -147,6 +151,9 @@ struct udevice {
 #ifdef CONFIG_DEVRES
 	struct list_head devres_head;
 #endif
+#if CONFIG_IS_ENABLED(DM_UCLASS_INDEX)
+	struct uclass_index_entry *index_entry;
+#endif
 };
 
 /* Maximum sequence number supported */
@@ -163,9 +170,32 @@ static inline int dev_of_offset(const struct udevice *dev)
 	return ofnode_to_offset(dev->node);
 }
 
+/**
+ * dev_set_ofnode() - Change the device tree node of a device
+ *
+ * This keeps the uclass's index of devices up to date, so must be used
+ * instead of setting @dev->node once the device is bound.
+ *
+ * @dev: Device to update
+ * @node: New node
+ */
+void dev_set_ofnode(struct udevice *dev, ofnode node);
+
+/**
+ * dev_set_req_seq() - Change the requested sequence number of a device
+ *
+ * Like dev_set_ofnode(), this keeps the uclass's index of devices up to
+ * date, so must be used instead of setting @dev->req_seq once the device
+ * is bound.
+ *
+ * @dev: Device to update
+ * @req_seq: New requested sequence number, or -1 for any
+ */
+void dev_set_req_seq(struct udevice *dev, int req_seq);
+
 static inline void dev_set_of_offset(struct udevice *dev, int of_offset)
 {
-	dev->node = offset_to_ofnode(of_offset);
+	dev_set_ofnode(dev, offset_to_ofnode(of_offset));
 }
 
 static inline bool dev_has_of_node(struct udevice *dev)
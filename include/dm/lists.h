@@ -33,6 +33,32 @@ struct driver *lists_driver_lookup_name(const char *name);
  */
 struct uclass_driver *lists_uclass_lookup(enum uclass_id id);
 
+/**
+ * lists_init() - Set up for looking up drivers
+ *
+ * This is called by dm_init(), after any manual relocation of the drivers.
+ * With CONFIG_DM_COMPAT_INDEX it builds the index used by
+ * lists_driver_lookup_compat(), forgetting any index from before
+ * relocation.
+ */
+void lists_init(void);
+
+/**
+ * lists_driver_lookup_compat() - Find the driver for a compatible string
+ *
+ * This finds the first driver, in linker-list order, which lists @compat
+ * in its of_match table. With CONFIG_DM_COMPAT_INDEX this uses an index of
+ * all the drivers' compatible strings, built by lists_init(). If there is
+ * no index, e.g. because there was too little memory, it searches every
+ * driver instead.
+ *
+ * @compat:	Compatible string to look up
+ * @idp:	Returns the entry of the driver's of_match table which matched
+ * @return pointer to driver, or NULL if not found
+ */
+struct driver *lists_driver_lookup_compat(const char *compat,
+					  const struct udevice_id **idp);
+
 /**
  * lists_bind_drivers() - search for and bind all drivers to parent
  *
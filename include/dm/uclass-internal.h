@@ -12,6 +12,23 @@
 
 #include <dm/ofnode.h>
 
+/**
+ * enum uclass_index_key - Keys by which a uclass's devices are indexed
+ *
+ * @UCLASS_INDEX_SEQ: Allocated sequence number, if any
+ * @UCLASS_INDEX_REQ_SEQ: Requested sequence number, if any
+ * @UCLASS_INDEX_OFNODE: Device tree node, if any
+ * @UCLASS_INDEX_PHANDLE: Phandle of the device tree node, if any
+ */
+enum uclass_index_key {
+	UCLASS_INDEX_SEQ,
+	UCLASS_INDEX_REQ_SEQ,
+	UCLASS_INDEX_OFNODE,
+	UCLASS_INDEX_PHANDLE,
+
+	UCLASS_INDEX_COUNT,
+};
+
 /**
  * uclass_get_device_tail() - handle the end of a get_device call
  *
@@ -132,6 +149,22 @@ int uclass_find_device_by_of_offset(enum uclass_id id, int node,
 int uclass_find_device_by_ofnode(enum uclass_id id, ofnode node,
 				 struct udevice **devp);
 
+/**
+ * uclass_find_device_by_phandle_id() - Find a uclass device by phandle
+ *
+ * This searches the devices in the uclass for one whose device tree node
+ * has the given phandle.
+ *
+ * The device is NOT probed, it is merely returned.
+ *
+ * @id: ID to look up
+ * @find_phandle: Phandle to search for (if 0 then -ENODEV is returned)
+ * @devp: Returns pointer to device (the first one with the phandle)
+ * @return 0 if OK, -ve on error
+ */
+int uclass_find_device_by_phandle_id(enum uclass_id id, uint find_phandle,
+				     struct udevice **devp);
+
 /**
  * uclass_bind_device() - Associate device with a uclass
  *
@@ -156,6 +189,21 @@ int uclass_unbind_device(struct udevice *dev);
 static inline int uclass_unbind_device(struct udevice *dev) { return 0; }
 #endif
 
+/**
+ * uclass_index_device() - Update a device's entries in its uclass's index
+ *
+ * This must be called after changing the name, sequence number, requested
+ * sequence number or device tree node of a device which is bound. It does
+ * nothing if the uclass has no index.
+ *
+ * @dev:	Pointer to the device
+ */
+#if CONFIG_IS_ENABLED(DM_UCLASS_INDEX)
+void uclass_index_device(struct udevice *dev);
+#else
+static inline void uclass_index_device(struct udevice *dev) {}
+#endif
+
 /**
  * uclass_pre_probe_device() - Deal with a device that is about to be probed
  *
@@ -201,6 +249,15 @@ static inline int uclass_pre_remove_device(struct udevice *dev) { return 0; }
  */
 struct uclass *uclass_find(enum uclass_id key);
 
+/**
+ * uclass_init_ids() - Set up the table of uclasses by ID
+ *
+ * This is called by dm_init() before any uclass is created. With
+ * CONFIG_DM_UCLASS_INDEX it allocates an empty table for uclass_find() to
+ * use instead of searching the list of uclasses.
+ */
+void uclass_init_ids(void);
+
 /**
  * uclass_destroy() - Destroy a uclass
  *
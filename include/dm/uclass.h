@@ -31,12 +31,23 @@
  * @dev_head: List of devices in this uclass (devices are attached to their
  * uclass when their bind method is called)
  * @sibling_node: Next uclass in the linked list of uclasses
+ * @index: Hash table of the devices by each enum uclass_index_key, or NULL
+ * to search @dev_head instead, as before relocation (CONFIG_DM_UCLASS_INDEX)
+ * @index_mask: Number of buckets for each key in @index less one
+ * @index_count: Number of entries in @index
+ * @index_pos: Position to give the next device bound
  */
 struct uclass {
 	void *priv;
 	struct uclass_driver *uc_drv;
 	struct list_head dev_head;
 	struct list_head sibling_node;
+#if CONFIG_IS_ENABLED(DM_UCLASS_INDEX)
+	struct hlist_head *index;
+	uint index_mask;
+	uint index_count;
+	uint index_pos;
+#endif
 };
 
 struct driver;
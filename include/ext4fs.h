@@ -133,6 +133,21 @@ int ext4_write_file(const char *filename, void *buf, loff_t offset, loff_t len,
 		    loff_t *actwrite);
 #endif
 
+/**
+ * struct ext4_block_run - A run of file blocks which are contiguous on disk
+ *
+ * @logical:	First block in the file
+ * @physical:	Its block in the filesystem, or 0 for a hole
+ * @len:	Number of blocks
+ * @unwritten:	The blocks are allocated but read as zeroes
+ */
+struct ext4_block_run {
+	uint32_t logical;
+	uint64_t physical;
+	uint32_t len;
+	bool unwritten;
+};
+
 struct ext_filesystem *get_fs(void);
 int ext4fs_open(const char *filename, loff_t *len);
 int ext4fs_read(char *buf, loff_t offset, loff_t len, loff_t *actread);
@@ -146,6 +161,22 @@ void ext4fs_free_node(struct ext2fs_node *node, struct ext2fs_node *currroot);
 int ext4fs_devread(lbaint_t sector, int byte_offset, int byte_len, char *buf);
 void ext4fs_set_blk_dev(struct blk_desc *rbdd, disk_partition_t *info);
 long int read_allocated_block(struct ext2_inode *inode, int fileblock);
+
+/**
+ * ext4fs_map_blocks() - Find where a run of file blocks is on disk
+ *
+ * The leaves of extent trees which are looked up are kept decoded, so
+ * that reading through a file walks its tree once per leaf rather than
+ * once per block.
+ *
+ * @inode:	Inode of the file
+ * @fileblock:	First block in the file to map
+ * @max:	Maximum number of blocks to map
+ * @run:	Returns the run starting at @fileblock, of up to @max blocks
+ * @return 0 if OK, -ve on error
+ */
+int ext4fs_map_blocks(struct ext2_inode *inode, uint32_t fileblock,
+		      uint32_t max, struct ext4_block_run *run);
 int ext4fs_probe(struct blk_desc *fs_dev_desc,
 		 disk_partition_t *fs_partition);
 int ext4_read_file(const char *filename, void *buf, loff_t offset, loff_t len,
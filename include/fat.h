@@ -25,6 +25,7 @@
 			 sizeof(dir_entry))
 
 #define FATBUFBLOCKS	6
+#define FATBUFWINDOWS	4
 #define FATBUFSIZE	(mydata->sect_size * FATBUFBLOCKS)
 #define FAT12BUFSIZE	((FATBUFSIZE*2)/3)
 #define FAT16BUFSIZE	(FATBUFSIZE/2)
@@ -155,6 +156,19 @@ typedef struct dir_slot {
 	__u8	name11_12[4];	/* Last 2 characters in name */
 } dir_slot;
 
+/*
+ * A window of FATBUFBLOCKS sectors of the FAT, held in the FAT buffer
+ *
+ * num:		Number of the window in the FAT, or -1 if unused
+ * used:	When the window was last used, to find the least recently used
+ * dirty:	Set if the window has been modified
+ */
+struct fat_window {
+	int	num;
+	__u32	used;
+	__u8	dirty;
+};
+
 /*
  * Private filesystem parameters
  *
@@ -162,16 +176,16 @@ typedef struct dir_slot {
  * (see FAT32 accesses)
  */
 typedef struct {
-	__u8	*fatbuf;	/* Current FAT buffer */
+	__u8	*fatbuf;	/* FAT buffer, FATBUFSIZE for each window */
 	int	fatsize;	/* Size of FAT in bits */
 	__u32	fatlength;	/* Length of FAT in sectors */
 	__u16	fat_sect;	/* Starting sector of the FAT */
-	__u8	fat_dirty;      /* Set if fatbuf has been modified */
 	__u32	rootdir_sect;	/* Start sector of root directory */
 	__u16	sect_size;	/* Size of sectors in bytes */
 	__u16	clust_size;	/* Size of clusters in sectors */
 	int	data_begin;	/* The sector of the first cluster, can be negative */
-	int	fatbufnum;	/* Used by get_fatent, init to -1 */
+	struct fat_window fatwin[FATBUFWINDOWS]; /* Windows in fatbuf */
+	__u32	fatwin_clock;	/* Counts uses of the windows */
 	int	rootdir_size;	/* Size of root dir for non-FAT32 */
 	__u32	root_cluster;	/* First cluster of root dir for FAT32 */
 } fsdata;
@@ -35,6 +35,7 @@ struct lmb;
 
 #define IMAGE_ENABLE_IGNORE	0
 #define IMAGE_INDENT_STRING	""
+#define IMAGE_ENABLE_STREAM_HASH	0
 
 #else
 
@@ -48,6 +49,7 @@ struct lmb;
 
 #define IMAGE_ENABLE_FIT	CONFIG_IS_ENABLED(FIT)
 #define IMAGE_ENABLE_OF_LIBFDT	CONFIG_IS_ENABLED(OF_LIBFDT)
+#define IMAGE_ENABLE_STREAM_HASH	CONFIG_IS_ENABLED(FIT_STREAM_HASH)
 
 #endif /* USE_HOSTCC */
 
@@ -982,6 +984,8 @@ int fit_image_get_data_offset(const void *fit, int noffset, int *data_offset);
 int fit_image_get_data_position(const void *fit, int noffset,
 				int *data_position);
 int fit_image_get_data_size(const void *fit, int noffset, int *data_size);
+int fit_image_get_data_and_size(const void *fit, int noffset,
+				const void **data, size_t *size);
 
 int fit_image_hash_get_algo(const void *fit, int noffset, char **algo);
 int fit_image_hash_get_value(const void *fit, int noffset, uint8_t **value,
@@ -1092,6 +1096,7 @@ struct image_sign_info {
 	int required_keynode;		/* Node offset of key to use: -1=any */
 	const char *require_keys;	/* Value for 'required' property */
 	const char *engine_id;		/* Engine to use for signing */
+	const uint8_t *checksum_value;	/* Checksum of the data, if known */
 };
 #endif /* Allow struct image_region to always be defined for rsa.h */
 
@@ -1311,6 +1316,42 @@ int board_fit_config_name_match(const char *name);
 void board_fit_image_post_process(void **p_image, size_t *p_size);
 #endif /* CONFIG_SPL_FIT_IMAGE_POST_PROCESS */
 
+#if IMAGE_ENABLE_STREAM_HASH
+/**
+ * fit_stream_load() - Hash a FIT's images while a loader brings it in
+ *
+ * A loader calls this with @size 0 when it starts loading to @addr, then
+ * again each time more of the image is in place. Once the FIT header has
+ * arrived, each image with external data and a hash or signature node is
+ * hashed as its data comes in, while it is still in the cache.
+ * fit_image_verify() then only has to compare the result, or check the
+ * signature against it.
+ *
+ * Data must arrive in order: a size smaller than the last one is ignored.
+ *
+ * @addr:	Address the image is being loaded to
+ * @size:	Number of bytes from @addr which are now loaded, 0 to start
+ */
+void fit_stream_load(ulong addr, ulong size);
+#else
+static inline void fit_stream_load(ulong addr, ulong size) {}
+#endif
+
+/**
+ * fit_stream_get_hash() - Get a hash worked out while a FIT was loaded
+ *
+ * For a signature node this is the checksum of the image data which the
+ * signature is over.
+ *
+ * @fit:	FIT which was loaded
+ * @noffset:	Offset of the image's hash or signature node
+ * @value:	Returns the hash value, FIT_MAX_HASH_LEN bytes at most
+ * @value_len:	Returns the length of the hash value
+ * @return 0 if OK, -ENOENT if this hash was not worked out during the load
+ */
+int fit_stream_get_hash(const void *fit, int noffset, uint8_t *value,
+			int *value_len);
+
 #define FDT_ERROR	((ulong)(-1))
 
 ulong fdt_getprop_u32(const void *fdt, int node, const char *prop);
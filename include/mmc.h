@@ -70,9 +70,12 @@
 #define MMC_MODE_4BIT		BIT(29)
 #define MMC_MODE_1BIT		BIT(28)
 #define MMC_MODE_SPI		BIT(27)
+/* SET_BLOCK_COUNT (CMD23) can be sent ahead of a multiple-block read */
+#define MMC_CAP_CMD23		BIT(26)
 
 
 #define SD_DATA_4BIT	0x00040000
+#define SD_SCR_CMD23_SUPPORT	BIT(1)
 
 #define IS_SD(x)	((x)->version & SD_VERSION_SD)
 #define IS_MMC(x)	((x)->version & MMC_VERSION_MMC)
@@ -629,6 +632,11 @@ struct mmc {
 				  * accessing the boot partitions
 				  */
 	u32 quirks;
+#ifndef CONFIG_SPL_BUILD
+	ulong cmd_count;	/* commands sent to the card */
+	ulong data_cmd_count;	/* commands which moved data */
+	u64 data_bytes;		/* bytes moved by those commands */
+#endif
 };
 
 struct mmc_hwpart_conf {
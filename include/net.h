@@ -485,6 +485,11 @@ struct icmp_hdr {
 #define PKTSIZE			1522
 #define PKTSIZE_ALIGN		1536
 
+#if defined(CONFIG_IP_DEFRAG) && !defined(CONFIG_NET_MAXDEFRAG)
+/* Largest datagram which can be reassembled from fragments */
+#define CONFIG_NET_MAXDEFRAG	16384
+#endif
+
 /*
  * Maximum receive ring size; that is, the number of packets
  * we can buffer before overflow happens. Basically, this just
@@ -10,6 +10,7 @@
 #ifndef __SDHCI_HW_H
 #define __SDHCI_HW_H
 
+#include <linux/errno.h>
 #include <asm/io.h>
 #include <mmc.h>
 #include <asm/gpio.h>
@@ -182,6 +183,7 @@
 /* 55-57 reserved */
 
 #define SDHCI_ADMA_ADDRESS	0x58
+#define SDHCI_ADMA_ADDRESS_HI	0x5C
 
 /* 60-FB reserved */
 
@@ -215,6 +217,8 @@
 #define SDHCI_QUIRK_BROKEN_VOLTAGE	(1 << 4)
 #define SDHCI_QUIRK_WAIT_SEND_CMD	(1 << 6)
 #define SDHCI_QUIRK_USE_WIDE8		(1 << 8)
+/* Controller cannot send SET_BLOCK_COUNT (CMD23) before a transfer */
+#define SDHCI_QUIRK_NO_CMD23		(1 << 9)
 
 /* to make gcc happy */
 struct sdhci_host;
@@ -224,6 +228,54 @@ struct sdhci_host;
  */
 #define SDHCI_DEFAULT_BOUNDARY_SIZE	(512 * 1024)
 #define SDHCI_DEFAULT_BOUNDARY_ARG	(7)
+
+/*
+ * ADMA2 descriptor table. Each descriptor moves up to ADMA_MAX_LEN bytes, so
+ * there are enough descriptors for the largest transfer the MMC core sends.
+ * 32-bit descriptors leave out @addr_hi.
+ */
+#define ADMA_MAX_LEN		65532
+#define ADMA_DESC_32_LEN	8
+#define ADMA_DESC_64_LEN	12
+#define ADMA_ALIGN		4
+#define ADMA_TABLE_NO_ENTRIES	DIV_ROUND_UP(CONFIG_SYS_MMC_MAX_BLK_COUNT * \
+					     MMC_MAX_BLOCK_LEN, ADMA_MAX_LEN)
+#define ADMA_TABLE_SZ		(ADMA_TABLE_NO_ENTRIES * ADMA_DESC_64_LEN)
+
+#define ADMA_DESC_ATTR_VALID	BIT(0)
+#define ADMA_DESC_ATTR_END	BIT(1)
+#define ADMA_DESC_ATTR_INT	BIT(2)
+#define ADMA_DESC_ATTR_ACT1	BIT(4)
+#define ADMA_DESC_ATTR_ACT2	BIT(5)
+#define ADMA_DESC_TRANSFER_DATA	ADMA_DESC_ATTR_ACT2
+
+struct sdhci_adma_desc {
+	u8 attr;
+	u8 reserved;
+	__le16 len;
+	__le32 addr_lo;
+	__le32 addr_hi;
+} __packed;
+
+/**
+ * struct sdhci_adma_seg - One piece of memory in an ADMA2 transfer
+ *
+ * @addr:	Bus address of the piece, aligned to ADMA_ALIGN
+ * @len:	Length of the piece in bytes
+ */
+struct sdhci_adma_seg {
+	dma_addr_t addr;
+	uint len;
+};
+
+/*
+ * host->flags: which kind of DMA the controller is set up for
+ */
+#define USE_SDMA	BIT(0)
+#define USE_ADMA	BIT(1)
+#define USE_ADMA64	BIT(2)
+#define USE_DMA		(USE_SDMA | USE_ADMA | USE_ADMA64)
+
 struct sdhci_ops {
 #ifdef CONFIG_MMC_SDHCI_IO_ACCESSORS
 	u32	(*read_l)(struct sdhci_host *host, int reg);
@@ -243,6 +295,7 @@ struct sdhci_host {
 	const char *name;
 	void *ioaddr;
 	unsigned int quirks;
+	unsigned int flags;
 	unsigned int host_caps;
 	unsigned int version;
 	unsigned int max_clk;   /* Maximum Base Clock frequency */
@@ -259,6 +312,9 @@ struct sdhci_host {
 	uint	voltages;
 
 	struct mmc_config cfg;
+#ifdef CONFIG_MMC_SDHCI_ADMA
+	void *adma_desc_table;	/* Allocated by sdhci_setup_cfg() if NULL */
+#endif
 };
 
 #ifdef CONFIG_MMC_SDHCI_IO_ACCESSORS
@@ -410,6 +466,52 @@ int sdhci_bind(struct udevice *dev, struct mmc *mmc, struct mmc_config *cfg);
 int add_sdhci(struct sdhci_host *host, u32 f_max, u32 f_min);
 #endif /* !CONFIG_BLK */
 
+#ifdef CONFIG_MMC_SDHCI_ADMA
+/**
+ * sdhci_prepare_adma_table() - Set up an ADMA2 transfer from several pieces
+ *
+ * This fills the host's descriptor table so that the controller moves the
+ * data to or from each piece of memory in turn, as if they were one buffer,
+ * and selects ADMA2 for the next transfer.
+ *
+ * @host:	SDHCI host
+ * @segs:	Pieces of memory, in order
+ * @count:	Number of pieces
+ * @return 0 if OK, -ENOTSUPP if the host is not using ADMA2, -EINVAL if a
+ *	piece is empty, misaligned or out of reach of 32-bit descriptors,
+ *	-E2BIG if the pieces need more descriptors than the table holds
+ */
+int sdhci_prepare_adma_table(struct sdhci_host *host,
+			     const struct sdhci_adma_seg *segs, int count);
+#else
+static inline int sdhci_prepare_adma_table(struct sdhci_host *host,
+					   const struct sdhci_adma_seg *segs,
+					   int count)
+{
+	return -ENOTSUPP;
+}
+#endif
+
+/**
+ * sdhci_send_command_segs() - Send a command whose data is in several pieces
+ *
+ * This is like the send_cmd operation, but the data is moved to or from
+ * the pieces of memory in @segs instead of @data's buffer, with a single
+ * ADMA2 transfer. @data still gives the block size, count and direction.
+ * The pieces must add up to the whole transfer.
+ *
+ * @mmc:	MMC device
+ * @cmd:	Command to send
+ * @data:	Data transfer for the command
+ * @segs:	Pieces of memory, in order
+ * @count:	Number of pieces
+ * @return 0 if OK, -ENOTSUPP if the host is not using ADMA2, -EINVAL if the
+ *	pieces do not match @data or cannot be used, other -ve on error
+ */
+int sdhci_send_command_segs(struct mmc *mmc, struct mmc_cmd *cmd,
+			    struct mmc_data *data,
+			    const struct sdhci_adma_seg *segs, int count);
+
 #ifdef CONFIG_DM_MMC
 /* Export the operations to drivers */
 int sdhci_probe(struct udevice *dev);
@@ -91,6 +91,10 @@ struct dm_spi_slave_platdata {
  * @max_write_size:	If non-zero, the maximum number of bytes which can
  *			be written at once.
  * @memory_map:		Address of read-only SPI flash access.
+ * @flash_cmds:		Which SPI flash commands the controller can send
+ *			(SPI_FLASH_CMDS_...). Controllers which decode the
+ *			opcodes set SPI_FLASH_CMDS_NO_... for those they do
+ *			not know.
  * @flags:		Indication of SPI flags.
  */
 struct spi_slave {
@@ -107,6 +111,9 @@ struct spi_slave {
 	unsigned int max_read_size;
 	unsigned int max_write_size;
 	void *memory_map;
+	uint flash_cmds;
+#define SPI_FLASH_CMDS_NO_CHIP_ERASE	BIT(0)	/* No chip erase (0xc7) */
+#define SPI_FLASH_CMDS_NO_ADDR_4B	BIT(1)	/* No 4-byte address opcodes */
 
 	u8 flags;
 #define SPI_XFER_BEGIN		BIT(0)	/* Assert CS before transfer */
@@ -26,8 +26,69 @@
 # define CONFIG_SF_DEFAULT_BUS		0
 #endif
 
+#define SPI_FLASH_MAX_ERASE_TYPES	4
+
 struct spi_slave;
 
+/**
+ * struct spi_flash_erase_type - Erase operation supported by a SPI flash
+ *
+ * @size:		Number of bytes erased by one command, 0 if unused
+ * @cmd:		Erase cmd
+ */
+struct spi_flash_erase_type {
+	u32 size;
+	u8 cmd;
+};
+
+/* Operations which keep the flash busy, each with its own timing */
+enum spi_flash_op {
+	SPI_FLASH_OP_PROGRAM,
+	/* One for each of the erase types, in the same order */
+	SPI_FLASH_OP_ERASE,
+	SPI_FLASH_OP_CHIP_ERASE = SPI_FLASH_OP_ERASE + SPI_FLASH_MAX_ERASE_TYPES,
+
+	SPI_FLASH_OP_COUNT,
+};
+
+/*
+ * Busy times are counted by how they compare with the typical time: under
+ * 1/2, under 1, under 2, under 4, under 8 and 8 or more times typical.
+ */
+#define SPI_FLASH_TIMING_BUCKETS	6
+
+/**
+ * struct spi_flash_timing - How long the flash is busy with an operation
+ *
+ * The wait time says when to start polling the status, and the maximum
+ * is the timeout. The rest records what was seen: operations which take
+ * longer and longer than typical are a sign of a wearing out part.
+ *
+ * @typ_us:		Typical busy time in microseconds
+ * @max_ms:		Maximum busy time in milliseconds
+ * @wait_us:		Time before the status is first polled: 3/4 of the
+ *			typical time if the part gives it, else 0
+ * @count:		Number of operations which completed
+ * @timeouts:		Number of operations which timed out
+ * @polls:		Number of times the status was read
+ * @min_us:		Shortest busy time seen
+ * @max_us:		Longest busy time seen
+ * @total_us:		Total busy time of all operations
+ * @hist:		Number of operations in each bucket, see above
+ */
+struct spi_flash_timing {
+	u32 typ_us;
+	u32 max_ms;
+	u32 wait_us;
+	u32 count;
+	u32 timeouts;
+	u32 polls;
+	u32 min_us;
+	u32 max_us;
+	u64 total_us;
+	u32 hist[SPI_FLASH_TIMING_BUCKETS];
+};
+
 /**
  * struct spi_flash - SPI flash structure
  *
@@ -45,9 +106,14 @@ struct spi_slave;
  * @bank_write_cmd:	Bank write cmd
  * @bank_curr:		Current flash bank
  * @erase_cmd:		Erase cmd 4K, 32K, 64K
+ * @erase_types:	Erase cmds usable by the erase planner, largest first
+ * @addr_width:		Number of address bytes sent with each cmd, 3 or 4
+ * @timing:		Busy time model and statistics for each spi_flash_op
  * @read_cmd:		Read cmd - Array Fast, Extn read and quad read.
  * @write_cmd:		Write cmd - page and quad program.
  * @dummy_byte:		Dummy cycles for read operation.
+ * @dual_dummy:		Dummy bytes of the dual output read
+ * @quad_dummy:		Dummy bytes of the quad output read
  * @memory_map:		Address of read-only SPI flash access
  * @flash_lock:		lock a region of the SPI Flash
  * @flash_unlock:	unlock a region of the SPI Flash
@@ -83,6 +149,11 @@ struct spi_flash {
 	u8 read_cmd;
 	u8 write_cmd;
 	u8 dummy_byte;
+	u8 dual_dummy;
+	u8 quad_dummy;
+	struct spi_flash_erase_type erase_types[SPI_FLASH_MAX_ERASE_TYPES];
+	u8 addr_width;
+	struct spi_flash_timing timing[SPI_FLASH_OP_COUNT];
 
 	void *memory_map;
 
@@ -115,6 +186,86 @@ struct dm_spi_flash_ops {
 	int (*erase)(struct udevice *dev, u32 offset, size_t len);
 };
 
+/* Default size of each buffer handed out by spi_flash_read_stream() */
+#define SPI_FLASH_STREAM_CHUNK	(64 << 10)
+
+/**
+ * spi_flash_stream_fn - Consume data read by spi_flash_read_stream()
+ *
+ * @priv:	Private data passed to spi_flash_read_stream()
+ * @offset:	Offset in the flash of the data
+ * @buf:	Data read from the flash
+ * @len:	Number of bytes in @buf
+ * @return 0 to carry on reading, else an error which stops the read
+ */
+typedef int (*spi_flash_stream_fn)(void *priv, u32 offset, const void *buf,
+				   size_t len);
+
+/**
+ * spi_flash_read_stream() - Read from SPI flash, handing each chunk on
+ *
+ * This keeps the SPI bus claimed for the whole read, only releasing it when
+ * the bank register has to change, and calls @fn for each chunk as soon as
+ * it is read. This suits a consumer such as a hash or decompressor which
+ * can work on the data while it streams in, rather than waiting for the
+ * whole image.
+ *
+ * If @data is NULL, the chunks are read into two buffers used in turn, so
+ * the buffer passed to @fn stays valid until @fn returns for the next one.
+ * A consumer can therefore look back into the previous chunk. Otherwise the
+ * chunks are read into @data and @fn is passed pointers into it.
+ *
+ * Memory-mapped flash is not copied unless @data is given.
+ *
+ * @flash:	SPI flash to read from
+ * @offset:	Offset into the flash to start reading
+ * @len:	Number of bytes to read
+ * @data:	Buffer to read into, or NULL to use internal buffers
+ * @chunk:	Maximum number of bytes to pass to @fn at once, or 0 for
+ *		SPI_FLASH_STREAM_CHUNK
+ * @fn:		Function to call with each chunk
+ * @priv:	Private data for @fn
+ * @return 0 if OK, -ve on read error, or the error returned by @fn
+ */
+int spi_flash_read_stream(struct spi_flash *flash, u32 offset, size_t len,
+			  void *data, size_t chunk, spi_flash_stream_fn fn,
+			  void *priv);
+
+/* Read commands which a flash may support, slowest first */
+enum spi_flash_read_mode {
+	SPI_FLASH_READ_SLOW,		/* no dummy cycles */
+	SPI_FLASH_READ_FAST,
+	SPI_FLASH_READ_DUAL,		/* dual output */
+	SPI_FLASH_READ_QUAD,		/* quad output */
+
+	SPI_FLASH_READ_MODE_COUNT,
+};
+
+/**
+ * spi_flash_set_read_mode() - Change the command used to read the flash
+ *
+ * This is meant for benchmarking the read commands against each other. A
+ * mode is only available if both the flash and the SPI bus support it.
+ * Quad reads also need the quad enable bit, so they are only available if
+ * the bit was set when the flash was probed. Dual and quad reads use the
+ * dummy cycles found at probe time.
+ *
+ * @flash:	SPI flash to change
+ * @mode:	Read mode to use from now on
+ * @return 0 if OK, -ENOTSUPP if the mode is not available
+ */
+#ifdef CONFIG_SPI_FLASH
+int spi_flash_set_read_mode(struct spi_flash *flash,
+			    enum spi_flash_read_mode mode);
+#else
+/* Flash drivers which do not use the common SPI flash code cannot change it */
+static inline int spi_flash_set_read_mode(struct spi_flash *flash,
+					  enum spi_flash_read_mode mode)
+{
+	return -ENOTSUPP;
+}
+#endif
+
 /* Access the serial operations for a device */
 #define sf_get_ops(dev) ((struct dm_spi_flash_ops *)(dev)->driver->ops)
 
@@ -190,6 +341,120 @@ int sandbox_sf_bind_emul(struct sandbox_state *state, int busnum, int cs,
 
 void sandbox_sf_unbind_emul(struct sandbox_state *state, int busnum, int cs);
 
+/**
+ * sandbox_sf_set_sfdp_only() - Hide an emulated flash from the ID table
+ *
+ * The emulator then reports a JEDEC ID which is not in spi_flash_ids[], so
+ * the flash can only be probed using its SFDP tables.
+ *
+ * @dev:	SPI flash emulator device
+ * @sfdp_only:	true to report an unknown ID, false for the real one
+ */
+void sandbox_sf_set_sfdp_only(struct udevice *dev, bool sfdp_only);
+
+/**
+ * sandbox_sf_set_sfdp_qer() - Change the quad enable method in the SFDP
+ *
+ * @dev:	SPI flash emulator device
+ * @qer:	Quad enable requirement to report (enum sfdp_qer)
+ */
+void sandbox_sf_set_sfdp_qer(struct udevice *dev, uint qer);
+
+/**
+ * sandbox_sf_set_quad_dummy() - Change the dummy cycles of a quad read
+ *
+ * The emulator then needs this many dummy bytes after the address of a
+ * quad output read, and gives the new value in its SFDP tables. This also
+ * resets any other change made to the SFDP tables.
+ *
+ * @dev:	SPI flash emulator device
+ * @dummy:	Number of dummy bytes (the default is 1)
+ */
+void sandbox_sf_set_quad_dummy(struct udevice *dev, uint dummy);
+
+/**
+ * struct sandbox_sf_timing - How long an emulated flash takes
+ *
+ * A busy time of 0 uses the typical time given in the emulator's SFDP
+ * tables.
+ *
+ * @sck_hz:		Serial clock rate, or 0 for transfers to take no time
+ * @pp_us:		Busy time of a page program
+ * @erase_4k_us:	Busy time of a 4KiB erase
+ * @erase_32k_us:	Busy time of a 32KiB erase
+ * @erase_us:		Busy time of a sector erase
+ * @chip_erase_us:	Busy time of a chip erase
+ */
+struct sandbox_sf_timing {
+	uint sck_hz;
+	uint pp_us;
+	uint erase_4k_us;
+	uint erase_32k_us;
+	uint erase_us;
+	uint chip_erase_us;
+};
+
+/**
+ * sandbox_sf_set_timing() - Make an emulated flash take time
+ *
+ * Transfers then take as long as they would at the given clock rate, with
+ * the data of dual and quad reads on 2 or 4 lines. After each program or
+ * erase the flash reports itself busy in the status register, and ignores
+ * other commands, until the busy time is up.
+ *
+ * @dev:	SPI flash emulator device
+ * @timing:	Timing to use, or NULL for everything to complete at once
+ */
+void sandbox_sf_set_timing(struct udevice *dev,
+			   const struct sandbox_sf_timing *timing);
+
+/**
+ * enum sandbox_sf_fault - Failures which an emulated flash can inject
+ *
+ * @SANDBOX_SF_FAULT_NONE:	Everything works
+ * @SANDBOX_SF_FAULT_PROGRAM:	A page program leaves the page unchanged
+ * @SANDBOX_SF_FAULT_ERASE:	An erase leaves the sector unchanged
+ */
+enum sandbox_sf_fault {
+	SANDBOX_SF_FAULT_NONE,
+	SANDBOX_SF_FAULT_PROGRAM,
+	SANDBOX_SF_FAULT_ERASE,
+};
+
+/**
+ * sandbox_sf_set_fault() - Make an emulated flash fail a program or erase
+ *
+ * The flash still takes the usual time and reports no error, as a real
+ * one does, so only reading the data back shows the failure. The fault
+ * is injected once, then cleared.
+ *
+ * @dev:	SPI flash emulator device
+ * @fault:	Operation to fail
+ * @skip:	Number of those operations to let through first
+ */
+void sandbox_sf_set_fault(struct udevice *dev, enum sandbox_sf_fault fault,
+			  int skip);
+
+/**
+ * sandbox_sf_get_cmd_count() - Count the commands sent to an emulated flash
+ *
+ * @dev:	SPI flash emulator device
+ * @cmd:	Command opcode
+ * @return number of times @cmd has been sent since the emulator was bound
+ */
+uint sandbox_sf_get_cmd_count(struct udevice *dev, u8 cmd);
+
+/**
+ * sandbox_sf_get_model_time() - Get the time an emulated flash has taken
+ *
+ * These are the times given by the timing model, whatever the host took.
+ *
+ * @dev:	SPI flash emulator device
+ * @sck_ns:	Returns the total time spent clocking transfers
+ * @busy_us:	Returns the total time spent busy with programs and erases
+ */
+void sandbox_sf_get_model_time(struct udevice *dev, u64 *sck_ns, u64 *busy_us);
+
 #else
 struct spi_flash *spi_flash_probe(unsigned int bus, unsigned int cs,
 		unsigned int max_hz, unsigned int spi_mode);
@@ -17,6 +17,30 @@ uint32_t crc32 (uint32_t, const unsigned char *, uint);
 uint32_t crc32_wd (uint32_t, const unsigned char *, uint, uint);
 uint32_t crc32_no_comp (uint32_t, const unsigned char *, uint);
 
+/**
+ * crc32_no_comp_generic() - CRC32 without ones complement, in portable C
+ *
+ * @crc:	CRC so far
+ * @buf:	Data to add to the CRC
+ * @len:	Number of bytes in @buf
+ * @return new CRC
+ */
+uint32_t crc32_no_comp_generic(uint32_t crc, const unsigned char *buf,
+			       uint len);
+
+/**
+ * crc32_no_comp_arch() - CRC32 without ones complement, using CPU instructions
+ *
+ * An architecture can provide this to use instructions which only some
+ * CPUs have. It must check that this CPU has them each time.
+ *
+ * @crc:	CRC so far, updated if the CPU could work it out
+ * @buf:	Data to add to the CRC
+ * @len:	Number of bytes in @buf
+ * @return 0 if OK, -ENOSYS if this CPU cannot work out the CRC this way
+ */
+int crc32_no_comp_arch(uint32_t *crc, const unsigned char *buf, uint len);
+
 /**
  * crc32_wd_buf - Perform CRC32 on a buffer and return result in buffer
  *
@@ -32,4 +56,23 @@ void crc32_wd_buf(const unsigned char *input, uint ilen,
 void crc32c_init(uint32_t *, uint32_t);
 uint32_t crc32c_cal(uint32_t, const char *, int, uint32_t *);
 
+/**
+ * crc32c_no_comp() - CRC32C (Castagnoli) without ones complement
+ *
+ * This gives the same result as crc32c_cal() with a table set up by
+ * crc32c_init(table, 0x82f63b78), but needs no table from the caller and
+ * uses CPU instructions where there are any.
+ *
+ * @crc:	CRC so far
+ * @buf:	Data to add to the CRC
+ * @len:	Number of bytes in @buf
+ * @return new CRC
+ */
+uint32_t crc32c_no_comp(uint32_t crc, const unsigned char *buf, uint len);
+
+/* As crc32_no_comp_generic() and crc32_no_comp_arch(), for CRC32C */
+uint32_t crc32c_no_comp_generic(uint32_t crc, const unsigned char *buf,
+				uint len);
+int crc32c_no_comp_arch(uint32_t *crc, const unsigned char *buf, uint len);
+
 #endif /* _UBOOT_CRC_H */
@@ -0,0 +1,115 @@
+/*
+ * Streaming decompression of the LZ4 frame format
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef _UBOOT_LZ4_H
+#define _UBOOT_LZ4_H
+
+#include <linux/types.h>
+
+struct blk_desc;
+
+/* Running xxHash32 of the decompressed data, for the content checksum */
+struct ulz4f_xxh32 {
+	u32 v[4];
+	u64 total;
+	u8 mem[16];
+	uint memsize;
+};
+
+/**
+ * struct ulz4f_stream - State of an LZ4 frame being decompressed in pieces
+ *
+ * Set up with ulz4f_stream_init(); all fields are private.
+ *
+ * @write:	Called with each piece of decompressed data in order
+ * @priv:	Private data passed to @write
+ * @verify:	true to check the header, block and content checksums
+ * @state:	What is being collected (enum ulz4f_state in lz4_wrapper.c)
+ * @flags:	Frame descriptor flags
+ * @block_max:	Maximum size of a block in this frame
+ * @block:	Header of the current block
+ * @have:	Bytes of the current item collected so far
+ * @need:	Bytes in the current item
+ * @hdr:	Frame header, block header or checksum being collected
+ * @in:		Block being collected when it is split across calls, or NULL
+ * @out:	Decompressed block, or NULL before the frame header is read
+ * @total_out:	Bytes passed to @write so far
+ * @content_size: Size given in the frame header, or 0 if none
+ * @xxh:	Checksum of the data passed to @write so far
+ */
+struct ulz4f_stream {
+	int (*write)(void *priv, const void *buf, size_t len);
+	void *priv;
+	bool verify;
+	int state;
+	u8 flags;
+	size_t block_max;
+	u32 block;
+	size_t have;
+	size_t need;
+	u8 hdr[15];
+	u8 *in;
+	u8 *out;
+	u64 total_out;
+	u64 content_size;
+	struct ulz4f_xxh32 xxh;
+};
+
+/**
+ * ulz4f_stream_init() - Set up to decompress an LZ4 frame in pieces
+ *
+ * @s:		Stream state to set up
+ * @write:	Called with each piece of decompressed data, in order. It
+ *		returns 0 if OK, or -ve to stop decompression with that error
+ * @priv:	Private data passed to @write
+ * @verify:	true to check the checksums which the frame has
+ */
+void ulz4f_stream_init(struct ulz4f_stream *s,
+		       int (*write)(void *priv, const void *buf, size_t len),
+		       void *priv, bool verify);
+
+/**
+ * ulz4f_stream_feed() - Decompress the next piece of an LZ4 frame
+ *
+ * Input may be split anywhere. A block which arrives in one piece is
+ * decompressed where it is; otherwise it is first collected in a buffer
+ * as large as the frame's maximum block size.
+ *
+ * @s:		Stream state from ulz4f_stream_init()
+ * @src:	Next piece of the frame
+ * @len:	Number of bytes in @src
+ * @return 1 if the frame has ended (and any data after it is ignored), 0 if
+ *	more input is needed, -ve on error
+ */
+int ulz4f_stream_feed(struct ulz4f_stream *s, const void *src, size_t len);
+
+/**
+ * ulz4f_stream_finish() - Finish decompressing an LZ4 frame
+ *
+ * This frees the buffers used for decompression.
+ *
+ * @s:		Stream state from ulz4f_stream_init()
+ * @return 0 if the whole frame was decompressed, -EINVAL if it was cut short
+ */
+int ulz4f_stream_finish(struct ulz4f_stream *s);
+
+/**
+ * lz4write() - Decompress an LZ4 frame from memory to a block device
+ *
+ * This works like gzwrite(), holding only @szwritebuf bytes of output and
+ * one block of the frame at a time.
+ *
+ * @src:	Compressed frame
+ * @len:	Length of @src in bytes
+ * @dev:	Block device to write to
+ * @szwritebuf:	Bytes per write, a multiple of the device's block size
+ * @startoffs:	Offset in bytes of the first write
+ * @return 0 if OK, -ve on error
+ */
+int lz4write(const void *src, size_t len, struct blk_desc *dev,
+	     ulong szwritebuf, u64 startoffs);
+
+#endif /* _UBOOT_LZ4_H */
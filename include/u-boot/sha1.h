@@ -31,7 +31,7 @@ extern const uint8_t sha1_der_prefix[];
 typedef struct
 {
     unsigned long total[2];	/*!< number of bytes processed	*/
-    unsigned long state[5];	/*!< intermediate digest state	*/
+    uint32_t state[5];		/*!< intermediate digest state	*/
     unsigned char buffer[64];	/*!< data block being processed */
 }
 sha1_context;
@@ -53,6 +53,30 @@ void sha1_starts( sha1_context *ctx );
 void sha1_update(sha1_context *ctx, const unsigned char *input,
 		 unsigned int ilen);
 
+/**
+ * \brief	   SHA-1 hash whole blocks in portable C
+ *
+ * \param state    intermediate digest state
+ * \param data	   data to hash, which need not be aligned
+ * \param blocks   number of 64-byte blocks in data
+ */
+void sha1_process_generic(uint32_t state[5], const unsigned char *data,
+			  unsigned int blocks);
+
+/**
+ * \brief	   SHA-1 hash whole blocks using CPU instructions
+ *
+ * An architecture can provide this to use instructions which only some
+ * CPUs have. It must check that this CPU has them each time.
+ *
+ * \param state    intermediate digest state
+ * \param data	   data to hash, which need not be aligned
+ * \param blocks   number of 64-byte blocks in data
+ * \return	   0 if OK, -ENOSYS if this CPU cannot hash this way
+ */
+int sha1_process_arch(uint32_t state[5], const unsigned char *data,
+		      unsigned int blocks);
+
 /**
  * \brief	   SHA-1 final digest
  *
@@ -19,6 +19,30 @@ void sha256_starts(sha256_context * ctx);
 void sha256_update(sha256_context *ctx, const uint8_t *input, uint32_t length);
 void sha256_finish(sha256_context * ctx, uint8_t digest[SHA256_SUM_LEN]);
 
+/**
+ * sha256_process_generic() - Hash whole blocks in portable C
+ *
+ * @state:	Hash state to update
+ * @data:	Data to hash, which need not be aligned
+ * @blocks:	Number of 64-byte blocks in @data
+ */
+void sha256_process_generic(uint32_t state[8], const uint8_t *data,
+			    unsigned int blocks);
+
+/**
+ * sha256_process_arch() - Hash whole blocks using CPU instructions
+ *
+ * An architecture can provide this to use instructions which only some
+ * CPUs have. It must check that this CPU has them each time.
+ *
+ * @state:	Hash state to update
+ * @data:	Data to hash, which need not be aligned
+ * @blocks:	Number of 64-byte blocks in @data
+ * @return 0 if OK, -ENOSYS if this CPU cannot hash this way
+ */
+int sha256_process_arch(uint32_t state[8], const uint8_t *data,
+			unsigned int blocks);
+
 void sha256_csum_wd(const unsigned char *input, unsigned int ilen,
 		unsigned char *output, unsigned int chunk_sz);
 
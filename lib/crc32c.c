@@ -12,6 +12,15 @@
 
 #include <common.h>
 #include <compiler.h>
+#include <errno.h>
+#include <u-boot/crc.h>
+
+#if CONFIG_IS_ENABLED(CRC32_SLICE8)
+#define CRC32C_TABLE_ROWS	8
+#else
+#define CRC32C_TABLE_ROWS	1
+#endif
+#include <generated/crc32table.h>
 
 uint32_t crc32c_cal(uint32_t crc, const char *data, int length,
 		    uint32_t *crc32c_table)
@@ -36,3 +45,44 @@ void crc32c_init(uint32_t *crc32c_table, uint32_t pol)
 		crc32c_table[i] = v;
 	}
 }
+
+uint32_t crc32c_no_comp_generic(uint32_t crc, const unsigned char *buf,
+				uint len)
+{
+#if CRC32C_TABLE_ROWS == 8
+	uint32_t one, two;
+
+	for (; len >= 8; len -= 8, buf += 8) {
+		one = crc ^ (buf[0] | buf[1] << 8 | buf[2] << 16 |
+			     (uint32_t)buf[3] << 24);
+		two = buf[4] | buf[5] << 8 | buf[6] << 16 |
+			(uint32_t)buf[7] << 24;
+		crc = crc32c_table[7][one & 0xff] ^
+		      crc32c_table[6][(one >> 8) & 0xff] ^
+		      crc32c_table[5][(one >> 16) & 0xff] ^
+		      crc32c_table[4][one >> 24] ^
+		      crc32c_table[3][two & 0xff] ^
+		      crc32c_table[2][(two >> 8) & 0xff] ^
+		      crc32c_table[1][(two >> 16) & 0xff] ^
+		      crc32c_table[0][two >> 24];
+	}
+#endif
+	while (len--)
+		crc = crc32c_table[0][(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+
+	return crc;
+}
+
+__weak int crc32c_no_comp_arch(uint32_t *crc, const unsigned char *buf,
+			       uint len)
+{
+	return -ENOSYS;
+}
+
+uint32_t crc32c_no_comp(uint32_t crc, const unsigned char *buf, uint len)
+{
+	if (!crc32c_no_comp_arch(&crc, buf, len))
+		return crc;
+
+	return crc32c_no_comp_generic(crc, buf, len);
+}
@@ -80,6 +80,51 @@ int gunzip(void *dst, int dstlen, unsigned char *src, unsigned long *lenp)
 	return zunzip(dst, dstlen, src, lenp, 1, offset);
 }
 
+int gunzip_stream_init(struct z_stream_s *s, void *dst, ulong dstlen)
+{
+	int r;
+
+	memset(s, '\0', sizeof(*s));
+	s->zalloc = gzalloc;
+	s->zfree = gzfree;
+
+	/* Let zlib parse the header and check the CRC in the trailer */
+	r = inflateInit2(s, 16 + MAX_WBITS);
+	if (r != Z_OK) {
+		printf("Error: inflateInit2() returned %d\n", r);
+		return -1;
+	}
+	s->next_out = dst;
+	s->avail_out = dstlen;
+
+	return 0;
+}
+
+int gunzip_stream(struct z_stream_s *s, const void *src, ulong len)
+{
+	int r;
+
+	s->next_in = (void *)src;
+	s->avail_in = len;
+	while (s->avail_in) {
+		r = inflate(s, Z_NO_FLUSH);
+		if (r == Z_STREAM_END)
+			return 1;
+		if (r != Z_OK) {
+			printf("Error: inflate() returned %d\n", r);
+			return -1;
+		}
+		WATCHDOG_RESET();
+	}
+
+	return 0;
+}
+
+void gunzip_stream_end(struct z_stream_s *s)
+{
+	inflateEnd(s);
+}
+
 #ifdef CONFIG_CMD_UNZIP
 __weak
 void gzwrite_progress_init(u64 expectedsize)
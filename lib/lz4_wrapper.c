@@ -5,9 +5,17 @@
  */
 
 #include <common.h>
+#include <blk.h>
 #include <compiler.h>
+#include <console.h>
+#include <div64.h>
+#include <malloc.h>
+#include <memalign.h>
+#include <watchdog.h>
 #include <linux/kernel.h>
 #include <linux/types.h>
+#include <asm/unaligned.h>
+#include <u-boot/lz4.h>
 
 static u16 LZ4_readLE16(const void *src) { return le16_to_cpu(*(u16 *)src); }
 static void LZ4_copy4(void *dst, const void *src) { *(u32 *)dst = *(u32 *)src; }
@@ -137,3 +145,408 @@ int ulz4fn(const void *src, size_t srcn, void *dst, size_t *dstn)
 	*dstn = out - dst;
 	return ret;
 }
+
+/* Frame descriptor flags which the stream decoder tests */
+#define LZ4F_FLG_BLOCK_CHECKSUM		BIT(4)
+#define LZ4F_FLG_CONTENT_SIZE		BIT(3)
+#define LZ4F_FLG_CONTENT_CHECKSUM	BIT(2)
+
+enum ulz4f_state {
+	ULZ4F_MAGIC,		/* magic, flags and block descriptor */
+	ULZ4F_HEADER,		/* rest of the frame header */
+	ULZ4F_BLOCK_SIZE,	/* block header, or end mark */
+	ULZ4F_BLOCK,		/* block data and its checksum */
+	ULZ4F_CHECKSUM,		/* content checksum */
+	ULZ4F_DONE,
+};
+
+/* xxHash32 with a seed of 0, as used for all the LZ4 frame checksums */
+#define XXH_P1	2654435761U
+#define XXH_P2	2246822519U
+#define XXH_P3	3266489917U
+#define XXH_P4	668265263U
+#define XXH_P5	374761393U
+
+#define XXH_ROTL(x, r)	(((x) << (r)) | ((x) >> (32 - (r))))
+
+static u32 xxh32_round(u32 v, const u8 *p)
+{
+	v += get_unaligned_le32(p) * XXH_P2;
+
+	return XXH_ROTL(v, 13) * XXH_P1;
+}
+
+static void xxh32_init(struct ulz4f_xxh32 *x)
+{
+	x->v[0] = XXH_P1 + XXH_P2;
+	x->v[1] = XXH_P2;
+	x->v[2] = 0;
+	x->v[3] = -XXH_P1;
+	x->total = 0;
+	x->memsize = 0;
+}
+
+static void xxh32_update(struct ulz4f_xxh32 *x, const u8 *p, size_t len)
+{
+	size_t n;
+	int i;
+
+	x->total += len;
+	if (x->memsize + len < sizeof(x->mem)) {
+		memcpy(x->mem + x->memsize, p, len);
+		x->memsize += len;
+		return;
+	}
+	if (x->memsize) {
+		n = sizeof(x->mem) - x->memsize;
+		memcpy(x->mem + x->memsize, p, n);
+		for (i = 0; i < 4; i++)
+			x->v[i] = xxh32_round(x->v[i], x->mem + 4 * i);
+		p += n;
+		len -= n;
+	}
+	for (; len >= 16; p += 16, len -= 16) {
+		for (i = 0; i < 4; i++)
+			x->v[i] = xxh32_round(x->v[i], p + 4 * i);
+	}
+	memcpy(x->mem, p, len);
+	x->memsize = len;
+}
+
+static u32 xxh32_digest(const struct ulz4f_xxh32 *x)
+{
+	const u8 *p = x->mem;
+	uint len = x->memsize;
+	u32 h;
+
+	if (x->total >= 16) {
+		h = XXH_ROTL(x->v[0], 1) + XXH_ROTL(x->v[1], 7) +
+			XXH_ROTL(x->v[2], 12) + XXH_ROTL(x->v[3], 18);
+	} else {
+		h = x->v[2] + XXH_P5;
+	}
+	h += (u32)x->total;
+	for (; len >= 4; p += 4, len -= 4) {
+		h += get_unaligned_le32(p) * XXH_P3;
+		h = XXH_ROTL(h, 17) * XXH_P4;
+	}
+	for (; len; p++, len--) {
+		h += *p * XXH_P5;
+		h = XXH_ROTL(h, 11) * XXH_P1;
+	}
+	h ^= h >> 15;
+	h *= XXH_P2;
+	h ^= h >> 13;
+	h *= XXH_P3;
+	h ^= h >> 16;
+
+	return h;
+}
+
+static u32 xxh32(const void *p, size_t len)
+{
+	struct ulz4f_xxh32 x;
+
+	xxh32_init(&x);
+	xxh32_update(&x, p, len);
+
+	return xxh32_digest(&x);
+}
+
+void ulz4f_stream_init(struct ulz4f_stream *s,
+		       int (*write)(void *priv, const void *buf, size_t len),
+		       void *priv, bool verify)
+{
+	memset(s, '\0', sizeof(*s));
+	s->write = write;
+	s->priv = priv;
+	s->verify = verify;
+	s->state = ULZ4F_MAGIC;
+	s->need = sizeof(struct lz4_frame_header);
+	xxh32_init(&s->xxh);
+}
+
+static void ulz4f_next(struct ulz4f_stream *s, int state, size_t need)
+{
+	s->state = state;
+	s->need = need;
+	s->have = 0;
+}
+
+static int ulz4f_magic(struct ulz4f_stream *s)
+{
+	const struct lz4_frame_header *h = (void *)s->hdr;
+
+	/* The same restrictions as ulz4fn() */
+	if (le32_to_cpu(h->magic) != LZ4F_MAGIC || h->version != 1)
+		return -EPROTONOSUPPORT;
+	if (h->reserved0 || h->reserved1 || h->reserved2)
+		return -EINVAL;
+	if (!h->independent_blocks)
+		return -EPROTONOSUPPORT;
+	if (h->max_block_size < 4)
+		return -EINVAL;
+
+	s->flags = h->flags;
+	s->block_max = 1 << (2 * h->max_block_size + 8);
+	/* Keep collecting the header after what is there already */
+	s->state = ULZ4F_HEADER;
+	s->need += sizeof(u8);
+	if (h->has_content_size)
+		s->need += sizeof(u64);
+
+	return 0;
+}
+
+static int ulz4f_header(struct ulz4f_stream *s)
+{
+	const size_t start = offsetof(struct lz4_frame_header, flags);
+	u8 check;
+
+	/* The header checksum covers the descriptor after the magic */
+	check = xxh32(s->hdr + start, s->need - start - 1) >> 8;
+	if (s->verify && check != s->hdr[s->need - 1])
+		return -EBADMSG;
+	if (s->flags & LZ4F_FLG_CONTENT_SIZE)
+		s->content_size = get_unaligned_le64(s->hdr +
+					sizeof(struct lz4_frame_header));
+
+	s->out = malloc(s->block_max);
+	if (!s->out)
+		return -ENOMEM;
+	ulz4f_next(s, ULZ4F_BLOCK_SIZE, sizeof(struct lz4_block_header));
+
+	return 0;
+}
+
+static int ulz4f_block_size(struct ulz4f_stream *s)
+{
+	struct lz4_block_header b;
+
+	b.raw = get_unaligned_le32(s->hdr);
+	if (!b.raw) {
+		if (s->flags & LZ4F_FLG_CONTENT_CHECKSUM)
+			ulz4f_next(s, ULZ4F_CHECKSUM, sizeof(u32));
+		else
+			ulz4f_next(s, ULZ4F_DONE, 0);
+		return 0;
+	}
+	if (b.size > s->block_max)
+		return -EINVAL;
+
+	s->block = b.raw;
+	ulz4f_next(s, ULZ4F_BLOCK, b.size);
+	if (s->flags & LZ4F_FLG_BLOCK_CHECKSUM)
+		s->need += sizeof(u32);
+
+	return 0;
+}
+
+static int ulz4f_block(struct ulz4f_stream *s, const u8 *data)
+{
+	struct lz4_block_header b;
+	const void *out = data;
+	int size;
+
+	b.raw = s->block;
+	size = b.size;
+	if (s->verify && (s->flags & LZ4F_FLG_BLOCK_CHECKSUM) &&
+	    xxh32(data, b.size) != get_unaligned_le32(data + b.size))
+		return -EBADMSG;
+
+	if (!b.not_compressed) {
+		/* constant folding essential, do not touch params! */
+		size = LZ4_decompress_generic((const void *)data,
+				(void *)s->out, b.size,
+				s->block_max, endOnInputSize,
+				full, 0, noDict, s->out, NULL, 0);
+		if (size < 0)
+			return -EPROTO;
+		out = s->out;
+	}
+	if (s->verify && (s->flags & LZ4F_FLG_CONTENT_CHECKSUM))
+		xxh32_update(&s->xxh, out, size);
+	s->total_out += size;
+	ulz4f_next(s, ULZ4F_BLOCK_SIZE, sizeof(struct lz4_block_header));
+
+	return s->write(s->priv, out, size);
+}
+
+static int ulz4f_checksum(struct ulz4f_stream *s)
+{
+	if (s->verify &&
+	    xxh32_digest(&s->xxh) != get_unaligned_le32(s->hdr))
+		return -EBADMSG;
+	ulz4f_next(s, ULZ4F_DONE, 0);
+
+	return 0;
+}
+
+int ulz4f_stream_feed(struct ulz4f_stream *s, const void *src, size_t len)
+{
+	const u8 *p = src;
+	size_t n;
+	int ret;
+
+	while (len && s->state != ULZ4F_DONE) {
+		if (s->state == ULZ4F_BLOCK && !s->have && len >= s->need) {
+			/* The whole block is here, so use it where it is */
+			n = s->need;
+			ret = ulz4f_block(s, p);
+			p += n;
+			len -= n;
+			if (ret)
+				return ret;
+			continue;
+		}
+
+		if (s->state == ULZ4F_BLOCK && !s->in) {
+			s->in = malloc(s->block_max + sizeof(u32));
+			if (!s->in)
+				return -ENOMEM;
+		}
+		n = min(len, s->need - s->have);
+		memcpy((s->state == ULZ4F_BLOCK ? s->in : s->hdr) + s->have,
+		       p, n);
+		s->have += n;
+		p += n;
+		len -= n;
+		if (s->have < s->need)
+			break;
+
+		switch (s->state) {
+		case ULZ4F_MAGIC:
+			ret = ulz4f_magic(s);
+			break;
+		case ULZ4F_HEADER:
+			ret = ulz4f_header(s);
+			break;
+		case ULZ4F_BLOCK_SIZE:
+			ret = ulz4f_block_size(s);
+			break;
+		case ULZ4F_BLOCK:
+			ret = ulz4f_block(s, s->in);
+			break;
+		default:
+			ret = ulz4f_checksum(s);
+			break;
+		}
+		if (ret)
+			return ret;
+		WATCHDOG_RESET();
+	}
+
+	return s->state == ULZ4F_DONE;
+}
+
+int ulz4f_stream_finish(struct ulz4f_stream *s)
+{
+	free(s->in);
+	free(s->out);
+	s->in = NULL;
+	s->out = NULL;
+	if (s->state != ULZ4F_DONE)
+		return -EINVAL;
+	if (s->content_size && s->content_size != s->total_out)
+		return -EINVAL;
+
+	return 0;
+}
+
+#ifdef CONFIG_CMD_UNZIP
+struct lz4write_priv {
+	struct ulz4f_stream s;
+	struct blk_desc *dev;
+	u8 *buf;
+	ulong size;
+	ulong fill;
+	lbaint_t block;
+	int iteration;
+};
+
+static int lz4write_flush(struct lz4write_priv *w)
+{
+	lbaint_t blocks = DIV_ROUND_UP(w->fill, w->dev->blksz);
+
+	if (w->block + blocks > w->dev->lba)
+		return -ENOSPC;
+	memset(w->buf + w->fill, '\0', blocks * w->dev->blksz - w->fill);
+	if (blk_dwrite(w->dev, w->block, blocks, w->buf) != blocks)
+		return -EIO;
+	w->block += blocks;
+	w->fill = 0;
+
+	gzwrite_progress(w->iteration++, w->s.total_out, w->s.content_size);
+	if (ctrlc()) {
+		puts("abort\n");
+		return -EINTR;
+	}
+
+	return 0;
+}
+
+static int lz4write_out(void *priv, const void *buf, size_t len)
+{
+	struct lz4write_priv *w = priv;
+	size_t n;
+	int ret;
+
+	while (len) {
+		n = min(len, (size_t)(w->size - w->fill));
+		memcpy(w->buf + w->fill, buf, n);
+		w->fill += n;
+		buf += n;
+		len -= n;
+		if (w->fill == w->size) {
+			ret = lz4write_flush(w);
+			if (ret)
+				return ret;
+		}
+	}
+
+	return 0;
+}
+
+int lz4write(const void *src, size_t len, struct blk_desc *dev,
+	     ulong szwritebuf, u64 startoffs)
+{
+	struct lz4write_priv w;
+	int ret, end_ret;
+
+	if (!szwritebuf || szwritebuf % dev->blksz) {
+		printf("%s: size %lu not a multiple of %lu\n",
+		       __func__, szwritebuf, dev->blksz);
+		return -EINVAL;
+	}
+	if (startoffs & (dev->blksz - 1)) {
+		printf("%s: start offset %llu not a multiple of %lu\n",
+		       __func__, startoffs, dev->blksz);
+		return -EINVAL;
+	}
+
+	memset(&w, '\0', sizeof(w));
+	w.dev = dev;
+	w.size = szwritebuf;
+	w.block = lldiv(startoffs, dev->blksz);
+	w.buf = malloc_cache_aligned(szwritebuf);
+	if (!w.buf)
+		return -ENOMEM;
+
+	gzwrite_progress_init(0);
+	ulz4f_stream_init(&w.s, lz4write_out, &w, true);
+	ret = ulz4f_stream_feed(&w.s, src, len);
+	if (ret == 1 && w.fill)
+		ret = lz4write_flush(&w);
+	end_ret = ulz4f_stream_finish(&w.s);
+	if (ret >= 0)
+		ret = end_ret;
+	free(w.buf);
+
+	if (ret)
+		printf("\n\terror %d after %llu bytes\n", ret, w.s.total_out);
+	else
+		printf("\n\t%llu bytes\n", w.s.total_out);
+
+	return ret;
+}
+#endif
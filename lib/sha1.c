@@ -19,6 +19,7 @@
 
 #ifndef USE_HOSTCC
 #include <common.h>
+#include <errno.h>
 #include <linux/string.h>
 #else
 #include <string.h>
@@ -34,13 +35,10 @@ const uint8_t sha1_der_prefix[SHA1_DER_LEN] = {
 /*
  * 32-bit integer manipulation macros (big endian)
  */
-#ifndef GET_UINT32_BE
-#define GET_UINT32_BE(n,b,i) {				\
-	(n) = ( (unsigned long) (b)[(i)    ] << 24 )	\
-	    | ( (unsigned long) (b)[(i) + 1] << 16 )	\
-	    | ( (unsigned long) (b)[(i) + 2] <<  8 )	\
-	    | ( (unsigned long) (b)[(i) + 3]       );	\
-}
+#ifndef GET_BE32
+#define GET_BE32(b)					\
+	((uint32_t)(b)[0] << 24 | (uint32_t)(b)[1] << 16 |	\
+	 (uint32_t)(b)[2] << 8 | (uint32_t)(b)[3])
 #endif
 #ifndef PUT_UINT32_BE
 #define PUT_UINT32_BE(n,b,i) {				\
@@ -66,28 +64,15 @@ void sha1_starts (sha1_context * ctx)
 	ctx->state[4] = 0xC3D2E1F0;
 }
 
-static void sha1_process(sha1_context *ctx, const unsigned char data[64])
+void sha1_process_generic(uint32_t state[5], const unsigned char *data,
+			  unsigned int blocks)
 {
-	unsigned long temp, W[16], A, B, C, D, E;
-
-	GET_UINT32_BE (W[0], data, 0);
-	GET_UINT32_BE (W[1], data, 4);
-	GET_UINT32_BE (W[2], data, 8);
-	GET_UINT32_BE (W[3], data, 12);
-	GET_UINT32_BE (W[4], data, 16);
-	GET_UINT32_BE (W[5], data, 20);
-	GET_UINT32_BE (W[6], data, 24);
-	GET_UINT32_BE (W[7], data, 28);
-	GET_UINT32_BE (W[8], data, 32);
-	GET_UINT32_BE (W[9], data, 36);
-	GET_UINT32_BE (W[10], data, 40);
-	GET_UINT32_BE (W[11], data, 44);
-	GET_UINT32_BE (W[12], data, 48);
-	GET_UINT32_BE (W[13], data, 52);
-	GET_UINT32_BE (W[14], data, 56);
-	GET_UINT32_BE (W[15], data, 60);
-
-#define S(x,n)	((x << n) | ((x & 0xFFFFFFFF) >> (32 - n)))
+	uint32_t temp, W[16], A, B, C, D, E;
+
+#define S(x,n)	(((x) << (n)) | ((x) >> (32 - (n))))
+
+/* Load a message word: the compiler turns this into one load and a swap */
+#define L(t) (W[t] = GET_BE32(data + 4 * (t)))
 
 #define R(t) (						\
 	temp = W[(t -  3) & 0x0F] ^ W[(t - 8) & 0x0F] ^	\
@@ -99,35 +84,36 @@ static void sha1_process(sha1_context *ctx, const unsigned char data[64])
 	e += S(a,5) + F(b,c,d) + K + x; b = S(b,30);	\
 }
 
-	A = ctx->state[0];
-	B = ctx->state[1];
-	C = ctx->state[2];
-	D = ctx->state[3];
-	E = ctx->state[4];
+	A = state[0];
+	B = state[1];
+	C = state[2];
+	D = state[3];
+	E = state[4];
 
+	for (; blocks; blocks--, data += 64) {
 #define F(x,y,z) (z ^ (x & (y ^ z)))
 #define K 0x5A827999
 
-	P (A, B, C, D, E, W[0]);
-	P (E, A, B, C, D, W[1]);
-	P (D, E, A, B, C, W[2]);
-	P (C, D, E, A, B, W[3]);
-	P (B, C, D, E, A, W[4]);
-	P (A, B, C, D, E, W[5]);
-	P (E, A, B, C, D, W[6]);
-	P (D, E, A, B, C, W[7]);
-	P (C, D, E, A, B, W[8]);
-	P (B, C, D, E, A, W[9]);
-	P (A, B, C, D, E, W[10]);
-	P (E, A, B, C, D, W[11]);
-	P (D, E, A, B, C, W[12]);
-	P (C, D, E, A, B, W[13]);
-	P (B, C, D, E, A, W[14]);
-	P (A, B, C, D, E, W[15]);
-	P (E, A, B, C, D, R (16));
-	P (D, E, A, B, C, R (17));
-	P (C, D, E, A, B, R (18));
-	P (B, C, D, E, A, R (19));
+		P (A, B, C, D, E, L(0));
+		P (E, A, B, C, D, L(1));
+		P (D, E, A, B, C, L(2));
+		P (C, D, E, A, B, L(3));
+		P (B, C, D, E, A, L(4));
+		P (A, B, C, D, E, L(5));
+		P (E, A, B, C, D, L(6));
+		P (D, E, A, B, C, L(7));
+		P (C, D, E, A, B, L(8));
+		P (B, C, D, E, A, L(9));
+		P (A, B, C, D, E, L(10));
+		P (E, A, B, C, D, L(11));
+		P (D, E, A, B, C, L(12));
+		P (C, D, E, A, B, L(13));
+		P (B, C, D, E, A, L(14));
+		P (A, B, C, D, E, L(15));
+		P (E, A, B, C, D, R (16));
+		P (D, E, A, B, C, R (17));
+		P (C, D, E, A, B, R (18));
+		P (B, C, D, E, A, R (19));
 
 #undef K
 #undef F
@@ -135,26 +121,26 @@ static void sha1_process(sha1_context *ctx, const unsigned char data[64])
 #define F(x,y,z) (x ^ y ^ z)
 #define K 0x6ED9EBA1
 
-	P (A, B, C, D, E, R (20));
-	P (E, A, B, C, D, R (21));
-	P (D, E, A, B, C, R (22));
-	P (C, D, E, A, B, R (23));
-	P (B, C, D, E, A, R (24));
-	P (A, B, C, D, E, R (25));
-	P (E, A, B, C, D, R (26));
-	P (D, E, A, B, C, R (27));
-	P (C, D, E, A, B, R (28));
-	P (B, C, D, E, A, R (29));
-	P (A, B, C, D, E, R (30));
-	P (E, A, B, C, D, R (31));
-	P (D, E, A, B, C, R (32));
-	P (C, D, E, A, B, R (33));
-	P (B, C, D, E, A, R (34));
-	P (A, B, C, D, E, R (35));
-	P (E, A, B, C, D, R (36));
-	P (D, E, A, B, C, R (37));
-	P (C, D, E, A, B, R (38));
-	P (B, C, D, E, A, R (39));
+		P (A, B, C, D, E, R (20));
+		P (E, A, B, C, D, R (21));
+		P (D, E, A, B, C, R (22));
+		P (C, D, E, A, B, R (23));
+		P (B, C, D, E, A, R (24));
+		P (A, B, C, D, E, R (25));
+		P (E, A, B, C, D, R (26));
+		P (D, E, A, B, C, R (27));
+		P (C, D, E, A, B, R (28));
+		P (B, C, D, E, A, R (29));
+		P (A, B, C, D, E, R (30));
+		P (E, A, B, C, D, R (31));
+		P (D, E, A, B, C, R (32));
+		P (C, D, E, A, B, R (33));
+		P (B, C, D, E, A, R (34));
+		P (A, B, C, D, E, R (35));
+		P (E, A, B, C, D, R (36));
+		P (D, E, A, B, C, R (37));
+		P (C, D, E, A, B, R (38));
+		P (B, C, D, E, A, R (39));
 
 #undef K
 #undef F
@@ -162,26 +148,26 @@ static void sha1_process(sha1_context *ctx, const unsigned char data[64])
 #define F(x,y,z) ((x & y) | (z & (x | y)))
 #define K 0x8F1BBCDC
 
-	P (A, B, C, D, E, R (40));
-	P (E, A, B, C, D, R (41));
-	P (D, E, A, B, C, R (42));
-	P (C, D, E, A, B, R (43));
-	P (B, C, D, E, A, R (44));
-	P (A, B, C, D, E, R (45));
-	P (E, A, B, C, D, R (46));
-	P (D, E, A, B, C, R (47));
-	P (C, D, E, A, B, R (48));
-	P (B, C, D, E, A, R (49));
-	P (A, B, C, D, E, R (50));
-	P (E, A, B, C, D, R (51));
-	P (D, E, A, B, C, R (52));
-	P (C, D, E, A, B, R (53));
-	P (B, C, D, E, A, R (54));
-	P (A, B, C, D, E, R (55));
-	P (E, A, B, C, D, R (56));
-	P (D, E, A, B, C, R (57));
-	P (C, D, E, A, B, R (58));
-	P (B, C, D, E, A, R (59));
+		P (A, B, C, D, E, R (40));
+		P (E, A, B, C, D, R (41));
+		P (D, E, A, B, C, R (42));
+		P (C, D, E, A, B, R (43));
+		P (B, C, D, E, A, R (44));
+		P (A, B, C, D, E, R (45));
+		P (E, A, B, C, D, R (46));
+		P (D, E, A, B, C, R (47));
+		P (C, D, E, A, B, R (48));
+		P (B, C, D, E, A, R (49));
+		P (A, B, C, D, E, R (50));
+		P (E, A, B, C, D, R (51));
+		P (D, E, A, B, C, R (52));
+		P (C, D, E, A, B, R (53));
+		P (B, C, D, E, A, R (54));
+		P (A, B, C, D, E, R (55));
+		P (E, A, B, C, D, R (56));
+		P (D, E, A, B, C, R (57));
+		P (C, D, E, A, B, R (58));
+		P (B, C, D, E, A, R (59));
 
 #undef K
 #undef F
@@ -189,35 +175,58 @@ static void sha1_process(sha1_context *ctx, const unsigned char data[64])
 #define F(x,y,z) (x ^ y ^ z)
 #define K 0xCA62C1D6
 
-	P (A, B, C, D, E, R (60));
-	P (E, A, B, C, D, R (61));
-	P (D, E, A, B, C, R (62));
-	P (C, D, E, A, B, R (63));
-	P (B, C, D, E, A, R (64));
-	P (A, B, C, D, E, R (65));
-	P (E, A, B, C, D, R (66));
-	P (D, E, A, B, C, R (67));
-	P (C, D, E, A, B, R (68));
-	P (B, C, D, E, A, R (69));
-	P (A, B, C, D, E, R (70));
-	P (E, A, B, C, D, R (71));
-	P (D, E, A, B, C, R (72));
-	P (C, D, E, A, B, R (73));
-	P (B, C, D, E, A, R (74));
-	P (A, B, C, D, E, R (75));
-	P (E, A, B, C, D, R (76));
-	P (D, E, A, B, C, R (77));
-	P (C, D, E, A, B, R (78));
-	P (B, C, D, E, A, R (79));
+		P (A, B, C, D, E, R (60));
+		P (E, A, B, C, D, R (61));
+		P (D, E, A, B, C, R (62));
+		P (C, D, E, A, B, R (63));
+		P (B, C, D, E, A, R (64));
+		P (A, B, C, D, E, R (65));
+		P (E, A, B, C, D, R (66));
+		P (D, E, A, B, C, R (67));
+		P (C, D, E, A, B, R (68));
+		P (B, C, D, E, A, R (69));
+		P (A, B, C, D, E, R (70));
+		P (E, A, B, C, D, R (71));
+		P (D, E, A, B, C, R (72));
+		P (C, D, E, A, B, R (73));
+		P (B, C, D, E, A, R (74));
+		P (A, B, C, D, E, R (75));
+		P (E, A, B, C, D, R (76));
+		P (D, E, A, B, C, R (77));
+		P (C, D, E, A, B, R (78));
+		P (B, C, D, E, A, R (79));
 
 #undef K
 #undef F
 
-	ctx->state[0] += A;
-	ctx->state[1] += B;
-	ctx->state[2] += C;
-	ctx->state[3] += D;
-	ctx->state[4] += E;
+		A = state[0] += A;
+		B = state[1] += B;
+		C = state[2] += C;
+		D = state[3] += D;
+		E = state[4] += E;
+	}
+}
+
+#ifndef USE_HOSTCC
+/*
+ * An architecture can hash whole blocks faster, usually with instructions
+ * which only some CPUs have. It returns -ENOSYS if this CPU cannot.
+ */
+__weak int sha1_process_arch(uint32_t state[5], const unsigned char *data,
+			     unsigned int blocks)
+{
+	return -ENOSYS;
+}
+#endif
+
+static void sha1_process(sha1_context *ctx, const unsigned char *data,
+			 unsigned int blocks)
+{
+#ifndef USE_HOSTCC
+	if (!sha1_process_arch(ctx->state, data, blocks))
+		return;
+#endif
+	sha1_process_generic(ctx->state, data, blocks);
 }
 
 /*
@@ -243,16 +252,16 @@ void sha1_update(sha1_context *ctx, const unsigned char *input,
 
 	if (left && ilen >= fill) {
 		memcpy ((void *) (ctx->buffer + left), (void *) input, fill);
-		sha1_process (ctx, ctx->buffer);
+		sha1_process (ctx, ctx->buffer, 1);
 		input += fill;
 		ilen -= fill;
 		left = 0;
 	}
 
-	while (ilen >= 64) {
-		sha1_process (ctx, input);
-		input += 64;
-		ilen -= 64;
+	if (ilen >= 64) {
+		sha1_process (ctx, input, ilen / 64);
+		input += ilen & ~0x3F;
+		ilen &= 0x3F;
 	}
 
 	if (ilen > 0) {
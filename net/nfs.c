@@ -31,6 +31,7 @@
 #include <net.h>
 #include <malloc.h>
 #include <mapmem.h>
+#include <linux/log2.h>
 #include "nfs.h"
 #include "bootp.h"
 
@@ -41,16 +42,41 @@
 #else
 # define NFS_TIMEOUT CONFIG_NFS_TIMEOUT
 #endif
+/*
+ * READs kept outstanding. Fragmented replies all share net.c's single
+ * reassembly buffer, so replies whose fragments interleave are lost and
+ * sent again after a timeout.
+ */
+#define NFS_READ_WINDOW CONFIG_NFS_READ_WINDOW
+/* Bytes loaded for each hash printed */
+#define NFS_HASH_BYTES	(NFS_READ_SIZE / 2 * 10)
+/* Words of a READ reply's data needed to reach the file data, at most */
+#define NFS_READ_REPLY_WORDS	32
 
 #define NFS_RPC_ERR	1
 #define NFS_RPC_DROP	124
 
 static int fs_mounted;
 static unsigned long rpc_id;
-static int nfs_offset = -1;
-static int nfs_len;
+static int nfs_offset = -1;	/* offset of the next READ to send */
+static int nfs_len;		/* number of bytes to ask for in each READ */
+static int nfs_eof_offset;	/* size of the file once known, else -1 */
+static ulong nfs_loaded;	/* bytes loaded so far */
+static int nfs_hashes;		/* number of hashes printed */
 static ulong nfs_timeout = NFS_TIMEOUT;
 
+/*
+ * A READ which has been sent and not yet fully answered. Each has its own
+ * RPC id, so that the replies can come back in any order.
+ */
+struct nfs_read_slot {
+	unsigned long id;
+	int offset;
+	int len;		/* bytes still to read, 0 if the slot is free */
+};
+
+static struct nfs_read_slot nfs_reads[NFS_READ_WINDOW];
+
 static char dirfh[NFS_FHSIZE];	/* NFSv2 / NFSv3 file handle of directory */
 static char filefh[NFS3_FHSIZE]; /* NFSv2 / NFSv3 file handle */
 static int filefh3_length;	/* (variable) length of filefh when NFSv3 */
@@ -386,6 +412,109 @@ static void nfs_read_req(int offset, int readlen)
 	rpc_req(PROG_NFS, NFS_READ, data, len);
 }
 
+/*
+ * Read as much at once as fits in a reply. This is one Ethernet frame unless
+ * fragmented datagrams are reassembled.
+ */
+static int nfs_read_size(void)
+{
+#ifdef CONFIG_IP_DEFRAG
+	int size = CONFIG_NET_MAXDEFRAG - NFS_READ_OVERHEAD;
+
+	if (supported_nfs_versions & NFSV2_FLAG)
+		size = min(size, NFS2_MAXDATA);
+
+	return rounddown_pow_of_two(size);
+#else
+	return NFS_READ_SIZE;
+#endif
+}
+
+static void nfs_read_start(void)
+{
+	nfs_offset = 0;
+	nfs_len = nfs_read_size();
+	nfs_eof_offset = -1;
+	nfs_loaded = 0;
+	nfs_hashes = 0;
+	memset(nfs_reads, '\0', sizeof(nfs_reads));
+	fit_stream_load(load_addr, 0);
+	debug("NFS read size %d, window %d\n", nfs_len, NFS_READ_WINDOW);
+}
+
+static void nfs_read_slot_send(struct nfs_read_slot *slot)
+{
+	nfs_read_req(slot->offset, slot->len);
+	slot->id = rpc_id;
+}
+
+/* Fill the free slots with READs of the rest of the file, until its end */
+static void nfs_read_fill(void)
+{
+	struct nfs_read_slot *slot;
+	int i;
+
+	for (i = 0; i < NFS_READ_WINDOW; i++) {
+		slot = &nfs_reads[i];
+		if (slot->len)
+			continue;
+		if (nfs_eof_offset >= 0 && nfs_offset >= nfs_eof_offset)
+			break;
+		slot->offset = nfs_offset;
+		slot->len = nfs_len;
+		nfs_offset += nfs_len;
+		nfs_read_slot_send(slot);
+	}
+}
+
+/* Send the outstanding READs again, as after a timeout, then fill the rest */
+static void nfs_read_send(void)
+{
+	int i;
+
+	for (i = 0; i < NFS_READ_WINDOW; i++) {
+		if (nfs_reads[i].len)
+			nfs_read_slot_send(&nfs_reads[i]);
+	}
+	nfs_read_fill();
+}
+
+static bool nfs_read_busy(void)
+{
+	int i;
+
+	for (i = 0; i < NFS_READ_WINDOW; i++) {
+		if (nfs_reads[i].len)
+			return true;
+	}
+
+	return false;
+}
+
+/* Everything before the first outstanding READ is in place */
+static void nfs_read_loaded(void)
+{
+	ulong loaded = nfs_offset;
+	int i;
+
+	for (i = 0; i < NFS_READ_WINDOW; i++) {
+		if (nfs_reads[i].len)
+			loaded = min_t(ulong, loaded, nfs_reads[i].offset);
+	}
+	fit_stream_load(load_addr, min_t(ulong, loaded, net_boot_file_size));
+}
+
+static void nfs_show_progress(int len)
+{
+	nfs_loaded += len;
+	while (nfs_hashes * NFS_HASH_BYTES < nfs_loaded) {
+		if (nfs_hashes && !(nfs_hashes % HASHES_PER_LINE))
+			puts("\n\t ");
+		putc('#');
+		nfs_hashes++;
+	}
+}
+
 /**************************************************************************
 RPC request dispatcher
 **************************************************************************/
@@ -416,7 +545,7 @@ static void nfs_send(void)
 		nfs_lookup_req(nfs_filename);
 		break;
 	case STATE_READ_REQ:
-		nfs_read_req(nfs_offset, nfs_len);
+		nfs_read_send();
 		break;
 	case STATE_READLINK_REQ:
 		nfs_readlink_req();
@@ -652,19 +781,36 @@ static int nfs_readlink_reply(uchar *pkt, unsigned len)
 	return 0;
 }
 
+/*
+ * Store the data of a READ reply at its offset in the file, whatever order
+ * the replies come in. If the server read less than was asked for, the rest
+ * is asked for again and later READs ask for less.
+ * Return the number of bytes stored or -ve on error.
+ */
 static int nfs_read_reply(uchar *pkt, unsigned len)
 {
 	struct rpc_t rpc_pkt;
-	int rlen;
+	struct nfs_read_slot *slot = NULL;
+	unsigned hdr_len = offsetof(struct rpc_t,
+				    u.reply.data[NFS_READ_REPLY_WORDS]);
+	unsigned long id;
 	uchar *data_ptr;
+	unsigned data_offset;
+	int rlen, eof;
+	int i;
 
 	debug("%s\n", __func__);
 
-	memcpy(&rpc_pkt.u.data[0], pkt, sizeof(rpc_pkt.u.reply));
+	/* Only the headers are copied; the data is stored from the packet */
+	memset(&rpc_pkt.u.data[0], '\0', hdr_len);
+	memcpy(&rpc_pkt.u.data[0], pkt, min(len, hdr_len));
 
-	if (ntohl(rpc_pkt.u.reply.id) > rpc_id)
-		return -NFS_RPC_ERR;
-	else if (ntohl(rpc_pkt.u.reply.id) < rpc_id)
+	id = ntohl(rpc_pkt.u.reply.id);
+	for (i = 0; i < NFS_READ_WINDOW; i++) {
+		if (nfs_reads[i].len && nfs_reads[i].id == id)
+			slot = &nfs_reads[i];
+	}
+	if (!slot)
 		return -NFS_RPC_DROP;
 
 	if (rpc_pkt.u.reply.rstatus  ||
@@ -678,31 +824,46 @@ static int nfs_read_reply(uchar *pkt, unsigned len)
 		return -ntohl(rpc_pkt.u.reply.data[0]);
 	}
 
-	if ((nfs_offset != 0) && !((nfs_offset) %
-			(NFS_READ_SIZE / 2 * 10 * HASHES_PER_LINE)))
-		puts("\n\t ");
-	if (!(nfs_offset % ((NFS_READ_SIZE / 2) * 10)))
-		putc('#');
-
 	if (supported_nfs_versions & NFSV2_FLAG) {
 		rlen = ntohl(rpc_pkt.u.reply.data[18]);
 		data_ptr = (uchar *)&(rpc_pkt.u.reply.data[19]);
+		/* NFSv2 has no EOF flag, only an empty read means the end */
+		eof = 0;
 	} else {  /* NFSV3_FLAG */
 		int nfsv3_data_offset =
 			nfs3_get_attributes_offset(rpc_pkt.u.reply.data);
 
 		/* count value */
 		rlen = ntohl(rpc_pkt.u.reply.data[1 + nfsv3_data_offset]);
-		/* Skip unused values :
-			EOF:		32 bits value,
+		eof = ntohl(rpc_pkt.u.reply.data[2 + nfsv3_data_offset]);
+		/* Skip unused value :
 			data_size:	32 bits value,
 		*/
 		data_ptr = (uchar *)
 			&(rpc_pkt.u.reply.data[4 + nfsv3_data_offset]);
 	}
 
-	if (store_block(data_ptr, nfs_offset, rlen))
-			return -9999;
+	data_offset = data_ptr - &rpc_pkt.u.data[0];
+	if (rlen < 0 || rlen > slot->len || data_offset + rlen > len) {
+		debug("NFS READ reply of %d bytes is bad\n", rlen);
+		return -NFS_RPC_ERR;
+	}
+
+	if (rlen && store_block(pkt + data_offset, slot->offset, rlen))
+		return -9999;
+	nfs_show_progress(rlen);
+
+	slot->offset += rlen;
+	slot->len -= rlen;
+	if (eof || !rlen) {
+		/* Any READs after this come back empty */
+		if (nfs_eof_offset < 0 || slot->offset < nfs_eof_offset)
+			nfs_eof_offset = slot->offset;
+		slot->len = 0;
+	} else if (slot->len) {
+		nfs_len = min(nfs_len, rlen);
+		nfs_read_slot_send(slot);
+	}
 
 	return rlen;
 }
@@ -796,8 +957,7 @@ static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			nfs_send();
 		} else {
 			nfs_state = STATE_READ_REQ;
-			nfs_offset = 0;
-			nfs_len = NFS_READ_SIZE;
+			nfs_read_start();
 			nfs_send();
 		}
 		break;
@@ -822,19 +982,24 @@ static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 
 	case STATE_READ_REQ:
 		rlen = nfs_read_reply(pkt, len);
+		if (rlen == -NFS_RPC_DROP)
+			break;
 		net_set_timeout_handler(nfs_timeout, nfs_timeout_handler);
-		if (rlen > 0) {
-			nfs_offset += rlen;
+		if (rlen >= 0) {
+			/* Keep the window full until the whole file is in */
+			nfs_read_fill();
+			nfs_read_loaded();
+			if (nfs_read_busy())
+				break;
+			nfs_download_state = NETLOOP_SUCCESS;
+			nfs_state = STATE_UMOUNT_REQ;
 			nfs_send();
 		} else if ((rlen == -NFSERR_ISDIR) || (rlen == -NFSERR_INVAL)) {
 			/* symbolic link */
 			nfs_state = STATE_READLINK_REQ;
 			nfs_send();
 		} else {
-			if (!rlen)
-				nfs_download_state = NETLOOP_SUCCESS;
-			if (rlen < 0)
-				debug("NFS READ error (%d)\n", rlen);
+			debug("NFS READ error (%d)\n", rlen);
 			nfs_state = STATE_UMOUNT_REQ;
 			nfs_send();
 		}
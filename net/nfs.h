@@ -39,10 +39,13 @@
 /*
  * Block size used for NFS read accesses.  A RPC reply packet (including  all
  * headers) must fit within a single Ethernet frame to avoid fragmentation.
- * However, if CONFIG_IP_DEFRAG is set, a bigger value could be used.  In any
- * case, most NFS servers are optimized for a power of 2.
+ * However, if CONFIG_IP_DEFRAG is set, reads are as big as will fit in
+ * CONFIG_NET_MAXDEFRAG after NFS_READ_OVERHEAD, up to NFS2_MAXDATA for
+ * NFSv2.  In any case, most NFS servers are optimized for a power of 2.
  */
 #define NFS_READ_SIZE	1024	/* biggest power of two that fits Ether frame */
+#define NFS_READ_OVERHEAD	256	/* IP, UDP, RPC and NFS reply headers */
+#define NFS2_MAXDATA	8192	/* biggest NFSv2 read */
 
 /* Values for Accept State flag on RPC answers (See: rfc1831) */
 enum rpc_accept_stat {
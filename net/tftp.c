@@ -134,6 +134,17 @@ static char tftp_filename[MAX_LEN];
 static unsigned short tftp_block_size = TFTP_BLOCK_SIZE;
 static unsigned short tftp_block_size_option = TFTP_MTU_BLOCKSIZE;
 
+/*
+ * RFC 7440 lets the server send a window of several blocks for each ACK, so
+ * that the transfer is not limited to one block per round trip.
+ */
+static unsigned short tftp_windowsize = 1;
+static unsigned short tftp_windowsize_option = CONFIG_TFTP_WINDOWSIZE;
+/* block number to acknowledge next, the last in the window */
+static ulong	tftp_next_ack;
+/* block last acknowledged because of a gap, TFTP_SEQUENCE_SIZE if none */
+static ulong	tftp_last_nack;
+
 #ifdef CONFIG_MCAST_TFTP
 #include <malloc.h>
 #define MTFTP_BITMAPSIZE	0x1000
@@ -162,6 +173,8 @@ static void mcast_cleanup(void)
 	tftp_mcast_ending_block = -1;
 }
 
+#else
+#define tftp_mcast_active	0
 #endif	/* CONFIG_MCAST_TFTP */
 
 static inline void store_block(int block, uchar *src, unsigned len)
@@ -203,6 +216,10 @@ static inline void store_block(int block, uchar *src, unsigned len)
 
 	if (net_boot_file_size < newsize)
 		net_boot_file_size = newsize;
+
+	/* Blocks only arrive in order without multicast */
+	if (!tftp_mcast_active)
+		fit_stream_load(load_addr, newsize);
 }
 
 /* Clear our state ready for a new transfer */
@@ -211,6 +228,7 @@ static void new_transfer(void)
 	tftp_prev_block = 0;
 	tftp_block_wrap = 0;
 	tftp_block_wrap_offset = 0;
+	tftp_last_nack = TFTP_SEQUENCE_SIZE;
 #ifdef CONFIG_CMD_TFTPPUT
 	tftp_put_final_block_sent = 0;
 #endif
@@ -303,6 +321,23 @@ static void update_block_number(void)
 	}
 }
 
+/*
+ * A block has been lost or overtaken by a later one. Acknowledge the last
+ * block received in order, so that the server sends again from the one after
+ * it. The rest of the window arrives out of order too, so only do this once
+ * for each block.
+ */
+static void tftp_nack(ulong block)
+{
+	debug("Block %ld out of order, acknowledging %ld\n", tftp_cur_block,
+	      block);
+	tftp_cur_block = block;
+	if (tftp_last_nack != block) {
+		tftp_last_nack = block;
+		tftp_send();
+	}
+}
+
 /* The TFTP get or put is complete */
 static void tftp_complete(void)
 {
@@ -372,6 +407,10 @@ static void tftp_send(void)
 		/* try for more effic. blk size */
 		pkt += sprintf((char *)pkt, "blksize%c%d%c",
 				0, tftp_block_size_option, 0);
+		/* and for several blocks per ACK */
+		if (tftp_state == STATE_SEND_RRQ && tftp_windowsize_option > 1)
+			pkt += sprintf((char *)pkt, "windowsize%c%d%c",
+				       0, tftp_windowsize_option, 0);
 #ifdef CONFIG_MCAST_TFTP
 		/* Check all preconditions before even trying the option */
 		if (!tftp_mcast_disabled) {
@@ -404,6 +443,9 @@ static void tftp_send(void)
 		s[0] = htons(TFTP_ACK);
 		s[1] = htons(tftp_cur_block);
 		pkt = (uchar *)(s + 2);
+		/* The remote may now send a window of blocks after this one */
+		tftp_next_ack = (tftp_cur_block + tftp_windowsize) %
+				TFTP_SEQUENCE_SIZE;
 #ifdef CONFIG_CMD_TFTPPUT
 		if (tftp_put_active) {
 			int toload = tftp_block_size;
@@ -540,6 +582,15 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 				debug("Blocksize ack: %s, %d\n",
 				      (char *)pkt + i + 8, tftp_block_size);
 			}
+			if (strcmp((char *)pkt + i, "windowsize") == 0) {
+				tftp_windowsize = (unsigned short)
+					simple_strtoul((char *)pkt + i + 11,
+						       NULL, 10);
+				if (!tftp_windowsize)
+					tftp_windowsize = 1;
+				debug("Windowsize ack: %s, %d\n",
+				      (char *)pkt + i + 11, tftp_windowsize);
+			}
 #ifdef CONFIG_TFTP_TSIZE
 			if (strcmp((char *)pkt+i, "tsize") == 0) {
 				tftp_tsize = simple_strtoul((char *)pkt + i + 6,
@@ -570,11 +621,19 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 		len -= 2;
 		tftp_cur_block = ntohs(*(__be16 *)pkt);
 
-		update_block_number();
-
 		if (tftp_state == STATE_SEND_RRQ)
 			debug("Server did not acknowledge timeout option!\n");
 
+		/*
+		 * With a window, the first block can be lost or overtaken
+		 * like any other, so ask for the window again.
+		 */
+		if (tftp_state == STATE_OACK && tftp_windowsize > 1 &&
+		    tftp_cur_block != 1) {
+			tftp_nack(0);
+			break;
+		}
+
 		if (tftp_state == STATE_SEND_RRQ || tftp_state == STATE_OACK ||
 		    tftp_state == STATE_RECV_WRQ) {
 			/* first block received */
@@ -602,6 +661,13 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			break;
 		}
 
+		if (!tftp_mcast_active && tftp_cur_block !=
+		    (tftp_prev_block + 1) % TFTP_SEQUENCE_SIZE) {
+			tftp_nack(tftp_prev_block);
+			break;
+		}
+
+		update_block_number();
 		tftp_prev_block = tftp_cur_block;
 		timeout_count_max = tftp_timeout_count_max;
 		net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
@@ -609,8 +675,8 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 		store_block(tftp_cur_block - 1, pkt + 2, len);
 
 		/*
-		 *	Acknowledge the block just received, which will prompt
-		 *	the remote for the next one.
+		 *	Acknowledge the last block of the window, which will
+		 *	prompt the remote for the next one.
 		 */
 #ifdef CONFIG_MCAST_TFTP
 		/* if I am the MasterClient, actively calculate what my next
@@ -638,7 +704,9 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			}
 		}
 #endif
-		tftp_send();
+		if (tftp_mcast_active || tftp_cur_block == tftp_next_ack ||
+		    len < tftp_block_size)
+			tftp_send();
 
 #ifdef CONFIG_MCAST_TFTP
 		if (tftp_mcast_active) {
@@ -710,6 +778,10 @@ void tftp_start(enum proto_t protocol)
 	if (ep != NULL)
 		tftp_block_size_option = simple_strtol(ep, NULL, 10);
 
+	ep = env_get("tftpwindowsize");
+	if (ep != NULL)
+		tftp_windowsize_option = simple_strtol(ep, NULL, 10);
+
 	ep = env_get("tftptimeout");
 	if (ep != NULL)
 		timeout_ms = simple_strtol(ep, NULL, 10);
@@ -731,8 +803,8 @@ void tftp_start(enum proto_t protocol)
 	}
 #endif
 
-	debug("TFTP blocksize = %i, timeout = %ld ms\n",
-	      tftp_block_size_option, timeout_ms);
+	debug("TFTP blocksize = %i, windowsize = %i, timeout = %ld ms\n",
+	      tftp_block_size_option, tftp_windowsize_option, timeout_ms);
 
 	tftp_remote_ip = net_server_ip;
 	if (net_boot_file_name[0] == '\0') {
@@ -805,6 +877,7 @@ void tftp_start(enum proto_t protocol)
 		printf("Load address: 0x%lx\n", load_addr);
 		puts("Loading: *\b");
 		tftp_state = STATE_SEND_RRQ;
+		fit_stream_load(load_addr, 0);
 #ifdef CONFIG_CMD_BOOTEFI
 		efi_set_bootdev("Net", "", tftp_filename);
 #endif
@@ -835,8 +908,11 @@ void tftp_start(enum proto_t protocol)
 
 	/* zero out server ether in case the server ip has changed */
 	memset(net_server_ethaddr, 0, 6);
-	/* Revert tftp_block_size to dflt */
+	/* Revert tftp_block_size and tftp_windowsize to dflt */
 	tftp_block_size = TFTP_BLOCK_SIZE;
+	tftp_windowsize = 1;
+	tftp_next_ack = 1;
+	tftp_last_nack = TFTP_SEQUENCE_SIZE;
 #ifdef CONFIG_MCAST_TFTP
 	mcast_cleanup();
 #endif
@@ -858,14 +934,18 @@ void tftp_start_server(void)
 	printf("Load address: 0x%lx\n", load_addr);
 
 	puts("Loading: *\b");
+	fit_stream_load(load_addr, 0);
 
 	timeout_count_max = tftp_timeout_count_max;
 	timeout_count = 0;
 	timeout_ms = TIMEOUT;
 	net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
 
-	/* Revert tftp_block_size to dflt */
+	/* Revert tftp_block_size and tftp_windowsize to dflt */
 	tftp_block_size = TFTP_BLOCK_SIZE;
+	tftp_windowsize = 1;
+	tftp_next_ack = 1;
+	tftp_last_nack = TFTP_SEQUENCE_SIZE;
 	tftp_cur_block = 0;
 	tftp_our_port = WELL_KNOWN_PORT;
 
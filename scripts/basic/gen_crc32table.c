@@ -0,0 +1,60 @@
+/*
+ * Generate the tables used by lib/crc32.c and lib/crc32c.c
+ *
+ * Row k of each table holds the CRC of each byte value followed by k zero
+ * bytes, so that eight bytes can be handled with one lookup in each row.
+ * A file including the result picks how many rows it wants by defining
+ * CRC32_TABLE_ROWS or CRC32C_TABLE_ROWS as 1 or 8 beforehand.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define ROWS	8
+
+static void gen_table(const char *name, const char *rows, uint32_t poly)
+{
+	uint32_t tab[ROWS][256];
+	uint32_t crc;
+	int i, j;
+
+	for (i = 0; i < 256; i++) {
+		crc = i;
+		for (j = 0; j < 8; j++)
+			crc = (crc >> 1) ^ (crc & 1 ? poly : 0);
+		tab[0][i] = crc;
+	}
+	for (j = 1; j < ROWS; j++) {
+		for (i = 0; i < 256; i++) {
+			crc = tab[j - 1][i];
+			tab[j][i] = (crc >> 8) ^ tab[0][crc & 0xff];
+		}
+	}
+
+	printf("#ifdef %s\n", rows);
+	printf("static const uint32_t %s_table[%s][256] = {\n", name, rows);
+	for (j = 0; j < ROWS; j++) {
+		if (j == 1)
+			printf("#if %s > 1\n", rows);
+		printf("\t{\n");
+		for (i = 0; i < 256; i++) {
+			printf("%s0x%08x,%s", i % 4 ? " " : "\t\t", tab[j][i],
+			       i % 4 == 3 ? "\n" : "");
+		}
+		printf("\t},\n");
+	}
+	printf("#endif\n");
+	printf("};\n");
+	printf("#endif\n\n");
+}
+
+int main(void)
+{
+	printf("/* Automatically generated by scripts/basic/gen_crc32table */\n\n");
+	gen_table("crc32", "CRC32_TABLE_ROWS", 0xedb88320);
+	gen_table("crc32c", "CRC32C_TABLE_ROWS", 0x82f63b78);
+
+	return 0;
+}
@@ -50,6 +50,9 @@ static cmd_tbl_t cmd_ut_sub[] = {
 #ifdef CONFIG_UT_TIME
 	U_BOOT_CMD_MKENT(time, CONFIG_SYS_MAXARGS, 1, do_ut_time, "", ""),
 #endif
+#ifdef CONFIG_UT_HASH
+	U_BOOT_CMD_MKENT(hash, CONFIG_SYS_MAXARGS, 1, do_ut_hash, "", ""),
+#endif
 #ifdef CONFIG_SANDBOX
 	U_BOOT_CMD_MKENT(compression, CONFIG_SYS_MAXARGS, 1, do_ut_compression,
 			 "", ""),
@@ -106,6 +109,9 @@ static char ut_help_text[] =
 #ifdef CONFIG_UT_TIME
 	"ut time - Very basic test of time functions\n"
 #endif
+#ifdef CONFIG_UT_HASH
+	"ut hash - Test SHA-1, SHA-256 and CRCs and show their speed\n"
+#endif
 #ifdef CONFIG_SANDBOX
 	"ut compression - Test compressors and bootm decompression\n"
 #endif
@@ -19,6 +19,7 @@
 #include <lzma/LzmaTools.h>
 
 #include <linux/lzo.h>
+#include <u-boot/lz4.h>
 #include <test/compression.h>
 #include <test/suites.h>
 #include <test/ut.h>
@@ -118,6 +119,33 @@ static const char lz4_compressed[] =
 	"\x9d\x12\x8c\x9d";
 static const unsigned long lz4_compressed_size = 276;
 
+/*
+ * The same text in two blocks, the second stored uncompressed, with block
+ * checksums, content size and content checksum
+ */
+static const char lz4_frame_checksums[] =
+	"\x04\x22\x4d\x18\x7c\x40\x5e\x01\x00\x00\x00\x00\x00\x00\x8f\xe3"
+	"\x00\x00\x00\xff\x19\x49\x20\x61\x6d\x20\x61\x20\x68\x69\x67\x68"
+	"\x6c\x79\x20\x63\x6f\x6d\x70\x72\x65\x73\x73\x61\x62\x6c\x65\x20"
+	"\x62\x69\x74\x20\x6f\x66\x20\x74\x65\x78\x74\x2e\x0a\x28\x00\x3d"
+	"\xf0\xa5\x54\x68\x65\x72\x65\x20\x61\x72\x65\x20\x6d\x61\x6e\x79"
+	"\x20\x6c\x69\x6b\x65\x20\x6d\x65\x2c\x20\x62\x75\x74\x20\x74\x68"
+	"\x69\x73\x20\x6f\x6e\x65\x20\x69\x73\x20\x6d\x69\x6e\x65\x2e\x0a"
+	"\x49\x66\x20\x49\x20\x77\x65\x72\x65\x20\x61\x6e\x79\x20\x73\x68"
+	"\x6f\x72\x74\x65\x72\x2c\x20\x74\x68\x65\x72\x65\x20\x77\x6f\x75"
+	"\x6c\x64\x6e\x27\x74\x20\x62\x65\x20\x6d\x75\x63\x68\x20\x73\x65"
+	"\x6e\x73\x65\x20\x69\x6e\x0a\x63\x6f\x6d\x70\x72\x65\x73\x73\x69"
+	"\x6e\x67\x20\x6d\x65\x20\x69\x6e\x20\x74\x68\x65\x20\x66\x69\x72"
+	"\x73\x74\x20\x70\x6c\x61\x63\x65\x2e\x20\x41\x74\x20\x6c\x65\x61"
+	"\x73\x74\x20\x77\x69\x74\x68\x20\x6c\x7a\x6f\x2c\x20\x61\x6e\x79"
+	"\x77\x61\x79\x2c\x0a\x77\x68\x69\x63\x68\x20\x61\x70\x70\x65\x61"
+	"\x72\x73\x20\x74\x6f\x20\xa8\x74\x6b\x04\x32\x00\x00\x80\x62\x65"
+	"\x68\x61\x76\x65\x20\x70\x6f\x6f\x72\x6c\x79\x20\x69\x6e\x20\x74"
+	"\x68\x65\x20\x66\x61\x63\x65\x20\x6f\x66\x20\x73\x68\x6f\x72\x74"
+	"\x20\x74\x65\x78\x74\x0a\x6d\x65\x73\x73\x61\x67\x65\x73\x2e\x0a"
+	"\x80\xea\x4e\xe2\x00\x00\x00\x00\x9d\x12\x8c\x9d";
+static const unsigned long lz4_frame_checksums_size = 316;
+
 
 #define TEST_BUFFER_SIZE	512
 
@@ -154,6 +182,29 @@ static int uncompress_using_gzip(struct unit_test_state *uts,
 	return ret;
 }
 
+/* Feed the data in a few bytes at a time, as a loader would */
+static int uncompress_using_gzip_stream(struct unit_test_state *uts,
+					void *in, unsigned long in_size,
+					void *out, unsigned long out_max,
+					unsigned long *out_size)
+{
+	unsigned long pos, len;
+	z_stream s;
+	int ret;
+
+	if (gunzip_stream_init(&s, out, out_max))
+		return 1;
+	for (ret = 0, pos = 0; !ret && pos < in_size; pos += len) {
+		len = min(in_size - pos, 7UL);
+		ret = gunzip_stream(&s, in + pos, len);
+	}
+	if (out_size)
+		*out_size = s.total_out;
+	gunzip_stream_end(&s);
+
+	return ret != 1;
+}
+
 static int compress_using_bzip2(struct unit_test_state *uts,
 				void *in, unsigned long in_size,
 				void *out, unsigned long out_max,
@@ -293,6 +344,54 @@ static int uncompress_using_lz4(struct unit_test_state *uts,
 	return (ret != 0);
 }
 
+struct lz4_stream_buf {
+	void *out;
+	unsigned long max;
+	unsigned long size;
+};
+
+static int lz4_stream_write(void *priv, const void *buf, size_t len)
+{
+	struct lz4_stream_buf *sb = priv;
+	size_t n = min(len, (size_t)(sb->max - sb->size));
+
+	memcpy(sb->out + sb->size, buf, n);
+	sb->size += n;
+
+	return n < len ? -ENOBUFS : 0;
+}
+
+/* Feed the data in a few bytes at a time, as a loader would */
+static int lz4_stream(const void *in, unsigned long in_size, void *out,
+		      unsigned long out_max, unsigned long *out_size)
+{
+	struct lz4_stream_buf sb = { .out = out, .max = out_max };
+	struct ulz4f_stream s;
+	unsigned long pos, len;
+	int ret, end_ret;
+
+	ulz4f_stream_init(&s, lz4_stream_write, &sb, true);
+	for (ret = 0, pos = 0; !ret && pos < in_size; pos += len) {
+		len = min(in_size - pos, 7UL);
+		ret = ulz4f_stream_feed(&s, in + pos, len);
+	}
+	end_ret = ulz4f_stream_finish(&s);
+	if (out_size)
+		*out_size = sb.size;
+	if (ret < 0)
+		return ret;
+
+	return end_ret;
+}
+
+static int uncompress_using_lz4_stream(struct unit_test_state *uts,
+				       void *in, unsigned long in_size,
+				       void *out, unsigned long out_max,
+				       unsigned long *out_size)
+{
+	return lz4_stream(in, in_size, out, out_max, out_size) != 0;
+}
+
 #define errcheck(statement) if (!(statement)) { \
 	fprintf(stderr, "\tFailed: %s\n", #statement); \
 	ret = 1; \
@@ -411,6 +510,13 @@ static int compression_test_gzip(struct unit_test_state *uts)
 }
 COMPRESSION_TEST(compression_test_gzip, 0);
 
+static int compression_test_gzip_stream(struct unit_test_state *uts)
+{
+	return run_test(uts, "gzip_stream", compress_using_gzip,
+			uncompress_using_gzip_stream);
+}
+COMPRESSION_TEST(compression_test_gzip_stream, 0);
+
 static int compression_test_bzip2(struct unit_test_state *uts)
 {
 	return run_test(uts, "bzip2", compress_using_bzip2,
@@ -437,6 +543,50 @@ static int compression_test_lz4(struct unit_test_state *uts)
 }
 COMPRESSION_TEST(compression_test_lz4, 0);
 
+static int compression_test_lz4_stream(struct unit_test_state *uts)
+{
+	return run_test(uts, "lz4_stream", compress_using_lz4,
+			uncompress_using_lz4_stream);
+}
+COMPRESSION_TEST(compression_test_lz4_stream, 0);
+
+/* Check that the block and content checksums are verified */
+static int compression_test_lz4_checksums(struct unit_test_state *uts)
+{
+	const unsigned long size = lz4_frame_checksums_size;
+	size_t plain_size = strlen(plain);
+	unsigned long out_size;
+	char out[TEST_BUFFER_SIZE];
+	char bad[size];
+
+	ut_assertok(ulz4fn(lz4_frame_checksums, size, out, &plain_size));
+	ut_asserteq(strlen(plain), plain_size);
+	ut_assertok(memcmp(plain, out, plain_size));
+
+	memset(out, '\0', sizeof(out));
+	ut_assertok(lz4_stream(lz4_frame_checksums, size, out, sizeof(out),
+			       &out_size));
+	ut_asserteq(strlen(plain), out_size);
+	ut_assertok(memcmp(plain, out, out_size));
+
+	/* A literal in the first block */
+	memcpy(bad, lz4_frame_checksums, size);
+	bad[40] ^= 1;
+	ut_asserteq(-EBADMSG, lz4_stream(bad, size, out, sizeof(out), NULL));
+
+	/* The content checksum */
+	memcpy(bad, lz4_frame_checksums, size);
+	bad[size - 1] ^= 1;
+	ut_asserteq(-EBADMSG, lz4_stream(bad, size, out, sizeof(out), NULL));
+
+	/* Missing the end mark */
+	ut_asserteq(-EINVAL, lz4_stream(lz4_frame_checksums, size - 8, out,
+					sizeof(out), NULL));
+
+	return 0;
+}
+COMPRESSION_TEST(compression_test_lz4_checksums, 0);
+
 static int compress_using_none(struct unit_test_state *uts,
 			       void *in, unsigned long in_size,
 			       void *out, unsigned long out_max,
@@ -6,6 +6,8 @@
 
 #include <common.h>
 #include <dm.h>
+#include <os.h>
+#include <sandboxblockdev.h>
 #include <usb.h>
 #include <asm/state.h>
 #include <dm/test.h>
@@ -168,3 +170,191 @@ static int dm_test_blk_get_from_parent(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_blk_get_from_parent, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+#ifdef CONFIG_BLOCK_CACHE
+static int blkcache_find_dev_stats(int iftype, int devnum,
+				   struct block_cache_dev_stats *stats)
+{
+	int i;
+
+	for (i = 0; !blkcache_dev_stats(i, stats); i++) {
+		if (stats->iftype == iftype && stats->devnum == devnum)
+			return 0;
+	}
+
+	return -ENOENT;
+}
+
+/* Test that the block cache finds blocks from fills of any size */
+static int dm_test_blk_cache(struct unit_test_state *uts)
+{
+	struct block_cache_dev_stats dev_stats;
+	struct block_cache_stats orig, stats;
+	u8 buf[40 * 512], data[10 * 512];
+	int i;
+
+	/* Start with the statistics reset */
+	blkcache_stats(&orig);
+	blkcache_find_dev_stats(IF_TYPE_HOST, 7, &dev_stats);
+	blkcache_configure(64, 16);
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = i + i / 512;
+
+	/* Blocks 5 to 14 span three lines */
+	blkcache_fill(IF_TYPE_HOST, 7, 5, 10, 512, buf);
+	ut_asserteq(1, blkcache_read(IF_TYPE_HOST, 7, 6, 3, 512, data));
+	ut_assertok(memcmp(buf + 512, data, 3 * 512));
+	ut_asserteq(1, blkcache_read(IF_TYPE_HOST, 7, 5, 10, 512, data));
+	ut_assertok(memcmp(buf, data, 10 * 512));
+
+	/* Not for a block which was never filled, or another device */
+	ut_asserteq(0, blkcache_read(IF_TYPE_HOST, 7, 4, 2, 512, data));
+	ut_asserteq(0, blkcache_read(IF_TYPE_HOST, 7, 14, 2, 512, data));
+	ut_asserteq(0, blkcache_read(IF_TYPE_HOST, 6, 5, 1, 512, data));
+	ut_assertok(blkcache_find_dev_stats(IF_TYPE_HOST, 7, &dev_stats));
+	ut_asserteq(2, dev_stats.hits);
+	ut_asserteq(2, dev_stats.misses);
+
+	blkcache_invalidate(IF_TYPE_HOST, 7);
+	ut_asserteq(0, blkcache_read(IF_TYPE_HOST, 7, 6, 3, 512, data));
+
+	/* 40 lines do not fit in 16, so the oldest are replaced */
+	for (i = 0; i < 40; i++)
+		blkcache_fill(IF_TYPE_HOST, 7, i * 8, 1, 512, buf + i * 512);
+	ut_asserteq(1, blkcache_read(IF_TYPE_HOST, 7, 39 * 8, 1, 512, data));
+	ut_assertok(memcmp(buf + 39 * 512, data, 512));
+	ut_assertok(blkcache_find_dev_stats(IF_TYPE_HOST, 7, &dev_stats));
+	ut_assert(dev_stats.evictions >= 24);
+	blkcache_stats(&stats);
+	ut_asserteq(dev_stats.evictions, stats.evictions);
+	ut_assert(stats.entries <= 16);
+
+	/* Fills bigger than the limit are not cached */
+	blkcache_invalidate(IF_TYPE_HOST, 7);
+	blkcache_configure(4, 16);
+	blkcache_fill(IF_TYPE_HOST, 7, 0, 10, 512, buf);
+	ut_asserteq(0, blkcache_read(IF_TYPE_HOST, 7, 0, 1, 512, data));
+
+	/* Invalidating a device gives up its slot for the next one */
+	blkcache_configure(64, 16);
+	for (i = 0; i < 20; i++) {
+		blkcache_fill(IF_TYPE_HOST, 10 + i, 0, 1, 512, buf);
+		ut_asserteq(1, blkcache_read(IF_TYPE_HOST, 10 + i, 0, 1, 512,
+					     data));
+		blkcache_invalidate(IF_TYPE_HOST, 10 + i);
+		ut_asserteq(-ENOENT, blkcache_find_dev_stats(IF_TYPE_HOST,
+							     10 + i,
+							     &dev_stats));
+	}
+	blkcache_stats(&stats);
+	ut_asserteq(0, stats.entries);
+
+	blkcache_configure(orig.max_blocks_per_entry, orig.max_entries);
+
+	return 0;
+}
+DM_TEST(dm_test_blk_cache, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+#ifdef CONFIG_BLOCK_CACHE_WRITEBACK
+#define BLKCACHE_TEST_FILE	"blkcache-writeback.img"
+
+/* Read blocks straight from the host file, bypassing the cache */
+static int blkcache_read_file(int start, int count, void *buf)
+{
+	int fd, ret;
+
+	fd = os_open(BLKCACHE_TEST_FILE, OS_O_RDONLY);
+	if (fd < 0)
+		return -ENOENT;
+	os_lseek(fd, start * 512, OS_SEEK_SET);
+	ret = os_read(fd, buf, count * 512);
+	os_close(fd);
+
+	return ret == count * 512 ? 0 : -EIO;
+}
+
+/* Test that small writes are held back, merged and written back in order */
+static int dm_test_blk_cache_writeback(struct unit_test_state *uts)
+{
+	struct block_cache_dev_stats dev_stats;
+	struct block_cache_stats orig;
+	struct blk_desc *desc;
+	u8 buf[24 * 512], data[24 * 512];
+	int fd, i;
+
+	fd = os_open(BLKCACHE_TEST_FILE, OS_O_RDWR | OS_O_CREAT);
+	ut_assert(fd >= 0);
+	memset(buf, '\0', sizeof(buf));
+	for (i = 0; i < 16; i++)
+		ut_asserteq(sizeof(buf), os_write(fd, buf, sizeof(buf)));
+	os_close(fd);
+
+	blkcache_stats(&orig);
+	blkcache_configure(64, 16);
+	ut_assertok(host_dev_bind(3, BLKCACHE_TEST_FILE));
+	ut_asserteq(3, blk_get_device_by_str("host", "3", &desc));
+	blkcache_find_dev_stats(IF_TYPE_HOST, 3, &dev_stats);
+
+	/* Write blocks 4 to 19 backwards, one at a time */
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = i + i / 512 + 1;
+	for (i = 19; i >= 4; i--)
+		ut_asserteq(1, blk_dwrite(desc, i, 1, buf + (i - 4) * 512));
+
+	/* They are not on the device yet, but read back from the cache */
+	ut_assertok(blkcache_read_file(4, 16, data));
+	ut_asserteq(0, data[0]);
+	ut_asserteq(16, blk_dread(desc, 4, 16, data));
+	ut_assertok(memcmp(buf, data, 16 * 512));
+
+	/* One write puts them all on the device */
+	ut_assertok(blkcache_flush(IF_TYPE_HOST, 3));
+	ut_assertok(blkcache_find_dev_stats(IF_TYPE_HOST, 3, &dev_stats));
+	ut_asserteq(1, dev_stats.writebacks);
+	ut_assertok(blkcache_read_file(4, 16, data));
+	ut_assertok(memcmp(buf, data, 16 * 512));
+
+	/* A read which misses on a dirty block writes it back first */
+	ut_asserteq(1, blk_dwrite(desc, 40, 1, buf));
+	ut_asserteq(2, blk_dread(desc, 40, 2, data));
+	ut_assertok(memcmp(buf, data, 512));
+	ut_assertok(blkcache_find_dev_stats(IF_TYPE_HOST, 3, &dev_stats));
+	ut_asserteq(1, dev_stats.writebacks);
+
+	/* A write too large to cache replaces what is dirty in its range */
+	ut_asserteq(1, blk_dwrite(desc, 100, 1, buf));
+	blkcache_configure(4, 16);
+	memset(data, 0x55, sizeof(data));
+	ut_asserteq(8, blk_dwrite(desc, 96, 8, data));
+	ut_assertok(blkcache_flush(IF_TYPE_HOST, 3));
+	memset(data, '\0', sizeof(data));
+	ut_assertok(blkcache_read_file(96, 8, data));
+	ut_asserteq(0x55, data[4 * 512]);
+	ut_asserteq(8, blk_dread(desc, 96, 8, data));
+	ut_asserteq(0x55, data[4 * 512]);
+
+	/* Switching hardware partition writes back and drops the blocks */
+	ut_asserteq(1, blk_dwrite(desc, 150, 1, buf));
+	ut_assertok(blkcache_select_hwpart(desc, desc->hwpart));
+	ut_assertok(blkcache_read_file(150, 1, data));
+	ut_asserteq(0, data[0]);
+	ut_assertok(blkcache_select_hwpart(desc, desc->hwpart + 1));
+	ut_assertok(blkcache_read_file(150, 1, data));
+	ut_assertok(memcmp(buf, data, 512));
+	ut_asserteq(0, blkcache_read(IF_TYPE_HOST, 3, 150, 1, 512, data));
+
+	/* Removing the device writes back what is left */
+	blkcache_configure(64, 16);
+	ut_asserteq(1, blk_dwrite(desc, 200, 1, buf));
+	ut_assertok(host_dev_bind(3, NULL));
+	ut_assertok(blkcache_read_file(200, 1, data));
+	ut_assertok(memcmp(buf, data, 512));
+
+	os_unlink(BLKCACHE_TEST_FILE);
+	blkcache_configure(orig.max_blocks_per_entry, orig.max_entries);
+
+	return 0;
+}
+DM_TEST(dm_test_blk_cache_writeback, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+#endif
+#endif
@@ -12,6 +12,7 @@
 #include <fdtdec.h>
 #include <malloc.h>
 #include <dm/device-internal.h>
+#include <dm/lists.h>
 #include <dm/root.h>
 #include <dm/util.h>
 #include <dm/test.h>
@@ -871,3 +872,245 @@ static int dm_test_uclass_names(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_uclass_names, DM_TESTF_SCAN_PDATA);
+
+/* Test that drivers are found by compatible string as a linear search would */
+static int dm_test_lookup_compat(struct unit_test_state *uts)
+{
+	struct driver *driver = ll_entry_start(struct driver, driver);
+	const int n_ents = ll_entry_count(struct driver, driver);
+	const struct udevice_id *of_match, *id, *first_id;
+	struct driver *entry, *first;
+	int count = 0;
+
+	/* Make sure the index is used, not the linear search */
+	if (CONFIG_IS_ENABLED(DM_COMPAT_INDEX))
+		ut_assertnonnull(gd->dm_compat);
+	for (entry = driver; entry != driver + n_ents; entry++) {
+		for (of_match = entry->of_match; of_match && of_match->compatible;
+		     of_match++) {
+			/* The first driver with the string must be found */
+			for (first = driver; first != entry; first++) {
+				for (first_id = first->of_match;
+				     first_id && first_id->compatible;
+				     first_id++) {
+					if (!strcmp(first_id->compatible,
+						    of_match->compatible))
+						goto found;
+				}
+			}
+			first_id = of_match;
+found:
+			id = NULL;
+			ut_asserteq_ptr(first, lists_driver_lookup_compat(
+					of_match->compatible, &id));
+			ut_asserteq_ptr(first_id, id);
+			count++;
+		}
+	}
+	ut_assert(count > 0);
+	ut_asserteq_ptr(NULL, lists_driver_lookup_compat(
+			"denx,u-boot-no-such-device", &id));
+
+	return 0;
+}
+DM_TEST(dm_test_lookup_compat, 0);
+
+/* Search a uclass's list for a device with a key like @want's */
+static struct udevice *find_in_list(struct uclass *uc,
+				    enum uclass_index_key key,
+				    struct udevice *want)
+{
+	struct udevice *dev;
+
+	uclass_foreach_dev(dev, uc) {
+		switch (key) {
+		case UCLASS_INDEX_SEQ:
+			if (dev->seq == want->seq)
+				return dev;
+			break;
+		case UCLASS_INDEX_REQ_SEQ:
+			if (dev->req_seq == want->req_seq)
+				return dev;
+			break;
+		case UCLASS_INDEX_OFNODE:
+			if (ofnode_equal(dev_ofnode(dev), dev_ofnode(want)))
+				return dev;
+			break;
+		case UCLASS_INDEX_PHANDLE:
+			if (dev_has_of_node(dev) &&
+			    dev_read_phandle(dev) == dev_read_phandle(want))
+				return dev;
+			break;
+		default:
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/* Search a uclass's list for a device by name, as it was always searched */
+static struct udevice *find_name_in_list(struct uclass *uc, const char *name)
+{
+	struct udevice *dev;
+
+	uclass_foreach_dev(dev, uc) {
+		if (!strncmp(dev->name, name, strlen(name)))
+			return dev;
+	}
+
+	return NULL;
+}
+
+/* Test that indexed lookups in a uclass find what a search of it would */
+static int dm_test_uclass_index(struct unit_test_state *uts)
+{
+	struct udevice *dev, *found;
+	struct uclass *uc, *ucl;
+	int id, seq, count = 0;
+
+	for (id = 0; id < UCLASS_COUNT; id++) {
+		uc = uclass_find(id);
+		list_for_each_entry(ucl, &gd->uclass_root, sibling_node) {
+			if (ucl->uc_drv->id == id)
+				break;
+		}
+		if (&ucl->sibling_node == &gd->uclass_root)
+			ucl = NULL;
+		ut_asserteq_ptr(ucl, uc);
+		if (!uc)
+			continue;
+
+		uclass_foreach_dev(dev, uc) {
+			ut_assertok(uclass_find_device_by_name(id, dev->name,
+							       &found));
+			ut_asserteq_ptr(find_name_in_list(uc, dev->name),
+					found);
+			if (dev->seq != -1) {
+				ut_assertok(uclass_find_device_by_seq(id,
+						dev->seq, false, &found));
+				ut_asserteq_ptr(find_in_list(uc,
+						UCLASS_INDEX_SEQ, dev), found);
+			}
+			if (dev->req_seq != -1) {
+				ut_assertok(uclass_find_device_by_seq(id,
+						dev->req_seq, true, &found));
+				ut_asserteq_ptr(find_in_list(uc,
+						UCLASS_INDEX_REQ_SEQ, dev),
+						found);
+			}
+			if (!dev_has_of_node(dev))
+				continue;
+			ut_assertok(uclass_find_device_by_ofnode(id,
+					dev_ofnode(dev), &found));
+			ut_asserteq_ptr(find_in_list(uc, UCLASS_INDEX_OFNODE,
+						     dev), found);
+			if (!of_live_active()) {
+				ut_assertok(uclass_find_device_by_of_offset(id,
+						dev_of_offset(dev), &found));
+				ut_asserteq_ptr(find_in_list(uc,
+						UCLASS_INDEX_OFNODE, dev),
+						found);
+			}
+			if (dev_read_phandle(dev)) {
+				ut_assertok(uclass_find_device_by_phandle_id(id,
+						dev_read_phandle(dev), &found));
+				ut_asserteq_ptr(find_in_list(uc,
+						UCLASS_INDEX_PHANDLE, dev),
+						found);
+			}
+			count++;
+		}
+	}
+	ut_assert(count > 0);
+
+	/* Changes to a device are seen by later lookups */
+	ut_assertok(uclass_get_device(UCLASS_TEST_FDT, 0, &dev));
+	seq = dev->seq;
+	ut_assertok(uclass_find_device_by_seq(UCLASS_TEST_FDT, seq, false,
+					      &found));
+	ut_asserteq_ptr(dev, found);
+	ut_assertok(device_remove(dev, DM_REMOVE_NORMAL));
+	ut_asserteq(-ENODEV, uclass_find_device_by_seq(UCLASS_TEST_FDT, seq,
+						       false, &found));
+	ut_assertok(device_set_name(dev, "renamed-test"));
+	ut_assertok(uclass_find_device_by_name(UCLASS_TEST_FDT, "renamed-test",
+					       &found));
+	ut_asserteq_ptr(dev, found);
+	ut_assertok(device_probe(dev));
+	ut_assertok(uclass_find_device_by_seq(UCLASS_TEST_FDT, seq, false,
+					      &found));
+	ut_asserteq_ptr(dev, found);
+	ut_asserteq(-ENODEV, uclass_find_device_by_name(UCLASS_TEST_FDT,
+							"no-such-device",
+							&found));
+	ut_asserteq(-ENODEV, uclass_find_device_by_seq(UCLASS_TEST_FDT,
+						       DM_MAX_SEQ, false,
+						       &found));
+
+	/* A name which is only a prefix still finds a device */
+	ut_assertok(uclass_find_device_by_name(UCLASS_TEST_FDT, "renamed-te",
+					       &found));
+	ut_asserteq_ptr(dev, found);
+
+	/* So is a new requested sequence number */
+	seq = dev->req_seq;
+	dev_set_req_seq(dev, DM_MAX_SEQ);
+	ut_assertok(uclass_find_device_by_seq(UCLASS_TEST_FDT, DM_MAX_SEQ, true,
+					      &found));
+	ut_asserteq_ptr(dev, found);
+	dev_set_req_seq(dev, seq);
+	ut_asserteq(-ENODEV, uclass_find_device_by_seq(UCLASS_TEST_FDT,
+						       DM_MAX_SEQ, true,
+						       &found));
+
+	return 0;
+}
+DM_TEST(dm_test_uclass_index, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT |
+	DM_TESTF_PROBE_TEST);
+
+/* Test lookups in a uclass large enough for its index to grow */
+static int dm_test_uclass_index_large(struct unit_test_state *uts)
+{
+	const int count = 500;
+	struct udevice *dev, *found;
+	struct driver *drv;
+	struct uclass *uc;
+	char name[20];
+	int i;
+
+	drv = lists_driver_lookup_name("test_drv");
+	ut_assertnonnull(drv);
+	for (i = 0; i < count; i++) {
+		ut_assertok(device_bind(dm_root(), drv, "index-test", NULL, -1,
+					&dev));
+		snprintf(name, sizeof(name), "index-test%d", i);
+		ut_assertok(device_set_name(dev, name));
+		dev_set_req_seq(dev, i);
+	}
+	ut_assertok(uclass_get(UCLASS_TEST, &uc));
+
+	for (i = 0; i < count; i++) {
+		ut_assertok(uclass_find_device_by_seq(UCLASS_TEST, i, true,
+						      &found));
+		snprintf(name, sizeof(name), "index-test%d", i);
+		ut_asserteq_str(name, found->name);
+	}
+
+	/* A name finds the first device it is a prefix of, even if not exact */
+	for (i = 0; i < count; i += 37) {
+		snprintf(name, sizeof(name), "index-test%d", i);
+		ut_assertok(uclass_find_device_by_name(UCLASS_TEST, name,
+						       &found));
+		ut_asserteq_ptr(find_name_in_list(uc, name), found);
+	}
+	ut_assertok(uclass_find_device_by_name(UCLASS_TEST, "index-test3",
+					       &dev));
+	ut_assertok(device_set_name(dev, "index-test40x"));
+	ut_assertok(uclass_find_device_by_name(UCLASS_TEST, "index-test40",
+					       &found));
+	ut_asserteq_ptr(dev, found);
+
+	return 0;
+}
+DM_TEST(dm_test_uclass_index_large, 0);
@@ -11,6 +11,7 @@
 #include <dm.h>
 #include <fdtdec.h>
 #include <malloc.h>
+#include <mapmem.h>
 #include <net.h>
 #include <dm/test.h>
 #include <dm/device-internal.h>
@@ -261,3 +262,163 @@ static int dm_test_net_retry(struct unit_test_state *uts)
 	return retval;
 }
 DM_TEST(dm_test_net_retry, DM_TESTF_SCAN_FDT);
+
+/* Download 'data' and check that the server saw 'windowsize' and 'acks' */
+static int dm_test_eth_tftp_check(struct unit_test_state *uts,
+				  const char *data, uint size,
+				  uint windowsize, uint acks)
+{
+	uint got_windowsize, got_acks;
+	void *buf;
+
+	ut_asserteq(size, net_loop(TFTPGET));
+	buf = map_sysmem(load_addr, size);
+	ut_assertok(memcmp(buf, data, size));
+	unmap_sysmem(buf);
+
+	sandbox_eth_tftp_stats(&got_windowsize, &got_acks);
+	ut_asserteq(windowsize, got_windowsize);
+	ut_asserteq(acks, got_acks);
+
+	return 0;
+}
+
+/* The asserts include a return on fail; cleanup in the caller */
+static int _dm_test_eth_tftp(struct unit_test_state *uts, const char *data,
+			     uint size)
+{
+	env_set("ethact", "eth@10002000");
+	env_set("tftpblocksize", "512");
+	copy_filename(net_boot_file_name, "test.bin",
+		      sizeof(net_boot_file_name));
+
+	/* One ACK for each of the 41 blocks, and one for the OACK */
+	env_set("tftpwindowsize", "1");
+	sandbox_eth_tftp_serve(data, size, 0);
+	ut_assertok(dm_test_eth_tftp_check(uts, data, size, 1, 42));
+
+	/* One ACK for each window of 8 blocks */
+	env_set("tftpwindowsize", "8");
+	sandbox_eth_tftp_serve(data, size, 0);
+	ut_assertok(dm_test_eth_tftp_check(uts, data, size, 8, 7));
+
+	/*
+	 * Losing block 10 puts 11 to 16 out of order, so block 9 is
+	 * acknowledged once and the server sends again from 10
+	 */
+	sandbox_eth_tftp_serve(data, size, 10);
+	ut_assertok(dm_test_eth_tftp_check(uts, data, size, 8, 7));
+
+	/* Losing the first block makes the client repeat the ACK of the OACK */
+	sandbox_eth_tftp_serve(data, size, 1);
+	ut_assertok(dm_test_eth_tftp_check(uts, data, size, 8, 8));
+
+	return 0;
+}
+
+static int dm_test_eth_tftp(struct unit_test_state *uts)
+{
+	const uint size = 40 * 512 + 100;
+	ulong old_load_addr = load_addr;
+	struct in_addr old_server_ip = net_server_ip;
+	char *data;
+	int retval;
+	int i;
+
+	data = malloc(size);
+	ut_assertnonnull(data);
+	for (i = 0; i < size; i++)
+		data[i] = i * 7 + (i >> 9);
+
+	load_addr = 0x1000000;
+	net_server_ip = string_to_ip("1.1.2.2");
+	retval = _dm_test_eth_tftp(uts, data, size);
+
+	/* Restore the env */
+	sandbox_eth_tftp_serve(NULL, 0, 0);
+	env_set("ethact", NULL);
+	env_set("tftpblocksize", NULL);
+	env_set("tftpwindowsize", NULL);
+	net_boot_file_name[0] = '\0';
+	load_addr = old_load_addr;
+	net_server_ip = old_server_ip;
+	free(data);
+
+	return retval;
+}
+DM_TEST(dm_test_eth_tftp, DM_TESTF_SCAN_FDT);
+
+/* Load 'data' and check that the server saw 'window' and 'reads' */
+static int dm_test_eth_nfs_check(struct unit_test_state *uts,
+				 const char *data, uint size,
+				 uint window, uint reads)
+{
+	uint got_window, got_reads;
+	void *buf;
+
+	ut_asserteq(size, net_loop(NFS));
+	buf = map_sysmem(load_addr, size);
+	ut_assertok(memcmp(buf, data, size));
+	unmap_sysmem(buf);
+
+	sandbox_eth_nfs_stats(&got_window, &got_reads);
+	ut_asserteq(window, got_window);
+	ut_asserteq(reads, got_reads);
+
+	return 0;
+}
+
+/* The asserts include a return on fail; cleanup in the caller */
+static int _dm_test_eth_nfs(struct unit_test_state *uts, const char *data,
+			    uint size)
+{
+	env_set("ethact", "eth@10002000");
+	copy_filename(net_boot_file_name, "/export/test.bin",
+		      sizeof(net_boot_file_name));
+
+	/*
+	 * The first window asks for four 8KiB blocks, which come back 1KiB
+	 * at a time, last first. Later READs ask for 1KiB, so 41 READs get
+	 * data and four more ask past the end of the file
+	 */
+	sandbox_eth_nfs_serve(data, size, 1024);
+	ut_assertok(dm_test_eth_nfs_check(uts, data, size,
+					  CONFIG_NFS_READ_WINDOW, 45));
+
+	/* Shorter replies again, 81 READs get data */
+	sandbox_eth_nfs_serve(data, size, 512);
+	ut_assertok(dm_test_eth_nfs_check(uts, data, size,
+					  CONFIG_NFS_READ_WINDOW, 85));
+
+	return 0;
+}
+
+static int dm_test_eth_nfs(struct unit_test_state *uts)
+{
+	const uint size = 40 * 1024 + 100;
+	ulong old_load_addr = load_addr;
+	struct in_addr old_server_ip = net_server_ip;
+	char *data;
+	int retval;
+	int i;
+
+	data = malloc(size);
+	ut_assertnonnull(data);
+	for (i = 0; i < size; i++)
+		data[i] = i * 7 + (i >> 10);
+
+	load_addr = 0x1000000;
+	net_server_ip = string_to_ip("1.1.2.2");
+	retval = _dm_test_eth_nfs(uts, data, size);
+
+	/* Restore the env */
+	sandbox_eth_nfs_serve(NULL, 0, 0);
+	env_set("ethact", NULL);
+	net_boot_file_name[0] = '\0';
+	load_addr = old_load_addr;
+	net_server_ip = old_server_ip;
+	free(data);
+
+	return retval;
+}
+DM_TEST(dm_test_eth_nfs, DM_TESTF_SCAN_FDT);
@@ -35,8 +35,13 @@ static int dm_test_mmc_blk(struct unit_test_state *uts)
 	ut_assertok(uclass_get_device(UCLASS_MMC, 0, &dev));
 	ut_assertok(blk_get_device_by_str("mmc", "0", &dev_desc));
 
-	/* Read a few blocks and look for the string we expect */
+	/*
+	 * Read a few blocks and look for the string we expect. Only
+	 * multiple-block reads give it, so do not let the blocks which the
+	 * partition scan read one at a time come from the block cache.
+	 */
 	ut_asserteq(512, dev_desc->blksz);
+	blkcache_invalidate(dev_desc->if_type, dev_desc->devnum);
 	memset(cmp, '\0', sizeof(cmp));
 	ut_asserteq(2, blk_dread(dev_desc, 0, 2, cmp));
 	ut_assertok(strcmp(cmp, "this is a test"));
@@ -44,3 +49,48 @@ static int dm_test_mmc_blk(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_mmc_blk, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+#ifdef CONFIG_MMC
+static int dm_test_mmc_cmd23(struct unit_test_state *uts)
+{
+	struct udevice *dev;
+	struct blk_desc *dev_desc;
+	struct mmc *mmc;
+	ulong cmd_count, data_cmd_count;
+	u64 data_bytes;
+	char buf[1024];
+
+	ut_assertok(uclass_get_device(UCLASS_MMC, 0, &dev));
+	ut_assertok(blk_get_device_by_str("mmc", "0", &dev_desc));
+	mmc = find_mmc_device(dev_desc->devnum);
+	ut_assertnonnull(mmc);
+	ut_assert(mmc->card_caps & mmc->host_caps & MMC_CAP_CMD23);
+
+	/*
+	 * The read is SET_BLOCKLEN, then SET_BLOCK_COUNT and a single
+	 * multiple-block read. The emulated card fails the read if CMD12
+	 * follows it.
+	 */
+	blkcache_invalidate(dev_desc->if_type, dev_desc->devnum);
+	cmd_count = mmc->cmd_count;
+	data_cmd_count = mmc->data_cmd_count;
+	data_bytes = mmc->data_bytes;
+	ut_asserteq(2, blk_dread(dev_desc, 0, 2, buf));
+	ut_assertok(strcmp(buf, "this is a test"));
+	ut_asserteq(cmd_count + 3, mmc->cmd_count);
+	ut_asserteq(data_cmd_count + 1, mmc->data_cmd_count);
+	ut_asserteq(data_bytes + sizeof(buf), mmc->data_bytes);
+
+	/*
+	 * A multiple-block write after it still ends with CMD12. Go to the
+	 * device itself, since the block cache would hold the write back.
+	 */
+	data_cmd_count = mmc->data_cmd_count;
+	ut_asserteq(2, blk_get_ops(dev_desc->bdev)->write(dev_desc->bdev, 0, 2,
+							  buf));
+	ut_asserteq(data_cmd_count + 1, mmc->data_cmd_count);
+
+	return 0;
+}
+DM_TEST(dm_test_mmc_cmd23, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+#endif
@@ -7,9 +7,14 @@
 #include <common.h>
 #include <dm.h>
 #include <fdtdec.h>
+#include <malloc.h>
+#include <mapmem.h>
 #include <spi.h>
 #include <spi_flash.h>
 #include <asm/state.h>
+#include <u-boot/crc.h>
+#include <u-boot/sha256.h>
+#include <dm/device-internal.h>
 #include <dm/test.h>
 #include <dm/util.h>
 #include <test/ut.h>
@@ -41,3 +46,731 @@ static int dm_test_spi_flash(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_spi_flash, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+/* Test that the erase planner erases exactly the requested range */
+static int dm_test_spi_flash_erase(struct unit_test_state *uts)
+{
+	struct sandbox_state *state = state_get_current();
+	const int size = 0x40000, sect = 0x10000;
+	struct udevice *dev, *emul;
+	struct spi_flash *flash;
+	uint sectors;
+	u8 *src, *dst;
+	int i;
+
+	ut_asserteq(0, run_command_list("sb save hostfs - 0 spi.bin 200000",
+					-1, 0));
+	ut_assertok(spi_flash_probe_bus_cs(0, 0, 1000000, 0, &dev));
+	flash = dev_get_uclass_priv(dev);
+	emul = state->spi[0][0].emul;
+
+	src = malloc(size);
+	ut_assertnonnull(src);
+	dst = malloc(size);
+	ut_assertnonnull(dst);
+	for (i = 0; i < size; i++)
+		src[i] = i;
+
+	ut_assertok(spi_flash_erase_dm(dev, 0, size));
+	ut_assertok(spi_flash_write_dm(dev, 0, size, src));
+
+	/* Erase the middle two sectors only */
+	ut_assertok(spi_flash_erase_dm(dev, sect, sect * 2));
+	ut_assertok(spi_flash_read_dm(dev, 0, size, dst));
+	ut_assertok(memcmp(src, dst, sect));
+	for (i = sect; i < sect * 3; i++)
+		ut_asserteq(0xff, dst[i]);
+	ut_assertok(memcmp(src + sect * 3, dst + sect * 3, sect));
+
+	/*
+	 * The whole device goes through a single chip erase. The table gives
+	 * no timing for this part, so it comes from the emulator's SFDP.
+	 */
+	ut_asserteq(512000, flash->timing[SPI_FLASH_OP_CHIP_ERASE].typ_us);
+	ut_asserteq(384000, flash->timing[SPI_FLASH_OP_CHIP_ERASE].wait_us);
+	sectors = sandbox_sf_get_cmd_count(emul, 0xd8);
+	ut_asserteq(0, sandbox_sf_get_cmd_count(emul, 0xc7));
+	ut_assertok(spi_flash_erase_dm(dev, 0, flash->size));
+	ut_asserteq(1, sandbox_sf_get_cmd_count(emul, 0xc7));
+	ut_asserteq(sectors, sandbox_sf_get_cmd_count(emul, 0xd8));
+	ut_assertok(spi_flash_read_dm(dev, 0, size, dst));
+	for (i = 0; i < size; i++)
+		ut_asserteq(0xff, dst[i]);
+
+	free(dst);
+	free(src);
+	sandbox_sf_unbind_emul(state_get_current(), 0, 0);
+
+	return 0;
+}
+DM_TEST(dm_test_spi_flash_erase, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT |
+	DM_TESTF_FLAT_TREE);
+
+/* Test writes which start and end part way through a page */
+static int dm_test_spi_flash_write(struct unit_test_state *uts)
+{
+	struct udevice *dev;
+	u8 *buf, *data;
+	int i;
+
+	ut_asserteq(0, run_command_list("sb save hostfs - 0 spi.bin 200000",
+					-1, 0));
+	ut_assertok(spi_flash_probe_bus_cs(0, 0, 1000000, 0, &dev));
+
+	buf = malloc(0x1000);
+	ut_assertnonnull(buf);
+	data = malloc(0x1000);
+	ut_assertnonnull(data);
+	for (i = 0; i < 0x1000; i++)
+		buf[i] = i * 3 + 1;
+	ut_assertok(spi_flash_erase_dm(dev, 0x10000, 0x10000));
+	ut_assertok(spi_flash_write_dm(dev, 0x100f0, 0x345, buf));
+
+	ut_assertok(spi_flash_read_dm(dev, 0x10000, 0x1000, data));
+	for (i = 0; i < 0x1000; i++) {
+		if (i < 0xf0 || i >= 0xf0 + 0x345) {
+			ut_asserteq(0xff, data[i]);
+		} else {
+			ut_asserteq(buf[i - 0xf0], data[i]);
+		}
+	}
+
+	free(data);
+	free(buf);
+	sandbox_sf_unbind_emul(state_get_current(), 0, 0);
+
+	return 0;
+}
+DM_TEST(dm_test_spi_flash_write, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT |
+	DM_TESTF_FLAT_TREE);
+
+/* Test that the sf test benchmark runs and checks what it reads */
+static int dm_test_spi_flash_bench(struct unit_test_state *uts)
+{
+	struct sandbox_state *state = state_get_current();
+	struct dm_spi_slave_platdata *plat;
+	struct udevice *bus, *dev;
+	struct spi_flash *flash;
+	int mode;
+	u8 *buf;
+	int i;
+
+	ut_asserteq(0, run_command_list(
+		"sb save hostfs - 0 spi.bin 200000;"
+		"sf probe;"
+		"sf test 0 10000 bench", -1, 0));
+
+	/*
+	 * Since we are about to destroy all devices, we must tell sandbox
+	 * to forget the emulation device
+	 */
+	sandbox_sf_unbind_emul(state, 0, 0);
+
+	/*
+	 * A part with dual and quad reads, probed through SFDP. Its quad read
+	 * has more dummy cycles than the default, so reading the right data
+	 * needs the SFDP value in every mode. From the ID table, the default
+	 * is right.
+	 */
+	ut_asserteq(0, run_command_list("sb save hostfs - 0 spiq.bin 1000000",
+					-1, 0));
+	state->spi[0][1].spec = "mx25l12805:spiq.bin";
+	ut_assertok(uclass_get_device_by_seq(UCLASS_SPI, 0, &bus));
+	ut_assertok(sandbox_sf_bind_emul(state, 0, 1, bus, -1, "mx25l12805"));
+	ut_assertok(spi_flash_probe_bus_cs(0, 1, 1000000,
+					   SPI_RX_DUAL | SPI_RX_QUAD, &dev));
+	plat = dev_get_parent_platdata(dev);
+	ut_asserteq(SPI_RX_DUAL | SPI_RX_QUAD, plat->mode);
+	flash = dev_get_uclass_priv(dev);
+	ut_asserteq(0x6b, flash->read_cmd);
+	ut_asserteq(1, flash->dummy_byte);
+	ut_asserteq(0, run_command_list("sf probe 0:1;"
+					"sf test 0 10000 bench", -1, 0));
+
+	sandbox_sf_set_quad_dummy(state->spi[0][1].emul, 2);
+	sandbox_sf_set_sfdp_only(state->spi[0][1].emul, true);
+	ut_assertok(device_remove(dev, DM_REMOVE_NORMAL));
+	ut_assertok(device_probe(dev));
+	flash = dev_get_uclass_priv(dev);
+	ut_asserteq_str("sfdp", flash->name);
+	ut_asserteq(0x6b, flash->read_cmd);
+	ut_asserteq(2, flash->dummy_byte);
+
+	/* The benchmark fails if any mode reads the wrong data */
+	ut_asserteq(0, run_command_list("sf probe 0:1;"
+					"sf test 0 10000 bench", -1, 0));
+
+	/* Each mode reads the right data, going into quad and out again */
+	buf = malloc(0x1000);
+	ut_assertnonnull(buf);
+	for (i = 0; i < 0x1000; i++)
+		buf[i] = i * 5;
+	flash = dev_get_uclass_priv(dev);
+	ut_assertok(spi_flash_erase_dm(dev, 0, 0x10000));
+	ut_assertok(spi_flash_write_dm(dev, 0, 0x1000, buf));
+	for (mode = SPI_FLASH_READ_QUAD; mode >= 0; mode--) {
+		ut_assertok(spi_flash_set_read_mode(flash, mode));
+		memset(buf, '\0', 0x1000);
+		ut_assertok(spi_flash_read_dm(dev, 0, 0x1000, buf));
+		for (i = 0; i < 0x1000; i++)
+			ut_asserteq((u8)(i * 5), buf[i]);
+	}
+	ut_assertok(spi_flash_set_read_mode(flash, SPI_FLASH_READ_QUAD));
+	ut_asserteq(2, flash->dummy_byte);
+	ut_assertok(spi_flash_read_dm(dev, 0, 0x1000, buf));
+	for (i = 0; i < 0x1000; i++)
+		ut_asserteq((u8)(i * 5), buf[i]);
+	free(buf);
+
+	plat->mode = 0;
+	ut_assertok(device_remove(dev, DM_REMOVE_NORMAL));
+	sandbox_sf_set_sfdp_only(state->spi[0][1].emul, false);
+	sandbox_sf_unbind_emul(state, 0, 1);
+	state->spi[0][1].spec = NULL;
+
+	return 0;
+}
+DM_TEST(dm_test_spi_flash_bench, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT |
+	DM_TESTF_FLAT_TREE);
+
+/* Test that sf update only programs what it needs to */
+static int dm_test_spi_flash_update(struct unit_test_state *uts)
+{
+	u8 *buf;
+	int i;
+
+	ut_asserteq(0, run_command_list(
+		"sb save hostfs - 0 spi.bin 200000;"
+		"sf probe;"
+		"sf erase 0 20000;"
+		/* Programming 0xaa over blank flash needs no erase */
+		"mw.b 10000 aa 20000;"
+		"sf update 10000 0 20000;"
+		/* Setting bits needs an erase, keeping the rest of the sector */
+		"mw.b 10000 55 100;"
+		"sf update 10000 0 100;"
+		/* Blank pages are not written back after the erase */
+		"mw.b 10000 ff 10000;"
+		"sf update 10000 10000 10000;"
+		"sf read 40000 0 20000;"
+		"sf stats;"
+		"sf stats reset", -1, 0));
+
+	buf = map_sysmem(0x40000, 0x20000);
+	for (i = 0; i < 0x100; i++)
+		ut_asserteq(0x55, buf[i]);
+	for (; i < 0x10000; i++)
+		ut_asserteq(0xaa, buf[i]);
+	for (; i < 0x20000; i++)
+		ut_asserteq(0xff, buf[i]);
+	unmap_sysmem(buf);
+
+	/*
+	 * Since we are about to destroy all devices, we must tell sandbox
+	 * to forget the emulation device
+	 */
+	sandbox_sf_unbind_emul(state_get_current(), 0, 0);
+
+	return 0;
+}
+DM_TEST(dm_test_spi_flash_update, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT |
+	DM_TESTF_FLAT_TREE);
+
+struct sf_stream_check {
+	u32 offset;		/* offset expected next */
+	const u8 *prev;		/* previous chunk, which must still be valid */
+	size_t prev_len;
+	u32 prev_offset;
+	int calls;
+};
+
+static int sf_stream_check(void *priv, u32 offset, const void *buf,
+			   size_t len)
+{
+	struct sf_stream_check *check = priv;
+	const u8 *ptr = buf;
+	size_t i;
+
+	if (offset != check->offset || len > 0x300)
+		return -EINVAL;
+	for (i = 0; i < len; i++) {
+		if (ptr[i] != (u8)((offset + i) * 7))
+			return -EINVAL;
+	}
+	for (i = 0; i < check->prev_len; i++) {
+		if (check->prev[i] != (u8)((check->prev_offset + i) * 7))
+			return -EINVAL;
+	}
+	check->prev = ptr;
+	check->prev_len = len;
+	check->prev_offset = offset;
+	check->offset += len;
+	check->calls++;
+
+	return 0;
+}
+
+/* Test streaming reads, with and without a destination buffer */
+static int dm_test_spi_flash_stream(struct unit_test_state *uts)
+{
+	struct sf_stream_check check;
+	struct spi_flash *flash;
+	struct udevice *dev;
+	u8 *buf, *data;
+	int i;
+
+	ut_asserteq(0, run_command_list("sb save hostfs - 0 spi.bin 200000",
+					-1, 0));
+	ut_assertok(spi_flash_probe_bus_cs(0, 0, 1000000, 0, &dev));
+	flash = dev_get_uclass_priv(dev);
+
+	buf = malloc(0x1000);
+	ut_assertnonnull(buf);
+	data = malloc(0x1000);
+	ut_assertnonnull(data);
+	for (i = 0; i < 0x1000; i++)
+		buf[i] = (0x10000 + i) * 7;
+	ut_assertok(spi_flash_erase_dm(dev, 0x10000, 0x10000));
+	ut_assertok(spi_flash_write_dm(dev, 0x10000, 0x1000, buf));
+
+	/* Ping-pong buffers */
+	memset(&check, '\0', sizeof(check));
+	check.offset = 0x10010;
+	ut_assertok(spi_flash_read_stream(flash, 0x10010, 0xfe0, NULL, 0x300,
+					  sf_stream_check, &check));
+	ut_asserteq(0x10ff0, check.offset);
+	ut_asserteq(6, check.calls);
+
+	/* Straight into the caller's buffer */
+	memset(&check, '\0', sizeof(check));
+	check.offset = 0x10000;
+	memset(data, '\0', 0x1000);
+	ut_assertok(spi_flash_read_stream(flash, 0x10000, 0x1000, data, 0x300,
+					  sf_stream_check, &check));
+	ut_asserteq(0x11000, check.offset);
+	ut_asserteq(0, memcmp(buf, data, 0x1000));
+
+	/* The consumer can stop the read */
+	memset(&check, '\0', sizeof(check));
+	check.offset = 0x20000;
+	ut_asserteq(-EINVAL, spi_flash_read_stream(flash, 0x10000, 0x1000,
+						   NULL, 0, sf_stream_check,
+						   &check));
+
+	free(data);
+	free(buf);
+	sandbox_sf_unbind_emul(state_get_current(), 0, 0);
+
+	return 0;
+}
+DM_TEST(dm_test_spi_flash_stream, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT |
+	DM_TESTF_FLAT_TREE);
+
+/* Test probing a flash which is not in the ID table, using its SFDP */
+static int dm_test_spi_flash_sfdp(struct unit_test_state *uts)
+{
+	struct sandbox_state *state = state_get_current();
+	struct spi_flash *flash;
+	struct udevice *dev;
+	u8 buf[0x100];
+	int i;
+
+	ut_asserteq(0, run_command_list("sb save hostfs - 0 spi.bin 200000",
+					-1, 0));
+	ut_assertok(spi_flash_probe_bus_cs(0, 0, 1000000, 0, &dev));
+	flash = dev_get_uclass_priv(dev);
+	ut_asserteq_str("m25p16", flash->name);
+
+	/* Hide the ID and probe again */
+	sandbox_sf_set_sfdp_only(state->spi[0][0].emul, true);
+	ut_assertok(device_remove(dev, DM_REMOVE_NORMAL));
+	ut_assertok(device_probe(dev));
+	flash = dev_get_uclass_priv(dev);
+	ut_asserteq_str("sfdp", flash->name);
+	ut_asserteq(0x200000, flash->size);
+	ut_asserteq(0x10000, flash->erase_size);
+	ut_asserteq(256, flash->page_size);
+	ut_asserteq(0x10000, flash->erase_types[0].size);
+	ut_asserteq(0xd8, flash->erase_types[0].cmd);
+	ut_asserteq(0, flash->erase_types[1].size);
+
+	/* The emulator gives short typical times */
+	ut_asserteq(256, flash->timing[SPI_FLASH_OP_PROGRAM].typ_us);
+	ut_asserteq(64000, flash->timing[SPI_FLASH_OP_ERASE].typ_us);
+	ut_asserteq(512000, flash->timing[SPI_FLASH_OP_CHIP_ERASE].typ_us);
+	ut_asserteq(384000, flash->timing[SPI_FLASH_OP_CHIP_ERASE].wait_us);
+
+	/* Check that it works */
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = i;
+	ut_assertok(spi_flash_erase_dm(dev, 0x10000, 0x10000));
+	ut_assertok(spi_flash_write_dm(dev, 0x10000, sizeof(buf), buf));
+	memset(buf, '\0', sizeof(buf));
+	ut_assertok(spi_flash_read_dm(dev, 0x10000, sizeof(buf), buf));
+	for (i = 0; i < sizeof(buf); i++)
+		ut_asserteq((u8)i, buf[i]);
+
+	/*
+	 * The emulator is never busy, so the first poll, at 3/4 of the
+	 * typical time, finds each operation done
+	 */
+	ut_asserteq(1, flash->timing[SPI_FLASH_OP_PROGRAM].count);
+	ut_asserteq(1, flash->timing[SPI_FLASH_OP_PROGRAM].polls);
+	ut_assert(flash->timing[SPI_FLASH_OP_PROGRAM].min_us >= 192);
+	ut_asserteq(1, flash->timing[SPI_FLASH_OP_ERASE].count);
+	ut_asserteq(1, flash->timing[SPI_FLASH_OP_ERASE].polls);
+	ut_assert(flash->timing[SPI_FLASH_OP_ERASE].min_us >= 48000);
+	ut_asserteq(0, flash->timing[SPI_FLASH_OP_ERASE].timeouts);
+
+	sandbox_sf_set_sfdp_only(state->spi[0][0].emul, false);
+	sandbox_sf_unbind_emul(state, 0, 0);
+
+	return 0;
+}
+DM_TEST(dm_test_spi_flash_sfdp, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT |
+	DM_TESTF_FLAT_TREE);
+
+/* Test that a flash over 16MiB is used with 4-byte address commands */
+static int dm_test_spi_flash_4b(struct unit_test_state *uts)
+{
+	struct sandbox_state *state = state_get_current();
+	struct dm_spi_slave_platdata *plat;
+	struct spi_flash *flash;
+	struct udevice *bus, *dev;
+	u8 buf[0x200];
+	int i;
+
+	ut_asserteq(0, run_command_list("sb save hostfs - 0 spi4b.bin 2000000",
+					-1, 0));
+	state->spi[0][1].spec = "s25fl256s_64k:spi4b.bin";
+	ut_assertok(uclass_get_device_by_seq(UCLASS_SPI, 0, &bus));
+	ut_assertok(sandbox_sf_bind_emul(state, 0, 1, bus, -1,
+					 "s25fl256s_64k"));
+	ut_assertok(spi_flash_probe_bus_cs(0, 1, 1000000, 0, &dev));
+	flash = dev_get_uclass_priv(dev);
+	ut_asserteq(0x2000000, flash->size);
+	ut_asserteq(4, flash->addr_width);
+	ut_asserteq(0x0c, flash->read_cmd);
+	ut_asserteq(0x12, flash->write_cmd);
+	ut_asserteq(0xdc, flash->erase_types[0].cmd);
+
+	/* Write and read back across the 16MiB boundary */
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = i;
+	ut_assertok(spi_flash_erase_dm(dev, 0xff0000, 0x20000));
+	ut_assertok(spi_flash_write_dm(dev, 0xffff00, sizeof(buf), buf));
+	memset(buf, '\0', sizeof(buf));
+	ut_assertok(spi_flash_read_dm(dev, 0xffff00, sizeof(buf), buf));
+	for (i = 0; i < sizeof(buf); i++)
+		ut_asserteq((u8)i, buf[i]);
+
+	/* The SFDP 4-byte address instruction table gives the same result */
+	sandbox_sf_set_sfdp_only(state->spi[0][1].emul, true);
+	ut_assertok(device_remove(dev, DM_REMOVE_NORMAL));
+	ut_assertok(device_probe(dev));
+	flash = dev_get_uclass_priv(dev);
+	ut_asserteq_str("sfdp", flash->name);
+	ut_asserteq(4, flash->addr_width);
+	ut_asserteq(0xdc, flash->erase_types[0].cmd);
+	memset(buf, '\0', sizeof(buf));
+	ut_assertok(spi_flash_read_dm(dev, 0xffff00, sizeof(buf), buf));
+	for (i = 0; i < sizeof(buf); i++)
+		ut_asserteq((u8)i, buf[i]);
+
+	sandbox_sf_set_sfdp_only(state->spi[0][1].emul, false);
+	sandbox_sf_unbind_emul(state, 0, 1);
+
+	/* Macronix has no 1-1-4 program with a 4-byte address */
+	ut_assertok(device_remove(dev, DM_REMOVE_NORMAL));
+	state->spi[0][1].spec = "mx25l25635f:spi4b.bin";
+	ut_assertok(sandbox_sf_bind_emul(state, 0, 1, bus, -1,
+					 "mx25l25635f"));
+	plat = dev_get_parent_platdata(dev);
+	plat->mode = SPI_TX_QUAD;
+	ut_assertok(device_probe(dev));
+	flash = dev_get_uclass_priv(dev);
+	ut_asserteq(4, flash->addr_width);
+	ut_asserteq(0x12, flash->write_cmd);
+
+	/*
+	 * The driver cannot set the quad enable bit in SR2 bit 7 (QER 3), so
+	 * it falls back to dual reads and single-line programs
+	 */
+	sandbox_sf_set_sfdp_only(state->spi[0][1].emul, true);
+	sandbox_sf_set_sfdp_qer(state->spi[0][1].emul, 3);
+	ut_assertok(device_remove(dev, DM_REMOVE_NORMAL));
+	plat->mode = SPI_RX_QUAD | SPI_RX_DUAL | SPI_TX_QUAD;
+	ut_assertok(device_probe(dev));
+	flash = dev_get_uclass_priv(dev);
+	ut_asserteq_str("sfdp", flash->name);
+	ut_asserteq(0x3c, flash->read_cmd);
+	ut_asserteq(0x12, flash->write_cmd);
+	ut_asserteq(-ENOTSUPP, spi_flash_set_read_mode(flash,
+						       SPI_FLASH_READ_QUAD));
+	memset(buf, '\0', sizeof(buf));
+	ut_assertok(spi_flash_read_dm(dev, 0xffff00, sizeof(buf), buf));
+	for (i = 0; i < sizeof(buf); i++)
+		ut_asserteq((u8)i, buf[i]);
+	sandbox_sf_set_sfdp_only(state->spi[0][1].emul, false);
+	plat->mode = 0;
+
+	ut_assertok(device_remove(dev, DM_REMOVE_NORMAL));
+	sandbox_sf_unbind_emul(state, 0, 1);
+	state->spi[0][1].spec = NULL;
+
+	return 0;
+}
+DM_TEST(dm_test_spi_flash_4b, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT |
+	DM_TESTF_FLAT_TREE);
+
+/* Test the driver against an emulator which takes as long as a real flash */
+static int dm_test_spi_flash_timing(struct unit_test_state *uts)
+{
+	struct sandbox_state *state = state_get_current();
+	struct sandbox_sf_timing timing = { .sck_hz = 10000000 };
+	u64 sck_ns, busy_us, single_ns, dual_ns, ns, us;
+	struct spi_flash_timing *t;
+	struct udevice *bus, *dev, *emul;
+	struct spi_flash *flash;
+	u8 *buf;
+	int i;
+
+	ut_asserteq(0, run_command_list("sb save hostfs - 0 spi4b.bin 2000000",
+					-1, 0));
+	state->spi[0][1].spec = "s25fl256s_64k:spi4b.bin";
+	ut_assertok(uclass_get_device_by_seq(UCLASS_SPI, 0, &bus));
+	ut_assertok(sandbox_sf_bind_emul(state, 0, 1, bus, -1,
+					 "s25fl256s_64k"));
+	ut_assertok(spi_flash_probe_bus_cs(0, 1, 1000000, 0, &dev));
+	flash = dev_get_uclass_priv(dev);
+	emul = state->spi[0][1].emul;
+	sandbox_sf_set_timing(emul, &timing);
+
+	buf = malloc(0x10000);
+	ut_assertnonnull(buf);
+	for (i = 0; i < 0x10000; i++)
+		buf[i] = i * 7;
+
+	/*
+	 * The emulator is busy for the typical times, and the driver cannot
+	 * see the operation finish any sooner
+	 */
+	t = &flash->timing[SPI_FLASH_OP_ERASE];
+	sandbox_sf_get_model_time(emul, &sck_ns, &busy_us);
+	ut_assertok(spi_flash_erase_dm(dev, 0, 0x10000));
+	sandbox_sf_get_model_time(emul, &ns, &us);
+	ut_asserteq(64000, us - busy_us);
+	ut_asserteq(1, t->count);
+	ut_assert(t->min_us >= 64000);
+
+	t = &flash->timing[SPI_FLASH_OP_PROGRAM];
+	busy_us = us;
+	ut_assertok(spi_flash_write_dm(dev, 0, 0x400, buf));
+	sandbox_sf_get_model_time(emul, &ns, &us);
+	ut_asserteq(4 * 256, us - busy_us);
+	ut_asserteq(4, t->count);
+	ut_assert(t->min_us >= 256);
+	ut_asserteq(0, t->timeouts);
+
+	/* 64KiB at 10MHz takes over 52ms on one line and half that on two */
+	sck_ns = ns;
+	ut_assertok(spi_flash_read_dm(dev, 0, 0x10000, buf));
+	sandbox_sf_get_model_time(emul, &ns, &us);
+	single_ns = ns - sck_ns;
+	ut_assert(single_ns >= 52428800);
+
+	flash->spi->mode |= SPI_RX_DUAL;
+	ut_assertok(spi_flash_set_read_mode(flash, SPI_FLASH_READ_DUAL));
+	memset(buf, '\0', 0x400);
+	sck_ns = ns;
+	ut_assertok(spi_flash_read_dm(dev, 0, 0x10000, buf));
+	sandbox_sf_get_model_time(emul, &ns, &us);
+	dual_ns = ns - sck_ns;
+	ut_assert(dual_ns >= 26214400);
+	ut_assert(dual_ns < single_ns);
+	for (i = 0; i < 0x400; i++)
+		ut_asserteq((u8)(i * 7), buf[i]);
+
+	free(buf);
+	sandbox_sf_unbind_emul(state, 0, 1);
+	state->spi[0][1].spec = NULL;
+
+	return 0;
+}
+DM_TEST(dm_test_spi_flash_timing, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT |
+	DM_TESTF_FLAT_TREE);
+
+/* Test that program and erase failures are caught when reading back */
+static int dm_test_spi_flash_fault(struct unit_test_state *uts)
+{
+	struct sandbox_state *state = state_get_current();
+	struct udevice *dev, *emul;
+	u8 buf[0x200], data[0x200];
+	struct spi_flash *flash;
+	struct spi_slave *slave;
+	uint reads;
+	int i;
+
+	ut_asserteq(0, run_command_list("sb save hostfs - 0 spi.bin 200000",
+					-1, 0));
+	ut_assertok(spi_flash_probe_bus_cs(0, 0, 1000000, 0, &dev));
+	emul = state->spi[0][0].emul;
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = i;
+
+	/* The second page fails to program, which the verify notices */
+	ut_assertok(spi_flash_erase_dm(dev, 0x10000, 0x10000));
+	sandbox_sf_set_fault(emul, SANDBOX_SF_FAULT_PROGRAM, 1);
+	ut_asserteq(-EIO, spi_flash_write_dm(dev, 0x10000, sizeof(buf), buf));
+	ut_assertok(spi_flash_read_dm(dev, 0x10000, sizeof(data), data));
+	ut_assertok(memcmp(buf, data, 0x100));
+	for (i = 0x100; i < sizeof(data); i++)
+		ut_asserteq(0xff, data[i]);
+
+	/* The fault is gone, so programming the second page again works */
+	ut_assertok(spi_flash_write_dm(dev, 0x10100, 0x100, buf + 0x100));
+
+	/* An erase which fails leaves bits at 0, so they cannot be written */
+	sandbox_sf_set_fault(emul, SANDBOX_SF_FAULT_ERASE, 0);
+	ut_assertok(spi_flash_erase_dm(dev, 0x10000, 0x10000));
+	ut_assertok(spi_flash_read_dm(dev, 0x10000, sizeof(data), data));
+	ut_assertok(memcmp(buf, data, sizeof(buf)));
+	memset(buf, 0xa5, sizeof(buf));
+	ut_asserteq(-EIO, spi_flash_write_dm(dev, 0x10000, sizeof(buf), buf));
+
+	/* The read back is split up as the controller needs, like any read */
+	flash = dev_get_uclass_priv(dev);
+	slave = dev_get_parent_priv(dev);
+	slave->max_read_size = 0x40;
+	reads = sandbox_sf_get_cmd_count(emul, flash->read_cmd);
+	ut_assertok(spi_flash_erase_dm(dev, 0x20000, 0x10000));
+	ut_assertok(spi_flash_write_dm(dev, 0x20000, 0x100, buf));
+	ut_asserteq(reads + 4, sandbox_sf_get_cmd_count(emul, flash->read_cmd));
+	slave->max_read_size = 0;
+
+	sandbox_sf_unbind_emul(state, 0, 0);
+
+	return 0;
+}
+DM_TEST(dm_test_spi_flash_fault, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT |
+	DM_TESTF_FLAT_TREE);
+
+#if IMAGE_ENABLE_STREAM_HASH
+/* Build a FIT at @fit with one image of @size bytes of external data */
+static int sf_build_fit(struct unit_test_state *uts, void *fit, int size)
+{
+	u8 sha[SHA256_SUM_LEN];
+	int images, node, hash;
+	u8 *data;
+	u32 crc;
+	int i;
+
+	ut_assertok(fdt_create_empty_tree(fit, 0x1000));
+	ut_assertok(fdt_setprop_string(fit, 0, FIT_DESC_PROP, "test"));
+	ut_assertok(fdt_setprop_u32(fit, 0, FIT_TIMESTAMP_PROP, 0));
+	images = fdt_add_subnode(fit, 0, "images");
+	ut_assert(images >= 0);
+	node = fdt_add_subnode(fit, images, "kernel");
+	ut_assert(node >= 0);
+	ut_assertok(fdt_setprop_u32(fit, node, FIT_DATA_OFFSET_PROP, 0));
+	ut_assertok(fdt_setprop_u32(fit, node, FIT_DATA_SIZE_PROP, size));
+
+	/* Space for the hash values, which are filled in below */
+	hash = fdt_add_subnode(fit, node, "hash-1");
+	ut_assert(hash >= 0);
+	ut_assertok(fdt_setprop_string(fit, hash, FIT_ALGO_PROP, "sha256"));
+	ut_assertok(fdt_setprop(fit, hash, FIT_VALUE_PROP, sha, sizeof(sha)));
+	hash = fdt_add_subnode(fit, node, "hash-2");
+	ut_assert(hash >= 0);
+	ut_assertok(fdt_setprop_string(fit, hash, FIT_ALGO_PROP, "crc32"));
+	ut_assertok(fdt_setprop(fit, hash, FIT_VALUE_PROP, &crc, sizeof(crc)));
+
+	/* A signature needs the SHA256 of the data, the value is not used */
+	hash = fdt_add_subnode(fit, node, "signature-1");
+	ut_assert(hash >= 0);
+	ut_assertok(fdt_setprop_string(fit, hash, FIT_ALGO_PROP,
+				       "sha256,rsa2048"));
+	ut_assertok(fdt_setprop(fit, hash, FIT_VALUE_PROP, sha, sizeof(sha)));
+	ut_assertok(fdt_pack(fit));
+
+	data = fit + ALIGN(fdt_totalsize(fit), 4);
+	for (i = 0; i < size; i++)
+		data[i] = i * 13 + (i >> 9);
+	sha256_csum_wd(data, size, sha, CHUNKSZ_SHA256);
+	crc = cpu_to_uimage(crc32(0, data, size));
+	hash = fdt_path_offset(fit, "/images/kernel/hash-1");
+	ut_assertok(fdt_setprop_inplace(fit, hash, FIT_VALUE_PROP, sha,
+					sizeof(sha)));
+	hash = fdt_path_offset(fit, "/images/kernel/hash-2");
+	ut_assertok(fdt_setprop_inplace(fit, hash, FIT_VALUE_PROP, &crc,
+					sizeof(crc)));
+
+	return 0;
+}
+
+/* Test that a FIT read with sf is hashed as it is read */
+static int dm_test_spi_flash_fit_stream(struct unit_test_state *uts)
+{
+	u8 value[FIT_MAX_HASH_LEN];
+	const void *fit;
+	int node, hash;
+	int value_len;
+	char cmd[80];
+	void *buf;
+	int size;
+
+	buf = map_sysmem(0x10000, 0x40000);
+	ut_assertok(sf_build_fit(uts, buf, 0x30123));
+	size = ALIGN(fdt_totalsize(buf), 4) + 0x30123;
+	unmap_sysmem(buf);
+
+	snprintf(cmd, sizeof(cmd), "sf update 10000 0 %x;sf read 100000 0 %x",
+		 size, size);
+	ut_asserteq(0, run_command_list("sb save hostfs - 0 spi.bin 200000;"
+					"sf probe", -1, 0));
+	ut_asserteq(0, run_command_list(cmd, -1, 0));
+
+	fit = map_sysmem(0x100000, size);
+	node = fdt_path_offset(fit, "/images/kernel");
+	ut_assert(node >= 0);
+
+	/* Both hashes were worked out during the read, and match */
+	hash = fdt_path_offset(fit, "/images/kernel/hash-1");
+	ut_assertok(fit_stream_get_hash(fit, hash, value, &value_len));
+	ut_asserteq(SHA256_SUM_LEN, value_len);
+	ut_assertok(memcmp(fdt_getprop(fit, hash, FIT_VALUE_PROP, NULL), value,
+			   value_len));
+	hash = fdt_path_offset(fit, "/images/kernel/hash-2");
+	ut_assertok(fit_stream_get_hash(fit, hash, value, &value_len));
+	ut_asserteq(4, value_len);
+	ut_assertok(memcmp(fdt_getprop(fit, hash, FIT_VALUE_PROP, NULL), value,
+			   value_len));
+	ut_asserteq(1, fit_image_verify(fit, node));
+
+	/* So was the checksum to check the signature against */
+	hash = fdt_path_offset(fit, "/images/kernel/signature-1");
+	ut_assertok(fit_stream_get_hash(fit, hash, value, &value_len));
+	ut_asserteq(SHA256_SUM_LEN, value_len);
+	node = fdt_path_offset(fit, "/images/kernel/hash-1");
+	ut_assertok(memcmp(fdt_getprop(fit, node, FIT_VALUE_PROP, NULL), value,
+			   value_len));
+	node = fdt_path_offset(fit, "/images/kernel");
+
+	/* Nothing is known about a FIT at another address */
+	ut_asserteq(-ENOENT, fit_stream_get_hash(map_sysmem(0x10000, 0),
+						 hash, value, &value_len));
+
+	/* Another load to the same address forgets the hashes */
+	fit_stream_load(0x100000, 0);
+	ut_asserteq(-ENOENT, fit_stream_get_hash(fit, hash, value,
+						 &value_len));
+	ut_asserteq(1, fit_image_verify(fit, node));
+	unmap_sysmem(fit);
+
+	sandbox_sf_unbind_emul(state_get_current(), 0, 0);
+
+	return 0;
+}
+DM_TEST(dm_test_spi_flash_fit_stream, DM_TESTF_SCAN_PDATA |
+	DM_TESTF_SCAN_FDT | DM_TESTF_FLAT_TREE);
+#endif
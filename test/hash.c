@@ -0,0 +1,347 @@
+/*
+ * Tests for the SHA-1, SHA-256, CRC32 and CRC32C implementations
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <command.h>
+#include <errno.h>
+#include <image.h>
+#include <malloc.h>
+#include <u-boot/crc.h>
+#include <u-boot/sha1.h>
+#include <u-boot/sha256.h>
+#include <test/hash.h>
+#include <test/suites.h>
+#include <test/ut.h>
+
+/* Size of the buffer used for the long and speed tests */
+#define HASH_BUF_SIZE		(1 << 20)
+
+static const char msg_abc[] = "abc";
+static const char msg_448[] =
+	"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+
+/* FIPS 180-2 test vectors */
+static const uint8_t sha1_abc[SHA1_SUM_LEN] = {
+	0xa9, 0x99, 0x3e, 0x36, 0x47, 0x06, 0x81, 0x6a, 0xba, 0x3e,
+	0x25, 0x71, 0x78, 0x50, 0xc2, 0x6c, 0x9c, 0xd0, 0xd8, 0x9d,
+};
+
+static const uint8_t sha1_448[SHA1_SUM_LEN] = {
+	0x84, 0x98, 0x3e, 0x44, 0x1c, 0x3b, 0xd2, 0x6e, 0xba, 0xae,
+	0x4a, 0xa1, 0xf9, 0x51, 0x29, 0xe5, 0xe5, 0x46, 0x70, 0xf1,
+};
+
+static const uint8_t sha1_million_a[SHA1_SUM_LEN] = {
+	0x34, 0xaa, 0x97, 0x3c, 0xd4, 0xc4, 0xda, 0xa4, 0xf6, 0x1e,
+	0xeb, 0x2b, 0xdb, 0xad, 0x27, 0x31, 0x65, 0x34, 0x01, 0x6f,
+};
+
+static const uint8_t sha256_abc[SHA256_SUM_LEN] = {
+	0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea,
+	0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+	0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c,
+	0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad,
+};
+
+static const uint8_t sha256_448[SHA256_SUM_LEN] = {
+	0x24, 0x8d, 0x6a, 0x61, 0xd2, 0x06, 0x38, 0xb8,
+	0xe5, 0xc0, 0x26, 0x93, 0x0c, 0x3e, 0x60, 0x39,
+	0xa3, 0x3c, 0xe4, 0x59, 0x64, 0xff, 0x21, 0x67,
+	0xf6, 0xec, 0xed, 0xd4, 0x19, 0xdb, 0x06, 0xc1,
+};
+
+static const uint8_t sha256_million_a[SHA256_SUM_LEN] = {
+	0xcd, 0xc7, 0x6e, 0x5c, 0x99, 0x14, 0xfb, 0x92,
+	0x81, 0xa1, 0xc7, 0xe2, 0x84, 0xd7, 0x3e, 0x67,
+	0xf1, 0x80, 0x9a, 0x48, 0xa4, 0x97, 0x20, 0x0e,
+	0x04, 0x6d, 0x39, 0xcc, 0xc7, 0x11, 0x2c, 0xd0,
+};
+
+static const uint32_t sha1_iv[5] = {
+	0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0,
+};
+
+static const uint32_t sha256_iv[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+	0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+/* Fill a buffer with bytes which are not all the same */
+static void fill_buf(uint8_t *buf, int size)
+{
+	uint32_t seed = 0x12345678;
+	int i;
+
+	for (i = 0; i < size; i++) {
+		seed = seed * 1103515245 + 12345;
+		buf[i] = seed >> 16;
+	}
+}
+
+static int hash_test_sha1_vectors(struct unit_test_state *uts)
+{
+	uint8_t out[SHA1_SUM_LEN];
+	uint8_t *buf;
+
+	sha1_csum_wd((const uint8_t *)msg_abc, strlen(msg_abc), out,
+		     CHUNKSZ_SHA1);
+	ut_assert(!memcmp(sha1_abc, out, sizeof(out)));
+	sha1_csum_wd((const uint8_t *)msg_448, strlen(msg_448), out,
+		     CHUNKSZ_SHA1);
+	ut_assert(!memcmp(sha1_448, out, sizeof(out)));
+
+	buf = malloc(1000000);
+	ut_assertnonnull(buf);
+	memset(buf, 'a', 1000000);
+	sha1_csum_wd(buf, 1000000, out, CHUNKSZ_SHA1);
+	free(buf);
+	ut_assert(!memcmp(sha1_million_a, out, sizeof(out)));
+
+	return 0;
+}
+HASH_TEST(hash_test_sha1_vectors, 0);
+
+static int hash_test_sha256_vectors(struct unit_test_state *uts)
+{
+	uint8_t out[SHA256_SUM_LEN];
+	uint8_t *buf;
+
+	sha256_csum_wd((const uint8_t *)msg_abc, strlen(msg_abc), out,
+		       CHUNKSZ_SHA256);
+	ut_assert(!memcmp(sha256_abc, out, sizeof(out)));
+	sha256_csum_wd((const uint8_t *)msg_448, strlen(msg_448), out,
+		       CHUNKSZ_SHA256);
+	ut_assert(!memcmp(sha256_448, out, sizeof(out)));
+
+	buf = malloc(1000000);
+	ut_assertnonnull(buf);
+	memset(buf, 'a', 1000000);
+	sha256_csum_wd(buf, 1000000, out, CHUNKSZ_SHA256);
+	free(buf);
+	ut_assert(!memcmp(sha256_million_a, out, sizeof(out)));
+
+	return 0;
+}
+HASH_TEST(hash_test_sha256_vectors, 0);
+
+/*
+ * Hash a buffer in uneven pieces starting at an odd address, so that the
+ * partial-block and multi-block paths all get used
+ */
+static int hash_test_split(struct unit_test_state *uts)
+{
+	uint8_t expect1[SHA1_SUM_LEN], out1[SHA1_SUM_LEN];
+	uint8_t expect256[SHA256_SUM_LEN], out256[SHA256_SUM_LEN];
+	const int size = 10000;
+	sha256_context ctx256;
+	sha1_context ctx1;
+	int pos, len, i;
+	uint8_t *buf;
+
+	buf = malloc(size + 1);
+	ut_assertnonnull(buf);
+	fill_buf(buf + 1, size);
+	sha1_csum(buf + 1, size, expect1);
+	sha256_csum_wd(buf + 1, size, expect256, 0);
+
+	sha1_starts(&ctx1);
+	sha256_starts(&ctx256);
+	for (pos = 0, i = 1; pos < size; pos += len, i++) {
+		len = min(size - pos, i * 37 % 300);
+		sha1_update(&ctx1, buf + 1 + pos, len);
+		sha256_update(&ctx256, buf + 1 + pos, len);
+	}
+	sha1_finish(&ctx1, out1);
+	sha256_finish(&ctx256, out256);
+	free(buf);
+
+	ut_assert(!memcmp(expect1, out1, sizeof(out1)));
+	ut_assert(!memcmp(expect256, out256, sizeof(out256)));
+
+	return 0;
+}
+HASH_TEST(hash_test_split, 0);
+
+/* Check that the CPU's instructions, if any, agree with the generic code */
+static int hash_test_arch(struct unit_test_state *uts)
+{
+	uint32_t state[8], expect[8];
+	uint8_t *buf;
+	int blocks;
+
+	buf = malloc(64 * 20 + 1);
+	ut_assertnonnull(buf);
+	fill_buf(buf, 64 * 20 + 1);
+
+	for (blocks = 1; blocks <= 20; blocks++) {
+		memcpy(expect, sha1_iv, sizeof(sha1_iv));
+		sha1_process_generic(expect, buf + 1, blocks);
+		memcpy(state, sha1_iv, sizeof(sha1_iv));
+		if (sha1_process_arch(state, buf + 1, blocks) == -ENOSYS)
+			break;
+		ut_assert(!memcmp(expect, state, sizeof(sha1_iv)));
+	}
+
+	for (blocks = 1; blocks <= 20; blocks++) {
+		memcpy(expect, sha256_iv, sizeof(sha256_iv));
+		sha256_process_generic(expect, buf + 1, blocks);
+		memcpy(state, sha256_iv, sizeof(sha256_iv));
+		if (sha256_process_arch(state, buf + 1, blocks) == -ENOSYS)
+			break;
+		ut_assert(!memcmp(expect, state, sizeof(sha256_iv)));
+	}
+	free(buf);
+
+	return 0;
+}
+HASH_TEST(hash_test_arch, 0);
+
+/* Work out a CRC a bit at a time, to check the faster versions against */
+static uint32_t crc_bitwise(uint32_t crc, const uint8_t *buf, int len,
+			    uint32_t poly)
+{
+	int i;
+
+	while (len--) {
+		crc ^= *buf++;
+		for (i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ (crc & 1 ? poly : 0);
+	}
+
+	return crc;
+}
+
+static int hash_test_crc32(struct unit_test_state *uts)
+{
+	uint32_t expect, crc;
+	int offset, len;
+	uint8_t *buf;
+
+	ut_asserteq(0xcbf43926, crc32(0, (const uint8_t *)"123456789", 9));
+
+	buf = malloc(520);
+	ut_assertnonnull(buf);
+	fill_buf(buf, 520);
+	for (offset = 0; offset < 8; offset++) {
+		for (len = 0; len <= 512; len += len < 40 ? 1 : 29) {
+			expect = crc_bitwise(0x12345678, buf + offset, len,
+					     0xedb88320);
+			crc = crc32_no_comp_generic(0x12345678, buf + offset,
+						    len);
+			ut_asserteq(expect, crc);
+			crc = crc32_no_comp(0x12345678, buf + offset, len);
+			ut_asserteq(expect, crc);
+			crc = 0x12345678;
+			if (!crc32_no_comp_arch(&crc, buf + offset, len))
+				ut_asserteq(expect, crc);
+		}
+	}
+	free(buf);
+
+	return 0;
+}
+HASH_TEST(hash_test_crc32, 0);
+
+#ifdef CONFIG_CRC32C
+static int hash_test_crc32c(struct unit_test_state *uts)
+{
+	uint32_t table[256];
+	uint32_t expect, crc;
+	int offset, len;
+	uint8_t *buf;
+
+	ut_asserteq(0xe3069283,
+		    ~crc32c_no_comp(~0, (const uint8_t *)"123456789", 9));
+
+	crc32c_init(table, 0x82f63b78);
+	buf = malloc(520);
+	ut_assertnonnull(buf);
+	fill_buf(buf, 520);
+	for (offset = 0; offset < 8; offset++) {
+		for (len = 0; len <= 512; len += len < 40 ? 1 : 29) {
+			expect = crc32c_cal(0x12345678,
+					    (const char *)buf + offset, len,
+					    table);
+			crc = crc32c_no_comp_generic(0x12345678, buf + offset,
+						     len);
+			ut_asserteq(expect, crc);
+			crc = crc32c_no_comp(0x12345678, buf + offset, len);
+			ut_asserteq(expect, crc);
+			crc = 0x12345678;
+			if (!crc32c_no_comp_arch(&crc, buf + offset, len))
+				ut_asserteq(expect, crc);
+		}
+	}
+	free(buf);
+
+	return 0;
+}
+HASH_TEST(hash_test_crc32c, 0);
+#endif
+
+static void show_speed(const char *name, ulong us)
+{
+	printf("%12s: %lu KiB/s\n", name,
+	       (ulong)((u64)(HASH_BUF_SIZE / 1024) * 1000000 / max(us, 1UL)));
+}
+
+/* Report how fast each implementation runs; this never fails */
+static int hash_test_speed(struct unit_test_state *uts)
+{
+	const int blocks = HASH_BUF_SIZE / 64;
+	uint32_t state[8], crc;
+	uint8_t *buf;
+	ulong start;
+
+	buf = malloc(HASH_BUF_SIZE);
+	ut_assertnonnull(buf);
+	fill_buf(buf, HASH_BUF_SIZE);
+
+	memcpy(state, sha1_iv, sizeof(sha1_iv));
+	start = timer_get_us();
+	sha1_process_generic(state, buf, blocks);
+	show_speed("sha1", timer_get_us() - start);
+	start = timer_get_us();
+	if (!sha1_process_arch(state, buf, blocks))
+		show_speed("sha1 arch", timer_get_us() - start);
+
+	memcpy(state, sha256_iv, sizeof(sha256_iv));
+	start = timer_get_us();
+	sha256_process_generic(state, buf, blocks);
+	show_speed("sha256", timer_get_us() - start);
+	start = timer_get_us();
+	if (!sha256_process_arch(state, buf, blocks))
+		show_speed("sha256 arch", timer_get_us() - start);
+
+	start = timer_get_us();
+	crc32_no_comp_generic(0, buf, HASH_BUF_SIZE);
+	show_speed("crc32", timer_get_us() - start);
+	crc = 0;
+	start = timer_get_us();
+	if (!crc32_no_comp_arch(&crc, buf, HASH_BUF_SIZE))
+		show_speed("crc32 arch", timer_get_us() - start);
+#ifdef CONFIG_CRC32C
+	start = timer_get_us();
+	crc32c_no_comp_generic(0, buf, HASH_BUF_SIZE);
+	show_speed("crc32c", timer_get_us() - start);
+	crc = 0;
+	start = timer_get_us();
+	if (!crc32c_no_comp_arch(&crc, buf, HASH_BUF_SIZE))
+		show_speed("crc32c arch", timer_get_us() - start);
+#endif
+	free(buf);
+
+	return 0;
+}
+HASH_TEST(hash_test_speed, 0);
+
+int do_ut_hash(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
+{
+	struct unit_test *tests = ll_entry_start(struct unit_test, hash_test);
+	const int n_ents = ll_entry_count(struct unit_test, hash_test);
+
+	return cmd_ut_category("hash", tests, n_ents, argc, argv);
+}